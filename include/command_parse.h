@@ -44,6 +44,14 @@ class CoreExport CommandParser
 	 */
 	void ProcessCommand(LocalUser* user, std::string& command, CommandBase::Params& parameters);
 
+	/** Records how long a command took to execute and logs it if it was slow.
+	 * @param user The user who executed the command.
+	 * @param handler The handler for the command.
+	 * @param parameters The parameters to the command.
+	 * @param started The value of the monotonic clock when execution started.
+	 */
+	void RecordExecution(LocalUser* user, Command* handler, const CommandBase::Params& parameters, uint64_t started);
+
 	/** Command list, a hash_map of command names to Command*
 	 */
 	CommandMap cmdlist;
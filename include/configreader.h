@@ -411,6 +411,19 @@ class CoreExport ServerConfig
 	/** The number of seconds that the server clock can skip by before server operators are warned. */
 	time_t TimeSkipWarn;
 
+	/** The maximum number of worker threads which can be started by the thread pool. */
+	unsigned long WorkerThreads;
+
+	/** The number of milliseconds a command from a local user can take to execute before it
+	 * is logged as slow or 0 to not log slow commands.
+	 */
+	unsigned long SlowCommand;
+
+	/** The number of milliseconds a main loop iteration can spend working before server
+	 * operators are warned or 0 to not warn about slow iterations.
+	 */
+	unsigned long SlowIteration;
+
 	/** True if we're going to hide ban reasons for non-opers (e.g. G-lines,
 	 * K-lines, Z-lines)
 	 */
@@ -246,6 +246,11 @@ class CoreExport Command : public CommandBase
 	/** The number of times this command has been executed. */
 	unsigned long use_count = 0;
 
+	/** The time in nanoseconds which executing this command has taken, including the
+	 * OnPreCommand and OnPostCommand hooks. Only commands from local users are timed.
+	 */
+	const std::unique_ptr<insp::log2_histogram> exec_time;
+
 	/** If non-empty then the syntax of the parameter for this command. */
 	std::vector<std::string> syntax;
 
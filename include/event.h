@@ -205,6 +205,7 @@ inline void Events::ModuleEventProvider::Call(void (Class::*function)(FunArgs...
 		if (!mod || mod->dying)
 			continue;
 
+		Profiler::Scope scope(mod, name);
 		Class* klass = static_cast<Class*>(subscriber);
 		(klass->*function)(std::forward<FwdArgs>(args)...);
 	}
@@ -223,8 +224,12 @@ inline ModResult Events::ModuleEventProvider::FirstResult(ModResult (Class::*fun
 		if (!mod || mod->dying)
 			continue;
 
-		Class* klass = static_cast<Class*>(subscriber);
-		result = (klass->*function)(std::forward<FwdArgs>(args)...);
+		{
+			Profiler::Scope scope(mod, name);
+			Class* klass = static_cast<Class*>(subscriber);
+			result = (klass->*function)(std::forward<FwdArgs>(args)...);
+		}
+
 		if (result != MOD_RES_PASSTHRU)
 			break;
 	}
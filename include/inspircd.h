@@ -98,10 +98,12 @@ CoreExport extern InspIRCd* ServerInstance;
 #include "snomasks.h"
 #include "filelogger.h"
 #include "message.h"
+#include "profiler.h"
 #include "modules.h"
 #include "clientprotocol.h"
 #include "thread.h"
 #include "threadsocket.h"
+#include "threadpool.h"
 #include "configreader.h"
 #include "inspstring.h"
 #include "protocol.h"
@@ -114,6 +116,53 @@ CoreExport extern InspIRCd* ServerInstance;
 class serverstats
 {
   public:
+	/** The phases of a main loop iteration which are timed. */
+	enum LoopPhase : uint8_t
+	{
+		/** Checking for a finished rehash, collecting statistics, running periodic module hooks and handling signals. */
+		PHASE_HOUSEKEEPING,
+
+		/** Running timers. */
+		PHASE_TIMERS,
+
+		/** Checking for users who need to be pinged or have not registered in time. */
+		PHASE_USERS,
+
+		/** Writing to sockets which have data waiting to be sent. */
+		PHASE_TRIALWRITES,
+
+		/** Handling socket events, excluding the time spent waiting for them. */
+		PHASE_EVENTS,
+
+		/** Deleting objects which were culled. */
+		PHASE_CULLS,
+
+		/** Running actions which were deferred until the end of the iteration. */
+		PHASE_ACTIONS,
+
+		/** The number of phases. */
+		PHASE_COUNT
+	};
+
+	/** The names of the main loop phases. */
+	static constexpr std::array<const char*, PHASE_COUNT> LOOP_PHASE_NAMES = {
+		"housekeeping", "timers", "users", "trialwrites", "events", "culls", "actions"
+	};
+
+	/** The time in nanoseconds each main loop iteration spent working, excluding the time
+	 * spent waiting for socket events.
+	 */
+	const std::unique_ptr<insp::log2_histogram> LoopTime;
+
+	/** The same as LoopTime but for the iterations in the current minute only. */
+	const std::unique_ptr<insp::log2_histogram> LoopTimeThisMinute;
+
+	/** The same as LoopTime but for the iterations in the previous minute only. */
+	const std::unique_ptr<insp::log2_histogram> LoopTimeLastMinute;
+
+	/** The time in nanoseconds each phase of the main loop has taken in the iterations that it ran in. */
+	std::array<std::unique_ptr<insp::log2_histogram>, PHASE_COUNT> LoopPhaseTime;
+
 	/** Number of accepted connections
 	 */
 	unsigned long Accept = 0;
@@ -158,6 +207,18 @@ class serverstats
 	 */
 	unsigned long Recv = 0;
 
+	/** Number of local users who have quit
+	 */
+	unsigned long Quits = 0;
+
+	/** Total bytes of data waiting in the sendq of every stream socket
+	 */
+	size_t SendQ = 0;
+
+	/** Total bytes of data waiting in the recvq of every stream socket
+	 */
+	size_t RecvQ = 0;
+
 #ifdef _WIN32
 	/** Cpu usage at last sample
 	*/
@@ -179,6 +240,9 @@ class serverstats
 	 */
 	timespec LastSampled;
 #endif
+
+	serverstats();
+	~serverstats();
 };
 
 /** The main class of the irc server.
@@ -274,6 +338,10 @@ class CoreExport InspIRCd
 	 */
 	TimerManager Timers;
 
+	/** Thread pool which expensive work such as password hashing is run on.
+	 */
+	ThreadPool Threads;
+
 	/** X-line manager. Handles G/K/Q/E-line setting, removal and matching
 	 */
 	XLineManager* XLines = nullptr;
@@ -488,6 +556,26 @@ class CoreExport InspIRCd
 	 */
 	bool PassCompare(Extensible* ex, const std::string& data, const std::string& input, const std::string& hashtype);
 
+	/** Compares a password to a string from the config file without blocking the main thread.
+	 * The OnPassCompare event is fired first. If no module handles the comparison and the hash
+	 * type is a key derivation function (e.g. bcrypt) the comparison is performed by the hash
+	 * provider on a worker thread. Otherwise, this is the same as calling the synchronous
+	 * version of this method.
+	 * @param creator The module which is requesting the comparison or nullptr for the core. If
+	 *                this module is unloaded before the comparison finishes the callback will
+	 *                not be called.
+	 * @param ex The object (user, server, whatever) causing the comparison.
+	 * @param data The data from the config file
+	 * @param input The data input by the oper
+	 * @param hashtype The hash from the config file
+	 * @param callback The function to call on the main thread with the result of the comparison.
+	 *                 If the comparison is not performed on a worker thread this will be called
+	 *                 before this method returns. As the object which caused the comparison may
+	 *                 be destroyed whilst the comparison is in progress the callback should not
+	 *                 capture it and should instead look it up again.
+	 */
+	void PassCompare(Module* creator, Extensible* ex, const std::string& data, const std::string& input, const std::string& hashtype, const std::function<void(bool)>& callback);
+
 	/** Returns the full version string of this ircd
 	 * @return The version string
 	 */
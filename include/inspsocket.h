@@ -198,6 +198,15 @@ class CoreExport StreamSocket : public EventHandler
 			nbytes += newdata.length();
 		}
 
+		/** Move a new buffer to the end of the queue
+		 * @param newdata Data to add
+		 */
+		void push_back(Element&& newdata)
+		{
+			nbytes += newdata.length();
+			data.push_back(std::move(newdata));
+		}
+
 		/** Clear the queue
 		 */
 		void clear()
@@ -247,6 +256,12 @@ class CoreExport StreamSocket : public EventHandler
 	/** Error - if nonempty, the socket is dead, and this is the reason. */
 	std::string error;
 
+	/** The size of the sendq which is included in the server-wide total. */
+	size_t countedsendq = 0;
+
+	/** The size of the recvq which is included in the server-wide total. */
+	size_t countedrecvq = 0;
+
 	/** Check if the socket has an error set, if yes, call OnError
 	 * @param err Error to pass to OnError()
 	 */
@@ -288,6 +303,15 @@ class CoreExport StreamSocket : public EventHandler
 		: type(sstype)
 	{
 	}
+
+	/** Removes the queues of this socket from the server-wide totals. */
+	~StreamSocket() override;
+
+	/** Updates the server-wide sendq and recvq totals with the current size of the queues. This
+	 * is done automatically when the socket is read from or written to but needs to be called
+	 * by anything else which changes the queues.
+	 */
+	void UpdateQueueTotals();
 	IOHook* GetIOHook() const;
 	void AddIOHook(IOHook* hook);
 	void DelIOHook();
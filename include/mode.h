@@ -759,6 +759,9 @@ class CoreExport ModeParser
 	 */
 	void ModeParamsToChangeList(User* user, ModeType type, const std::vector<std::string>& parameters, Modes::ChangeList& changelist, size_t beginindex = 1, size_t endindex = UINT_MAX);
 
+	/** @copydoc ModeParamsToChangeList(User*, ModeType, const std::vector<std::string>&, Modes::ChangeList&, size_t, size_t) */
+	void ModeParamsToChangeList(User* user, ModeType type, const std::vector<std::string_view>& parameters, Modes::ChangeList& changelist, size_t beginindex = 1, size_t endindex = UINT_MAX);
+
 	/** Find the mode handler for a given mode name and type.
 	 * @param modename The mode name to search for.
 	 * @param mt Type of mode to search for, user or channel.
@@ -138,7 +138,10 @@ class ModResult
 		try \
 		{ \
 			if (!(*_i)->dying) \
+			{ \
+				Profiler::Scope _scope(*_i, #y); \
 				(*_i)->y x ; \
+			} \
 		} \
 		catch (CoreException& modexcept) \
 		{ \
@@ -162,7 +165,10 @@ do { \
 		try \
 		{ \
 			if (!(*_i)->dying) \
-				v = (*_i)->n args;
+			{ \
+				Profiler::Scope _scope(*_i, #n); \
+				v = (*_i)->n args; \
+			}
 
 #define WHILE_EACH_HOOK(n) \
 		} \
@@ -320,6 +326,11 @@ class CoreExport Module : public Cullable, public usecountbase
 	 */
 	bool dying = false;
 
+	/** The time this module has spent handling each hook whilst profiling was enabled. This
+	 * is mutable because it is updated when an event is dispatched to a const listener.
+	 */
+	mutable Profiler::HookMap hookstats;
+
 	/** A description of this module. */
 	const std::string description;
 
@@ -0,0 +1,105 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+namespace Deflate
+{
+	class Compressor;
+	class Decompressor;
+	class Provider;
+
+	/** A unique pointer to a raw DEFLATE compressor. */
+	typedef std::unique_ptr<Compressor> CompressorPtr;
+
+	/** A unique pointer to a raw DEFLATE decompressor. */
+	typedef std::unique_ptr<Decompressor> DecompressorPtr;
+
+	/** The smallest window size which can be requested. */
+	static constexpr int MIN_WINDOW_BITS = 9;
+
+	/** The largest window size which can be requested. */
+	static constexpr int MAX_WINDOW_BITS = 15;
+}
+
+/** Compresses a stream of data into raw DEFLATE blocks (RFC 1951). */
+class Deflate::Compressor
+{
+ public:
+	virtual ~Compressor() = default;
+
+	/** Compresses a block of data and flushes the output to a byte boundary.
+	 * @param data The data to compress.
+	 * @param len The length of the data to compress.
+	 * @param out The buffer to append the compressed data to. This ends with the four byte
+	 *            empty stored block (00 00 FF FF) which a sync flush produces.
+	 * @return True if the data was compressed; otherwise, false.
+	 */
+	virtual bool Compress(const char* data, size_t len, std::string& out) = 0;
+
+	/** Discards the history window so that the next block does not refer to earlier data. */
+	virtual void Reset() = 0;
+};
+
+/** Decompresses a stream of raw DEFLATE blocks (RFC 1951). */
+class Deflate::Decompressor
+{
+ public:
+	virtual ~Decompressor() = default;
+
+	/** Decompresses a block of data.
+	 * @param data The data to decompress.
+	 * @param len The length of the data to decompress.
+	 * @param out The buffer to append the decompressed data to.
+	 * @param maxlen The maximum number of bytes to append to \p out.
+	 * @return True if the data was decompressed; otherwise, false if it was malformed or would
+	 *         have decompressed to more than \p maxlen bytes.
+	 */
+	virtual bool Decompress(const char* data, size_t len, std::string& out, size_t maxlen) = 0;
+
+	/** Discards the history window so that the next block can not refer to earlier data. */
+	virtual void Reset() = 0;
+};
+
+/** The base class for DEFLATE implementations. */
+class Deflate::Provider
+	: public DataProvider
+{
+ protected:
+	/** Initializes a new instance of the Deflate::Provider class.
+	 * @param Creator The module which created this instance.
+	 * @param Name The name of this DEFLATE implementation.
+	 */
+	Provider(Module* Creator, const std::string& Name)
+		: DataProvider(Creator, "deflate/" + Name)
+	{
+	}
+
+ public:
+	/** Creates a new compressor. The compressor MUST NOT outlive the module which created it.
+	 * @param windowbits The base two logarithm of the history window size. This must be
+	 *                   between MIN_WINDOW_BITS and MAX_WINDOW_BITS.
+	 * @param level The compression level from 1 (fastest) to 9 (smallest).
+	 */
+	virtual CompressorPtr CreateCompressor(int windowbits, int level) = 0;
+
+	/** Creates a new decompressor. The decompressor MUST NOT outlive the module which created it.
+	 * @param windowbits The base two logarithm of the history window size. This must be
+	 *                   between MIN_WINDOW_BITS and MAX_WINDOW_BITS.
+	 */
+	virtual DecompressorPtr CreateDecompressor(int windowbits) = 0;
+};
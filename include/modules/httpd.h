@@ -239,6 +239,24 @@ class HTTPRequest
 	}
 };
 
+/** Generates the body of a HTTP response incrementally as the client reads it. This allows
+ * large documents to be sent without building them in memory first or blocking the server.
+ */
+class HTTPDocumentStream
+{
+ public:
+	virtual ~HTTPDocumentStream() = default;
+
+	/** Appends the next part of the document to a buffer. This is called whenever the client
+	 * has read most of the previously generated data.
+	 * @param out The buffer to append the next part of the document to.
+	 * @param hint The number of bytes which should be appended before returning. This may be
+	 *             exceeded if the document can not be split at that point.
+	 * @return True if there is more of the document to generate; otherwise, false.
+	 */
+	virtual bool Generate(std::string& out, size_t hint) = 0;
+};
+
 /** If you want to reply to HTTP requests, you must return a HTTPDocumentResponse to
  * the httpd module via the HTTPdAPI.
  * When you initialize this class you initialize it with all components required to
@@ -253,6 +271,12 @@ class HTTPDocumentResponse
 	Module* const module;
 
 	std::stringstream* document;
+
+	/** If non-null then the document is generated on demand by this instead. It MUST NOT
+	 * refer to anything which may be deleted before it has finished.
+	 */
+	std::unique_ptr<HTTPDocumentStream> stream;
+
 	unsigned int responsecode;
 
 	/** Any extra headers to include with the defaults
@@ -272,6 +296,42 @@ class HTTPDocumentResponse
 		: module(mod), document(doc), responsecode(response), src(req)
 	{
 	}
+
+	/** Initialize a HTTPDocumentResponse with a document which is generated as it is sent.
+	 * The response is sent with chunked transfer encoding if the client supports it.
+	 * @param mod A pointer to the module who responded to the request
+	 * @param req The request you obtained from the HTTPRequest at an earlier time
+	 * @param strm The generator for the document body. The httpd module takes ownership of this.
+	 * @param response A valid HTTP/1.0 or HTTP/1.1 response code.
+	 */
+	HTTPDocumentResponse(Module* mod, HTTPRequest& req, std::unique_ptr<HTTPDocumentStream> strm, unsigned int response)
+		: module(mod), document(nullptr), stream(std::move(strm)), responsecode(response), src(req)
+	{
+	}
+};
+
+/** Statistics about the connections which have been handled by the httpd module. */
+struct HTTPdStats final
+{
+	/** The number of connections which have been accepted. */
+	unsigned long accepted = 0;
+
+	/** The number of connections which were refused because too many were already open. */
+	unsigned long refused = 0;
+
+	/** The number of connections which are currently open. */
+	unsigned long open = 0;
+
+	/** The number of requests which have been received. */
+	unsigned long requests = 0;
+
+	/** The number of requests which were received on a connection that had already been
+	 * used for an earlier request.
+	 */
+	unsigned long reused = 0;
+
+	/** The number of connections which were closed after being idle between requests. */
+	unsigned long idletimeouts = 0;
 };
 
 class HTTPdAPIBase : public DataProvider
@@ -286,6 +346,9 @@ class HTTPdAPIBase : public DataProvider
 	 * @param response The response created by your module that will be sent to the client
 	 */
 	virtual void SendResponse(HTTPDocumentResponse& response) = 0;
+
+	/** Retrieves statistics about the connections which have been handled. */
+	virtual const HTTPdStats& GetStats() = 0;
 };
 
 /** The API provided by the httpd module that allows other modules to respond to incoming
@@ -0,0 +1,205 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "event.h"
+#include "utility/histogram.h"
+
+namespace Metrics
+{
+	class EventListener;
+	class EventProvider;
+	class Writer;
+
+	/** The labels which identify a sample within a metric family. */
+	typedef std::vector<std::pair<std::string, std::string>> Labels;
+
+	/** The types of metric family. */
+	enum class Type
+	{
+		/** A value which only ever increases, e.g. the number of bytes sent. */
+		COUNTER,
+
+		/** A value which can increase and decrease, e.g. the number of users. */
+		GAUGE,
+
+		/** A distribution of values. */
+		HISTOGRAM
+	};
+}
+
+/** Writes metrics in the Prometheus text exposition format. */
+class Metrics::Writer final
+{
+ private:
+	/** The buffer to write the metrics to. */
+	std::string& out;
+
+	void WriteLabels(const Labels& labels, const char* extraname = nullptr, const std::string& extravalue = std::string())
+	{
+		if (labels.empty() && !extraname)
+			return;
+
+		out.push_back('{');
+		bool first = true;
+		for (const auto& [name, value] : labels)
+		{
+			if (!first)
+				out.push_back(',');
+			first = false;
+			WriteLabel(name, value);
+		}
+
+		if (extraname)
+		{
+			if (!first)
+				out.push_back(',');
+			WriteLabel(extraname, extravalue);
+		}
+		out.push_back('}');
+	}
+
+	void WriteLabel(const std::string& name, const std::string& value)
+	{
+		out.append(name).append("=\"");
+		for (const auto chr : value)
+		{
+			switch (chr)
+			{
+				case '\\':
+					out.append("\\\\");
+					break;
+				case '"':
+					out.append("\\\"");
+					break;
+				case '\n':
+					out.append("\\n");
+					break;
+				default:
+					out.push_back(chr);
+					break;
+			}
+		}
+		out.push_back('"');
+	}
+
+	static std::string FormatDouble(double value)
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%.9g", value);
+		return buffer;
+	}
+
+ public:
+	Writer(std::string& buffer)
+		: out(buffer)
+	{
+	}
+
+	/** Starts a new metric family. This must be called before writing any samples for it.
+	 * @param name The name of the metric family.
+	 * @param type The type of the metric family.
+	 * @param help A description of the metric family.
+	 */
+	void Family(const std::string& name, Type type, const std::string& help)
+	{
+		static const char* typenames[] = { "counter", "gauge", "histogram" };
+		out.append("# HELP ").append(name).push_back(' ');
+		out.append(help).push_back('\n');
+		out.append("# TYPE ").append(name).push_back(' ');
+		out.append(typenames[static_cast<size_t>(type)]).push_back('\n');
+	}
+
+	/** Writes a sample of a counter or gauge.
+	 * @param name The name of the metric family.
+	 * @param value The value of the sample.
+	 * @param labels The labels which identify the sample.
+	 */
+	void Sample(const std::string& name, uint64_t value, const Labels& labels = Labels())
+	{
+		out.append(name);
+		WriteLabels(labels);
+		out.push_back(' ');
+		out.append(ConvToStr(value)).push_back('\n');
+	}
+
+	/** Writes the samples of a histogram.
+	 * @param name The name of the metric family.
+	 * @param histogram The histogram to write.
+	 * @param divisor The number to divide the recorded values by to convert them to the
+	 *                unit of the metric family (e.g. 1000000000 for nanoseconds to seconds).
+	 * @param labels The labels which identify the histogram.
+	 */
+	void Histogram(const std::string& name, const insp::log2_histogram& histogram, double divisor = 1, const Labels& labels = Labels())
+	{
+		// Every bucket is always written so that the set of series does not change between
+		// scrapes. The last bucket holds values up to UINT64_MAX so it is written as +Inf.
+		const auto& buckets = histogram.get_buckets();
+		uint64_t cumulative = 0;
+		for (size_t bucket = 0; bucket < buckets.size() - 1; ++bucket)
+		{
+			cumulative += buckets[bucket];
+			out.append(name).append("_bucket");
+			WriteLabels(labels, "le", FormatDouble(insp::log2_histogram::bucket_max(bucket) / divisor));
+			out.push_back(' ');
+			out.append(ConvToStr(cumulative)).push_back('\n');
+		}
+
+		out.append(name).append("_bucket");
+		WriteLabels(labels, "le", "+Inf");
+		out.push_back(' ');
+		out.append(ConvToStr(histogram.get_count())).push_back('\n');
+
+		out.append(name).append("_sum");
+		WriteLabels(labels);
+		out.push_back(' ');
+		out.append(FormatDouble(histogram.get_sum() / divisor)).push_back('\n');
+
+		out.append(name).append("_count");
+		WriteLabels(labels);
+		out.push_back(' ');
+		out.append(ConvToStr(histogram.get_count())).push_back('\n');
+	}
+};
+
+class Metrics::EventListener
+	: public Events::ModuleEventListener
+{
+ protected:
+	EventListener(Module* mod)
+		: ModuleEventListener(mod, "event/metrics")
+	{
+	}
+
+ public:
+	/** Called when the metrics of the server are being collected. This may be called often
+	 * so implementations MUST NOT do anything expensive like iterating over every user.
+	 * @param writer The writer to write metrics to.
+	 */
+	virtual void OnCollectMetrics(Writer& writer) = 0;
+};
+
+class Metrics::EventProvider
+	: public Events::ModuleEventProvider
+{
+ public:
+	EventProvider(Module* mod)
+		: Events::ModuleEventProvider(mod, "event/metrics")
+	{
+	}
+};
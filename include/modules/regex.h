@@ -33,11 +33,19 @@ namespace Regex
 	class EngineReference;
 	class Exception;
 	class Pattern;
+	class PatternSet;
+	class SimplePatternSet;
 	template<typename> class SimpleEngine;
 
 	/** A shared pointer to a regex pattern. */
 	typedef std::shared_ptr<Pattern> PatternPtr;
 
+	/** A unique pointer to a regex pattern set. */
+	typedef std::unique_ptr<PatternSet> PatternSetPtr;
+
+	/** The value returned by PatternSet::FindFirst when no pattern matches. */
+	static constexpr size_t NO_MATCH = SIZE_MAX;
+
 	/** The options to use when matching a pattern. */
 	enum PatternOptions : uint8_t
 	{
@@ -71,6 +79,13 @@ class Regex::Engine
 	 */
 	virtual PatternPtr Create(const std::string& pattern, uint8_t options = Regex::OPT_NONE) = 0;
 
+	/** Creates an empty set of patterns which can be matched against text in a single pass.
+	 * Engines which can not do this natively return a set which matches each pattern in turn.
+	 * @param options One or more options to use when matching the patterns in the set.
+	 * @return A unique pointer to an instance of the Regex::PatternSet class.
+	 */
+	virtual PatternSetPtr CreateSet(uint8_t options = Regex::OPT_NONE);
+
 	/** Compiles a regular expression from the human-writable form.
 	 * @param pattern The pattern to compile in the format /pattern/flags.
 	 * @return A shared pointer to an instance of the Regex::Pattern class.
@@ -183,6 +198,97 @@ class Regex::Pattern
 	virtual bool IsMatch(const std::string& text) = 0;
 };
 
+/** Represents a set of regular expression patterns which share the same options. */
+class Regex::PatternSet
+{
+ private:
+	/** The options used when matching the patterns in this set. */
+	const uint8_t optionflags;
+
+ protected:
+	/** Initializes a new instance of the PatternSet class.
+	 * @param options The options used when matching the patterns in this set.
+	 */
+	PatternSet(uint8_t options)
+		: optionflags(options)
+	{
+	}
+
+ public:
+	/** Destroys an instance of the PatternSet class. */
+	virtual ~PatternSet() = default;
+
+	/** Retrieves the options used when matching the patterns in this set. */
+	uint8_t GetOptions() const { return optionflags; }
+
+	/** Adds a pattern to this set. This must not be called after Compile().
+	 * @param pattern The pattern to add. This must have been compiled by the engine which created
+	 *                this set with the same options as this set. Sets which match natively only
+	 *                use the text of the pattern; others keep a reference to it.
+	 * @return The index of the pattern within the set. Patterns are numbered from 0 in the order they are added.
+	 */
+	virtual size_t Add(const PatternPtr& pattern) = 0;
+
+	/** Prepares this set for matching once all patterns have been added. */
+	virtual void Compile() = 0;
+
+	/** Finds the first pattern in this set which matches the specified text.
+	 * @param text The text to match against.
+	 * @param predicate If not empty then only patterns whose index this returns true for are considered.
+	 * @return The index of the lowest numbered pattern which matched or Regex::NO_MATCH if none matched.
+	 */
+	virtual size_t FindFirst(const std::string& text, const std::function<bool(size_t)>& predicate = nullptr) = 0;
+};
+
+/** A pattern set for engines which can not match multiple patterns at once. This matches the
+ * already compiled patterns which were added to it in turn.
+ */
+class Regex::SimplePatternSet final
+	: public Regex::PatternSet
+{
+ private:
+	/** The patterns in this set. */
+	std::vector<PatternPtr> patterns;
+
+ public:
+	/** Initializes a new instance of the SimplePatternSet class.
+	 * @param options The options used when matching the patterns in this set.
+	 */
+	SimplePatternSet(uint8_t options)
+		: Regex::PatternSet(options)
+	{
+	}
+
+	/** @copydoc Regex::PatternSet::Add */
+	size_t Add(const PatternPtr& pattern) override
+	{
+		patterns.push_back(pattern);
+		return patterns.size() - 1;
+	}
+
+	/** @copydoc Regex::PatternSet::Compile */
+	void Compile() override
+	{
+	}
+
+	/** @copydoc Regex::PatternSet::FindFirst */
+	size_t FindFirst(const std::string& text, const std::function<bool(size_t)>& predicate) override
+	{
+		for (size_t idx = 0; idx < patterns.size(); ++idx)
+		{
+			// Check the predicate first as it is usually cheaper than matching.
+			if ((!predicate || predicate(idx)) && patterns[idx]->IsMatch(text))
+				return idx;
+		}
+		return NO_MATCH;
+	}
+};
+
+inline Regex::PatternSetPtr Regex::Engine::CreateSet(uint8_t options)
+{
+	return std::make_unique<SimplePatternSet>(options);
+}
+
 inline Regex::PatternPtr Regex::Engine::CreateHuman(const std::string& pattern)
 {
 	if (pattern.empty() || pattern[0] != '/')
@@ -23,6 +23,7 @@
 
 #pragma once
 
+#include <variant>
 
 namespace SQL
 {
@@ -30,6 +31,7 @@ namespace SQL
 	class Provider;
 	class Query;
 	class Result;
+	class Statement;
 
 	/** A list of parameter replacement values. */
 	typedef std::vector<std::string> ParamList;
@@ -37,6 +39,15 @@ namespace SQL
 	/** A map of parameter replacement values. */
 	typedef std::map<std::string, std::string> ParamMap;
 
+	/** A typed value which can be bound to a parameter of a prepared statement. */
+	typedef std::variant<std::nullptr_t, int64_t, double, std::string> Value;
+
+	/** A list of values to bind to the parameters of a prepared statement in order. */
+	typedef std::vector<Value> ValueList;
+
+	/** A map of parameter names to the values to bind to them. */
+	typedef std::map<std::string, Value> ValueMap;
+
 	/** A single SQL field. */
 	typedef std::optional<std::string> Field;
 
@@ -193,6 +204,159 @@ class SQL::Query : public Cullable
 	virtual void OnResult(SQL::Result& result) = 0;
 };
 
+/** A query which is parsed once and then executed many times with different values bound
+ * to its parameters. Unlike with ParamMap the values are sent to the database separately
+ * from the query so they never need to be escaped and the database only has to plan the
+ * query once per connection.
+ *
+ * Parameters are written in the same way as with ParamMap, either as $name or as '$name'. In
+ * the latter form the quotes are removed when the statement is prepared. If a parameter is
+ * part of a larger string literal (e.g. '%$nick%') the statement can not be prepared and the
+ * values are substituted into the query text exactly as they would be with ParamMap instead.
+ */
+class SQL::Statement final
+{
+ private:
+	/** The query this statement was parsed from. */
+	std::string format;
+
+	/** The parts of the query between parameters. This has one more entry than parameters. */
+	std::vector<std::string> literals;
+
+	/** The names of the parameters in the order they appear in the query. */
+	std::vector<std::string> parameters;
+
+	/** Whether every parameter is a complete value so the statement can be prepared. */
+	bool preparable = true;
+
+	/** The query with each parameter replaced with a '?' placeholder. */
+	std::string query;
+
+ public:
+	/** Initializes an empty statement. */
+	Statement() = default;
+
+	/** Parses a statement.
+	 * @param fmt The parameterized query string ('$name' parameters).
+	 */
+	Statement(const std::string& fmt)
+		: format(fmt)
+	{
+		bool quoted = false;
+		literals.emplace_back();
+		for (size_t i = 0; i < format.length(); ++i)
+		{
+			if (format[i] != '$')
+			{
+				// An escaped quote within a string literal is doubled so this toggles twice.
+				if (format[i] == '\'')
+					quoted = !quoted;
+
+				literals.back().push_back(format[i]);
+				continue;
+			}
+
+			std::string field;
+			while (i + 1 < format.length() && isalnum(static_cast<unsigned char>(format[i + 1])))
+				field.push_back(format[++i]);
+
+			if (field.empty())
+			{
+				literals.back().push_back('$');
+				continue;
+			}
+
+			if (quoted)
+			{
+				// Remove the quotes if the parameter is the whole of the string literal.
+				std::string& literal = literals.back();
+				if (!literal.empty() && literal.back() == '\'' && i + 1 < format.length() && format[i + 1] == '\'')
+				{
+					literal.pop_back();
+					quoted = false;
+					i++;
+				}
+				else
+					preparable = false;
+			}
+
+			parameters.push_back(field);
+			literals.emplace_back();
+		}
+		query = GetQuery([](size_t) { return "?"; });
+	}
+
+	/** Determines whether every parameter of this statement is a complete value. If not then
+	 * the values have to be substituted into the query text instead of being bound.
+	 */
+	bool CanPrepare() const { return preparable; }
+
+	/** Retrieves the query this statement was parsed from. */
+	const std::string& GetFormat() const { return format; }
+
+	/** Retrieves the names of the parameters in the order they appear in the query. */
+	const std::vector<std::string>& GetParameters() const { return parameters; }
+
+	/** Retrieves the query with each parameter replaced with a '?' placeholder. */
+	const std::string& GetQuery() const { return query; }
+
+	/** Builds the query using the placeholder syntax of a specific database.
+	 * @param placeholder A function which returns the placeholder for the parameter at the
+	 *                    specified zero-indexed position.
+	 */
+	std::string GetQuery(const std::function<std::string(size_t)>& placeholder) const
+	{
+		std::string result;
+		for (size_t i = 0; i < literals.size(); ++i)
+		{
+			if (i)
+				result.append(placeholder(i - 1));
+			result.append(literals[i]);
+		}
+		return result;
+	}
+
+	/** Orders the values in a map to match the parameters of this statement.
+	 * @param values The values to order. Parameters which have no value are bound to an
+	 *               empty string for consistency with ParamMap.
+	 */
+	ValueList GetValues(const ValueMap& values) const
+	{
+		ValueList result;
+		result.reserve(parameters.size());
+		for (const auto& parameter : parameters)
+		{
+			ValueMap::const_iterator it = values.find(parameter);
+			if (it != values.end())
+				result.push_back(it->second);
+			else
+				result.emplace_back(std::string());
+		}
+		return result;
+	}
+
+	/** Converts values for the parameters of this statement to a map of strings which can be
+	 * substituted into the query text.
+	 * @param values The values to convert. Null values are left out of the map so they are
+	 *               substituted as an empty string.
+	 */
+	ParamMap GetParams(const ValueList& values) const
+	{
+		ParamMap result;
+		for (size_t i = 0; i < parameters.size() && i < values.size(); ++i)
+		{
+			const Value& value = values[i];
+			if (std::holds_alternative<int64_t>(value))
+				result[parameters[i]] = ConvToStr(std::get<int64_t>(value));
+			else if (std::holds_alternative<double>(value))
+				result[parameters[i]] = InspIRCd::Format("%.17g", std::get<double>(value));
+			else if (std::holds_alternative<std::string>(value))
+				result[parameters[i]] = std::get<std::string>(value);
+		}
+		return result;
+	}
+};
+
 /**
  * Provider object for SQL servers
  */
@@ -230,6 +394,44 @@ class SQL::Provider : public DataProvider
 	 * @param p Parameters to fill in for the '$name' entries
 	 */
 	virtual void Submit(Query* callback, const std::string& format, const ParamMap& p) = 0;
+
+	/** Submit an asynchronous execution of a prepared statement. If the database supports it
+	 * the statement is prepared the first time it is executed on each connection and reused
+	 * afterwards. Otherwise, or if the statement can not be prepared, the values are escaped
+	 * and substituted into the query text like with ParamMap.
+	 * @param callback The result reporting point
+	 * @param statement The statement to execute.
+	 * @param values The values to bind to the parameters of the statement in order.
+	 */
+	void Submit(Query* callback, const Statement& statement, const ValueList& values)
+	{
+		if (statement.CanPrepare())
+			SubmitPrepared(callback, statement, values);
+		else
+			Submit(callback, statement.GetFormat(), statement.GetParams(values));
+	}
+
+	/** Submit an asynchronous execution of a prepared statement.
+	 * @param callback The result reporting point
+	 * @param statement The statement to execute.
+	 * @param values The values to bind to the named parameters of the statement.
+	 */
+	void Submit(Query* callback, const Statement& statement, const ValueMap& values)
+	{
+		Submit(callback, statement, statement.GetValues(values));
+	}
+
+ protected:
+	/** Executes a statement which can be prepared. Databases which support prepared statements
+	 * should override this. By default the values are substituted into the query text.
+	 * @param callback The result reporting point
+	 * @param statement The statement to execute.
+	 * @param values The values to bind to the parameters of the statement in order.
+	 */
+	virtual void SubmitPrepared(Query* callback, const Statement& statement, const ValueList& values)
+	{
+		Submit(callback, statement.GetFormat(), statement.GetParams(values));
+	}
 };
 
 inline void SQL::PopulateUserInfo(User* user, ParamMap& userinfo)
@@ -0,0 +1,87 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+class Module;
+
+namespace Profiler
+{
+	struct HookStats;
+	class Scope;
+
+	/** The statistics for each hook a module has handled keyed by the hook name. */
+	typedef std::map<std::string, HookStats, std::less<>> HookMap;
+
+	/** Whether the time taken by module hooks is being recorded. This is checked on every
+	 * hook call so it is a plain variable rather than something which needs to be looked up.
+	 */
+	CoreExport extern bool enabled;
+
+	/** Records the time taken by a call to a module hook.
+	 * @param mod The module which handled the hook.
+	 * @param hook The name of the hook.
+	 * @param elapsed The time the hook took in nanoseconds.
+	 */
+	CoreExport void Record(const Module* mod, const std::string_view& hook, uint64_t elapsed);
+
+	/** Discards the statistics which have been recorded for every module. */
+	CoreExport void Reset();
+}
+
+/** The statistics for calls to a module hook. */
+struct Profiler::HookStats final
+{
+	/** The number of times the hook has been called. */
+	unsigned long calls = 0;
+
+	/** The total time in nanoseconds which the hook has taken. */
+	uint64_t total = 0;
+
+	/** The longest time in nanoseconds which a single call to the hook has taken. */
+	uint64_t max = 0;
+};
+
+/** Times a call to a module hook if profiling is enabled. When it is not the cost of this is
+ * a single branch on construction and destruction.
+ */
+class Profiler::Scope final
+{
+ private:
+	/** The module which is handling the hook. */
+	const Module* const mod;
+
+	/** The name of the hook. */
+	const std::string_view hook;
+
+	/** The value of the monotonic clock when the hook was called or 0 if it is not being timed. */
+	const uint64_t started;
+
+ public:
+	Scope(const Module* m, const std::string_view& h)
+		: mod(m)
+		, hook(h)
+		, started(enabled ? insp::monotonic_ns() : 0)
+	{
+	}
+
+	~Scope()
+	{
+		if (started)
+			Record(mod, hook, insp::monotonic_ns() - started);
+	}
+};
@@ -231,6 +231,9 @@ class CoreExport SocketEngine
 		void CheckFlush() const;
 
 	 public:
+		Statistics();
+		~Statistics();
+
 		/** Update counters for network data received.
 		 * This should be called after every read-type syscall.
 		 * @param len_in Number of bytes received, or -1 for error, as typically
@@ -245,6 +248,11 @@ class CoreExport SocketEngine
 		 */
 		void UpdateWriteCounters(ssize_t len_out);
 
+		/** Update counters for a call to DispatchEvents.
+		 * @param events Number of events returned by the socket engine, or -1 for error.
+		 */
+		void UpdateDispatchCounters(int events);
+
 		/** Get data transfer statistics.
 		 * @param kbitpersec_in Filled with incoming traffic in this second in kbit/s.
 		 * @param kbitpersec_out Filled with outgoing traffic in this second in kbit/s.
@@ -256,6 +264,21 @@ class CoreExport SocketEngine
 		unsigned long ReadEvents = 0;
 		unsigned long WriteEvents = 0;
 		unsigned long ErrorEvents = 0;
+
+		/** Total bytes received since startup. */
+		unsigned long BytesIn = 0;
+
+		/** Total bytes sent since startup. */
+		unsigned long BytesOut = 0;
+
+		/** Number of calls to DispatchEvents. */
+		unsigned long Dispatches = 0;
+
+		/** Number of events returned by each call to DispatchEvents. */
+		const std::unique_ptr<insp::log2_histogram> DispatchSizes;
+
+		/** The value of the monotonic clock when the last call to DispatchEvents stopped waiting for events. */
+		uint64_t LastWake = 0;
 	};
 
  private:
@@ -0,0 +1,91 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+/** Runs expensive work such as password hashing on a pool of worker threads and
+ * delivers the results back to the main thread. The worker threads are started
+ * on demand up to the limit specified in <performance:workerthreads>.
+ */
+class CoreExport ThreadPool final
+{
+ public:
+	class Task;
+
+ private:
+	class Dispatcher;
+
+	/** Manages the worker threads. Created when the first task is submitted. */
+	Dispatcher* dispatcher = nullptr;
+
+ public:
+	/** Destroys the thread pool. Stop() must have been called before this. */
+	~ThreadPool();
+
+	/** Prepares the thread pool for a module to be unloaded. Tasks which were submitted by the
+	 * module are cancelled and this waits for the worker threads to finish all other tasks as
+	 * they may be using code from the module. The results of those tasks are delivered from the
+	 * main loop later rather than from inside this call.
+	 * @param mod The module which is being unloaded.
+	 */
+	void Flush(Module* mod);
+
+	/** Retrieves the number of tasks which are waiting for a worker thread. */
+	size_t GetQueueSize() const;
+
+	/** Retrieves the number of worker threads which have been started. */
+	size_t GetThreadCount() const;
+
+	/** Stops all of the worker threads and cancels any tasks which have not been delivered. */
+	void Stop();
+
+	/** Submits a task to be run on a worker thread.
+	 * @param task The task to run. The thread pool takes ownership of this and deletes it once
+	 *             Task::OnComplete has been called or the task has been cancelled.
+	 */
+	void Submit(Task* task);
+};
+
+/** A unit of work which is run by a ThreadPool. */
+class CoreExport ThreadPool::Task
+{
+ public:
+	/** The module which submitted this task. If this module is unloaded before the task is
+	 * delivered then the task is deleted without OnComplete() being called.
+	 */
+	Module* const creator;
+
+	/** Initializes a new instance of the Task class.
+	 * @param mod The module which is submitting this task.
+	 */
+	Task(Module* mod)
+		: creator(mod)
+	{
+	}
+
+	virtual ~Task() = default;
+
+	/** Performs the work of this task. This is called on a worker thread so it MUST NOT access
+	 * anything which is not thread safe. This includes users, channels, the config, and logging.
+	 */
+	virtual void Run() = 0;
+
+	/** Called on the main thread once Run() has returned. This is where the result of the task
+	 * should be acted on.
+	 */
+	virtual void OnComplete() = 0;
+};
@@ -28,6 +28,15 @@
 
 class Module;
 
+namespace insp
+{
+	/** Retrieves the current value of the monotonic clock in nanoseconds. Unlike the time
+	 * which is cached at the start of each main loop iteration this is suitable for timing
+	 * short operations.
+	 */
+	CoreExport uint64_t monotonic_ns();
+}
+
 /** Timer class for one-second resolution timers
  * Timer provides a facility which allows module
  * developers to create one-shot timers. The timer
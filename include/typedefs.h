@@ -52,6 +52,11 @@ class XLineFactory;
 struct ConnectClass;
 class ModResult;
 
+namespace insp
+{
+	class log2_histogram;
+}
+
 namespace ClientProtocol
 {
 	class Event;
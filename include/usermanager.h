@@ -70,6 +70,22 @@ class CoreExport UserManager
 	 */
 	uint64_t already_sent_id;
 
+	/** Checks whether a user can be quit and logs an error if they can not.
+	 * @param user The user to check.
+	 * @return True if the user is not already quitting and is not a server; otherwise, false.
+	 */
+	static bool CanQuit(User* user);
+
+	/** Removes a user who has been allowed to quit. This is the part of quitting a user which
+	 * is shared by QuitUser() and QuitUsers().
+	 * @param user The user to remove.
+	 * @param quitmsg The quit message to show to normal users.
+	 * @param operquitmsg The quit message to show to opers.
+	 * @param cache If non-null then the cache of local channel members to use when sending the
+	 *              QUIT message to the neighbors of the user.
+	 */
+	void FinishQuit(User* user, const std::string& quitmsg, const std::string& operquitmsg, User::LocalMemberCache* cache);
+
  public:
 	/** Constructor, initializes variables
 	 */
@@ -125,6 +141,15 @@ class CoreExport UserManager
 	 */
 	void QuitUser(User* user, const std::string& quitreason, const std::string* operreason = NULL);
 
+	/** Disconnect multiple users at once, for example when the server they are on splits.
+	 * This has the same effect as calling QuitUser() on each user but the local members of
+	 * the channels the remote users are in are only looked up once for all of them.
+	 * @param users The users to remove
+	 * @param quitreason The quit reason to show to normal users
+	 * @param operreason The quit reason to show to opers, can be NULL if same as quitreason
+	 */
+	void QuitUsers(const std::vector<User*>& users, const std::string& quitreason, const std::string* operreason = NULL);
+
 	/** Add a user to the clone map
 	 * @param user The user to add
 	 */
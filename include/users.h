@@ -288,6 +288,24 @@ class CoreExport User : public Extensible
 		virtual void Execute(LocalUser* user) = 0;
 	};
 
+	/** Caches the local members of channels for use by ForEachNeighbor(). When visiting the neighbors
+	 * of many users who share channels this avoids walking the full member list of every shared
+	 * channel once per user. The cache must not be used after local users join or leave a channel
+	 * which it has cached.
+	 */
+	class CoreExport LocalMemberCache final
+	{
+	 private:
+		/** The local members of each channel that has been looked up. */
+		std::unordered_map<Channel*, std::vector<LocalUser*>> members;
+
+	 public:
+		/** Retrieves the local members of the specified channel.
+		 * @param chan The channel to retrieve the local members of.
+		 */
+		const std::vector<LocalUser*>& GetMembers(Channel* chan);
+	};
+
 	/** An enumeration of all possible types of user. */
 	enum Type : uint8_t
 	{
@@ -575,6 +593,13 @@ class CoreExport User : public Extensible
 	 */
 	void ForEachNeighbor(ForEachNeighborHandler& handler, bool include_self = true);
 
+	/** Execute a function once for each local neighbor of this user using a cache of channel members.
+	 * @param handler Function object to call, inherited from ForEachNeighborHandler.
+	 * @param cache The cache to look up the local members of the user's channels in.
+	 * @param include_self True to include this user in the set of neighbors, false otherwise.
+	 */
+	void ForEachNeighbor(ForEachNeighborHandler& handler, LocalMemberCache& cache, bool include_self = true);
+
 	/** Return true if the user shares at least one channel with another user
 	 * @param other The other user to compare the channel list against
 	 * @return True if the given user shares at least one channel with this user
@@ -657,9 +682,56 @@ class CoreExport UserIOHandler : public StreamSocket
 class CoreExport LocalUser : public User, public insp::intrusive_list_node<LocalUser>
 {
  private:
+	/** The result of comparing the password this user sent to the password of a connect class. */
+	struct ClassPassword final
+	{
+		/** The password from the connect class. */
+		std::string data;
+
+		/** The hash type of the password from the connect class. */
+		std::string hashtype;
+
+		/** Whether the comparison has finished. */
+		bool done = false;
+
+		/** Whether the comparison finished after the class was checked. */
+		bool background = false;
+
+		/** Whether the passwords matched. */
+		bool result = false;
+
+		ClassPassword(const std::string& d, const std::string& h)
+			: data(d)
+			, hashtype(h)
+		{
+		}
+	};
+
 	/** The connect class this user is in. */
 	std::shared_ptr<ConnectClass> connectclass;
 
+	/** The results of comparing the password this user sent to connect class passwords which
+	 * are hashed with a key derivation function. These are compared on a worker thread.
+	 */
+	std::vector<ClassPassword> classpasswords;
+
+	/** Compares the password this user sent to the password of a connect class. If the password
+	 * is hashed with a key derivation function then the comparison is started on a worker thread
+	 * and the password is treated as not matching until the result is available.
+	 * @param klass The connect class to compare the password of.
+	 * @return True if the password matches; otherwise, false.
+	 */
+	bool CheckClassPassword(const std::shared_ptr<ConnectClass>& klass);
+
+	/** Called when comparing the password of a user to the password of a connect class has finished.
+	 * @param uuid The UUID of the user.
+	 * @param data The password from the connect class.
+	 * @param hashtype The hash type of the password from the connect class.
+	 * @param input The password the user sent.
+	 * @param result Whether the passwords matched.
+	 */
+	static void OnClassPasswordChecked(const std::string& uuid, const std::string& data, const std::string& hashtype, const std::string& input, bool result);
+
 	/** Message list, can be passed to the two parameter Send(). */
 	static ClientProtocol::MessageList sendmsglist;
 
@@ -718,6 +790,17 @@ class CoreExport LocalUser : public User, public insp::intrusive_list_node<Local
 	 */
 	void CheckClass(bool clone_count = true);
 
+	/** Starts comparing the password this user sent to the passwords of the connect classes they
+	 * match which are hashed with a key derivation function.
+	 * @return True if all of the comparisons have finished; otherwise, false.
+	 */
+	bool CheckClassPasswords();
+
+	/** Forgets the results of comparing the password this user sent to the passwords of connect
+	 * classes. This must be called when the password of the user changes.
+	 */
+	void ResetClassPasswords() { classpasswords.clear(); }
+
 	/** Server address and port that this user is connected to.
 	 */
 	irc::sockets::sockaddrs server_sa;
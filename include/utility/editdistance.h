@@ -0,0 +1,158 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+namespace insp
+{
+	class edit_distance;
+}
+
+/** Calculates the Levenshtein distance between a pattern and any number of texts using Myers'
+ * bit-parallel algorithm. The pattern is split into 64 character blocks so the cost of each
+ * comparison is O(ceil(m/64) * n) rather than the O(m * n) of the dynamic programming matrix.
+ * The match vectors for the pattern are built once by set_pattern() and reused for every text
+ * it is compared against.
+ */
+class insp::edit_distance final
+{
+ private:
+	/** The number of bits in a block. */
+	static constexpr size_t BLOCK_BITS = 64;
+
+	/** The match vectors for each byte value; 256 * blocks entries. Only the entries for the
+	 * bytes which occur in the pattern are ever non-zero.
+	 */
+	std::vector<uint64_t> peq;
+
+	/** The positive vertical deltas for each block. This is scratch space for distance(). */
+	mutable std::vector<uint64_t> pv;
+
+	/** The negative vertical deltas for each block. This is scratch space for distance(). */
+	mutable std::vector<uint64_t> mv;
+
+	/** The pattern which texts are compared against. */
+	std::string pattern;
+
+	/** The number of blocks the pattern occupies. */
+	size_t blocks = 0;
+
+	/** The mask for the bit which holds the last row of the pattern in the final block. */
+	uint64_t lastbit = 0;
+
+ public:
+	/** Sets the pattern which texts will be compared against.
+	 * @param str The new pattern.
+	 */
+	void set_pattern(const std::string_view& str)
+	{
+		// Clear the match vectors which were set for the previous pattern.
+		for (const auto chr : pattern)
+			std::fill_n(peq.begin() + (static_cast<unsigned char>(chr) * blocks), blocks, 0);
+
+		pattern.assign(str.data(), str.size());
+		blocks = (pattern.size() + BLOCK_BITS - 1) / BLOCK_BITS;
+		lastbit = UINT64_C(1) << ((pattern.size() - 1) % BLOCK_BITS);
+		if (peq.size() < 256 * blocks)
+		{
+			peq.assign(256 * blocks, 0);
+			pv.resize(blocks);
+			mv.resize(blocks);
+		}
+
+		for (size_t idx = 0; idx < pattern.size(); ++idx)
+		{
+			const auto chr = static_cast<unsigned char>(pattern[idx]);
+			peq[chr * blocks + idx / BLOCK_BITS] |= UINT64_C(1) << (idx % BLOCK_BITS);
+		}
+	}
+
+	/** Retrieves the pattern which texts are compared against. */
+	const std::string& get_pattern() const { return pattern; }
+
+	/** Calculates the edit distance between the pattern and the specified text.
+	 * @param text The text to compare against the pattern.
+	 * @param limit The largest distance which is of interest to the caller. The comparison
+	 *              stops as soon as the distance is known to exceed this.
+	 * @return The edit distance if it is less than or equal to \p limit; otherwise, \p limit + 1.
+	 */
+	size_t distance(const std::string_view& text, size_t limit = SIZE_MAX - 1) const
+	{
+		const size_t plen = pattern.size();
+		const size_t tlen = text.size();
+
+		// Every character of the longer string which has no counterpart in the shorter one
+		// needs an insertion or a deletion so the length difference is a lower bound.
+		const size_t lengthdiff = plen > tlen ? plen - tlen : tlen - plen;
+		if (lengthdiff > limit)
+			return limit + 1;
+
+		if (!plen || !tlen)
+			return lengthdiff;
+
+		std::fill_n(pv.begin(), blocks, UINT64_MAX);
+		std::fill_n(mv.begin(), blocks, 0);
+
+		size_t score = plen;
+		for (size_t col = 0; col < tlen; ++col)
+		{
+			const uint64_t* eqs = peq.data() + (static_cast<unsigned char>(text[col]) * blocks);
+
+			// The top row of the matrix increases by one in every column.
+			int carry = 1;
+			for (size_t blk = 0; blk < blocks; ++blk)
+			{
+				const uint64_t highbit = (blk + 1 == blocks) ? lastbit : UINT64_C(1) << (BLOCK_BITS - 1);
+
+				uint64_t eq = eqs[blk];
+				const uint64_t xv = eq | mv[blk];
+				if (carry < 0)
+					eq |= 1;
+
+				const uint64_t xh = (((eq & pv[blk]) + pv[blk]) ^ pv[blk]) | eq;
+				uint64_t ph = mv[blk] | ~(xh | pv[blk]);
+				uint64_t mh = pv[blk] & xh;
+
+				const int nextcarry = (ph & highbit) ? 1 : ((mh & highbit) ? -1 : 0);
+
+				ph <<= 1;
+				mh <<= 1;
+				if (carry < 0)
+					mh |= 1;
+				else if (carry > 0)
+					ph |= 1;
+
+				pv[blk] = mh | ~(xv | ph);
+				mv[blk] = ph & xv;
+				carry = nextcarry;
+			}
+
+			if (carry > 0)
+				score++;
+			else if (carry < 0)
+				score--;
+
+			// The bottom row can decrease by at most one per remaining column so if it can
+			// no longer reach the limit there is no point in continuing.
+			const size_t remaining = tlen - col - 1;
+			if (score > remaining && score - remaining > limit)
+				return limit + 1;
+		}
+
+		return score > limit ? limit + 1 : score;
+	}
+};
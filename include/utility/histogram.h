@@ -0,0 +1,133 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+/** Records values into buckets whose upper bounds increase in powers of two. This keeps the
+ * memory usage constant regardless of how many values are recorded whilst still allowing
+ * percentiles to be estimated to within a factor of two.
+ */
+class insp::log2_histogram final
+{
+ public:
+	/** The number of buckets. Bucket N holds values which are N bits long. */
+	static constexpr size_t BUCKETS = 65;
+
+ private:
+	/** The number of values in each bucket. */
+	std::array<uint64_t, BUCKETS> buckets = { };
+
+	/** The number of values which have been recorded. */
+	uint64_t count = 0;
+
+	/** The largest value which has been recorded. */
+	uint64_t max = 0;
+
+	/** The sum of all of the values which have been recorded. */
+	uint64_t sum = 0;
+
+ public:
+	/** Retrieves the index of the bucket which a value belongs in.
+	 * @param value The value to look up.
+	 */
+	static size_t bucket_of(uint64_t value)
+	{
+		size_t bits = 0;
+		for (; value; value >>= 1)
+			bits++;
+		return bits;
+	}
+
+	/** Retrieves the largest value which can be stored in a bucket.
+	 * @param bucket The index of the bucket.
+	 */
+	static uint64_t bucket_max(size_t bucket)
+	{
+		return bucket >= 64 ? UINT64_MAX : (UINT64_C(1) << bucket) - 1;
+	}
+
+	/** Records a value in the histogram.
+	 * @param value The value to record.
+	 */
+	void add(uint64_t value)
+	{
+		buckets[bucket_of(value)]++;
+		count++;
+		sum += value;
+		if (value > max)
+			max = value;
+	}
+
+	/** Removes all recorded values from the histogram. */
+	void clear()
+	{
+		buckets.fill(0);
+		count = max = sum = 0;
+	}
+
+	/** Retrieves the number of values in each bucket. */
+	const std::array<uint64_t, BUCKETS>& get_buckets() const { return buckets; }
+
+	/** Retrieves the number of values which have been recorded. */
+	uint64_t get_count() const { return count; }
+
+	/** Retrieves the largest value which has been recorded. */
+	uint64_t get_max() const { return max; }
+
+	/** Retrieves the sum of all values which have been recorded. */
+	uint64_t get_sum() const { return sum; }
+
+	/** Retrieves the mean of all values which have been recorded. */
+	uint64_t get_mean() const { return count ? sum / count : 0; }
+
+	/** Estimates the value below which the specified percentage of recorded values fall.
+	 * @param percent The percentile to estimate (e.g. 99).
+	 * @return The upper bound of the bucket which contains the percentile or the largest
+	 *         recorded value if that is smaller.
+	 */
+	uint64_t get_percentile(unsigned int percent) const
+	{
+		if (!count)
+			return 0;
+
+		// The rank of the value we are looking for, rounded up.
+		const uint64_t rank = (count * std::min(percent, 100U) + 99) / 100;
+		uint64_t seen = 0;
+		for (size_t bucket = 0; bucket < BUCKETS; ++bucket)
+		{
+			seen += buckets[bucket];
+			if (seen >= rank && seen)
+				return std::min(bucket_max(bucket), max);
+		}
+		return max;
+	}
+
+	/** Summarises the recorded values in a human readable form for use in stats output.
+	 * @param divisor The amount to divide each value by (e.g. 1000 to show nanoseconds as
+	 *                microseconds).
+	 * @param unit The unit to show after each value (e.g. "us").
+	 * @return A string of the form "mean 5us, p50 4us, p90 8us, p99 16us, max 20us".
+	 */
+	std::string summarize(uint64_t divisor, const std::string& unit) const
+	{
+		return "mean " + std::to_string(get_mean() / divisor) + unit
+			+ ", p50 " + std::to_string(get_percentile(50) / divisor) + unit
+			+ ", p90 " + std::to_string(get_percentile(90) / divisor) + unit
+			+ ", p99 " + std::to_string(get_percentile(99) / divisor) + unit
+			+ ", max " + std::to_string(get_max() / divisor) + unit;
+	}
+};
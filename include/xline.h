@@ -344,6 +344,8 @@ class CoreExport XLineFactory
 	std::string type;
 
  public:
+	/** The number of times a line of this type has matched a user or pattern. */
+	unsigned long hits = 0;
 
 	/** Create an XLine factory
 	 * @param t Type of XLine this factory generates
@@ -471,6 +473,9 @@ class CoreExport XLineManager
 	 */
 	XLineFactory* GetFactory(const std::string &type);
 
+	/** Get all of the registered XLineFactory instances keyed by type. */
+	const XLineFactMap& GetFactories() const { return line_factory; }
+
 	/** Check if a user matches an XLine
 	 * @param type The type of line to look up
 	 * @param user The user to match against (what is checked is specific to the xline type)
@@ -485,6 +490,12 @@ class CoreExport XLineManager
 	 */
 	XLine* MatchesLine(const std::string &type, const std::string &pattern);
 
+	/** Records that an X-line has matched a user or pattern.
+	 * @param line The X-line which matched.
+	 * @return The X-line which matched.
+	 */
+	XLine* RecordHit(XLine* line);
+
 	/** Expire a line given two iterators which identify it in the main map.
 	 * @param container Iterator to the first level of entries the map
 	 * @param item Iterator to the second level of entries in the map
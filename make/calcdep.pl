@@ -51,7 +51,7 @@ exit 0;
 sub run() {
 	create_directory(BUILDPATH, 0770) or die "Could not create build directory: $!";
 	chdir BUILDPATH or die "Could not open build directory: $!";
-	mkdir $_ for qw/bin modules obj/;
+	mkdir $_ for qw(bin modules obj obj/bench);
 
 	open MAKE, '>real.mk' or die "Could not write real.mk: $!";
 	chdir "${\SOURCEPATH}/src";
@@ -109,18 +109,35 @@ END
 		}
 	}
 
+	# The benchmark suite links the core objects with its own main() so the
+	# object which contains the core main() is rebuilt without it.
+	my @bench_deps = grep { $_ ne 'obj/inspircd.o' } @core_deps;
+	dep_cpp 'inspircd.cpp', 'obj/bench/inspircd.o', 'gen-bench-o';
+	push @bench_deps, 'obj/bench/inspircd.o';
+	for my $file (<bench/*.cpp>) {
+		my $out = find_output $file;
+		dep_cpp $file, $out, 'gen-o';
+		push @bench_deps, $out;
+	}
+
 	my $core_mk = join ' ', @core_deps;
+	my $bench_mk = join ' ', @bench_deps;
 	my $mods = join ' ', @modlist;
 	print MAKE <<END;
 
 bin/inspircd: $core_mk
 	@\$(SOURCEPATH)/make/unit-cc.pl core-ld \$\@ \$^ \$>
 
+bin/inspircd-bench: $bench_mk
+	@\$(SOURCEPATH)/make/unit-cc.pl core-ld \$\@ \$^ \$>
+
 inspircd: bin/inspircd
 
+bench: bin/inspircd-bench
+
 modules: $mods
 
-.PHONY: all bad-target inspircd modules
+.PHONY: all bad-target bench inspircd modules
 
 END
 }
@@ -132,6 +149,8 @@ sub find_output {
 		return "modules/$base${\DLL_EXT}";
 	} elsif ($path eq '' || $path eq 'modes/' || $path =~ /^[a-z]+engines\/$/) {
 		return "obj/$base.o";
+	} elsif ($path eq 'bench/') {
+		return "obj/bench/$base.o";
 	} elsif ($path =~ m#modules/(m_.*)/# || $path =~ m#coremods/(core_.*)/#) {
 		return "obj/$1/$base.o";
 	} else {
@@ -214,6 +214,10 @@ target: $(HEADER)
 debug:
 	@${MAKE} INSPIRCD_DEBUG=1 all
 
+bench:
+	@${MAKE} INSPIRCD_TARGET="bench modules" target
+	"$(BUILDPATH)/bin/inspircd-bench" $(BENCHFLAGS)
+
 debug-header:
 	@echo "*************************************"
 	@echo "*    BUILDING WITH DEBUG SYMBOLS    *"
@@ -354,6 +358,7 @@ help:
 	@echo ' INSPIRCD_DEBUG=1    Enable debug build, for module development or crash tracing'
 	@echo ' INSPIRCD_DEBUG=2    Enable debug build with optimizations, for detailed backtraces'
 	@echo ' INSPIRCD_DEBUG=3    Enable fast build with no optimisations or symbols (only for CI)'
+	@echo ' BENCHFLAGS=         Options for "make bench", e.g. "--json --filter cidr/"'
 	@echo ' DESTDIR=            Specify a destination root directory (for tarball creation)'
 	@echo ' -j <N>              Run a parallel build using N jobs'
 	@echo ''
@@ -361,6 +366,7 @@ help:
 	@echo ' all       Complete build of InspIRCd, without installing (default)'
 	@echo ' install   Build and install InspIRCd to the directory chosen in ./configure'
 	@echo ' debug     Compile a debug build. Equivalent to "make D=1 all"'
+	@echo ' bench     Build and run the benchmark suite for the core hot paths'
 	@echo ''
 	@echo ' INSPIRCD_TARGET=target  Builds a user-specified target, such as "inspircd" or "core_dns"'
 	@echo '                         Multiple targets may be separated by a space'
@@ -372,4 +378,4 @@ help:
 
 .NOTPARALLEL:
 
-.PHONY: all target debug debug-header mod-header mod-footer std-header finishmessage install clean deinstall configureclean help
+.PHONY: all target bench debug debug-header mod-header mod-footer std-header finishmessage install clean deinstall configureclean help
@@ -45,6 +45,8 @@ if ($type eq 'core-ld') {
 	do_link_dir(@ARGV);
 } elsif ($type eq 'gen-o') {
 	do_compile(1, 0, @ARGV);
+} elsif ($type eq 'gen-bench-o') {
+	do_compile(1, 0, @ARGV, '-DINSPIRCD_BENCHMARK');
 } elsif ($type eq 'gen-so') {
 	do_compile(1, 1, @ARGV);
 } elsif ($type eq 'link-so') {
@@ -86,12 +88,13 @@ sub do_link_dir {
 }
 
 sub do_compile {
-	my ($do_compile, $do_link, $file) = @_;
+	my ($do_compile, $do_link, $file, $extra_flags) = @_;
 
 	my $flags = '';
 	my $libs = '';
 	if ($do_compile) {
 		$flags = $ENV{CORECXXFLAGS} . ' ' . get_directive($file, 'CompilerFlags', '');
+		$flags .= " $extra_flags" if defined $extra_flags;
 
 		if ($file =~ m#(?:^|/)((?:m|core)_[^/. ]+)(?:\.cpp|/.*\.cpp)$#) {
 			$flags .= ' -DMODNAME=\\"'.$1.'\\"';
@@ -0,0 +1,88 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "inspircd.h"
+
+namespace Bench
+{
+	class Registrar;
+
+	/** A benchmark body. This is called with the number of operations to perform and must
+	 * perform exactly that many so that the time per operation can be calculated.
+	 */
+	typedef std::function<void(size_t)> Function;
+
+	/** Adds a benchmark to the suite.
+	 * @param name The name of the benchmark in the form "<group>/<case>".
+	 * @param func The body of the benchmark.
+	 */
+	void Add(const std::string& name, const Function& func);
+
+	/** Prevents the compiler from optimising away the calculation of a value.
+	 * @param value The value which must be calculated.
+	 */
+	template <typename T>
+	inline void DoNotOptimize(const T& value)
+	{
+		asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+	/** Generates the datasets which benchmarks run against. The data is generated from a
+	 * fixed seed so every run of the suite measures exactly the same work.
+	 */
+	namespace Data
+	{
+		/** Generates hostnames which look like those of residential and hosting providers. */
+		std::vector<std::string> Hostnames(size_t count);
+
+		/** Generates IPv4 addresses in their string form. */
+		std::vector<std::string> IPv4Addresses(size_t count);
+
+		/** Generates IPv6 addresses in their string form. */
+		std::vector<std::string> IPv6Addresses(size_t count);
+
+		/** Generates nicknames. */
+		std::vector<std::string> Nicks(size_t count);
+
+		/** Generates channel names. */
+		std::vector<std::string> Channels(size_t count);
+
+		/** Generates nick!user\@host ban masks of the kinds which are set on real channels. */
+		std::vector<std::string> BanMasks(size_t count);
+
+		/** Generates CIDR masks for both IPv4 and IPv6. */
+		std::vector<std::string> CIDRMasks(size_t count);
+
+		/** Generates messages from clients, some of which have message tags. */
+		std::vector<std::string> ClientLines(size_t count);
+
+		/** Generates random binary data. */
+		std::string Bytes(size_t count);
+	}
+}
+
+/** Adds benchmarks to the suite once the server has been initialised. */
+class Bench::Registrar final
+{
+ public:
+	/** Registers a function which adds benchmarks to the suite.
+	 * @param func The function to call once the server has been initialised.
+	 */
+	Registrar(void (*func)());
+};
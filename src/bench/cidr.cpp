@@ -0,0 +1,67 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "bench.h"
+
+namespace
+{
+	void Register()
+	{
+		const std::vector<std::string> ips = Bench::Data::IPv4Addresses(1000);
+		const std::vector<std::string> masks = Bench::Data::CIDRMasks(100);
+
+		Bench::Add("cidr/parse_mask", [=](size_t ops) {
+			for (size_t op = 0; op < ops; ++op)
+				Bench::DoNotOptimize(irc::sockets::cidr_mask(masks[op % masks.size()]));
+		});
+
+		std::vector<irc::sockets::sockaddrs> addrs(ips.size());
+		for (size_t idx = 0; idx < ips.size(); ++idx)
+			irc::sockets::aptosa(ips[idx], 0, addrs[idx]);
+
+		std::vector<irc::sockets::cidr_mask> cidrs;
+		for (const auto& mask : masks)
+			cidrs.emplace_back(mask);
+
+		// Matches pre-parsed addresses against pre-parsed masks like the connect class and
+		// X-line checks do.
+		Bench::Add("cidr/match_parsed", [=](size_t ops) {
+			for (size_t op = 0; op < ops; ++op)
+				Bench::DoNotOptimize(cidrs[op % cidrs.size()].match(addrs[op % addrs.size()]));
+		});
+
+		Bench::Add("cidr/match_string", [=](size_t ops) {
+			for (size_t op = 0; op < ops; ++op)
+				Bench::DoNotOptimize(irc::sockets::MatchCIDR(ips[op % ips.size()], masks[op % masks.size()], false));
+		});
+
+		std::vector<std::string> userips;
+		for (const auto& ip : ips)
+			userips.push_back("~ident@" + ip);
+
+		std::vector<std::string> usermasks;
+		for (const auto& mask : masks)
+			usermasks.push_back("*@" + mask);
+
+		Bench::Add("cidr/match_string_user", [=](size_t ops) {
+			for (size_t op = 0; op < ops; ++op)
+				Bench::DoNotOptimize(irc::sockets::MatchCIDR(userips[op % userips.size()], usermasks[op % usermasks.size()], true));
+		});
+	}
+
+	Bench::Registrar registrar(Register);
+}
@@ -0,0 +1,267 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "bench.h"
+
+#include <random>
+
+namespace
+{
+	// std::mt19937 produces the same sequence on every platform unlike the distributions
+	// in <random> so all of the values are derived from it directly.
+	class Generator final
+	{
+	 private:
+		std::mt19937 engine;
+
+	 public:
+		Generator(unsigned int seed)
+			: engine(seed)
+		{
+		}
+
+		// Retrieves a number in the range [0, max).
+		size_t Below(size_t max)
+		{
+			return engine() % max;
+		}
+
+		template <size_t Size>
+		const char* Pick(const char* const (&values)[Size])
+		{
+			return values[Below(Size)];
+		}
+
+		std::string Word(size_t minlen, size_t maxlen, const char* chars = "abcdefghijklmnopqrstuvwxyz")
+		{
+			const size_t charcount = strlen(chars);
+			std::string word(minlen + Below(maxlen - minlen + 1), '\0');
+			for (auto& chr : word)
+				chr = chars[Below(charcount)];
+			return word;
+		}
+
+		std::string IPv4()
+		{
+			return InspIRCd::Format("%zu.%zu.%zu.%zu", 1 + Below(223), Below(256), Below(256), 1 + Below(254));
+		}
+
+		std::string IPv6()
+		{
+			return InspIRCd::Format("2001:db8:%zx:%zx:%zx:%zx:%zx:%zx", Below(0x10000), Below(0x10000),
+				Below(0x10000), Below(0x10000), Below(0x10000), Below(0x10000));
+		}
+	};
+
+	const char* const isps[] = {
+		"example-broadband.net", "cable.example.com", "dsl.example.org", "mobile.example.net",
+		"fibre.example.co.uk", "res.example-telecom.de", "dyn.example.fr", "pool.example.it"
+	};
+
+	const char* const hosting[] = {
+		"vps.example-cloud.com", "compute.example-hosting.net", "dedicated.example.org",
+		"shell.example-bnc.net"
+	};
+
+	const char* const words[] = {
+		"hello", "there", "is", "anyone", "around", "to", "help", "with", "the", "config", "my",
+		"server", "won't", "link", "again", "lol", "thanks", "that", "worked", "see", "you", "later"
+	};
+}
+
+std::vector<std::string> Bench::Data::Hostnames(size_t count)
+{
+	Generator gen(1);
+	std::vector<std::string> hosts;
+	hosts.reserve(count);
+	for (size_t idx = 0; idx < count; ++idx)
+	{
+		switch (gen.Below(4))
+		{
+			case 0: // e.g. 203-0-113-42.cable.example.com
+			{
+				std::string ip = gen.IPv4();
+				std::replace(ip.begin(), ip.end(), '.', '-');
+				hosts.push_back(ip + "." + gen.Pick(isps));
+				break;
+			}
+			case 1: // e.g. host81-2-69-160.range81-2.dsl.example.org
+				hosts.push_back(InspIRCd::Format("host%zu-%zu-%zu-%zu.range%zu.%s", gen.Below(256), gen.Below(256),
+					gen.Below(256), gen.Below(256), gen.Below(1000), gen.Pick(isps)));
+				break;
+			case 2: // e.g. ip-12-34.a1b2.vps.example-cloud.com
+				hosts.push_back(InspIRCd::Format("ip-%zu-%zu.%s.%s", gen.Below(256), gen.Below(256),
+					gen.Word(4, 4, "0123456789abcdef").c_str(), gen.Pick(hosting)));
+				break;
+			case 3: // A cloaked host.
+				hosts.push_back(gen.Word(8, 8, "0123456789ABCDEF") + "." + gen.Word(8, 8, "0123456789ABCDEF") + ".IP");
+				break;
+		}
+	}
+	return hosts;
+}
+
+std::vector<std::string> Bench::Data::IPv4Addresses(size_t count)
+{
+	Generator gen(2);
+	std::vector<std::string> ips;
+	ips.reserve(count);
+	for (size_t idx = 0; idx < count; ++idx)
+		ips.push_back(gen.IPv4());
+	return ips;
+}
+
+std::vector<std::string> Bench::Data::IPv6Addresses(size_t count)
+{
+	Generator gen(3);
+	std::vector<std::string> ips;
+	ips.reserve(count);
+	for (size_t idx = 0; idx < count; ++idx)
+		ips.push_back(gen.IPv6());
+	return ips;
+}
+
+std::vector<std::string> Bench::Data::Nicks(size_t count)
+{
+	Generator gen(4);
+	std::vector<std::string> nicks;
+	nicks.reserve(count);
+	for (size_t idx = 0; idx < count; ++idx)
+	{
+		std::string nick = gen.Word(1, 1, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ[]\\`_^{|}");
+		nick.append(gen.Word(2, 14, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789[]\\`_^{|}-"));
+		nicks.push_back(nick);
+	}
+	return nicks;
+}
+
+std::vector<std::string> Bench::Data::Channels(size_t count)
+{
+	Generator gen(5);
+	std::vector<std::string> channels;
+	channels.reserve(count);
+	for (size_t idx = 0; idx < count; ++idx)
+		channels.push_back("#" + gen.Word(3, 20, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_."));
+	return channels;
+}
+
+std::vector<std::string> Bench::Data::BanMasks(size_t count)
+{
+	Generator gen(6);
+	const std::vector<std::string> hosts = Hostnames(64);
+	std::vector<std::string> masks;
+	masks.reserve(count);
+	for (size_t idx = 0; idx < count; ++idx)
+	{
+		switch (gen.Below(6))
+		{
+			case 0: // *!*@host
+				masks.push_back("*!*@" + hosts[gen.Below(hosts.size())]);
+				break;
+			case 1: // *!*@*.isp
+				masks.push_back(std::string("*!*@*.") + gen.Pick(isps));
+				break;
+			case 2: // nick!*@*
+				masks.push_back(gen.Word(3, 12) + "!*@*");
+				break;
+			case 3: // *!ident@*
+				masks.push_back("*!" + gen.Word(3, 10) + "@*");
+				break;
+			case 4: // *!*@1.2.3.*
+			{
+				const std::string ip = gen.IPv4();
+				masks.push_back("*!*@" + ip.substr(0, ip.rfind('.')) + ".*");
+				break;
+			}
+			case 5: // nick?*!*ident@*.host
+				masks.push_back(gen.Word(2, 5) + "?*!*" + gen.Word(2, 6) + "@*." + gen.Pick(hosting));
+				break;
+		}
+	}
+	return masks;
+}
+
+std::vector<std::string> Bench::Data::CIDRMasks(size_t count)
+{
+	Generator gen(7);
+	std::vector<std::string> masks;
+	masks.reserve(count);
+	for (size_t idx = 0; idx < count; ++idx)
+	{
+		if (gen.Below(4))
+			masks.push_back(gen.IPv4() + "/" + ConvToStr(8 + gen.Below(25)));
+		else
+			masks.push_back(gen.IPv6() + "/" + ConvToStr(32 + gen.Below(97)));
+	}
+	return masks;
+}
+
+std::vector<std::string> Bench::Data::ClientLines(size_t count)
+{
+	Generator gen(8);
+	const std::vector<std::string> nicks = Nicks(64);
+	const std::vector<std::string> channels = Channels(64);
+	std::vector<std::string> lines;
+	lines.reserve(count);
+	for (size_t idx = 0; idx < count; ++idx)
+	{
+		std::string text;
+		for (size_t wordcount = 1 + gen.Below(20); wordcount; --wordcount)
+		{
+			if (!text.empty())
+				text.push_back(' ');
+			text.append(gen.Pick(words));
+		}
+
+		const std::string& channel = channels[gen.Below(channels.size())];
+		const std::string& nick = nicks[gen.Below(nicks.size())];
+		switch (gen.Below(10))
+		{
+			case 0:
+				lines.push_back("@+draft/reply=" + gen.Word(20, 20, "0123456789abcdef") + ";+draft/react=lol TAGMSG " + channel);
+				break;
+			case 1:
+				lines.push_back("@label=" + gen.Word(6, 6) + " PRIVMSG " + channel + " :" + text);
+				break;
+			case 2:
+				lines.push_back("JOIN " + channel);
+				break;
+			case 3:
+				lines.push_back("MODE " + channel + " +b *!*@" + gen.IPv4());
+				break;
+			case 4:
+				lines.push_back("NOTICE " + nick + " :" + text);
+				break;
+			case 5:
+				lines.push_back("@+typing=active TAGMSG " + nick);
+				break;
+			default:
+				lines.push_back("PRIVMSG " + channel + " :" + text);
+				break;
+		}
+	}
+	return lines;
+}
+
+std::string Bench::Data::Bytes(size_t count)
+{
+	Generator gen(9);
+	std::string bytes(count, '\0');
+	for (auto& byte : bytes)
+		byte = static_cast<char>(gen.Below(256));
+	return bytes;
+}
@@ -0,0 +1,123 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "bench.h"
+#include "utility/editdistance.h"
+
+#include <random>
+
+namespace
+{
+	/** The dynamic programming implementation which m_repeat used before insp::edit_distance. */
+	size_t Levenshtein(const std::string& s1, const std::string& s2, std::vector<size_t> (&mx)[2])
+	{
+		const size_t l1 = s1.size();
+		const size_t l2 = s2.size();
+
+		for (size_t i = 0; i <= l2; i++)
+			mx[0][i] = i;
+		for (size_t i = 0; i < l1; i++)
+		{
+			mx[1][0] = i + 1;
+			for (size_t j = 0; j < l2; j++)
+				mx[1][j + 1] = std::min(std::min(mx[1][j] + 1, mx[0][j + 1] + 1), mx[0][j] + ((s1[i] == s2[j]) ? 0 : 1));
+
+			mx[0].swap(mx[1]);
+		}
+		return mx[0][l2];
+	}
+
+	/** Builds messages of the specified length from the text of generated client lines. */
+	std::vector<std::string> Messages(size_t count, size_t length)
+	{
+		std::string text;
+		for (const auto& line : Bench::Data::ClientLines(count * 4))
+		{
+			const std::string::size_type colon = line.find(" :");
+			if (colon != std::string::npos)
+				text.append(line, colon + 2).push_back(' ');
+		}
+
+		std::vector<std::string> messages;
+		for (size_t idx = 0; messages.size() < count; idx += length)
+			messages.push_back(text.substr(idx % (text.size() - length), length));
+		return messages;
+	}
+
+	/** Changes about 15% of the characters in a message like a spammer evading an exact match. */
+	std::string Mutate(const std::string& message, std::minstd_rand& rng)
+	{
+		std::string mutated = message;
+		for (size_t edits = message.size() * 15 / 100; edits; --edits)
+			mutated[rng() % mutated.size()] = 'a' + (rng() % 26);
+		return mutated;
+	}
+
+	void Register()
+	{
+		// The lengths of a short chat line, a typical one, and one which is nearly as long as
+		// the default maximum that m_repeat compares.
+		for (const size_t length : { 40, 120, 400 })
+		{
+			std::minstd_rand rng(length);
+			const std::vector<std::string> messages = Messages(20, length);
+			std::vector<std::string> similar;
+			for (const auto& message : messages)
+				similar.push_back(Mutate(message, rng));
+
+			// m_repeat is usually configured to allow a difference of around 20%.
+			const size_t limit = length * 20 / 100;
+
+			Bench::Add(InspIRCd::Format("editdistance/dp_%zu", length), [=](size_t ops) {
+				std::vector<size_t> mx[2] = { std::vector<size_t>(length + 1), std::vector<size_t>(length + 1) };
+				for (size_t op = 0; op < ops; ++op)
+					Bench::DoNotOptimize(Levenshtein(messages[op % messages.size()], similar[op % similar.size()], mx));
+			});
+
+			// Compares a message against a backlog of similar messages like m_repeat does.
+			Bench::Add(InspIRCd::Format("editdistance/similar_%zu", length), [=](size_t ops) {
+				insp::edit_distance matcher;
+				for (size_t op = 0; op < ops; ++op)
+				{
+					if (!(op % similar.size()))
+						matcher.set_pattern(messages[(op / similar.size()) % messages.size()]);
+					Bench::DoNotOptimize(matcher.distance(similar[op % similar.size()], limit));
+				}
+			});
+
+			// Compares a message against a backlog of unrelated messages which are rejected early.
+			Bench::Add(InspIRCd::Format("editdistance/different_%zu", length), [=](size_t ops) {
+				insp::edit_distance matcher;
+				for (size_t op = 0; op < ops; ++op)
+				{
+					if (!(op % messages.size()))
+						matcher.set_pattern(similar[(op / messages.size() + 1) % similar.size()]);
+					Bench::DoNotOptimize(matcher.distance(messages[op % messages.size()], limit));
+				}
+			});
+
+			Bench::Add(InspIRCd::Format("editdistance/set_pattern_%zu", length), [=](size_t ops) {
+				insp::edit_distance matcher;
+				for (size_t op = 0; op < ops; ++op)
+					matcher.set_pattern(messages[op % messages.size()]);
+				Bench::DoNotOptimize(matcher.get_pattern());
+			});
+		}
+	}
+
+	Bench::Registrar registrar(Register);
+}
@@ -0,0 +1,91 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "bench.h"
+
+namespace
+{
+	void Register()
+	{
+		const std::vector<std::string> nicks = Bench::Data::Nicks(1000);
+		const std::vector<std::string> channels = Bench::Data::Channels(1000);
+		const std::vector<std::string> lines = Bench::Data::ClientLines(1000);
+
+		Bench::Add("hashcomp/insensitive_hash", [=](size_t ops) {
+			const irc::insensitive hasher;
+			for (size_t op = 0; op < ops; ++op)
+				Bench::DoNotOptimize(hasher(nicks[op % nicks.size()]));
+		});
+
+		Bench::Add("hashcomp/insensitive_swo", [=](size_t ops) {
+			const irc::insensitive_swo compare;
+			for (size_t op = 0; op < ops; ++op)
+				Bench::DoNotOptimize(compare(channels[op % channels.size()], channels[(op + 1) % channels.size()]));
+		});
+
+		Bench::Add("hashcomp/equals", [=](size_t ops) {
+			for (size_t op = 0; op < ops; ++op)
+			{
+				const std::string& nick = nicks[op % nicks.size()];
+				Bench::DoNotOptimize(irc::equals(nick, nick));
+			}
+		});
+
+		// Tokenises a whole line into its parameters like the RFC serializer does.
+		Bench::Add("hashcomp/tokenstream_line", [=](size_t ops) {
+			std::string token;
+			for (size_t op = 0; op < ops; ++op)
+			{
+				irc::tokenstream tokens(lines[op % lines.size()]);
+				while (tokens.GetTrailing(token))
+					Bench::DoNotOptimize(token);
+			}
+		});
+
+		// Between one and eight channels like the targets of a JOIN.
+		std::vector<std::string> targets;
+		for (size_t idx = 0; idx < channels.size(); ++idx)
+		{
+			std::string target;
+			for (size_t count = 0; count < 1 + idx % 8; ++count)
+				target.append(target.empty() ? "" : ",").append(channels[(idx + count) % channels.size()]);
+			targets.push_back(target);
+		}
+
+		Bench::Add("hashcomp/commasepstream_join", [=](size_t ops) {
+			std::string token;
+			for (size_t op = 0; op < ops; ++op)
+			{
+				irc::commasepstream stream(targets[op % targets.size()]);
+				while (stream.GetToken(token))
+					Bench::DoNotOptimize(token);
+			}
+		});
+
+		Bench::Add("hashcomp/spacesepstream_line", [=](size_t ops) {
+			std::string token;
+			for (size_t op = 0; op < ops; ++op)
+			{
+				irc::spacesepstream stream(lines[op % lines.size()]);
+				while (stream.GetToken(token))
+					Bench::DoNotOptimize(token);
+			}
+		});
+	}
+
+	Bench::Registrar registrar(Register);
+}
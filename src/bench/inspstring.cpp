@@ -0,0 +1,48 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "bench.h"
+
+namespace
+{
+	void Register()
+	{
+		// The size of a SASL PLAIN payload and of a large IRCv3 multiline batch chunk.
+		for (const size_t size : { 48, 400, 4096 })
+		{
+			const std::string data = Bench::Data::Bytes(size);
+			const std::string encoded = Base64::Encode(data);
+
+			Bench::Add(InspIRCd::Format("inspstring/base64_encode_%zu", size), [=](size_t ops) {
+				for (size_t op = 0; op < ops; ++op)
+					Bench::DoNotOptimize(Base64::Encode(data));
+			});
+
+			Bench::Add(InspIRCd::Format("inspstring/base64_decode_%zu", size), [=](size_t ops) {
+				for (size_t op = 0; op < ops; ++op)
+					Bench::DoNotOptimize(Base64::Decode(encoded));
+			});
+
+			Bench::Add(InspIRCd::Format("inspstring/hex_encode_%zu", size), [=](size_t ops) {
+				for (size_t op = 0; op < ops; ++op)
+					Bench::DoNotOptimize(Hex::Encode(data));
+			});
+		}
+	}
+
+	Bench::Registrar registrar(Register);
+}
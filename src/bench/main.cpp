@@ -0,0 +1,293 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "bench.h"
+#include "exitcodes.h"
+
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+namespace
+{
+	// The number of allocations which have been made since the program started. This is not
+	// atomic as the benchmarks are single threaded and the thread pool is idle whilst they run.
+	uint64_t allocations = 0;
+
+	struct Benchmark final
+	{
+		std::string name;
+		Bench::Function func;
+	};
+
+	struct Result final
+	{
+		// The number of operations in each sample.
+		size_t ops;
+
+		// The time per operation of each sample in nanoseconds, sorted in ascending order.
+		std::vector<double> nsperop;
+
+		// The number of allocations per operation.
+		double allocsperop;
+	};
+
+	struct Options final
+	{
+		// Only run the benchmarks whose names contain this string.
+		std::string filter;
+
+		// Whether to write the results as JSON lines rather than a table.
+		bool json = false;
+
+		// The minimum time in nanoseconds which each sample should take.
+		uint64_t sampletime = 50000000;
+
+		// The number of samples to take of each benchmark.
+		size_t samples = 7;
+
+		// The directory to load modules from.
+		std::string moduledir;
+	};
+
+	std::vector<Benchmark>& GetBenchmarks()
+	{
+		static std::vector<Benchmark> benchmarks;
+		return benchmarks;
+	}
+
+	std::vector<void (*)()>& GetRegistrars()
+	{
+		static std::vector<void (*)()> registrars;
+		return registrars;
+	}
+
+	[[noreturn]] void Usage(const char* argv0, int status)
+	{
+		std::cerr << "Usage: " << argv0 << " [--filter <text>] [--json] [--samples <count>] [--time <ms>] [--moduledir <dir>]" << std::endl
+			<< std::endl
+			<< "  --filter <text>    Only run benchmarks whose names contain <text>." << std::endl
+			<< "  --json             Write one JSON object per benchmark instead of a table." << std::endl
+			<< "  --samples <count>  The number of samples to take of each benchmark (default: 7)." << std::endl
+			<< "  --time <ms>        The minimum duration of each sample (default: 50)." << std::endl
+			<< "  --moduledir <dir>  The directory to load the core modules from (default: ../modules)." << std::endl;
+		exit(status);
+	}
+
+	Options ParseOptions(int argc, char** argv)
+	{
+		Options options;
+		const std::string argv0 = argv[0];
+		const std::string::size_type lastslash = argv0.rfind('/');
+		options.moduledir = (lastslash == std::string::npos ? "." : argv0.substr(0, lastslash)) + "/../modules";
+		for (int idx = 1; idx < argc; ++idx)
+		{
+			const std::string arg = argv[idx];
+			const bool hasvalue = idx + 1 < argc;
+			if (arg == "--filter" && hasvalue)
+				options.filter = argv[++idx];
+			else if (arg == "--json")
+				options.json = true;
+			else if (arg == "--samples" && hasvalue)
+				options.samples = std::max<size_t>(ConvToNum<size_t>(argv[++idx]), 1);
+			else if (arg == "--time" && hasvalue)
+				options.sampletime = std::max<uint64_t>(ConvToNum<uint64_t>(argv[++idx]), 1) * 1000000;
+			else if (arg == "--moduledir" && hasvalue)
+				options.moduledir = argv[++idx];
+			else
+				Usage(argv[0], arg == "--help" ? EXIT_STATUS_NOERROR : EXIT_STATUS_ARGV);
+		}
+		return options;
+	}
+
+	// Starts a server which has no listeners so that code which depends on the server state
+	// (e.g. the configured line length) can be benchmarked.
+	void StartServer(const std::string& moduledir)
+	{
+		char configfile[] = "/tmp/inspircd-bench-XXXXXX";
+		const int configfd = mkstemp(configfile);
+		if (configfd < 0)
+		{
+			std::cerr << "Unable to create the benchmark config file: " << strerror(errno) << std::endl;
+			exit(EXIT_STATUS_CONFIG);
+		}
+
+		const std::string config = "<server name=\"bench.example\" description=\"Benchmark\" network=\"Bench\">\n"
+			"<admin name=\"Benchmark\" nick=\"bench\" email=\"bench@bench.example\">\n"
+			"<path moduledir=\"" + moduledir + "\">\n"
+			"<dns timeout=\"1\">\n";
+		if (write(configfd, config.c_str(), config.length()) != static_cast<ssize_t>(config.length()))
+		{
+			std::cerr << "Unable to write the benchmark config file: " << strerror(errno) << std::endl;
+			exit(EXIT_STATUS_CONFIG);
+		}
+		close(configfd);
+
+		// Hide the startup banner so that it does not get mixed in with the results.
+		std::ofstream devnull("/dev/null");
+		std::streambuf* const oldbuf = std::cout.rdbuf(devnull.rdbuf());
+
+		const char* args[] = { "inspircd-bench", "--config", configfile, "--nofork", "--nolog", "--nopid", "--runasroot", nullptr };
+		new InspIRCd(sizeof(args) / sizeof(*args) - 1, const_cast<char**>(args));
+
+		std::cout.rdbuf(oldbuf);
+		unlink(configfile);
+	}
+
+	Result Run(const Benchmark& benchmark, const Options& options)
+	{
+		// Find the number of operations which takes at least the sample time. This also warms
+		// up the caches and lets any lazily initialised state in the benchmark be created.
+		size_t ops = 1;
+		for (;;)
+		{
+			const uint64_t started = insp::monotonic_ns();
+			benchmark.func(ops);
+			const uint64_t elapsed = insp::monotonic_ns() - started;
+			if (elapsed >= options.sampletime)
+				break;
+
+			// Aim slightly above the sample time so the next attempt usually succeeds.
+			const double scale = elapsed ? (options.sampletime * 1.2) / elapsed : 100;
+			ops = static_cast<size_t>(ops * std::min(std::max(scale, 2.0), 100.0));
+		}
+
+		Result result;
+		result.ops = ops;
+		uint64_t allocated = 0;
+		for (size_t sample = 0; sample < options.samples; ++sample)
+		{
+			const uint64_t startallocs = allocations;
+			const uint64_t started = insp::monotonic_ns();
+			benchmark.func(ops);
+			const uint64_t elapsed = insp::monotonic_ns() - started;
+			allocated += allocations - startallocs;
+			result.nsperop.push_back(static_cast<double>(elapsed) / ops);
+		}
+
+		std::sort(result.nsperop.begin(), result.nsperop.end());
+		result.allocsperop = static_cast<double>(allocated) / (ops * options.samples);
+		return result;
+	}
+
+	void WriteResult(const Benchmark& benchmark, const Result& result, const Options& options)
+	{
+		// The median is used as it is not affected by the occasional sample being interrupted.
+		const double median = result.nsperop[result.nsperop.size() / 2];
+		const double min = result.nsperop.front();
+		const double max = result.nsperop.back();
+		if (options.json)
+		{
+			// Benchmark names never need to be escaped.
+			std::cout << InspIRCd::Format("{\"name\":\"%s\",\"ns_per_op\":%.2f,\"min_ns_per_op\":%.2f,\"max_ns_per_op\":%.2f,\"allocs_per_op\":%.3f,\"ops_per_sample\":%zu,\"samples\":%zu}",
+				benchmark.name.c_str(), median, min, max, result.allocsperop, result.ops, result.nsperop.size()) << std::endl;
+		}
+		else
+		{
+			std::cout << InspIRCd::Format("%-40s %12.2f %12.2f %12.2f %10.3f", benchmark.name.c_str(), median, min, max,
+				result.allocsperop) << std::endl;
+		}
+	}
+}
+
+void Bench::Add(const std::string& name, const Function& func)
+{
+	GetBenchmarks().push_back({ name, func });
+}
+
+Bench::Registrar::Registrar(void (*func)())
+{
+	GetRegistrars().push_back(func);
+}
+
+int main(int argc, char** argv)
+{
+	const Options options = ParseOptions(argc, argv);
+	StartServer(options.moduledir);
+
+	for (const auto& registrar : GetRegistrars())
+		registrar();
+
+	std::sort(GetBenchmarks().begin(), GetBenchmarks().end(), [](const Benchmark& lhs, const Benchmark& rhs) {
+		return lhs.name < rhs.name;
+	});
+
+	if (!options.json)
+		std::cout << InspIRCd::Format("%-40s %12s %12s %12s %10s", "benchmark", "ns/op", "min ns/op", "max ns/op", "allocs/op") << std::endl;
+
+	for (const auto& benchmark : GetBenchmarks())
+	{
+		if (benchmark.name.find(options.filter) == std::string::npos)
+			continue;
+
+		const Result result = Run(benchmark, options);
+		WriteResult(benchmark, result, options);
+	}
+
+	ServerInstance->Exit(EXIT_STATUS_NOERROR);
+	return EXIT_STATUS_NOERROR;
+}
+
+// Count every allocation so that benchmarks can report how many allocations each operation
+// makes. These are exported so that modules also use them.
+CoreExport void* operator new(size_t size)
+{
+	allocations++;
+	if (void* ptr = malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+CoreExport void* operator new[](size_t size)
+{
+	allocations++;
+	if (void* ptr = malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+CoreExport void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	allocations++;
+	return malloc(size ? size : 1);
+}
+
+CoreExport void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	allocations++;
+	return malloc(size ? size : 1);
+}
+
+CoreExport void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+CoreExport void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+
+CoreExport void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+CoreExport void operator delete[](void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
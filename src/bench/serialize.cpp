@@ -0,0 +1,78 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "bench.h"
+
+namespace
+{
+	void Register()
+	{
+		ClientProtocol::Serializer* ser = ServerInstance->Modules.FindDataService<ClientProtocol::Serializer>("serializer/rfc");
+		if (!ser)
+			return;
+
+		const std::vector<std::string> lines = Bench::Data::ClientLines(1000);
+
+		// The user is never connected so it is deliberately leaked rather than quit.
+		irc::sockets::sockaddrs sa;
+		irc::sockets::aptosa("127.0.0.1", 6667, sa);
+		LocalUser* user = new LocalUser(-1, &sa, &sa);
+
+		Bench::Add("serialize/rfc_parse", [=](size_t ops) {
+			for (size_t op = 0; op < ops; ++op)
+			{
+				ClientProtocol::ParseOutput output;
+				Bench::DoNotOptimize(ser->Parse(user, lines[op % lines.size()], output));
+				user->CommandFloodPenalty = 0;
+			}
+		});
+
+		// Messages only keep a pointer to their source so it must outlive them.
+		static const std::string source = "nick!~ident@" + ServerInstance->Config->ServerName;
+		auto messages = std::make_shared<std::vector<std::unique_ptr<ClientProtocol::Message>>>();
+		for (size_t idx = 0; idx < lines.size(); ++idx)
+		{
+			ClientProtocol::ParseOutput output;
+			ser->Parse(user, lines[idx], output);
+			user->CommandFloodPenalty = 0;
+
+			auto msg = std::make_unique<ClientProtocol::Message>(output.cmd.c_str(), source);
+			for (const auto& param : output.params)
+				msg->PushParam(param);
+			if (idx % 4 == 0)
+				msg->AddTag("time", nullptr, "2025-01-01T00:00:00.000Z");
+			if (idx % 8 == 0)
+				msg->AddTag("msgid", nullptr, ConvToStr(idx));
+			messages->push_back(std::move(msg));
+		}
+
+		// Serializes the kind of message which is sent to every member of a channel.
+		Bench::Add("serialize/rfc_serialize", [=](size_t ops) {
+			for (size_t op = 0; op < ops; ++op)
+			{
+				const ClientProtocol::Message& msg = *(*messages)[op % messages->size()];
+				ClientProtocol::TagSelection tagwl;
+				const ClientProtocol::TagMap& tags = msg.GetTags();
+				for (auto tag = tags.begin(); tag != tags.end(); ++tag)
+					tagwl.Select(tags, tag);
+				Bench::DoNotOptimize(ser->Serialize(msg, tagwl));
+			}
+		});
+	}
+
+	Bench::Registrar registrar(Register);
+}
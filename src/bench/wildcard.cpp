@@ -0,0 +1,62 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "bench.h"
+
+namespace
+{
+	void Register()
+	{
+		const std::vector<std::string> hosts = Bench::Data::Hostnames(1000);
+		const std::vector<std::string> masks = Bench::Data::BanMasks(100);
+		const std::vector<std::string> ips = Bench::Data::IPv4Addresses(1000);
+		const std::vector<std::string> cidrs = Bench::Data::CIDRMasks(100);
+
+		std::vector<std::string> nuhs;
+		for (size_t idx = 0; idx < hosts.size(); ++idx)
+			nuhs.push_back(InspIRCd::Format("user%zu!~ident%zu@%s", idx, idx, hosts[idx].c_str()));
+
+		// Matches nick!user@host against a ban list like a channel join does.
+		Bench::Add("wildcard/match_banlist", [=](size_t ops) {
+			for (size_t op = 0; op < ops; ++op)
+			{
+				const std::string& nuh = nuhs[op % nuhs.size()];
+				const std::string& mask = masks[op % masks.size()];
+				Bench::DoNotOptimize(InspIRCd::Match(nuh, mask, ascii_case_insensitive_map));
+			}
+		});
+
+		Bench::Add("wildcard/match_literal", [=](size_t ops) {
+			for (size_t op = 0; op < ops; ++op)
+			{
+				const std::string& host = hosts[op % hosts.size()];
+				Bench::DoNotOptimize(InspIRCd::Match(host, host, ascii_case_insensitive_map));
+			}
+		});
+
+		Bench::Add("wildcard/matchcidr_ip", [=](size_t ops) {
+			for (size_t op = 0; op < ops; ++op)
+			{
+				const std::string& ip = ips[op % ips.size()];
+				const std::string& mask = cidrs[op % cidrs.size()];
+				Bench::DoNotOptimize(InspIRCd::MatchCIDR(ip, mask, ascii_case_insensitive_map));
+			}
+		});
+	}
+
+	Bench::Registrar registrar(Register);
+}
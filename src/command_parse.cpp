@@ -24,6 +24,67 @@
 
 
 #include "inspircd.h"
+#include "modules/hash.h"
+#include "utility/histogram.h"
+
+namespace
+{
+	/** Compares a password using a key derivation function on a worker thread. */
+	class PassCompareTask final : public ThreadPool::Task
+	{
+	 private:
+		HashProvider* const provider;
+		const std::string data;
+		const std::string input;
+		const std::function<void(bool)> callback;
+		bool result = false;
+
+	 public:
+		PassCompareTask(Module* mod, HashProvider* hp, const std::string& d, const std::string& i, const std::function<void(bool)>& cb)
+			: ThreadPool::Task(mod)
+			, provider(hp)
+			, data(d)
+			, input(i)
+			, callback(cb)
+		{
+		}
+
+		void Run() override
+		{
+			result = provider->Compare(input, data);
+		}
+
+		void OnComplete() override
+		{
+			callback(result);
+		}
+	};
+
+	/** Finds the provider of a key derivation function with the specified name. */
+	HashProvider* FindKDF(const std::string& hashtype)
+	{
+		if (hashtype.empty())
+			return nullptr;
+
+		HashProvider* hp = ServerInstance->Modules.FindDataService<HashProvider>("hash/" + hashtype);
+		return hp && hp->IsKDF() ? hp : nullptr;
+	}
+
+	/** Compares a password which no module has handled. */
+	bool CompareUnhandled(const std::string& data, const std::string& input, const std::string& hashtype)
+	{
+		/* Key derivation functions are compared here so that PassCompare can do it off the main thread */
+		HashProvider* hp = FindKDF(hashtype);
+		if (hp)
+			return hp->Compare(input, data);
+
+		/* We dont handle any hash types except for plaintext - Thanks tra26 */
+		if (!hashtype.empty() && !stdalgo::string::equalsci(hashtype, "plaintext"))
+			return false;
+
+		return InspIRCd::TimingSafeCompare(data, input);
+	}
+}
 
 bool InspIRCd::PassCompare(Extensible* ex, const std::string& data, const std::string& input, const std::string& hashtype)
 {
@@ -38,11 +99,29 @@ bool InspIRCd::PassCompare(Extensible* ex, const std::string& data, const std::s
 	if (res == MOD_RES_DENY)
 		return false;
 
-	/* We dont handle any hash types except for plaintext - Thanks tra26 */
-	if (!hashtype.empty() && !stdalgo::string::equalsci(hashtype, "plaintext"))
-		return false;
+	return CompareUnhandled(data, input, hashtype);
+}
+
+void InspIRCd::PassCompare(Module* creator, Extensible* ex, const std::string& data, const std::string& input, const std::string& hashtype, const std::function<void(bool)>& callback)
+{
+	ModResult res;
+	FIRST_MOD_RESULT(OnPassCompare, res, (ex, data, input, hashtype));
+	if (res != MOD_RES_PASSTHRU)
+	{
+		callback(res == MOD_RES_ALLOW);
+		return;
+	}
 
-	return TimingSafeCompare(data, input);
+	// Key derivation functions are deliberately slow so they are compared off the main
+	// thread. Anything else is cheap enough to compare here.
+	HashProvider* hp = FindKDF(hashtype);
+	if (hp)
+	{
+		Threads.Submit(new PassCompareTask(creator, hp, data, input, callback));
+		return;
+	}
+
+	callback(CompareUnhandled(data, input, hashtype));
 }
 
 bool CommandParser::LoopCall(User* user, Command* handler, const CommandBase::Params& parameters, unsigned int splithere, int extra, bool usemax)
@@ -320,12 +399,14 @@ void CommandParser::ProcessCommand(LocalUser* user, std::string& command, Comman
 	{
 		/* passed all checks.. first, do the (ugly) stats counters. */
 		handler->use_count++;
+		const uint64_t started = insp::monotonic_ns();
 
 		/* module calls too */
 		FIRST_MOD_RESULT(OnPreCommand, MOD_RESULT, (command, command_p, user, true));
 		if (MOD_RESULT == MOD_RES_DENY)
 		{
 			FOREACH_MOD(OnCommandBlocked, (command, command_p, user));
+			RecordExecution(user, handler, command_p, started);
 			return;
 		}
 
@@ -335,6 +416,25 @@ void CommandParser::ProcessCommand(LocalUser* user, std::string& command, Comman
 		CmdResult result = handler->Handle(user, command_p);
 
 		FOREACH_MOD(OnPostCommand, (handler, command_p, user, result, false));
+		RecordExecution(user, handler, command_p, started);
+	}
+}
+
+void CommandParser::RecordExecution(LocalUser* user, Command* handler, const CommandBase::Params& parameters, uint64_t started)
+{
+	const uint64_t elapsed = insp::monotonic_ns() - started;
+	handler->exec_time->add(elapsed);
+
+	// The user may have quit during the command but they are not deleted until the end of
+	// the current main loop iteration so it is still safe to refer to them here.
+	const unsigned long threshold = ServerInstance->Config->SlowCommand;
+	if (threshold && elapsed >= threshold * 1000000)
+	{
+		// The parameters are not logged as they can contain passwords (e.g. OPER, PASS or a
+		// message to a services bot).
+		ServerInstance->Logs.Log("COMMAND", LOG_DEFAULT, "Slow command: %s from %s (%s) with %zu parameters took %lu ms",
+			handler->name.c_str(), user->uuid.c_str(), user->GetFullRealHost().c_str(), parameters.size(),
+			static_cast<unsigned long>(elapsed / 1000000));
 	}
 }
 
@@ -23,6 +23,7 @@
 
 
 #include "inspircd.h"
+#include "utility/histogram.h"
 
 CommandBase::CommandBase(Module* mod, const std::string& cmd, unsigned int minpara, unsigned int maxpara)
 	: ServiceProvider(mod, cmd, SERVICE_COMMAND)
@@ -42,6 +43,7 @@ RouteDescriptor CommandBase::GetRouting(User* user, const Params& parameters)
 
 Command::Command(Module* mod, const std::string& cmd, unsigned int minpara, unsigned int maxpara)
 	: CommandBase(mod, cmd, minpara, maxpara)
+	, exec_time(std::make_unique<insp::log2_histogram>())
 {
 }
 
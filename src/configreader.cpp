@@ -349,6 +349,9 @@ void ServerConfig::Fill()
 	CCOnConnect = ConfValue("performance")->getBool("clonesonconnect", true);
 	MaxConn = static_cast<int>(ConfValue("performance")->getUInt("somaxconn", SOMAXCONN));
 	TimeSkipWarn = ConfValue("performance")->getDuration("timeskipwarn", 2, 0, 30);
+	WorkerThreads = ConfValue("performance")->getUInt("workerthreads", std::max(std::thread::hardware_concurrency(), 1U), 1, 256);
+	SlowCommand = ConfValue("performance")->getUInt("slowcommand", 0);
+	SlowIteration = ConfValue("performance")->getUInt("slowiteration", 500);
 	XLineMessage = options->getString("xlinemessage", "You're banned!", 1);
 	ServerDesc = server->getString("description", "Configure Me", 1);
 	Network = server->getString("network", "Network", 1);
@@ -21,8 +21,12 @@
 
 #include "inspircd.h"
 #include "modules/dns.h"
+#include "modules/metrics.h"
+#include "modules/stats.h"
+#include "utility/histogram.h"
 #include <iostream>
 #include <fstream>
+#include <queue>
 
 #ifdef _WIN32
 #include <Iphlpapi.h>
@@ -210,6 +214,27 @@ class Packet : public Query
 
 				break;
 			}
+			case QUERY_SOA:
+			{
+				if (pos + rdlength > input_size)
+					throw Exception("Unable to unpack SOA resource record");
+
+				const unsigned short end = pos + rdlength;
+				record.rdata = this->UnpackName(input, input_size, pos);
+				record.rdata += " " + this->UnpackName(input, input_size, pos);
+				if (pos + 20 > end)
+					throw Exception("Unable to unpack SOA resource record");
+
+				// Skip over the serial, refresh, retry, and expire fields.
+				pos += 16;
+
+				// RFC 2308 section 5: the TTL of a negative answer is the smaller of the TTL of
+				// the SOA record and its MINIMUM field.
+				unsigned int minimum = (input[pos] << 24) | (input[pos + 1] << 16) | (input[pos + 2] << 8) | input[pos + 3];
+				record.ttl = std::min(record.ttl, minimum);
+				pos = end;
+				break;
+			}
 			case QUERY_SRV:
 			{
 				if (rdlength < 6 || pos + rdlength > input_size)
@@ -261,6 +286,9 @@ class Packet : public Query
 	/* Flags on the packet */
 	unsigned short flags = 0;
 
+	/* The time for which a negative answer may be cached if the authority section contains a SOA record */
+	std::optional<unsigned int> negativettl;
+
 	void Fill(const unsigned char* input, const unsigned short len)
 	{
 		if (len < HEADER_LENGTH)
@@ -295,6 +323,22 @@ class Packet : public Query
 
 		for (unsigned i = 0; i < ancount; ++i)
 			this->answers.push_back(this->UnpackResourceRecord(input, len, packet_pos));
+
+		// The authority section is only used for negative caching so a malformed record here
+		// should not cause the entire answer to be rejected.
+		try
+		{
+			for (unsigned i = 0; i < nscount; ++i)
+			{
+				const ResourceRecord rr = this->UnpackResourceRecord(input, len, packet_pos);
+				if (rr.type == QUERY_SOA)
+					this->negativettl = std::min(rr.ttl, this->negativettl.value_or(UINT_MAX));
+			}
+		}
+		catch (const Exception& ex)
+		{
+			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Ignoring malformed authority section: " + ex.GetReason());
+		}
 	}
 
 	unsigned short Pack(unsigned char* output, unsigned short output_size)
@@ -369,55 +413,598 @@ class Packet : public Query
 	}
 };
 
-class MyManager : public Manager, public Timer, public EventHandler
+/** Caches answers from the nameserver. Entries are evicted in least recently used order once
+ * the cache uses more than the configured amount of memory and are removed once they expire.
+ */
+class Cache final
 {
-	typedef std::unordered_map<Question, Query, Question::hash> cache_map;
-	cache_map cache;
+ private:
+	struct Entry final
+	{
+		/** The cached answer. If this has an error set then it is a negative cache entry. */
+		Query query;
 
-	irc::sockets::sockaddrs myserver;
-	bool unloading = false;
+		/** The time at which this entry expires. */
+		time_t expires;
+
+		/** The approximate amount of memory used by this entry. */
+		size_t size;
+
+		/** The position of this entry in the LRU list. */
+		std::list<Question>::iterator position;
+	};
+
+	typedef std::unordered_map<Question, Entry, Question::hash> EntryMap;
+	typedef std::pair<time_t, Question> Expiry;
 
-	/** Maximum number of entries in cache
+	struct ExpiryCompare final
+	{
+		bool operator()(const Expiry& lhs, const Expiry& rhs) const
+		{
+			return lhs.first > rhs.first;
+		}
+	};
+
+	/** The cached entries. */
+	EntryMap entries;
+
+	/** The cached questions ordered from most to least recently used. */
+	std::list<Question> lru;
+
+	/** The expiry times of the cached entries. This may also contain entries which have been
+	 * replaced or evicted; these are skipped when they reach the top.
 	 */
-	static const unsigned int MAX_CACHE_SIZE = 1000;
+	std::priority_queue<Expiry, std::vector<Expiry>, ExpiryCompare> expiries;
+
+	/** The approximate amount of memory used by the cached entries. */
+	size_t memory = 0;
 
-	static bool IsExpired(const Query& record, time_t now = ServerInstance->Time())
+	/** The number of negative entries in the cache. */
+	size_t negative = 0;
+
+	/** Escapes a field of the cache file so that it is always a single token. */
+	static std::string EscapeField(const std::string& field)
 	{
-		const ResourceRecord& req = record.answers[0];
-		return (req.created + static_cast<time_t>(req.ttl) < now);
+		std::string escaped;
+		escaped.reserve(field.length());
+		for (const auto chr : field)
+		{
+			const unsigned char uchr = static_cast<unsigned char>(chr);
+			if (uchr <= 0x20 || uchr == 0x7F || uchr == '%')
+				escaped.append(InspIRCd::Format("%%%02X", uchr));
+			else
+				escaped.push_back(chr);
+		}
+		return escaped;
 	}
 
-	/** Check the DNS cache to see if request can be handled by a cached result
-	 * @return true if a cached result was found.
+	/** Reverses EscapeField. Returns false if the field is not validly escaped. */
+	static bool UnescapeField(const std::string& field, std::string& out)
+	{
+		out.clear();
+		for (size_t idx = 0; idx < field.length(); ++idx)
+		{
+			if (field[idx] != '%')
+			{
+				out.push_back(field[idx]);
+				continue;
+			}
+
+			if (idx + 2 >= field.length() || !isxdigit(static_cast<unsigned char>(field[idx + 1]))
+				|| !isxdigit(static_cast<unsigned char>(field[idx + 2])))
+				return false;
+
+			out.push_back(static_cast<char>(std::stoi(field.substr(idx + 1, 2), nullptr, 16)));
+			idx += 2;
+		}
+		return true;
+	}
+
+	/** Checks that a name from a cache entry contains no whitespace or control characters. */
+	static bool IsSafeName(const std::string& name)
+	{
+		if (name.empty())
+			return false;
+
+		for (const auto chr : name)
+		{
+			const unsigned char uchr = static_cast<unsigned char>(chr);
+			if (uchr <= 0x20 || uchr == 0x7F)
+				return false;
+		}
+		return true;
+	}
+
+	/** Checks that the data of a cached record contains no control characters and only
+	 * contains spaces if its type separates fields with them.
 	 */
-	bool CheckCache(DNS::Request* req, const DNS::Question& question)
+	static bool IsSafeData(QueryType type, const std::string& rdata)
 	{
-		ServerInstance->Logs.Log(MODNAME, LOG_SPARSE, "cache: Checking cache for " + question.name);
+		if (rdata.empty())
+			return false;
 
-		cache_map::iterator it = this->cache.find(question);
-		if (it == this->cache.end())
+		const bool spaces = type == QUERY_TXT || type == QUERY_SOA || type == QUERY_SRV;
+		for (const auto chr : rdata)
+		{
+			const unsigned char uchr = static_cast<unsigned char>(chr);
+			if (uchr < 0x20 || uchr == 0x7F || (uchr == 0x20 && !spaces))
+				return false;
+		}
+		return true;
+	}
+
+	/** Checks whether a query can be written to and read from the cache file safely. */
+	static bool IsSafeQuery(const Query& query)
+	{
+		if (!IsSafeName(query.question.name))
 			return false;
 
-		Query& record = it->second;
-		if (IsExpired(record))
+		for (const auto& rr : query.answers)
+		{
+			if (!IsSafeName(rr.name) || !IsSafeData(rr.type, rr.rdata))
+				return false;
+		}
+		return true;
+	}
+
+	static size_t EstimateSize(const Query& query)
+	{
+		// This is only an approximation as it does not take allocator overhead into account.
+		size_t size = sizeof(Entry) + sizeof(Question) * 3 + query.question.name.length() * 3;
+		for (const auto& rr : query.answers)
+			size += sizeof(ResourceRecord) + rr.name.length() + rr.rdata.length();
+		return size;
+	}
+
+	void Erase(EntryMap::iterator it)
+	{
+		memory -= it->second.size;
+		if (it->second.query.error != ERROR_NONE)
+			negative--;
+		lru.erase(it->second.position);
+		entries.erase(it);
+	}
+
+	void Insert(const Query& query, time_t expires)
+	{
+		EntryMap::iterator it = entries.find(query.question);
+		if (it != entries.end())
+			Erase(it);
+
+		lru.push_front(query.question);
+		Entry& entry = entries[query.question];
+		entry.query = query;
+		entry.expires = expires;
+		entry.size = EstimateSize(query);
+		entry.position = lru.begin();
+
+		memory += entry.size;
+		if (query.error != ERROR_NONE)
+			negative++;
+
+		// Rebuild the expiry heap if it is mostly made up of stale entries.
+		if (expiries.size() > entries.size() * 2 + 64)
 		{
-			this->cache.erase(it);
+			decltype(expiries) newexpiries;
+			for (const auto& [question, e] : entries)
+				newexpiries.emplace(e.expires, question);
+			std::swap(expiries, newexpiries);
+		}
+		expiries.emplace(expires, query.question);
+
+		while (memory > maxmemory && !lru.empty())
+		{
+			evictions++;
+			Erase(entries.find(lru.back()));
+		}
+	}
+
+ public:
+	/** The maximum amount of memory the cache may use. */
+	size_t maxmemory = 1024 * 1024;
+
+	/** The maximum time for which a positive answer may be cached. */
+	unsigned long maxttl = 24*60*60;
+
+	/** The maximum time for which a negative answer may be cached. */
+	unsigned long maxnegativettl = 15*60;
+
+	/** The number of lookups which were answered by a positive entry. */
+	uint64_t hits = 0;
+
+	/** The number of lookups which were answered by a negative entry. */
+	uint64_t negativehits = 0;
+
+	/** The number of lookups which could not be answered from the cache. */
+	uint64_t misses = 0;
+
+	/** The number of entries which were removed to stay within the memory limit. */
+	uint64_t evictions = 0;
+
+	/** The number of entries which were removed because they expired. */
+	uint64_t expirations = 0;
+
+	/** Adds an answer from the nameserver to the cache.
+	 * @param query The answer to cache.
+	 * @param ttl The time in seconds for which the answer is valid.
+	 */
+	void Add(const Query& query, unsigned int ttl)
+	{
+		const unsigned long limit = query.error == ERROR_NONE ? maxttl : maxnegativettl;
+		if (!ttl || !limit)
+			return;
+
+		Insert(query, ServerInstance->Time() + std::min<unsigned long>(ttl, limit));
+	}
+
+	/** Removes all entries from the cache. */
+	void Clear()
+	{
+		entries.clear();
+		lru.clear();
+		expiries = decltype(expiries)();
+		memory = negative = 0;
+	}
+
+	/** Removes all expired entries from the cache.
+	 * @return The number of entries which were removed.
+	 */
+	unsigned long Expire()
+	{
+		unsigned long expired = 0;
+		const time_t now = ServerInstance->Time();
+		while (!expiries.empty() && expiries.top().first <= now)
+		{
+			EntryMap::iterator it = entries.find(expiries.top().second);
+			if (it != entries.end() && it->second.expires == expiries.top().first)
+			{
+				Erase(it);
+				expired++;
+			}
+			expiries.pop();
+		}
+		expirations += expired;
+		return expired;
+	}
+
+	/** Looks up a question in the cache.
+	 * @param question The question to look up.
+	 * @return The cached answer or nullptr if the question is not cached.
+	 */
+	Query* Find(const Question& question)
+	{
+		EntryMap::iterator it = entries.find(question);
+		if (it == entries.end())
+		{
+			misses++;
+			return nullptr;
+		}
+
+		if (it->second.expires <= ServerInstance->Time())
+		{
+			Erase(it);
+			expirations++;
+			misses++;
+			return nullptr;
+		}
+
+		if (it->second.query.error == ERROR_NONE)
+			hits++;
+		else
+			negativehits++;
+
+		// Move the entry to the front so that it is evicted last.
+		lru.splice(lru.begin(), lru, it->second.position);
+		return &it->second.query;
+	}
+
+	size_t GetCount() const { return entries.size(); }
+	size_t GetMemory() const { return memory; }
+	size_t GetNegativeCount() const { return negative; }
+
+	/** Reads cached entries which were written by Save.
+	 * @param path The file to read from.
+	 */
+	void Load(const std::string& path)
+	{
+		std::ifstream stream(path);
+		if (!stream.is_open())
+			return;
+
+		std::string line;
+		if (!std::getline(stream, line) || line != "VERSION 2")
+		{
+			ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "Ignoring DNS cache file \"%s\" with an unknown format", path.c_str());
+			return;
+		}
+
+		const time_t now = ServerInstance->Time();
+		size_t loaded = 0;
+		size_t rejected = 0;
+		while (std::getline(stream, line))
+		{
+			// ENTRY <expires> <type> <error> <answers> <name>
+			irc::spacesepstream entrystream(line);
+			std::string token, name;
+			time_t expires;
+			unsigned long type, error, answers;
+			if (!entrystream.GetToken(token) || token != "ENTRY" || !entrystream.GetNumericToken(expires)
+				|| !entrystream.GetNumericToken(type) || !entrystream.GetNumericToken(error)
+				|| !entrystream.GetNumericToken(answers) || !entrystream.GetToken(token)
+				|| !UnescapeField(token, name) || !entrystream.StreamEnd())
+				break;
+
+			Query query(Question(name, static_cast<QueryType>(type)));
+			query.error = static_cast<Error>(error);
+			for (unsigned long i = 0; i < answers && std::getline(stream, line); ++i)
+			{
+				// ANSWER <type> <ttl> <name> <rdata>
+				irc::spacesepstream answerstream(line);
+				std::string rrname, rdata;
+				unsigned long rrtype;
+				unsigned int ttl;
+				if (!answerstream.GetToken(token) || token != "ANSWER" || !answerstream.GetNumericToken(rrtype)
+					|| !answerstream.GetNumericToken(ttl) || !answerstream.GetToken(token) || !UnescapeField(token, rrname)
+					|| !answerstream.GetToken(token) || !UnescapeField(token, rdata) || !answerstream.StreamEnd())
+					break;
+
+				ResourceRecord& rr = query.answers.emplace_back(rrname, static_cast<QueryType>(rrtype));
+				rr.ttl = ttl;
+				rr.rdata = rdata;
+				if (rr.type == QUERY_SRV)
+				{
+					auto srv = std::make_shared<Record::SRV>();
+					irc::spacesepstream srvstream(rdata);
+					srvstream.GetNumericToken(srv->priority);
+					srvstream.GetNumericToken(srv->weight);
+					srvstream.GetNumericToken(srv->port);
+					srvstream.GetToken(srv->host);
+					rr.rdataobj = srv;
+				}
+			}
+
+			if (query.answers.size() != answers)
+				break;
+
+			// The file may have been edited or written by a version which did not check the
+			// names so anything which could not have come from a valid answer is dropped.
+			if (!IsSafeQuery(query))
+			{
+				rejected++;
+				continue;
+			}
+
+			if (expires > now && (query.error != ERROR_NONE || !query.answers.empty()))
+			{
+				Insert(query, expires);
+				loaded++;
+			}
+		}
+
+		if (rejected)
+			ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "Rejected %zu invalid entries from the DNS cache file \"%s\"", rejected, path.c_str());
+		ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "Loaded %zu entries from the DNS cache file \"%s\"", loaded, path.c_str());
+	}
+
+	/** Writes the cached entries to a file so they can be reused after a restart.
+	 * @param path The file to write to.
+	 * @return True if the file was written; otherwise, false.
+	 */
+	bool Save(const std::string& path)
+	{
+		// Write to a temporary file first so we don't leave a partial cache behind on failure.
+		const std::string newpath = path + ".new";
+		std::ofstream stream(newpath);
+		if (!stream.is_open())
+		{
+			ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "Cannot create DNS cache file \"%s\": %s (%d)", newpath.c_str(), strerror(errno), errno);
+			return false;
+		}
+
+		stream << "VERSION 2" << std::endl;
+
+		// Write the least recently used entries first so that they are evicted first when loaded.
+		const time_t now = ServerInstance->Time();
+		for (std::list<Question>::const_reverse_iterator it = lru.rbegin(); it != lru.rend(); ++it)
+		{
+			const Entry& entry = entries.find(*it)->second;
+			if (entry.expires <= now)
+				continue;
+
+			// Every field is escaped but names with whitespace or control characters can not
+			// be valid hostnames so they are not kept at all.
+			const Query& query = entry.query;
+			if (!IsSafeQuery(query))
+				continue;
+
+			stream << "ENTRY " << entry.expires << ' ' << query.question.type << ' ' << query.error << ' '
+				<< query.answers.size() << ' ' << EscapeField(query.question.name) << std::endl;
+
+			for (const auto& rr : query.answers)
+				stream << "ANSWER " << rr.type << ' ' << rr.ttl << ' ' << EscapeField(rr.name) << ' ' << EscapeField(rr.rdata) << std::endl;
+		}
+
+		if (stream.fail())
+		{
+			ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "Cannot write to DNS cache file \"%s\": %s (%d)", newpath.c_str(), strerror(errno), errno);
+			return false;
+		}
+		stream.close();
+
+#ifdef _WIN32
+		remove(path.c_str());
+#endif
+		if (rename(newpath.c_str(), path.c_str()) < 0)
+		{
+			ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "Cannot replace DNS cache file \"%s\": %s (%d)", path.c_str(), strerror(errno), errno);
 			return false;
 		}
+		return true;
+	}
+};
+
+/** A nameserver which queries can be sent to. */
+struct Nameserver final
+{
+	/** The address of the nameserver. */
+	irc::sockets::sockaddrs addr;
+
+	/** The smoothed round trip time to the nameserver in microseconds or 0 if it is not known yet. */
+	uint64_t srtt = 0;
+
+	/** The round trip times of the answers received from the nameserver in nanoseconds. */
+	insp::log2_histogram rtt;
+
+	/** The number of queries which have been sent to the nameserver. */
+	uint64_t queries = 0;
+
+	/** The number of answers which have been received from the nameserver. */
+	uint64_t answers = 0;
+
+	/** The number of queries which the nameserver did not answer in time. */
+	uint64_t timeouts = 0;
+
+	/** The number of queries which the nameserver answered with SERVFAIL or REFUSED. */
+	uint64_t failures = 0;
+
+	Nameserver(const irc::sockets::sockaddrs& sa)
+		: addr(sa)
+	{
+	}
+};
+
+/** A query which has been sent to at least one nameserver but not answered yet. */
+struct Transmission final
+{
+	/** The packed query so it can be sent to another nameserver. */
+	std::vector<unsigned char> packet;
+
+	/** The indices of the nameservers which the query has been sent to, most recent last. */
+	std::vector<size_t> servers;
+
+	/** The monotonic time in nanoseconds at which the query was last sent. */
+	uint64_t sent = 0;
+};
+
+/** A query which should be sent to another nameserver if it has not been answered by a specific time. */
+struct Retry final
+{
+	/** The time at which the query should be sent again. */
+	time_t due;
+
+	/** The request slot of the query. */
+	size_t slot;
+
+	/** The value of Transmission::sent when this retry was scheduled. */
+	uint64_t sent;
+};
+
+class MyManager;
+
+/** A UDP socket which queries are sent from. Each socket has its own space of request ids. */
+class DNSSocket final : public EventHandler
+{
+ private:
+	MyManager* const manager;
+
+ public:
+	/** The index of this socket within the manager. */
+	const size_t index;
+
+	DNSSocket(MyManager* m, size_t i)
+		: manager(m)
+		, index(i)
+	{
+	}
+
+	void OnEventHandlerError(int errcode) override
+	{
+		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "UDP socket got an error event");
+	}
+
+	void OnEventHandlerRead() override;
+};
+
+class MyManager : public Manager, public Timer
+{
+ public:
+	/** The ways in which the nameserver to send a query to can be selected. */
+	enum Selection
+	{
+		/** Send to the nameserver with the lowest smoothed round trip time. */
+		SELECT_LATENCY,
+
+		/** Send to each nameserver in turn. */
+		SELECT_ROUNDROBIN
+	};
+
+ private:
+	/** The number of request slots which each socket has. */
+	static constexpr size_t SLOTS = MAX_REQUEST_ID + 1;
+
+	/** The longest round trip time in microseconds which a nameserver can be penalised to. */
+	static constexpr uint64_t MAX_SRTT = 10 * 1000 * 1000;
+
+	bool unloading = false;
+
+	/** The nameservers which queries are sent to. */
+	std::vector<Nameserver> servers;
+
+	/** The sockets which queries are sent from. */
+	std::vector<std::unique_ptr<DNSSocket>> sockets;
+
+	/** The queries which have been sent but not answered yet keyed by request slot. */
+	std::unordered_map<size_t, Transmission> transmissions;
+
+	/** The queries which should be sent again if they have not been answered yet, in order of due time. */
+	std::deque<Retry> retries;
+
+	/** The socket which the next query will be sent from. */
+	size_t nextsocket = 0;
+
+	/** The nameserver which the next round robin selection will start from. */
+	size_t nextserver = 0;
+
+	/** The number of nameserver selections which have been made. */
+	uint64_t selections = 0;
+
+	/** Check the DNS cache to see if request can be handled by a cached result
+	 * @return true if a cached result was found.
+	 */
+	bool CheckCache(DNS::Request* req, const DNS::Question& question)
+	{
+		ServerInstance->Logs.Log(MODNAME, LOG_SPARSE, "cache: Checking cache for " + question.name);
+
+		Query* record = this->cache.Find(question);
+		if (!record)
+			return false;
 
 		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "cache: Using cached result for " + question.name);
-		record.cached = true;
-		req->OnLookupComplete(&record);
+		record->cached = true;
+		if (record->error == ERROR_NONE)
+			req->OnLookupComplete(record);
+		else
+			req->OnError(record);
 		return true;
 	}
 
 	/** Add a record to the dns cache
 	 * @param r The record
 	 */
-	void AddCache(Query& r)
+	void AddCache(Packet& r)
 	{
-		if (cache.size() >= MAX_CACHE_SIZE)
-			cache.clear();
+		if (r.error != ERROR_NONE)
+		{
+			// RFC 2308 section 5: negative answers without a SOA record must not be cached.
+			if (!r.negativettl)
+				return;
+
+			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "cache: added negative cache for " + r.question.name + " ttl: " + ConvToStr(*r.negativettl));
+			Query negative(r.question);
+			negative.error = r.error;
+			this->cache.Add(negative, *r.negativettl);
+			return;
+		}
 
 		// Determine the lowest TTL value and use that as the TTL of the cache entry
 		unsigned int cachettl = UINT_MAX;
@@ -427,57 +1014,203 @@ class MyManager : public Manager, public Timer, public EventHandler
 				cachettl = rr.ttl;
 		}
 
-		cachettl = std::min<unsigned int>(cachettl, 5*60);
 		ResourceRecord& rr = r.answers.front();
 		// Set TTL to what we've determined to be the lowest
 		rr.ttl = cachettl;
 		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "cache: added cache for " + rr.name + " -> " + rr.rdata + " ttl: " + ConvToStr(rr.ttl));
-		this->cache[r.question] = r;
+		this->cache.Add(r, cachettl);
+	}
+
+	/** Selects the nameserver to send a query to.
+	 * @param exclude The nameservers which the query has already been sent to. These are only
+	 *                selected if every nameserver has already been tried.
+	 * @return The index of the selected nameserver.
+	 */
+	size_t SelectServer(const std::vector<size_t>& exclude)
+	{
+		std::vector<size_t> candidates;
+		for (size_t idx = 0; idx < servers.size(); ++idx)
+		{
+			if (!stdalgo::isin(exclude, idx))
+				candidates.push_back(idx);
+		}
+		if (candidates.empty())
+		{
+			for (size_t idx = 0; idx < servers.size(); ++idx)
+				candidates.push_back(idx);
+		}
+
+		// Every 16th latency selection is made round robin so that penalised nameservers get a
+		// chance to show they have recovered.
+		if (selection == SELECT_ROUNDROBIN || !(selections++ % 16))
+		{
+			for (size_t tries = 0; tries < servers.size(); ++tries)
+			{
+				const size_t idx = nextserver++ % servers.size();
+				if (stdalgo::isin(candidates, idx))
+					return idx;
+			}
+		}
+
+		// Nameservers which have not answered yet have an unknown round trip time and are
+		// preferred so that it gets measured.
+		size_t best = candidates.front();
+		for (size_t idx : candidates)
+		{
+			if (servers[idx].srtt < servers[best].srtt)
+				best = idx;
+		}
+		return best;
+	}
+
+	/** Penalises a nameserver which failed to answer a query so it is less likely to be selected
+	 * until it answers again.
+	 * @param server The nameserver to penalise.
+	 */
+	void Penalise(Nameserver& server)
+	{
+		server.srtt = std::min(std::max(server.srtt * 2, static_cast<uint64_t>(retrytime) * 1000 * 1000), MAX_SRTT);
+	}
+
+	/** Sends a query to a nameserver which it has not been sent to yet if there are any.
+	 * @param slot The request slot of the query.
+	 * @return True if the query was sent; otherwise, false.
+	 */
+	bool Transmit(size_t slot)
+	{
+		Transmission& trans = transmissions[slot];
+		const size_t idx = SelectServer(trans.servers);
+		Nameserver& server = servers[idx];
+
+		DNSSocket* sock = sockets[slot / SLOTS].get();
+		const ssize_t len = static_cast<ssize_t>(trans.packet.size());
+		if (SocketEngine::SendTo(sock, trans.packet.data(), len, 0, server.addr) != len)
+			return false;
+
+		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Sent query %zu (attempt %zu) to %s", slot, trans.servers.size() + 1, server.addr.str().c_str());
+		server.queries++;
+		trans.servers.push_back(idx);
+		trans.sent = insp::monotonic_ns();
+		retries.push_back({ ServerInstance->Time() + static_cast<time_t>(retrytime), slot, trans.sent });
+		return true;
+	}
+
+	/** Sends a query which has not been answered to another nameserver if there are any left
+	 * to try and there is enough time left before the request times out.
+	 * @param slot The request slot of the query.
+	 * @return True if the query was sent again; otherwise, false.
+	 */
+	bool Resend(size_t slot)
+	{
+		const Transmission& trans = transmissions[slot];
+		if (servers.size() < 2 || trans.servers.size() >= servers.size())
+			return false;
+
+		return Transmit(slot);
+	}
+
+	/** Finds the request slot which a request is stored in.
+	 * @return The request slot or SIZE_MAX if the request is not stored in any slot.
+	 */
+	size_t FindSlot(DNS::Request* req) const
+	{
+		for (size_t sock = 0; sock < sockets.size(); ++sock)
+		{
+			const size_t slot = sock * SLOTS + req->id;
+			if (requests[slot] == req)
+				return slot;
+
+			WaitingMap::const_iterator it = waiting.find(slot);
+			if (it != waiting.end() && stdalgo::isin(it->second, req))
+				return slot;
+		}
+		return SIZE_MAX;
+	}
+
+	typedef std::unordered_map<Question, size_t, Question::hash> InflightMap;
+	typedef std::unordered_map<size_t, std::deque<DNS::Request*>> WaitingMap;
+
+	/** The request slots of the queries which have been sent but not answered yet. */
+	InflightMap inflight;
+
+	/** Requests which are waiting for the answer to a query which was sent for another request. */
+	WaitingMap waiting;
+
+	/** Stops new requests for the specified question from waiting on the specified slot. */
+	void ForgetInflight(const Question& question, size_t slot)
+	{
+		InflightMap::iterator it = inflight.find(question);
+		if (it != inflight.end() && it->second == slot)
+			inflight.erase(it);
 	}
 
  public:
-	DNS::Request* requests[MAX_REQUEST_ID+1];
+	/** The requests which queries have been sent for. A request with id N that was sent from
+	 * socket M is stored in slot M * 65536 + N.
+	 */
+	std::vector<DNS::Request*> requests;
+	Cache cache;
+
+	/** The number of requests which shared the answer to a query sent for another request. */
+	uint64_t coalesced = 0;
+
+	/** The number of times a query was sent to another nameserver. */
+	uint64_t resent = 0;
+
+	/** How the nameserver to send a query to is selected. */
+	Selection selection = SELECT_LATENCY;
+
+	/** The number of seconds to wait for an answer before sending a query to another nameserver. */
+	unsigned long retrytime = 1;
 
 	MyManager(Module* c)
 		: Manager(c)
-		, Timer(5*60, true)
+		, Timer(1, true)
 	{
-		for (unsigned int i = 0; i <= MAX_REQUEST_ID; ++i)
-			requests[i] = NULL;
 		ServerInstance->Timers.AddTimer(this);
 	}
 
 	~MyManager() override
 	{
 		// Ensure Process() will fail for new requests
-		Close();
 		unloading = true;
 
-		for (unsigned int i = 0; i <= MAX_REQUEST_ID; ++i)
+		for (DNS::Request* request : GetRequests())
 		{
-			DNS::Request* request = requests[i];
-			if (!request)
-				continue;
-
 			Query rr(request->question);
 			rr.error = ERROR_UNKNOWN;
 			request->OnError(&rr);
 
 			delete request;
 		}
+		Close();
 	}
 
 	void Close()
 	{
-		// Shutdown the socket if it exists.
-		if (HasFd())
+		// The request slots depend on the sockets so any pending requests have to be failed.
+		for (DNS::Request* request : GetRequests())
+		{
+			Query rr(request->question);
+			rr.error = ERROR_DISABLED;
+			request->OnError(&rr);
+
+			delete request;
+		}
+
+		// Shutdown the sockets if they exist.
+		for (const auto& sock : sockets)
 		{
-			SocketEngine::Shutdown(this, 2);
-			SocketEngine::Close(this);
+			SocketEngine::Shutdown(sock.get(), 2);
+			SocketEngine::Close(sock.get());
 		}
+		sockets.clear();
+		requests.clear();
+		transmissions.clear();
+		retries.clear();
 
 		// Remove all entries from the cache.
-		cache.clear();
+		cache.Clear();
 	}
 
 	void Process(DNS::Request* req) override
@@ -485,7 +1218,7 @@ class MyManager : public Manager, public Timer, public EventHandler
 		if ((unloading) || (req->creator->dying))
 			throw Exception("Module is being unloaded");
 
-		if (!HasFd())
+		if (sockets.empty())
 		{
 			Query rr(req->question);
 			rr.error = ERROR_DISABLED;
@@ -493,7 +1226,47 @@ class MyManager : public Manager, public Timer, public EventHandler
 			return;
 		}
 
-		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Processing request to lookup " + req->question.name + " of type " + ConvToStr(req->question.type) + " to " + this->myserver.addr());
+		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Processing request to lookup " + req->question.name + " of type " + ConvToStr(req->question.type));
+
+		Packet p;
+		p.flags = QUERYFLAGS_RD;
+		p.question = req->question;
+
+		unsigned char buffer[524];
+		unsigned short len = p.Pack(buffer, sizeof(buffer));
+
+		/* Note that calling Pack() above can actually change the contents of p.question.name, if the query is a PTR,
+		 * to contain the value that would be in the DNS cache, which is why this is here.
+		 */
+		if (req->use_cache && this->CheckCache(req, p.question))
+		{
+			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Using cached result");
+			delete req;
+			return;
+		}
+
+		// Update name in the original request so question checking works for PTR queries
+		req->question.name = p.question.name;
+
+		/* Check whether an identical question is already waiting for an answer. If it is then
+		 * this request can share that answer instead of sending another query. Requests which
+		 * bypass the cache always get a query of their own.
+		 */
+		InflightMap::const_iterator inflightiter = req->use_cache ? this->inflight.find(req->question) : this->inflight.end();
+		if (inflightiter != this->inflight.end())
+		{
+			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Waiting for the answer to an identical query");
+			req->id = inflightiter->second % SLOTS;
+			this->waiting[inflightiter->second].push_back(req);
+			this->coalesced++;
+
+			// Add timer for timeout
+			ServerInstance->Timers.AddTimer(req);
+			return;
+		}
+
+		/* Spread the queries over the sockets so each one has its own set of ids */
+		const size_t base = (nextsocket++ % sockets.size()) * SLOTS;
 
 		/* Create an id */
 		unsigned int tries = 0;
@@ -509,7 +1282,7 @@ class MyManager : public Manager, public Timer, public EventHandler
 				id = -1;
 				for (unsigned int i = 0; i <= DNS::MAX_REQUEST_ID; i++)
 				{
-					if (!this->requests[i])
+					if (!this->requests[base + i])
 					{
 						id = i;
 						break;
@@ -522,34 +1295,27 @@ class MyManager : public Manager, public Timer, public EventHandler
 				break;
 			}
 		}
-		while (this->requests[id]);
+		while (this->requests[base + id]);
 
+		const size_t slot = base + id;
 		req->id = id;
-		this->requests[req->id] = req;
-
-		Packet p;
-		p.flags = QUERYFLAGS_RD;
-		p.id = req->id;
-		p.question = req->question;
+		this->requests[slot] = req;
+		if (req->use_cache)
+			this->inflight[req->question] = slot;
 
-		unsigned char buffer[524];
-		unsigned short len = p.Pack(buffer, sizeof(buffer));
+		// The packet was packed before the id was known so fill it in now.
+		buffer[0] = req->id >> 8;
+		buffer[1] = req->id & 0xFF;
 
-		/* Note that calling Pack() above can actually change the contents of p.question.name, if the query is a PTR,
-		 * to contain the value that would be in the DNS cache, which is why this is here.
-		 */
-		if (req->use_cache && this->CheckCache(req, p.question))
+		Transmission& trans = this->transmissions[slot];
+		trans.packet.assign(buffer, buffer + len);
+		if (!this->Transmit(slot))
 		{
-			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Using cached result");
-			delete req;
-			return;
-		}
-
-		// Update name in the original request so question checking works for PTR queries
-		req->question.name = p.question.name;
-
-		if (SocketEngine::SendTo(this, buffer, len, 0, this->myserver) != len)
+			this->requests[slot] = NULL;
+			this->ForgetInflight(req->question, slot);
+			this->transmissions.erase(slot);
 			throw Exception("DNS: Unable to send query");
+		}
 
 		// Add timer for timeout
 		ServerInstance->Timers.AddTimer(req);
@@ -557,10 +1323,55 @@ class MyManager : public Manager, public Timer, public EventHandler
 
 	void RemoveRequest(DNS::Request* req) override
 	{
-		if (requests[req->id] == req)
-			requests[req->id] = NULL;
+		const size_t slot = FindSlot(req);
+		if (slot == SIZE_MAX)
+			return;
+
+		WaitingMap::iterator it = waiting.find(slot);
+		if (requests[slot] == req)
+		{
+			if (it == waiting.end())
+			{
+				// Nothing else is waiting for this answer.
+				requests[slot] = NULL;
+				ForgetInflight(req->question, slot);
+				transmissions.erase(slot);
+				return;
+			}
+
+			// Let the next request which is waiting for this answer take over.
+			requests[slot] = it->second.front();
+			it->second.pop_front();
+		}
+		else
+		{
+			stdalgo::erase(it->second, req);
+		}
+
+		if (it->second.empty())
+			waiting.erase(it);
+	}
+
+	/** Retrieves all requests which are waiting for an answer. */
+	std::vector<DNS::Request*> GetRequests() const
+	{
+		std::vector<DNS::Request*> result;
+		for (DNS::Request* request : requests)
+		{
+			if (request)
+				result.push_back(request);
+		}
+		for (const auto& [_, reqs] : waiting)
+			result.insert(result.end(), reqs.begin(), reqs.end());
+		return result;
 	}
 
+	/** Retrieves the nameservers which queries are sent to. */
+	const std::vector<Nameserver>& GetServers() const { return servers; }
+
+	/** Retrieves the number of sockets which queries are sent from. */
+	size_t GetSocketCount() const { return sockets.size(); }
+
 	std::string GetErrorStr(Error e) override
 	{
 		switch (e)
@@ -612,28 +1423,26 @@ class MyManager : public Manager, public Timer, public EventHandler
 		}
 	}
 
-	void OnEventHandlerError(int errcode) override
-	{
-		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "UDP socket got an error event");
-	}
-
-	void OnEventHandlerRead() override
+	void OnRead(DNSSocket* sock)
 	{
 		unsigned char buffer[524];
 		irc::sockets::sockaddrs from;
 		socklen_t x = sizeof(from);
 
-		ssize_t length = SocketEngine::RecvFrom(this, buffer, sizeof(buffer), 0, &from.sa, &x);
+		ssize_t length = SocketEngine::RecvFrom(sock, buffer, sizeof(buffer), 0, &from.sa, &x);
 
 		if (length < Packet::HEADER_LENGTH)
 			return;
 
-		if (myserver != from)
+		size_t serveridx = 0;
+		while (serveridx < servers.size() && servers[serveridx].addr != from)
+			serveridx++;
+
+		if (serveridx == servers.size())
 		{
 			std::string server1 = from.str();
-			std::string server2 = myserver.str();
-			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Got a result from the wrong server! Bad NAT or DNS forging attempt? '%s' != '%s'",
-				server1.c_str(), server2.c_str());
+			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Got a result from an unknown server! Bad NAT or DNS forging attempt? '%s'",
+				server1.c_str());
 			return;
 		}
 
@@ -651,7 +1460,8 @@ class MyManager : public Manager, public Timer, public EventHandler
 		}
 
 		// recv_packet.id must be filled in here
-		DNS::Request* request = this->requests[recv_packet.id];
+		const size_t slot = sock->index * SLOTS + recv_packet.id;
+		DNS::Request* request = this->requests[slot];
 		if (request == NULL)
 		{
 			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Received an answer for something we didn't request");
@@ -665,18 +1475,35 @@ class MyManager : public Manager, public Timer, public EventHandler
 			return;
 		}
 
+		const Transmission& trans = this->transmissions[slot];
+		if (!stdalgo::isin(trans.servers, serveridx))
+		{
+			std::string server1 = from.str();
+			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Got a result from a server the query was not sent to! Bad NAT or DNS forging attempt? '%s'",
+				server1.c_str());
+			return;
+		}
+
+		// Only the most recent transmission has a known send time.
+		Nameserver& server = this->servers[serveridx];
+		server.answers++;
+		if (trans.servers.back() == serveridx)
+		{
+			const uint64_t rtt = insp::monotonic_ns() - trans.sent;
+			server.rtt.add(rtt);
+			server.srtt = server.srtt ? (server.srtt * 7 + rtt / 1000) / 8 : std::max<uint64_t>(rtt / 1000, 1);
+		}
+
 		if (!valid)
 		{
 			ServerInstance->stats.DnsBad++;
 			recv_packet.error = ERROR_MALFORMED;
-			request->OnError(&recv_packet);
 		}
 		else if (recv_packet.flags & QUERYFLAGS_OPCODE)
 		{
 			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Received a nonstandard query");
 			ServerInstance->stats.DnsBad++;
 			recv_packet.error = ERROR_NONSTANDARD_QUERY;
-			request->OnError(&recv_packet);
 		}
 		else if (!(recv_packet.flags & QUERYFLAGS_QR) || (recv_packet.flags & QUERYFLAGS_RCODE))
 		{
@@ -708,109 +1535,190 @@ class MyManager : public Manager, public Timer, public EventHandler
 					break;
 			}
 
+			// A failure on one nameserver says nothing about the others so try another one.
+			if (error == ERROR_SERVER_FAILURE || error == ERROR_REFUSED)
+			{
+				server.failures++;
+				this->Penalise(server);
+				if (this->Resend(slot))
+				{
+					this->resent++;
+					return;
+				}
+			}
+
 			ServerInstance->stats.DnsBad++;
 			recv_packet.error = error;
-			request->OnError(&recv_packet);
+			if (error == ERROR_DOMAIN_NOT_FOUND)
+				this->AddCache(recv_packet);
 		}
 		else if (recv_packet.answers.empty())
 		{
 			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "No resource records returned");
 			ServerInstance->stats.DnsBad++;
 			recv_packet.error = ERROR_NO_RECORDS;
-			request->OnError(&recv_packet);
+			this->AddCache(recv_packet);
 		}
 		else
 		{
 			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Lookup complete for " + request->question.name);
 			ServerInstance->stats.DnsGood++;
-			request->OnLookupComplete(&recv_packet);
 			this->AddCache(recv_packet);
 		}
 
 		ServerInstance->stats.Dns++;
 
-		/* Request's destructor removes it from the request map */
-		delete request;
+		/* Stop new requests from joining this answer. Any request made by one of the callbacks
+		 * below needs to send a query of its own rather than wait on a slot which is about to
+		 * be emptied.
+		 */
+		this->ForgetInflight(request->question, slot);
+
+		// Deliver the answer to the request and every other request which was waiting for it.
+		while ((request = this->requests[slot]))
+		{
+			if (recv_packet.error == ERROR_NONE)
+				request->OnLookupComplete(&recv_packet);
+			else
+				request->OnError(&recv_packet);
+
+			/* Request's destructor removes it from the request map and moves the next waiting request into its place */
+			delete request;
+		}
 	}
 
 	bool Tick(time_t now) override
 	{
-		unsigned long expired = 0;
-		for (cache_map::iterator it = this->cache.begin(); it != this->cache.end(); )
+		// Send the queries which have not been answered in time to another nameserver.
+		while (!retries.empty() && retries.front().due <= now)
 		{
-			const Query& query = it->second;
-			if (IsExpired(query, now))
-			{
-				expired++;
-				this->cache.erase(it++);
-			}
-			else
-				++it;
+			const Retry retry = retries.front();
+			retries.pop_front();
+
+			std::unordered_map<size_t, Transmission>::const_iterator it = transmissions.find(retry.slot);
+			if (it == transmissions.end() || it->second.sent != retry.sent)
+				continue; // Answered or already sent again.
+
+			Nameserver& server = servers[it->second.servers.back()];
+			server.timeouts++;
+			Penalise(server);
+
+			if (Resend(retry.slot))
+				resent++;
 		}
 
+		unsigned long expired = this->cache.Expire();
 		if (expired)
 			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "cache: purged %lu expired DNS entries", expired);
 
 		return true;
 	}
 
-	void Rehash(const std::string& dnsserver, std::string sourceaddr, unsigned int sourceport)
+	void Rehash(const std::string& dnsservers, std::string sourceaddr, unsigned int sourceport, size_t socketcount)
 	{
-		irc::sockets::aptosa(dnsserver, DNS::PORT, myserver);
-
-		/* Initialize mastersocket */
 		Close();
-		int s = socket(myserver.family(), SOCK_DGRAM, 0);
-		this->SetFd(s);
+		servers.clear();
+
+		irc::spacesepstream serverstream(dnsservers);
+		for (std::string dnsserver; serverstream.GetToken(dnsserver); )
+		{
+			irc::sockets::sockaddrs sa;
+			if (!irc::sockets::aptosa(dnsserver, DNS::PORT, sa))
+			{
+				ServerInstance->Logs.Log(MODNAME, LOG_SPARSE, "Nameserver address \"%s\" is not valid, ignoring it", dnsserver.c_str());
+				continue;
+			}
+
+			// All of the nameservers are queried from the same sockets.
+			if (!servers.empty() && sa.family() != servers.front().addr.family())
+			{
+				ServerInstance->Logs.Log(MODNAME, LOG_SPARSE, "Nameserver %s has a different address family to %s, ignoring it",
+					dnsserver.c_str(), servers.front().addr.addr().c_str());
+				continue;
+			}
+			servers.emplace_back(sa);
+		}
+
+		if (servers.empty())
+		{
+			ServerInstance->Logs.Log(MODNAME, LOG_SPARSE, "No valid nameservers - hostnames will NOT resolve");
+			return;
+		}
 
-		/* Have we got a socket? */
-		if (this->HasFd())
+		const int family = servers.front().addr.family();
+		if (sourceaddr.empty())
 		{
+			// set a sourceaddr for irc::sockets::aptosa() based on the servers af type
+			if (family == AF_INET)
+				sourceaddr = "0.0.0.0";
+			else if (family == AF_INET6)
+				sourceaddr = "::";
+		}
+
+		for (size_t idx = 0; idx < socketcount; ++idx)
+		{
+			/* Initialize mastersocket */
+			int s = socket(family, SOCK_DGRAM, 0);
+			if (s < 0)
+			{
+				ServerInstance->Logs.Log(MODNAME, LOG_SPARSE, "Error creating DNS socket - hostnames will NOT resolve");
+				break;
+			}
+
+			auto sock = std::make_unique<DNSSocket>(this, idx);
+			sock->SetFd(s);
 			SocketEngine::SetReuse(s);
 			SocketEngine::NonBlocking(s);
 
+			// If a source port is specified each socket uses the next one along.
 			irc::sockets::sockaddrs bindto;
-			if (sourceaddr.empty())
-			{
-				// set a sourceaddr for irc::sockets::aptosa() based on the servers af type
-				if (myserver.family() == AF_INET)
-					sourceaddr = "0.0.0.0";
-				else if (myserver.family() == AF_INET6)
-					sourceaddr = "::";
-			}
-			irc::sockets::aptosa(sourceaddr, sourceport, bindto);
+			irc::sockets::aptosa(sourceaddr, sourceport ? sourceport + idx : 0, bindto);
 
-			if (SocketEngine::Bind(this->GetFd(), bindto) < 0)
+			if (SocketEngine::Bind(s, bindto) < 0)
 			{
 				/* Failed to bind */
 				ServerInstance->Logs.Log(MODNAME, LOG_SPARSE, "Error binding dns socket - hostnames will NOT resolve");
-				SocketEngine::Close(this->GetFd());
-				this->SetFd(-1);
+				SocketEngine::Close(s);
+				break;
 			}
-			else if (!SocketEngine::AddFd(this, FD_WANT_POLL_READ | FD_WANT_NO_WRITE))
+			else if (!SocketEngine::AddFd(sock.get(), FD_WANT_POLL_READ | FD_WANT_NO_WRITE))
 			{
 				ServerInstance->Logs.Log(MODNAME, LOG_SPARSE, "Internal error starting DNS - hostnames will NOT resolve.");
-				SocketEngine::Close(this->GetFd());
-				this->SetFd(-1);
+				SocketEngine::Close(s);
+				break;
 			}
 
-			if (bindto.family() != myserver.family())
+			if (bindto.family() != family)
 				ServerInstance->Logs.Log(MODNAME, LOG_SPARSE, "Nameserver address family differs from source address family - hostnames might not resolve");
+
+			sockets.push_back(std::move(sock));
 		}
-		else
-		{
-			ServerInstance->Logs.Log(MODNAME, LOG_SPARSE, "Error creating DNS socket - hostnames will NOT resolve");
-		}
+
+		requests.assign(sockets.size() * SLOTS, NULL);
 	}
 };
 
-class ModuleDNS : public Module
+void DNSSocket::OnEventHandlerRead()
+{
+	manager->OnRead(this);
+}
+
+class ModuleDNS : public Module, public Metrics::EventListener, public Stats::EventListener
 {
 	MyManager manager;
 	std::string DNSServer;
 	std::string SourceIP;
 	unsigned int SourcePort = 0;
 
+	/** The number of sockets to send queries from. */
+	size_t SocketCount = 1;
+
+	/** The file to store the cache in across restarts or an empty string to not store it. */
+	std::string CacheFile;
+
+	/** Whether the cache has been loaded from CacheFile yet. */
+	bool CacheLoaded = false;
+
 	void FindDNSServer()
 	{
 #ifdef _WIN32
@@ -832,14 +1740,21 @@ class ModuleDNS : public Module
 			if (pFixedInfo)
 			{
 				if (GetNetworkParams(pFixedInfo, &dwBufferSize) == NO_ERROR)
-					DNSServer = pFixedInfo->DnsServerList.IpAddress.String;
+				{
+					for (PIP_ADDR_STRING server = &pFixedInfo->DnsServerList; server; server = server->Next)
+					{
+						if (!DNSServer.empty())
+							DNSServer.push_back(' ');
+						DNSServer.append(server->IpAddress.String);
+					}
+				}
 
 				HeapFree(GetProcessHeap(), 0, pFixedInfo);
 			}
 
 			if (!DNSServer.empty())
 			{
-				ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "<dns:server> set to '%s' as first active resolver in the system settings.", DNSServer.c_str());
+				ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "<dns:server> set to '%s' from the active resolvers in the system settings.", DNSServer.c_str());
 				return;
 			}
 		}
@@ -851,19 +1766,27 @@ class ModuleDNS : public Module
 
 		std::ifstream resolv("/etc/resolv.conf");
 
-		while (resolv >> DNSServer)
+		std::string token;
+		while (resolv >> token)
 		{
-			if (DNSServer == "nameserver")
+			if (token == "nameserver")
 			{
-				resolv >> DNSServer;
-				if (DNSServer.find_first_not_of("0123456789.") == std::string::npos || DNSServer.find_first_not_of("0123456789ABCDEFabcdef:") == std::string::npos)
+				resolv >> token;
+				if (token.find_first_not_of("0123456789.") == std::string::npos || token.find_first_not_of("0123456789ABCDEFabcdef:") == std::string::npos)
 				{
-					ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "<dns:server> set to '%s' as first resolver in /etc/resolv.conf.",DNSServer.c_str());
-					return;
+					if (!DNSServer.empty())
+						DNSServer.push_back(' ');
+					DNSServer.append(token);
 				}
 			}
 		}
 
+		if (!DNSServer.empty())
+		{
+			ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "<dns:server> set to '%s' from the resolvers in /etc/resolv.conf.", DNSServer.c_str());
+			return;
+		}
+
 		ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "/etc/resolv.conf contains no viable nameserver entries! Defaulting to nameserver '127.0.0.1'!");
 #endif
 		DNSServer = "127.0.0.1";
@@ -872,19 +1795,41 @@ class ModuleDNS : public Module
  public:
 	ModuleDNS()
 		: Module(VF_CORE | VF_VENDOR, "Provides support for DNS lookups")
+		, Metrics::EventListener(this)
+		, Stats::EventListener(this)
 		, manager(this)
 	{
 	}
 
+	void OnShutdown(const std::string& reason) override
+	{
+		if (!CacheFile.empty())
+			this->manager.cache.Save(CacheFile);
+	}
+
 	void ReadConfig(ConfigStatus& status) override
 	{
 		auto tag = ServerInstance->Config->ConfValue("dns");
+
+		// Write the cache out on rehash too so that less of it is lost if the server does not
+		// shut down cleanly.
+		if (CacheLoaded && !CacheFile.empty() && !this->manager.cache.Save(CacheFile) && status.srcuser)
+			status.srcuser->WriteNotice("*** Unable to write the DNS cache file; see the log for details.");
+
+		this->manager.cache.maxmemory = tag->getUInt("cachesize", 1024*1024);
+		this->manager.cache.maxttl = tag->getDuration("maxttl", 24*60*60);
+		this->manager.cache.maxnegativettl = tag->getDuration("maxnegativettl", 15*60);
+
+		const std::string cachefile = tag->getString("cachefile");
+		CacheFile = cachefile.empty() ? cachefile : ServerInstance->Config->Paths.PrependData(cachefile);
+
 		if (!tag->getBool("enabled", true))
 		{
 			// Clear these so they get reset if DNS is enabled again.
 			DNSServer.clear();
 			SourceIP.clear();
 			SourcePort = 0;
+			SocketCount = 1;
 
 			this->manager.Close();
 			return;
@@ -899,21 +1844,89 @@ class ModuleDNS : public Module
 		const unsigned int oldport = SourcePort;
 		SourcePort = static_cast<unsigned int>(tag->getUInt("sourceport", 0, 0, UINT16_MAX));
 
+		const size_t oldcount = SocketCount;
+		SocketCount = tag->getUInt("sockets", 1, 1, 16);
+
+		this->manager.selection = tag->getEnum("selection", MyManager::SELECT_LATENCY, {
+			{ "latency",    MyManager::SELECT_LATENCY    },
+			{ "roundrobin", MyManager::SELECT_ROUNDROBIN },
+		});
+		this->manager.retrytime = tag->getDuration("retry", 1, 1);
+
 		if (DNSServer.empty())
 			FindDNSServer();
 
-		if (oldserver != DNSServer || oldip != SourceIP || oldport != SourcePort)
-			this->manager.Rehash(DNSServer, SourceIP, SourcePort);
+		if (oldserver != DNSServer || oldip != SourceIP || oldport != SourcePort || oldcount != SocketCount)
+			this->manager.Rehash(DNSServer, SourceIP, SourcePort, SocketCount);
+
+		// Warm the cache with the answers from before the last restart.
+		if (!CacheLoaded && !CacheFile.empty())
+		{
+			this->manager.cache.Load(CacheFile);
+			CacheLoaded = true;
+		}
 	}
 
-	void OnUnloadModule(Module* mod) override
+	void OnCollectMetrics(Metrics::Writer& writer) override
+	{
+		const Cache& cache = this->manager.cache;
+		writer.Family("inspircd_dns_cache_entries", Metrics::Type::GAUGE, "The number of answers in the DNS cache.");
+		writer.Sample("inspircd_dns_cache_entries", cache.GetCount() - cache.GetNegativeCount(), { { "type", "positive" } });
+		writer.Sample("inspircd_dns_cache_entries", cache.GetNegativeCount(), { { "type", "negative" } });
+
+		writer.Family("inspircd_dns_cache_memory_bytes", Metrics::Type::GAUGE, "The amount of memory used by the DNS cache.");
+		writer.Sample("inspircd_dns_cache_memory_bytes", cache.GetMemory());
+
+		writer.Family("inspircd_dns_cache_lookups_total", Metrics::Type::COUNTER, "The number of lookups which were answered by the DNS cache or missed it.");
+		writer.Sample("inspircd_dns_cache_lookups_total", cache.hits, { { "result", "hit" } });
+		writer.Sample("inspircd_dns_cache_lookups_total", cache.negativehits, { { "result", "negativehit" } });
+		writer.Sample("inspircd_dns_cache_lookups_total", cache.misses, { { "result", "miss" } });
+
+		writer.Family("inspircd_dns_cache_removals_total", Metrics::Type::COUNTER, "The number of entries which were removed from the DNS cache.");
+		writer.Sample("inspircd_dns_cache_removals_total", cache.evictions, { { "reason", "evicted" } });
+		writer.Sample("inspircd_dns_cache_removals_total", cache.expirations, { { "reason", "expired" } });
+
+		writer.Family("inspircd_dns_server_queries_total", Metrics::Type::COUNTER, "The number of queries sent to each nameserver and what happened to them.");
+		for (const Nameserver& server : this->manager.GetServers())
+		{
+			const std::string addr = server.addr.addr();
+			writer.Sample("inspircd_dns_server_queries_total", server.queries, { { "server", addr }, { "result", "sent" } });
+			writer.Sample("inspircd_dns_server_queries_total", server.answers, { { "server", addr }, { "result", "answered" } });
+			writer.Sample("inspircd_dns_server_queries_total", server.timeouts, { { "server", addr }, { "result", "timeout" } });
+			writer.Sample("inspircd_dns_server_queries_total", server.failures, { { "server", addr }, { "result", "failure" } });
+		}
+
+		writer.Family("inspircd_dns_server_rtt_seconds", Metrics::Type::HISTOGRAM, "The round trip time of queries to each nameserver.");
+		for (const Nameserver& server : this->manager.GetServers())
+			writer.Histogram("inspircd_dns_server_rtt_seconds", server.rtt, 1e9, { { "server", server.addr.addr() } });
+	}
+
+	ModResult OnStats(Stats::Context& stats) override
 	{
-		for (unsigned int i = 0; i <= MAX_REQUEST_ID; ++i)
+		if (stats.GetSymbol() != 'D')
+			return MOD_RES_PASSTHRU;
+
+		const Cache& cache = this->manager.cache;
+		stats.AddRow(249, "DNS cache: " + ConvToStr(cache.GetCount()) + " entries (" + ConvToStr(cache.GetNegativeCount())
+			+ " negative) using " + ConvToStr(cache.GetMemory()) + " of " + ConvToStr(cache.maxmemory) + " bytes");
+		stats.AddRow(249, "DNS cache: " + ConvToStr(cache.hits) + " hits, " + ConvToStr(cache.negativehits) + " negative hits, "
+			+ ConvToStr(cache.misses) + " misses, " + ConvToStr(cache.evictions) + " evictions, " + ConvToStr(cache.expirations) + " expirations");
+		stats.AddRow(249, "DNS queries: " + ConvToStr(this->manager.coalesced) + " requests shared an answer with an identical query, "
+			+ ConvToStr(this->manager.resent) + " queries sent to another nameserver, " + ConvToStr(this->manager.GetSocketCount()) + " sockets");
+
+		for (const Nameserver& server : this->manager.GetServers())
 		{
-			DNS::Request* req = this->manager.requests[i];
-			if (!req)
-				continue;
+			stats.AddRow(249, "DNS server " + server.addr.addr() + ": " + ConvToStr(server.queries) + " queries, " + ConvToStr(server.answers)
+				+ " answers, " + ConvToStr(server.timeouts) + " timeouts, " + ConvToStr(server.failures) + " failures, srtt " + ConvToStr(server.srtt) + "us");
+			stats.AddRow(249, "DNS server " + server.addr.addr() + " latency: " + server.rtt.summarize(1000, "us"));
+		}
+		return MOD_RES_DENY;
+	}
 
+	void OnUnloadModule(Module* mod) override
+	{
+		for (DNS::Request* req : this->manager.GetRequests())
+		{
 			if (req->creator == mod)
 			{
 				Query rr(req->question);
@@ -30,47 +30,85 @@
 
 CommandOper::CommandOper(Module* parent)
 	: SplitCommand(parent, "OPER", 2, 2)
+	, pending(parent, "oper-pending", ExtensionItem::EXT_USER)
 {
 	syntax = { "<username> <password>" };
 }
 
+namespace
+{
+	void OperFailed(LocalUser* user, const std::string& login, bool match_login, bool match_pass, bool match_hosts)
+	{
+		std::string fields;
+		if (!match_login)
+			fields.append("login ");
+		if (!match_pass)
+			fields.append("password ");
+		if (!match_hosts)
+			fields.append("hosts ");
+		fields.erase(fields.length() - 1, 1);
+
+		// Tell them they failed (generically). The caller has already lagged them up to help prevent brute-force attacks.
+		user->WriteNumeric(ERR_NOOPERHOST, "Invalid oper credentials");
+
+		ServerInstance->SNO.WriteGlobalSno('o', "WARNING! Failed oper attempt by %s using login '%s': The following fields do not match: %s", user->GetFullRealHost().c_str(), login.c_str(), fields.c_str());
+	}
+}
+
 CmdResult CommandOper::HandleLocal(LocalUser* user, const Params& parameters)
 {
-	bool match_login = false;
-	bool match_pass = false;
-	bool match_hosts = false;
+	// Only one attempt may be checked at once so a client can not queue up lots of expensive comparisons.
+	if (pending.Get(user))
+	{
+		user->CommandFloodPenalty += 10000;
+		user->WriteNumeric(ERR_NOOPERHOST, "Your previous oper attempt has not finished yet");
+		return CmdResult::FAILURE;
+	}
+
+	// Lag them up to help prevent brute-force attacks. This is done before the password is
+	// checked so it applies to the rest of the commands they have sent whilst we wait.
+	user->CommandFloodPenalty += 10000;
 
 	ServerConfig::OperIndex::const_iterator i = ServerInstance->Config->oper_blocks.find(parameters[0]);
-	if (i != ServerInstance->Config->oper_blocks.end())
+	if (i == ServerInstance->Config->oper_blocks.end())
 	{
-		const std::string userHost = user->ident + "@" + user->GetRealHost();
-		const std::string userIP = user->ident + "@" + user->GetIPString();
-		std::shared_ptr<OperInfo> ifo = i->second;
-		std::shared_ptr<ConfigTag> tag = ifo->oper_block;
-		match_login = true;
-		match_pass = ServerInstance->PassCompare(user, tag->getString("password"), parameters[1], tag->getString("hash"));
-		match_hosts = InspIRCd::MatchMask(tag->getString("host"), userHost, userIP);
-
-		if (match_pass && match_hosts)
-		{
-			user->Oper(ifo);
-			return CmdResult::SUCCESS;
-		}
+		OperFailed(user, parameters[0], false, false, false);
+		return CmdResult::FAILURE;
 	}
 
-	std::string fields;
-	if (!match_login)
-		fields.append("login ");
-	if (!match_pass)
-		fields.append("password ");
-	if (!match_hosts)
-		fields.append("hosts ");
-	fields.erase(fields.length() - 1, 1);
+	const std::string userHost = user->ident + "@" + user->GetRealHost();
+	const std::string userIP = user->ident + "@" + user->GetIPString();
+	std::shared_ptr<OperInfo> ifo = i->second;
+	std::shared_ptr<ConfigTag> tag = ifo->oper_block;
+	const bool match_hosts = InspIRCd::MatchMask(tag->getString("host"), userHost, userIP);
 
-	// Tell them they failed (generically) and lag them up to help prevent brute-force attacks
-	user->WriteNumeric(ERR_NOOPERHOST, "Invalid oper credentials");
-	user->CommandFloodPenalty += 10000;
+	// Hashed passwords may be checked on a worker thread so the rest of this happens in the
+	// callback. The user may have quit by the time it is called so we have to look them up.
+	const std::string uuid = user->uuid;
+	const std::string login = parameters[0];
+
+	// If the password is not checked on a worker thread the callback is called before
+	// PassCompare returns so we can return the real result. Otherwise, the attempt is
+	// reported as having failed as we do not know yet whether it will succeed.
+	auto result = std::make_shared<CmdResult>(CmdResult::FAILURE);
 
-	ServerInstance->SNO.WriteGlobalSno('o', "WARNING! Failed oper attempt by %s using login '%s': The following fields do not match: %s", user->GetFullRealHost().c_str(), parameters[0].c_str(), fields.c_str());
-	return CmdResult::FAILURE;
+	pending.Set(user);
+	ServerInstance->PassCompare(creator, user, tag->getString("password"), parameters[1], tag->getString("hash"), [this, uuid, login, ifo, match_hosts, result](bool match_pass)
+	{
+		LocalUser* luser = IS_LOCAL(ServerInstance->Users.FindUUID(uuid));
+		if (!luser || luser->quitting)
+			return;
+
+		pending.Unset(luser);
+		if (match_pass && match_hosts)
+		{
+			// Successful attempts are not penalised.
+			luser->CommandFloodPenalty -= std::min(luser->CommandFloodPenalty, 10000U);
+			luser->Oper(ifo);
+			*result = CmdResult::SUCCESS;
+		}
+		else
+			OperFailed(luser, login, true, match_pass, match_hosts);
+	});
+	return *result;
 }
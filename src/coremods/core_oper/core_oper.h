@@ -59,6 +59,10 @@ class CommandKill : public Command
 
 class CommandOper : public SplitCommand
 {
+ private:
+	/** Whether the user has an OPER attempt which is still being checked. */
+	BoolExtItem pending;
+
  public:
 	CommandOper(Module* parent);
 	CmdResult HandleLocal(LocalUser* user, const Params& parameters) override;
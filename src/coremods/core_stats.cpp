@@ -27,6 +27,7 @@
 
 
 #include "inspircd.h"
+#include "utility/histogram.h"
 #include "xline.h"
 #include "modules/stats.h"
 
@@ -62,6 +63,92 @@ class CommandStats : public Command
 	}
 };
 
+class CommandProfile final
+	: public Command
+{
+ public:
+	CommandProfile(Module* Creator)
+		: Command(Creator, "PROFILE", 1, 1)
+	{
+		access_needed = CmdAccess::OPERATOR;
+		syntax = { "ON|OFF|RESET" };
+	}
+
+	CmdResult Handle(User* user, const Params& parameters) override
+	{
+		const std::string& action = parameters[0];
+		if (irc::equals(action, "ON"))
+		{
+			Profiler::enabled = true;
+			ServerInstance->SNO.WriteGlobalSno('a', "%s enabled module hook profiling.", user->nick.c_str());
+		}
+		else if (irc::equals(action, "OFF"))
+		{
+			Profiler::enabled = false;
+			ServerInstance->SNO.WriteGlobalSno('a', "%s disabled module hook profiling.", user->nick.c_str());
+		}
+		else if (irc::equals(action, "RESET"))
+		{
+			Profiler::Reset();
+			ServerInstance->SNO.WriteGlobalSno('a', "%s reset the module hook profiling statistics.", user->nick.c_str());
+		}
+		else
+		{
+			user->WriteNotice("*** PROFILE: Unknown action '" + action + "'; expected ON, OFF, or RESET.");
+			return CmdResult::FAILURE;
+		}
+		return CmdResult::SUCCESS;
+	}
+};
+
+static void GenerateStatsF(Stats::Context& stats)
+{
+	if (!Profiler::enabled)
+		stats.AddRow(249, "Module hook profiling is disabled. Use /PROFILE ON to enable it.");
+
+	std::vector<std::tuple<const Module*, const std::string*, const Profiler::HookStats*>> hooks;
+	for (const auto& [_, mod] : ServerInstance->Modules.GetModules())
+	{
+		for (const auto& [hook, hookstats] : mod->hookstats)
+			hooks.emplace_back(mod, &hook, &hookstats);
+	}
+
+	// Show the hooks which have cost the most in total first.
+	std::sort(hooks.begin(), hooks.end(), [](const auto& lhs, const auto& rhs) {
+		return std::get<2>(lhs)->total > std::get<2>(rhs)->total;
+	});
+
+	// Most hooks take less than a microsecond so the mean is shown in nanoseconds.
+	for (const auto& [mod, hook, hookstats] : hooks)
+	{
+		stats.AddRow(249, InspIRCd::Format("%s %s: %lu calls, total %luus, mean %luns, max %luus",
+			ModuleManager::ShrinkModName(mod->ModuleSourceFile).c_str(), hook->c_str(), hookstats->calls,
+			static_cast<unsigned long>(hookstats->total / 1000), static_cast<unsigned long>(hookstats->total / hookstats->calls),
+			static_cast<unsigned long>(hookstats->max / 1000)));
+	}
+}
+
+static std::string FormatLoopTimes(const insp::log2_histogram& h)
+{
+	// The iteration times are recorded in nanoseconds but shown in microseconds.
+	return ConvToStr(h.get_count()) + " samples, " + h.summarize(1000, "us");
+}
+
+static void GenerateStatsW(Stats::Context& stats)
+{
+	const serverstats& loopstats = ServerInstance->stats;
+	stats.AddRow(249, "Iterations in the last minute: " + FormatLoopTimes(*loopstats.LoopTimeLastMinute));
+	stats.AddRow(249, "Iterations since startup: " + FormatLoopTimes(*loopstats.LoopTime));
+	for (size_t phase = 0; phase < serverstats::PHASE_COUNT; ++phase)
+		stats.AddRow(249, std::string("Phase ") + serverstats::LOOP_PHASE_NAMES[phase] + ": " + FormatLoopTimes(*loopstats.LoopPhaseTime[phase]));
+
+	const insp::log2_histogram& events = *SocketEngine::GetStats().DispatchSizes;
+	stats.AddRow(249, InspIRCd::Format("Events per wakeup: %lu samples, mean %.2f, p50 %lu, p90 %lu, p99 %lu, max %lu",
+		static_cast<unsigned long>(events.get_count()), events.get_count() ? static_cast<double>(events.get_sum()) / events.get_count() : 0.0,
+		static_cast<unsigned long>(events.get_percentile(50)), static_cast<unsigned long>(events.get_percentile(90)),
+		static_cast<unsigned long>(events.get_percentile(99)), static_cast<unsigned long>(events.get_max())));
+}
+
 static void GenerateStatsLl(Stats::Context& stats)
 {
 	stats.AddRow(211, InspIRCd::Format("nick[ident@%s] sendq cmds_out bytes_out cmds_in bytes_in time_open", (stats.GetSymbol() == 'l' ? "host" : "ip")));
@@ -70,6 +157,32 @@ static void GenerateStatsLl(Stats::Context& stats)
 		stats.AddRow(211, u->nick+"["+u->ident+"@"+(stats.GetSymbol() == 'l' ? u->GetDisplayedHost() : u->GetIPString())+"] "+ConvToStr(u->eh.GetSendQSize())+" "+ConvToStr(u->cmds_out)+" "+ConvToStr(u->bytes_out)+" "+ConvToStr(u->cmds_in)+" "+ConvToStr(u->bytes_in)+" "+ConvToStr(ServerInstance->Time() - u->signon));
 }
 
+static void GenerateStatsM(Stats::Context& stats)
+{
+	std::vector<const Command*> commands;
+	for (const auto& [_, command] : ServerInstance->Parser.GetCommands())
+	{
+		if (command->exec_time->get_count())
+			commands.push_back(command);
+	}
+
+	// Show the commands which have cost the most in total first.
+	std::sort(commands.begin(), commands.end(), [](const Command* lhs, const Command* rhs) {
+		return lhs->exec_time->get_sum() > rhs->exec_time->get_sum();
+	});
+
+	// The execution times are recorded in nanoseconds but shown in microseconds.
+	for (const auto* command : commands)
+	{
+		const insp::log2_histogram& h = *command->exec_time;
+		stats.AddRow(249, InspIRCd::Format("%s: %lu calls, total %lums, mean %luus, p50 %luus, p90 %luus, p99 %luus, max %luus",
+			command->name.c_str(), static_cast<unsigned long>(h.get_count()), static_cast<unsigned long>(h.get_sum() / 1000000),
+			static_cast<unsigned long>(h.get_mean() / 1000), static_cast<unsigned long>(h.get_percentile(50) / 1000),
+			static_cast<unsigned long>(h.get_percentile(90) / 1000), static_cast<unsigned long>(h.get_percentile(99) / 1000),
+			static_cast<unsigned long>(h.get_max() / 1000)));
+	}
+}
+
 void CommandStats::DoStats(Stats::Context& stats)
 {
 	User* const user = stats.GetSource();
@@ -225,6 +338,21 @@ void CommandStats::DoStats(Stats::Context& stats)
 		}
 		break;
 
+		/* stats F (show how long each module hook has taken to execute) */
+		case 'F':
+			GenerateStatsF(stats);
+		break;
+
+		/* stats M (show how long each command has taken to execute) */
+		case 'M':
+			GenerateStatsM(stats);
+		break;
+
+		/* stats W (show how long the main loop and each of its phases have taken) */
+		case 'W':
+			GenerateStatsW(stats);
+		break;
+
 		/* stats z (debug and memory info) */
 		case 'z':
 		{
@@ -396,11 +524,13 @@ class CoreModStats : public Module
 {
  private:
 	CommandStats cmd;
+	CommandProfile profilecmd;
 
  public:
 	CoreModStats()
-		: Module(VF_CORE | VF_VENDOR, "Provides the STATS command")
+		: Module(VF_CORE | VF_VENDOR, "Provides the PROFILE and STATS commands")
 		, cmd(this)
+		, profilecmd(this)
 	{
 	}
 
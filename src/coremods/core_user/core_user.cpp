@@ -43,6 +43,8 @@ class CommandPass : public SplitCommand
 		}
 		user->password = parameters[0];
 
+		// Any connect class passwords we have already compared were compared against the old password.
+		user->ResetClassPasswords();
 		return CmdResult::SUCCESS;
 	}
 };
@@ -52,6 +52,7 @@
 #include <iostream>
 #include "xline.h"
 #include "exitcodes.h"
+#include "utility/histogram.h"
 
 InspIRCd* ServerInstance = NULL;
 
@@ -380,8 +381,113 @@ namespace
 	{
 		exit(EXIT_STATUS_NOERROR);
 	}
+
+	// Times the phases of each main loop iteration and warns about slow iterations.
+	class LoopTimer final
+	{
+	 private:
+		// The time in nanoseconds that each phase has taken in the current iteration.
+		std::array<uint64_t, serverstats::PHASE_COUNT> phases;
+
+		// Whether each phase has run in the current iteration.
+		std::array<bool, serverstats::PHASE_COUNT> ran;
+
+		// The value of the monotonic clock when the current phase started.
+		uint64_t last;
+
+		// The time at which the last slow iteration warning was sent.
+		time_t lastwarning = 0;
+
+		// The number of slow iterations which were not warned about since the last warning.
+		unsigned long suppressed = 0;
+
+		void Warn(uint64_t elapsed)
+		{
+			// Only warn once every ten seconds so a struggling server does not flood opers.
+			if (ServerInstance->Time() - lastwarning < 10)
+			{
+				suppressed++;
+				return;
+			}
+
+			size_t slowest = 0;
+			for (size_t phase = 1; phase < serverstats::PHASE_COUNT; ++phase)
+			{
+				if (phases[phase] > phases[slowest])
+					slowest = phase;
+			}
+
+			const std::string others = suppressed ? InspIRCd::Format(" (%lu more slow iterations since the last warning)", suppressed) : "";
+			ServerInstance->SNO.WriteToSnoMask('a', "\002Performance warning!\002 A main loop iteration took %lums; the slowest phase was %s at %lums%s.",
+				static_cast<unsigned long>(elapsed / 1000000), serverstats::LOOP_PHASE_NAMES[slowest],
+				static_cast<unsigned long>(phases[slowest] / 1000000), others.c_str());
+
+			lastwarning = ServerInstance->Time();
+			suppressed = 0;
+		}
+
+	 public:
+		void Start()
+		{
+			phases.fill(0);
+			ran.fill(false);
+			last = insp::monotonic_ns();
+		}
+
+		void Mark(serverstats::LoopPhase phase)
+		{
+			const uint64_t now = insp::monotonic_ns();
+			phases[phase] += now - last;
+			ran[phase] = true;
+			last = now;
+		}
+
+		void MarkEvents()
+		{
+			// The time before the socket engine woke up was spent waiting rather than working.
+			const uint64_t now = insp::monotonic_ns();
+			const uint64_t woke = SocketEngine::GetStats().LastWake;
+			const uint64_t started = (woke > last && woke <= now) ? woke : last;
+			phases[serverstats::PHASE_EVENTS] += now - started;
+			ran[serverstats::PHASE_EVENTS] = true;
+			last = now;
+		}
+
+		void Finish()
+		{
+			serverstats& stats = ServerInstance->stats;
+
+			uint64_t elapsed = 0;
+			for (size_t phase = 0; phase < serverstats::PHASE_COUNT; ++phase)
+			{
+				if (!ran[phase])
+					continue;
+
+				elapsed += phases[phase];
+				stats.LoopPhaseTime[phase]->add(phases[phase]);
+			}
+
+			stats.LoopTime->add(elapsed);
+			stats.LoopTimeThisMinute->add(elapsed);
+
+			const unsigned long threshold = ServerInstance->Config->SlowIteration;
+			if (threshold && elapsed >= threshold * 1000000)
+				Warn(elapsed);
+		}
+	};
+}
+
+serverstats::serverstats()
+	: LoopTime(std::make_unique<insp::log2_histogram>())
+	, LoopTimeThisMinute(std::make_unique<insp::log2_histogram>())
+	, LoopTimeLastMinute(std::make_unique<insp::log2_histogram>())
+{
+	for (auto& histogram : LoopPhaseTime)
+		histogram = std::make_unique<insp::log2_histogram>();
 }
 
+serverstats::~serverstats() = default;
+
 void InspIRCd::Cleanup()
 {
 	// Close all listening sockets
@@ -403,6 +509,7 @@ void InspIRCd::Cleanup()
 
 	GlobalCulls.Apply();
 	Modules.UnloadAll();
+	Threads.Stop();
 
 	/* Delete objects dynamically allocated in constructor (destructor would be more appropriate, but we're likely exiting) */
 	/* Must be deleted before modes as it decrements modelines */
@@ -616,9 +723,12 @@ void InspIRCd::Run()
 {
 	UpdateTime();
 	time_t OLDTIME = TIME.tv_sec;
+	LoopTimer looptimer;
 
 	while (true)
 	{
+		looptimer.Start();
+
 		/* Check if there is a config thread which has finished executing but has not yet been freed */
 		if (this->ConfigThread && this->ConfigThread->IsDone())
 		{
@@ -640,13 +750,24 @@ void InspIRCd::Run()
 			CollectStats();
 			CheckTimeSkip(OLDTIME, TIME.tv_sec);
 
+			// Keep the iteration times of the previous minute separately so that recent
+			// problems are not hidden by the history of a server with a long uptime.
+			if ((TIME.tv_sec / 60) != (OLDTIME / 60))
+			{
+				*stats.LoopTimeLastMinute = *stats.LoopTimeThisMinute;
+				stats.LoopTimeThisMinute->clear();
+			}
+
 			OLDTIME = TIME.tv_sec;
 
 			if ((TIME.tv_sec % 3600) == 0)
 				FOREACH_MOD(OnGarbageCollect, ());
 
+			looptimer.Mark(serverstats::PHASE_HOUSEKEEPING);
 			Timers.TickTimers(TIME.tv_sec);
+			looptimer.Mark(serverstats::PHASE_TIMERS);
 			Users.DoBackgroundUserStuff();
+			looptimer.Mark(serverstats::PHASE_USERS);
 
 			if ((TIME.tv_sec % 5) == 0)
 			{
@@ -654,6 +775,7 @@ void InspIRCd::Run()
 				SNO.FlushSnotices();
 			}
 		}
+		looptimer.Mark(serverstats::PHASE_HOUSEKEEPING);
 
 		/* Call the socket engine to wait on the active
 		 * file descriptors. The socket engine has everything's
@@ -663,17 +785,23 @@ void InspIRCd::Run()
 		 * dispatched to their handlers.
 		 */
 		SocketEngine::DispatchTrialWrites();
+		looptimer.Mark(serverstats::PHASE_TRIALWRITES);
 		SocketEngine::DispatchEvents();
+		looptimer.MarkEvents();
 
 		/* if any users were quit, take them out */
 		GlobalCulls.Apply();
+		looptimer.Mark(serverstats::PHASE_CULLS);
 		AtomicActions.Run();
+		looptimer.Mark(serverstats::PHASE_ACTIONS);
 
 		if (s_signal)
 		{
 			this->SignalHandler(s_signal);
 			s_signal = 0;
 		}
+		looptimer.Mark(serverstats::PHASE_HOUSEKEEPING);
+		looptimer.Finish();
 	}
 }
 
@@ -689,7 +817,11 @@ void InspIRCd::SetSignal(int signal)
  * defines smain() and the real main() is in the service code under
  * win32service.cpp. This allows the service control manager to control
  * the process where we are running as a windows service.
+ *
+ * The benchmark suite builds this file with INSPIRCD_BENCHMARK defined so
+ * that it can provide its own main().
  */
+#ifndef INSPIRCD_BENCHMARK
 ENTRYPOINT
 {
 	new InspIRCd(argc, argv);
@@ -697,3 +829,4 @@ ENTRYPOINT
 	delete ServerInstance;
 	return 0;
 }
+#endif
@@ -123,6 +123,27 @@ void StreamSocket::Close()
 		SocketEngine::Shutdown(this, 2);
 		SocketEngine::Close(this);
 	}
+
+	UpdateQueueTotals();
+}
+
+StreamSocket::~StreamSocket()
+{
+	// A socket which is destroyed without being closed still has to be removed from the totals.
+	closing = true;
+	UpdateQueueTotals();
+}
+
+void StreamSocket::UpdateQueueTotals()
+{
+	// The queues of a closed socket are never sent or processed so they are not counted. The
+	// sendq includes the data which is buffered by I/O hooks as that has not been sent either.
+	const size_t sendqsize = closing ? 0 : GetSendQSize();
+	const size_t recvqsize = closing ? 0 : recvq.size();
+	ServerInstance->stats.SendQ += sendqsize - countedsendq;
+	ServerInstance->stats.RecvQ += recvqsize - countedrecvq;
+	countedsendq = sendqsize;
+	countedrecvq = recvqsize;
 }
 
 void StreamSocket::Close(bool writeblock)
@@ -168,6 +189,8 @@ void StreamSocket::DoRead()
 
 	if (recvq.size() > prevrecvqsize)
 		OnDataReady();
+
+	UpdateQueueTotals();
 }
 
 long StreamSocket::ReadToRecvQ(std::string& rq)
@@ -261,6 +284,8 @@ void StreamSocket::DoWrite()
 	if (psendq)
 		FlushSendQ(*psendq);
 
+	UpdateQueueTotals();
+
 	if (GetSendQSize() == 0 && closeonempty)
 		Close();
 }
@@ -370,6 +395,7 @@ void StreamSocket::WriteData(const std::string &data)
 
 	/* Append the data to the back of the queue ready for writing */
 	sendq.push_back(data);
+	UpdateQueueTotals();
 
 	SocketEngine::ChangeEventMask(this, FD_ADD_TRIAL_WRITE);
 }
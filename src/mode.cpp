@@ -349,7 +349,8 @@ ModeAction ModeParser::TryMode(User* user, User* targetuser, Channel* chan, Mode
 	return MODEACTION_ALLOW;
 }
 
-void ModeParser::ModeParamsToChangeList(User* user, ModeType type, const std::vector<std::string>& parameters, Modes::ChangeList& changelist, size_t beginindex, size_t endindex)
+template <typename Parameters>
+static void ParamsToChangeList(ModeParser& parser, User* user, ModeType type, const Parameters& parameters, Modes::ChangeList& changelist, size_t beginindex, size_t endindex)
 {
 	if (endindex > parameters.size())
 		endindex = parameters.size();
@@ -365,7 +366,7 @@ void ModeParser::ModeParamsToChangeList(User* user, ModeType type, const std::ve
 			continue;
 		}
 
-		ModeHandler *mh = this->FindMode(modechar, type);
+		ModeHandler *mh = parser.FindMode(modechar, type);
 		if (!mh)
 		{
 			/* No mode handler? Unknown mode character then. */
@@ -377,12 +378,22 @@ void ModeParser::ModeParamsToChangeList(User* user, ModeType type, const std::ve
 
 		std::string parameter;
 		if ((mh->NeedsParam(adding)) && (param_at < endindex))
-			parameter = parameters[param_at++];
+			parameter.assign(parameters[param_at++]);
 
 		changelist.push(mh, adding, parameter);
 	}
 }
 
+void ModeParser::ModeParamsToChangeList(User* user, ModeType type, const std::vector<std::string>& parameters, Modes::ChangeList& changelist, size_t beginindex, size_t endindex)
+{
+	ParamsToChangeList(*this, user, type, parameters, changelist, beginindex, endindex);
+}
+
+void ModeParser::ModeParamsToChangeList(User* user, ModeType type, const std::vector<std::string_view>& parameters, Modes::ChangeList& changelist, size_t beginindex, size_t endindex)
+{
+	ParamsToChangeList(*this, user, type, parameters, changelist, beginindex, endindex);
+}
+
 static bool IsModeParamValid(User* user, Channel* targetchannel, User* targetuser, const Modes::Change& item)
 {
 	// An empty parameter is never acceptable
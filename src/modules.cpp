@@ -37,6 +37,27 @@
 
 static insp::intrusive_list<dynamic_reference_base>* dynrefs = NULL;
 
+bool Profiler::enabled = false;
+
+void Profiler::Record(const Module* mod, const std::string_view& hook, uint64_t elapsed)
+{
+	auto it = mod->hookstats.find(hook);
+	if (it == mod->hookstats.end())
+		it = mod->hookstats.emplace(std::string(hook), HookStats()).first;
+
+	HookStats& stats = it->second;
+	stats.calls++;
+	stats.total += elapsed;
+	if (elapsed > stats.max)
+		stats.max = elapsed;
+}
+
+void Profiler::Reset()
+{
+	for (const auto& [_, mod] : ServerInstance->Modules.GetModules())
+		mod->hookstats.clear();
+}
+
 void dynamic_reference_base::reset_all()
 {
 	if (!dynrefs)
@@ -385,6 +406,10 @@ void ModuleManager::UnregisterModes(Module* mod, ModeType modetype)
 
 void ModuleManager::DoSafeUnload(Module* mod)
 {
+	// Finish any work which is running on a worker thread as it may be using code or
+	// data which belongs to the module being unloaded.
+	ServerInstance->Threads.Flush(mod);
+
 	// First, notify all modules that a module is about to be unloaded, so in case
 	// they pass execution to the soon to be unloaded module, it will happen now,
 	// i.e. before we unregister the services of the module being unloaded
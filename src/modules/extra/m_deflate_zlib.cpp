@@ -0,0 +1,201 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// $CompilerFlags: find_compiler_flags("zlib")
+/// $LinkerFlags: find_linker_flags("zlib")
+
+/// $PackageInfo: require_system("arch") pkgconf zlib
+/// $PackageInfo: require_system("centos") pkgconfig zlib-devel
+/// $PackageInfo: require_system("darwin") pkg-config zlib
+/// $PackageInfo: require_system("debian") pkg-config zlib1g-dev
+/// $PackageInfo: require_system("ubuntu") pkg-config zlib1g-dev
+
+
+#include "inspircd.h"
+#include "modules/deflate.h"
+
+#include <zlib.h>
+
+class ZlibCompressor final
+	: public Deflate::Compressor
+{
+ private:
+	z_stream stream = { };
+	bool ok;
+
+ public:
+	ZlibCompressor(int windowbits, int level)
+	{
+		// A negative window size tells zlib to produce raw DEFLATE data without a header.
+		ok = deflateInit2(&stream, level, Z_DEFLATED, -windowbits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+	}
+
+	~ZlibCompressor() override
+	{
+		if (ok)
+			deflateEnd(&stream);
+	}
+
+	bool Compress(const char* data, size_t len, std::string& out) override
+	{
+		if (!ok)
+			return false;
+
+		stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+		stream.avail_in = static_cast<uInt>(len);
+
+		size_t outpos = out.size();
+		do
+		{
+			// Compressed data is almost always smaller than the input so this rarely loops.
+			out.resize(outpos + deflateBound(&stream, stream.avail_in) + 16);
+			stream.next_out = reinterpret_cast<Bytef*>(&out[outpos]);
+			stream.avail_out = static_cast<uInt>(out.size() - outpos);
+
+			if (deflate(&stream, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+			{
+				out.resize(outpos);
+				return false;
+			}
+			outpos = out.size() - stream.avail_out;
+		}
+		while (stream.avail_out == 0);
+
+		out.resize(outpos);
+		return true;
+	}
+
+	void Reset() override
+	{
+		if (ok)
+			deflateReset(&stream);
+	}
+};
+
+class ZlibDecompressor final
+	: public Deflate::Decompressor
+{
+ private:
+	z_stream stream = { };
+	bool ok;
+
+ public:
+	ZlibDecompressor(int windowbits)
+	{
+		ok = inflateInit2(&stream, -windowbits) == Z_OK;
+	}
+
+	~ZlibDecompressor() override
+	{
+		if (ok)
+			inflateEnd(&stream);
+	}
+
+	bool Decompress(const char* data, size_t len, std::string& out, size_t maxlen) override
+	{
+		if (!ok)
+			return false;
+
+		stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+		stream.avail_in = static_cast<uInt>(len);
+
+		const size_t startpos = out.size();
+		const size_t chunksize = std::max<size_t>(len * 4, 256);
+		size_t outpos = startpos;
+		for (;;)
+		{
+			if (outpos - startpos >= maxlen)
+			{
+				// Refuse to expand a small message into an unreasonably large one.
+				out.resize(startpos);
+				return false;
+			}
+
+			out.resize(std::min(outpos + chunksize, startpos + maxlen));
+			stream.next_out = reinterpret_cast<Bytef*>(&out[outpos]);
+			stream.avail_out = static_cast<uInt>(out.size() - outpos);
+
+			const uInt oldavailin = stream.avail_in;
+			const int result = inflate(&stream, Z_SYNC_FLUSH);
+			const size_t oldoutpos = outpos;
+			outpos = out.size() - stream.avail_out;
+			if (result == Z_STREAM_END)
+			{
+				// The sender finished the stream; anything it sends after this starts a new one.
+				inflateReset(&stream);
+			}
+			else if (result != Z_OK && result != Z_BUF_ERROR)
+			{
+				out.resize(startpos);
+				return false;
+			}
+
+			// If there is space left in the buffer then all of the pending output has been flushed.
+			if (!stream.avail_in && stream.avail_out)
+				break;
+
+			if (stream.avail_in == oldavailin && outpos == oldoutpos)
+			{
+				out.resize(startpos);
+				return false;
+			}
+		}
+
+		out.resize(outpos);
+		return true;
+	}
+
+	void Reset() override
+	{
+		if (ok)
+			inflateReset(&stream);
+	}
+};
+
+class ZlibProvider final
+	: public Deflate::Provider
+{
+ public:
+	ZlibProvider(Module* Creator)
+		: Deflate::Provider(Creator, "zlib")
+	{
+	}
+
+	Deflate::CompressorPtr CreateCompressor(int windowbits, int level) override
+	{
+		return std::make_unique<ZlibCompressor>(windowbits, level);
+	}
+
+	Deflate::DecompressorPtr CreateDecompressor(int windowbits) override
+	{
+		return std::make_unique<ZlibDecompressor>(windowbits);
+	}
+};
+
+class ModuleDeflateZlib : public Module
+{
+ private:
+	ZlibProvider zlib;
+
+ public:
+	ModuleDeflateZlib()
+		: Module(VF_VENDOR, "Provides DEFLATE compression using the zlib library.")
+		, zlib(this)
+	{
+	}
+};
+
+MODULE_INIT(ModuleDeflateZlib)
@@ -43,6 +43,8 @@
 #include "inspircd.h"
 #include <mysql.h>
 #include "modules/sql.h"
+#include "modules/stats.h"
+#include "utility/histogram.h"
 
 #ifdef __GNUC__
 # pragma GCC diagnostic pop
@@ -60,21 +62,21 @@
  * that instead, you should thread your program. This is what i've done here to allow for
  * asynchronous SQL requests via mysql. The way this works is as follows:
  *
- * The module spawns a thread via class Thread, and performs its mysql queries in this thread,
- * using a queue with priorities. There is a mutex on either end which prevents two threads
- * adjusting the queue at the same time, and crashing the ircd. Every 50 milliseconds, the
- * worker thread wakes up, and checks if there is a request at the head of its queue.
- * If there is, it processes this request, blocking the worker thread but leaving the ircd
- * thread to go about its business as usual. During this period, the ircd thread is able
- * to insert further pending requests into the queue.
+ * Each configured database spawns a thread via class SocketThread, and performs its mysql
+ * queries in this thread, using its own queue. This means that a slow query against one
+ * database does not hold up queries against any of the others. There is a mutex on either end
+ * which prevents two threads adjusting the queue at the same time, and crashing the ircd.
+ * Whenever a request is added to the queue the worker thread is woken up to process it,
+ * blocking the worker thread but leaving the ircd thread to go about its business as usual.
+ * During this period, the ircd thread is able to insert further pending requests into the queue.
  *
- * Once the processing of a request is complete, it is removed from the incoming queue to
+ * Once the processing of a request is complete, it is moved from the incoming queue to
  * an outgoing queue, and initialized as a 'response'. The worker thread then signals the
- * ircd thread (via a loopback socket) of the fact a result is available, by sending the
- * connection ID through the connection.
+ * ircd thread (via a loopback socket) of the fact a result is available.
  *
- * The ircd thread then mutexes the queue once more, reads the outbound response off the head
- * of the queue, and sends it on its way to the original calling module.
+ * The ircd thread then mutexes the queue once more, takes every outbound response which is
+ * available off the queue in one go, and sends them on their way to the original calling
+ * modules.
  *
  * XXX: You might be asking "why doesnt it just send the response from within the worker thread?"
  * The answer to this is simple. The majority of InspIRCd, and in fact most ircd's are not
@@ -88,23 +90,30 @@
 
 class SQLConnection;
 class MySQLresult;
-class DispatcherThread;
+
+// The type which MYSQL_BIND uses for booleans. This is my_bool on MariaDB and older versions
+// of MySQL and bool on MySQL 8.
+typedef std::remove_pointer_t<decltype(MYSQL_BIND::is_null)> MySQLBool;
 
 struct QueryQueueItem
 {
-	// An SQL database which this query is executed on.
-	SQLConnection* connection;
-
 	// An object which handles the result of the query.
 	SQL::Query* query;
 
 	// The SQL query which is to be executed.
 	std::string querystr;
 
-	QueryQueueItem(SQL::Query* q, const std::string& s, SQLConnection* c)
-		: connection(c)
-		, query(q)
+	// If the query is a prepared statement then the values to bind to its parameters.
+	std::optional<SQL::ValueList> values;
+
+	// The monotonic time in nanoseconds at which the query was submitted.
+	uint64_t submitted;
+
+	QueryQueueItem(SQL::Query* q, const std::string& s, const std::optional<SQL::ValueList>& v = std::nullopt)
+		: query(q)
 		, querystr(s)
+		, values(v)
+		, submitted(insp::monotonic_ns())
 	{
 	}
 };
@@ -117,9 +126,13 @@ struct ResultQueueItem
 	// The result returned from executing the MySQL query.
 	MySQLresult* result;
 
-	ResultQueueItem(SQL::Query* q, MySQLresult* r)
+	// The monotonic time in nanoseconds at which the query was submitted.
+	uint64_t submitted;
+
+	ResultQueueItem(SQL::Query* q, MySQLresult* r, uint64_t s)
 		: query(q)
 		, result(r)
+		, submitted(s)
 	{
 	}
 };
@@ -130,12 +143,9 @@ typedef std::deque<ResultQueueItem> ResultQueue;
 
 /** MySQL module
  *  */
-class ModuleSQL : public Module
+class ModuleSQL : public Module, public Stats::EventListener
 {
  public:
-	DispatcherThread* Dispatcher = nullptr;
-	QueryQueue qq;       // MUST HOLD MUTEX
-	ResultQueue rq;      // MUST HOLD MUTEX
 	ConnMap connections; // main thread only
 
 	void init() override;
@@ -143,16 +153,7 @@ class ModuleSQL : public Module
 	~ModuleSQL() override;
 	void ReadConfig(ConfigStatus& status) override;
 	void OnUnloadModule(Module* mod) override;
-};
-
-class DispatcherThread : public SocketThread
-{
- private:
-	ModuleSQL* const Parent;
- public:
-	DispatcherThread(ModuleSQL* CreatorModule) : Parent(CreatorModule) { }
-	void OnStart() override;
-	void OnNotify() override;
+	ModResult OnStats(Stats::Context& stats) override;
 };
 
 /** Represents a mysql result set
@@ -210,6 +211,11 @@ class MySQLresult : public SQL::Result
 		}
 	}
 
+	MySQLresult()
+		: err(SQL::SUCCESS)
+	{
+	}
+
 	MySQLresult(SQL::Error& e)
 		: err(e)
 	{
@@ -266,9 +272,15 @@ class MySQLresult : public SQL::Result
 
 /** Represents a connection to a mysql database
  */
-class SQLConnection : public SQL::Provider
+class SQLConnection : public SQL::Provider, public SocketThread
 {
  private:
+	QueryQueue qq; // MUST HOLD MUTEX
+	ResultQueue rq; // MUST HOLD MUTEX
+
+	// Whether the worker thread should exit. MUST HOLD MUTEX
+	bool shutdown = false;
+
 	bool EscapeString(SQL::Query* query, const std::string& in, std::string& out)
 	{
 		// In the worst case each character may need to be encoded as using two bytes and one
@@ -296,8 +308,22 @@ class SQLConnection : public SQL::Provider
  public:
 	std::shared_ptr<ConfigTag> config;
 	MYSQL* connection = nullptr;
+
+	// The statements which have been prepared on the connection keyed by their query. Worker thread only.
+	std::unordered_map<std::string, MYSQL_STMT*> statements;
+
+	// Held by the worker thread whilst it is executing a query.
 	std::mutex lock;
 
+	// The number of queries which have completed successfully. Main thread only.
+	uint64_t successes = 0;
+
+	// The number of queries which have failed. Main thread only.
+	uint64_t failures = 0;
+
+	// The time between queries being submitted and their results being delivered in nanoseconds. Main thread only.
+	insp::log2_histogram latency;
+
 	// This constructor creates an SQLConnection object with the given credentials, but does not connect yet.
 	SQLConnection(Module* p, std::shared_ptr<ConfigTag> tag)
 		: SQL::Provider(p, tag->getString("id"))
@@ -307,13 +333,80 @@ class SQLConnection : public SQL::Provider
 
 	~SQLConnection() override
 	{
+		ClearStatements();
 		mysql_close(connection);
 	}
 
+	// Frees all of the statements which have been prepared on the connection.
+	void ClearStatements()
+	{
+		for (const auto& [_, stmt] : statements)
+			mysql_stmt_close(stmt);
+		statements.clear();
+	}
+
+	void OnStart() override;
+	void OnNotify() override;
+
+	// Stops the worker thread, fails any queries which have not been started and delivers the
+	// results of any which have.
+	void Shutdown()
+	{
+		LockQueue();
+		shutdown = true;
+		UnlockQueueWakeup();
+		Stop();
+
+		SQL::Error err(SQL::BAD_DBID);
+		for (const auto& item : qq)
+		{
+			item.query->OnError(err);
+			delete item.query;
+		}
+		qq.clear();
+		OnNotify();
+	}
+
+	// Fails any queries from the specified module which have not been started and waits for
+	// the query which is being executed to finish.
+	void PurgeModule(Module* mod)
+	{
+		SQL::Error err(SQL::BAD_DBID);
+		LockQueue();
+		for (QueryQueue::iterator it = qq.begin(); it != qq.end(); )
+		{
+			if (it->query->creator == mod)
+			{
+				it->query->OnError(err);
+				delete it->query;
+				it = qq.erase(it);
+			}
+			else
+				++it;
+		}
+		UnlockQueue();
+
+		// The query being executed might be from the module so wait for it to finish.
+		lock.lock();
+		lock.unlock();
+		OnNotify();
+	}
+
+	// Retrieves the number of queries which are waiting to be executed.
+	size_t GetQueueSize()
+	{
+		LockQueue();
+		size_t size = qq.size();
+		UnlockQueue();
+		return size;
+	}
+
 	// This method connects to the database using the credentials supplied to the constructor, and returns
 	// true upon success.
 	bool Connect()
 	{
+		// Prepared statements do not survive a reconnection.
+		ClearStatements();
 		connection = mysql_init(connection);
 
 		// Set the connection timeout.
@@ -354,11 +447,6 @@ class SQLConnection : public SQL::Provider
 		return true;
 	}
 
-	ModuleSQL* Parent()
-	{
-		return (ModuleSQL*)(Module*)creator;
-	}
-
 	MySQLresult* DoBlockingQuery(const std::string& query)
 	{
 
@@ -379,6 +467,162 @@ class SQLConnection : public SQL::Provider
 		}
 	}
 
+	MySQLresult* FetchResult(MYSQL_STMT* stmt)
+	{
+		MYSQL_RES* meta = mysql_stmt_result_metadata(stmt);
+		if (!meta)
+		{
+			// The statement did not return a result set (e.g. INSERT or UPDATE).
+			MySQLresult* result = new MySQLresult();
+			result->rows = int(mysql_stmt_affected_rows(stmt));
+			return result;
+		}
+
+		// Buffer the result set so we know how large each field can be before fetching it.
+		MySQLBool update_max_length = 1;
+		mysql_stmt_attr_set(stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &update_max_length);
+		if (mysql_stmt_store_result(stmt))
+		{
+			SQL::Error e(SQL::QREPLY_FAIL, InspIRCd::Format("%u: %s", mysql_stmt_errno(stmt), mysql_stmt_error(stmt)));
+			mysql_free_result(meta);
+			return new MySQLresult(e);
+		}
+
+		// Have the server convert every field to a string like mysql_real_query does. The
+		// library writes the length and nullness of each field through the pointers in the
+		// binds so these need storage of their own.
+		const unsigned int field_count = mysql_num_fields(meta);
+		const MYSQL_FIELD* fields = mysql_fetch_fields(meta);
+		std::vector<MYSQL_BIND> binds(field_count);
+		std::vector<std::vector<char>> buffers(field_count);
+		std::vector<unsigned long> lengths(field_count);
+		// This is not a std::vector as MySQLBool can be bool and std::vector<bool> is bit packed.
+		auto nulls = std::make_unique<MySQLBool[]>(field_count);
+
+		MySQLresult* result = new MySQLresult();
+		for (unsigned int i = 0; i < field_count; ++i)
+		{
+			result->colnames.push_back(fields[i].name ? fields[i].name : "");
+
+			buffers[i].resize(fields[i].max_length + 1);
+			memset(&binds[i], 0, sizeof(MYSQL_BIND));
+			binds[i].buffer_type = MYSQL_TYPE_STRING;
+			binds[i].buffer = buffers[i].data();
+			binds[i].buffer_length = buffers[i].size();
+			binds[i].length = &lengths[i];
+			binds[i].is_null = &nulls[i];
+		}
+
+		if (mysql_stmt_bind_result(stmt, binds.data()))
+		{
+			SQL::Error e(SQL::QREPLY_FAIL, InspIRCd::Format("%u: %s", mysql_stmt_errno(stmt), mysql_stmt_error(stmt)));
+			mysql_stmt_free_result(stmt);
+			mysql_free_result(meta);
+			delete result;
+			return new MySQLresult(e);
+		}
+
+		while (mysql_stmt_fetch(stmt) == 0)
+		{
+			SQL::Row& row = result->fieldlists.emplace_back();
+			for (unsigned int i = 0; i < field_count; ++i)
+			{
+				if (nulls[i])
+					row.emplace_back();
+				else
+					row.emplace_back(std::string(buffers[i].data(), std::min<size_t>(lengths[i], buffers[i].size())));
+			}
+			result->rows++;
+		}
+
+		mysql_stmt_free_result(stmt);
+		mysql_free_result(meta);
+		return result;
+	}
+
+	MySQLresult* DoPreparedQuery(const std::string& query, const SQL::ValueList& values)
+	{
+		if (!CheckConnection())
+		{
+			SQL::Error e(SQL::BAD_CONN, InspIRCd::Format("%u: %s", mysql_errno(connection), mysql_error(connection)));
+			return new MySQLresult(e);
+		}
+
+		MYSQL_STMT* stmt;
+		auto it = statements.find(query);
+		if (it != statements.end())
+			stmt = it->second;
+		else
+		{
+			stmt = mysql_stmt_init(connection);
+			if (!stmt)
+			{
+				SQL::Error e(SQL::QSEND_FAIL, InspIRCd::Format("%u: %s", mysql_errno(connection), mysql_error(connection)));
+				return new MySQLresult(e);
+			}
+
+			if (mysql_stmt_prepare(stmt, query.data(), query.length()))
+			{
+				SQL::Error e(SQL::QSEND_FAIL, InspIRCd::Format("%u: %s", mysql_stmt_errno(stmt), mysql_stmt_error(stmt)));
+				mysql_stmt_close(stmt);
+				return new MySQLresult(e);
+			}
+			it = statements.emplace(query, stmt).first;
+		}
+
+		if (mysql_stmt_param_count(stmt) != values.size())
+		{
+			SQL::Error e(SQL::QSEND_FAIL, InspIRCd::Format("The statement has %lu parameters but %zu values were given",
+				mysql_stmt_param_count(stmt), values.size()));
+			return new MySQLresult(e);
+		}
+
+		// The library reads the values through the pointers in the binds when the statement is
+		// executed so the values must stay alive until then.
+		std::vector<MYSQL_BIND> binds(values.size());
+		std::vector<unsigned long> lengths(values.size());
+		for (size_t i = 0; i < values.size(); ++i)
+		{
+			MYSQL_BIND& bind = binds[i];
+			memset(&bind, 0, sizeof(MYSQL_BIND));
+
+			const SQL::Value& value = values[i];
+			if (std::holds_alternative<int64_t>(value))
+			{
+				bind.buffer_type = MYSQL_TYPE_LONGLONG;
+				bind.buffer = const_cast<int64_t*>(&std::get<int64_t>(value));
+			}
+			else if (std::holds_alternative<double>(value))
+			{
+				bind.buffer_type = MYSQL_TYPE_DOUBLE;
+				bind.buffer = const_cast<double*>(&std::get<double>(value));
+			}
+			else if (std::holds_alternative<std::string>(value))
+			{
+				const std::string& str = std::get<std::string>(value);
+				lengths[i] = str.length();
+				bind.buffer_type = MYSQL_TYPE_STRING;
+				bind.buffer = const_cast<char*>(str.data());
+				bind.buffer_length = str.length();
+				bind.length = &lengths[i];
+			}
+			else
+				bind.buffer_type = MYSQL_TYPE_NULL;
+		}
+
+		if (mysql_stmt_bind_param(stmt, binds.data()) || mysql_stmt_execute(stmt))
+		{
+			SQL::Error e(SQL::QREPLY_FAIL, InspIRCd::Format("%u: %s", mysql_stmt_errno(stmt), mysql_stmt_error(stmt)));
+
+			// The statement might have been invalidated (e.g. by a change to a table it uses)
+			// so prepare it again next time.
+			mysql_stmt_close(stmt);
+			statements.erase(it);
+			return new MySQLresult(e);
+		}
+		return FetchResult(stmt);
+	}
+
 	bool CheckConnection()
 	{
 		if (!connection || mysql_ping(connection) != 0)
@@ -389,9 +633,17 @@ class SQLConnection : public SQL::Provider
 	void Submit(SQL::Query* q, const std::string& qs) override
 	{
 		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Executing MySQL query: " + qs);
-		Parent()->Dispatcher->LockQueue();
-		Parent()->qq.emplace_back(q, qs, this);
-		Parent()->Dispatcher->UnlockQueueWakeup();
+		LockQueue();
+		qq.emplace_back(q, qs);
+		UnlockQueueWakeup();
+	}
+
+	void SubmitPrepared(SQL::Query* call, const SQL::Statement& statement, const SQL::ValueList& values) override
+	{
+		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Executing MySQL statement: " + statement.GetQuery());
+		LockQueue();
+		qq.emplace_back(call, statement.GetQuery(), values);
+		UnlockQueueWakeup();
 	}
 
 	void Submit(SQL::Query* call, const std::string& q, const SQL::ParamList& p) override
@@ -436,27 +688,21 @@ void ModuleSQL::init()
 {
 	if (mysql_library_init(0, NULL, NULL))
 		throw ModuleException("Unable to initialise the MySQL library!");
-
-	Dispatcher = new DispatcherThread(this);
-	Dispatcher->Start();
 }
 
 ModuleSQL::ModuleSQL()
 	: Module(VF_VENDOR, "Provides the ability for SQL modules to query a MySQL database.")
+	, Stats::EventListener(this)
 {
 }
 
 ModuleSQL::~ModuleSQL()
 {
-	if (Dispatcher)
-	{
-		Dispatcher->Stop();
-		Dispatcher->OnNotify();
-		delete Dispatcher;
-	}
-
 	for (const auto& [_, connection] : connections)
+	{
+		connection->Shutdown();
 		delete connection;
+	}
 
 	mysql_library_end();
 }
@@ -477,6 +723,7 @@ void ModuleSQL::ReadConfig(ConfigStatus& status)
 			SQLConnection* conn = new SQLConnection(this, tag);
 			conns.emplace(id, conn);
 			ServerInstance->Modules.AddService(*conn);
+			conn->Start();
 		}
 		else
 		{
@@ -486,90 +733,58 @@ void ModuleSQL::ReadConfig(ConfigStatus& status)
 	}
 
 	// now clean up the deleted databases
-	Dispatcher->LockQueue();
-	SQL::Error err(SQL::BAD_DBID);
-
 	for (const auto& [_, connection] : connections)
 	{
 		ServerInstance->Modules.DelService(*connection);
-		// it might be running a query on this database. Wait for that to complete
-		connection->lock.lock();
-		connection->lock.unlock();
-		// now remove all active queries to this DB
-		for (size_t j = qq.size(); j > 0; j--)
-		{
-			size_t k = j - 1;
-			if (qq[k].connection == connection)
-			{
-				qq[k].query->OnError(err);
-				delete qq[k].query;
-				qq.erase(qq.begin() + k);
-			}
-		}
-		// finally, nuke the connection
+		// this waits for any query which is running on this database to complete
+		connection->Shutdown();
 		delete connection;
 	}
-	Dispatcher->UnlockQueue();
 	connections.swap(conns);
 }
 
 void ModuleSQL::OnUnloadModule(Module* mod)
 {
-	SQL::Error err(SQL::BAD_DBID);
-	Dispatcher->LockQueue();
-	size_t i = qq.size();
-	while (i > 0)
+	for (const auto& [_, connection] : connections)
+		connection->PurgeModule(mod);
+}
+
+ModResult ModuleSQL::OnStats(Stats::Context& stats)
+{
+	if (stats.GetSymbol() != 'Q')
+		return MOD_RES_PASSTHRU;
+
+	for (const auto& [id, connection] : connections)
 	{
-		i--;
-		if (qq[i].query->creator == mod)
-		{
-			if (i == 0)
-			{
-				// need to wait until the query is done
-				// (the result will be discarded)
-				qq[i].connection->lock.lock();
-			}
-			qq[i].query->OnError(err);
-			delete qq[i].query;
-			qq.erase(qq.begin() + i);
-		}
+		const std::string prefix = "MySQL " + id;
+		stats.AddRow(249, prefix + ": " + ConvToStr(connection->GetQueueSize()) + " queued, "
+			+ ConvToStr(connection->successes) + " succeeded, " + ConvToStr(connection->failures) + " failed");
+
+		// The latency is recorded in nanoseconds.
+		stats.AddRow(249, prefix + " latency: " + connection->latency.summarize(1000, "us"));
 	}
-	Dispatcher->UnlockQueue();
-	// clean up any result queue entries
-	Dispatcher->OnNotify();
+
+	// Other SQL modules may also have databases to show.
+	return MOD_RES_PASSTHRU;
 }
 
-void DispatcherThread::OnStart()
+void SQLConnection::OnStart()
 {
 	this->LockQueue();
-	while (!this->IsStopping())
+	while (!shutdown)
 	{
-		if (!Parent->qq.empty())
+		if (!qq.empty())
 		{
-			QueryQueueItem i = Parent->qq.front();
-			i.connection->lock.lock();
+			QueryQueueItem i = qq.front();
+			qq.pop_front();
+			lock.lock();
 			this->UnlockQueue();
-			MySQLresult* res = i.connection->DoBlockingQuery(i.querystr);
-			i.connection->lock.unlock();
-
-			/*
-			 * At this point, the main thread could be working on:
-			 *  Rehash - delete i.connection out from under us. We don't care about that.
-			 *  UnloadModule - delete i.query and the qq item. Need to avoid reporting results.
-			 */
+			MySQLresult* res = i.values ? DoPreparedQuery(i.querystr, *i.values) : DoBlockingQuery(i.querystr);
+			lock.unlock();
 
 			this->LockQueue();
-			if (!Parent->qq.empty() && Parent->qq.front().query == i.query)
-			{
-				Parent->qq.pop_front();
-				Parent->rq.emplace_back(i.query, res);
-				NotifyParent();
-			}
-			else
-			{
-				// UnloadModule ate the query
-				delete res;
-			}
+			rq.emplace_back(i.query, res, i.submitted);
+			NotifyParent();
 		}
 		else
 		{
@@ -580,24 +795,38 @@ void DispatcherThread::OnStart()
 		}
 	}
 	this->UnlockQueue();
+
+	// Release the per-thread state which the MySQL library allocated for us.
+	mysql_thread_end();
 }
 
-void DispatcherThread::OnNotify()
+void SQLConnection::OnNotify()
 {
-	// this could unlock during the dispatch, but OnResult isn't expected to take that long
+	// Take all of the available results at once so that the queue is not locked whilst they
+	// are being delivered.
+	ResultQueue results;
 	this->LockQueue();
-	for (const auto& item : Parent->rq)
+	results.swap(rq);
+	this->UnlockQueue();
+
+	for (const auto& item : results)
 	{
+		latency.add(insp::monotonic_ns() - item.submitted);
+
 		MySQLresult* res = item.result;
 		if (res->err.code == SQL::SUCCESS)
+		{
+			successes++;
 			item.query->OnResult(*res);
+		}
 		else
+		{
+			failures++;
 			item.query->OnError(res->err);
+		}
 		delete item.query;
 		delete item.result;
 	}
-	Parent->rq.clear();
-	this->UnlockQueue();
 }
 
 MODULE_INIT(ModuleSQL)
@@ -88,7 +88,15 @@ struct QueueItem
 {
 	SQL::Query* c;
 	std::string q;
+
+	/** If the query is a prepared statement then the values to bind to its parameters. */
+	std::optional<std::vector<SQL::Field>> params;
+
+	/** The name of the statement if it is currently being prepared. */
+	std::string preparing;
+
 	QueueItem(SQL::Query* C, const std::string& Q) : c(C), q(Q) {}
+	QueueItem(SQL::Query* C, const std::string& Q, const std::vector<SQL::Field>& P) : c(C), q(Q), params(P) {}
 };
 
 /** PgSQLresult is a subclass of the mostly-pure-virtual class SQLresult.
@@ -190,6 +198,7 @@ class SQLConn : public SQL::Provider, public EventHandler
 	PGconn* sql = nullptr; /* PgSQL database connection handle */
 	SQLstatus status = CWRITE; /* PgSQL database connection status */
 	QueueItem qinprog; /* If there is currently a query in progress */
+	std::unordered_map<std::string, std::string> statements; /* The names of the prepared statements keyed by their query */
 
 	SQLConn(Module* Creator, std::shared_ptr<ConfigTag> tag)
 		: SQL::Provider(Creator, tag->getString("id"))
@@ -345,7 +354,7 @@ restart:
 			{
 				/* Nothing happens here */
 			}
-			else if (qinprog.c)
+			else if (qinprog.c || !qinprog.preparing.empty())
 			{
 				/* Fetch the result.. */
 				PGresult* result = PQgetResult(sql);
@@ -362,6 +371,33 @@ restart:
 					result = temp;
 				}
 
+				if (!qinprog.preparing.empty())
+				{
+					/* This was the statement being prepared rather than the query itself. */
+					if (PQresultStatus(result) == PGRES_COMMAND_OK)
+					{
+						statements.emplace(qinprog.q, qinprog.preparing);
+						qinprog.preparing.clear();
+						PQclear(result);
+
+						QueueItem item = qinprog;
+						qinprog = QueueItem(NULL, "");
+						if (item.c)
+							DoQuery(item);
+						goto restart;
+					}
+
+					SQL::Error err(SQL::QSEND_FAIL, PQresultErrorMessage(result));
+					PQclear(result);
+					if (qinprog.c)
+					{
+						qinprog.c->OnError(err);
+						delete qinprog.c;
+					}
+					qinprog = QueueItem(NULL, "");
+					goto restart;
+				}
+
 				/* ..and the result */
 				PgSQLresult reply(result);
 				switch(PQresultStatus(result))
@@ -483,7 +519,59 @@ restart:
 		Submit(req, res);
 	}
 
-	void DoQuery(const QueueItem& req)
+	void SubmitPrepared(SQL::Query* req, const SQL::Statement& statement, const SQL::ValueList& values) override
+	{
+		// PostgreSQL uses numbered placeholders instead of question marks.
+		const std::string q = statement.GetQuery([](size_t idx) { return "$" + ConvToStr(idx + 1); });
+		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Executing PostgreSQL statement: " + q);
+
+		// Parameters are sent in the text format and their types are inferred by the server.
+		std::vector<SQL::Field> params;
+		params.reserve(values.size());
+		for (const auto& value : values)
+		{
+			if (std::holds_alternative<int64_t>(value))
+				params.push_back(ConvToStr(std::get<int64_t>(value)));
+			else if (std::holds_alternative<double>(value))
+				params.push_back(InspIRCd::Format("%.17g", std::get<double>(value)));
+			else if (std::holds_alternative<std::string>(value))
+				params.push_back(std::get<std::string>(value));
+			else
+				params.emplace_back();
+		}
+
+		QueueItem item(req, q, params);
+		if (qinprog.q.empty())
+			DoQuery(item);
+		else
+			queue.push_back(item);
+	}
+
+	bool SendQuery(QueueItem& req)
+	{
+		if (!req.params)
+			return PQsendQuery(sql, req.q.c_str());
+
+		auto it = statements.find(req.q);
+		if (it == statements.end())
+		{
+			// The statement has not been prepared on this connection yet. Once it has been
+			// prepared DoConnectedPoll will send this query again.
+			req.preparing = "inspircd_" + ConvToStr(statements.size() + 1);
+			return PQsendPrepare(sql, req.preparing.c_str(), req.q.c_str(), 0, NULL);
+		}
+
+		std::vector<const char*> values;
+		std::vector<int> lengths;
+		for (const auto& param : *req.params)
+		{
+			values.push_back(param ? param->c_str() : NULL);
+			lengths.push_back(param ? static_cast<int>(param->length()) : 0);
+		}
+		return PQsendQueryPrepared(sql, it->second.c_str(), static_cast<int>(values.size()), values.data(), lengths.data(), NULL, 0);
+	}
+
+	void DoQuery(QueueItem req)
 	{
 		if (status != WREAD && status != WWRITE)
 		{
@@ -494,7 +582,7 @@ restart:
 			return;
 		}
 
-		if(PQsendQuery(sql, req.q.c_str()))
+		if (SendQuery(req))
 		{
 			qinprog = req;
 		}
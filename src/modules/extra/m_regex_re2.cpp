@@ -31,12 +31,10 @@
 
 #include <re2/re2.h>
 
-class RE2Pattern final
-	: public Regex::Pattern
-{
- private:
-	RE2 regex;
+#include <re2/set.h>
 
+namespace
+{
 	RE2::Options BuildOptions(uint8_t options)
 	{
 		RE2::Options re2options;
@@ -44,6 +42,13 @@ class RE2Pattern final
 		re2options.set_log_errors(false);
 		return re2options;
 	}
+}
+
+class RE2Pattern final
+	: public Regex::Pattern
+{
+ private:
+	RE2 regex;
 
  public:
 	RE2Pattern(const std::string& pattern, uint8_t options)
@@ -60,15 +65,98 @@ class RE2Pattern final
 	}
 };
 
+class RE2PatternSet final
+	: public Regex::PatternSet
+{
+ private:
+	/** The amount of memory a compiled set may use. This is larger than the default for a
+	 * single pattern as sets usually contain hundreds of patterns.
+	 */
+	static constexpr int64_t MAX_MEMORY = 64 * 1024 * 1024;
+
+	/** The number of patterns which have been added to the set. */
+	size_t count = 0;
+
+	/** The indices of the patterns which matched the last text. */
+	std::vector<int> matches;
+
+	/** The underlying RE2 set. Patterns are anchored at both ends to match RE2Pattern::IsMatch. */
+	RE2::Set regexes;
+
+	static RE2::Options BuildSetOptions(uint8_t options)
+	{
+		RE2::Options re2options = BuildOptions(options);
+		re2options.set_max_mem(MAX_MEMORY);
+		return re2options;
+	}
+
+ public:
+	RE2PatternSet(uint8_t options)
+		: Regex::PatternSet(options)
+		, regexes(BuildSetOptions(options), RE2::ANCHOR_BOTH)
+	{
+	}
+
+	size_t Add(const Regex::PatternPtr& pattern) override
+	{
+		std::string error;
+		if (regexes.Add(pattern->GetPattern(), &error) < 0)
+			throw Regex::Exception(pattern->GetPattern(), error);
+		return count++;
+	}
+
+	void Compile() override
+	{
+		if (!regexes.Compile())
+			throw Regex::Exception("<set of " + ConvToStr(count) + " patterns>", "out of memory");
+	}
+
+	size_t FindFirst(const std::string& text, const std::function<bool(size_t)>& predicate) override
+	{
+		matches.clear();
+		if (!regexes.Match(text, &matches))
+			return Regex::NO_MATCH;
+
+		// RE2 returns the matches in an unspecified order.
+		std::sort(matches.begin(), matches.end());
+		for (int match : matches)
+		{
+			if (!predicate || predicate(match))
+				return match;
+		}
+		return Regex::NO_MATCH;
+	}
+};
+
+class RE2Engine final
+	: public Regex::Engine
+{
+ public:
+	RE2Engine(Module* Creator)
+		: Regex::Engine(Creator, "re2")
+	{
+	}
+
+	Regex::PatternPtr Create(const std::string& pattern, uint8_t options) override
+	{
+		return std::make_shared<RE2Pattern>(pattern, options);
+	}
+
+	Regex::PatternSetPtr CreateSet(uint8_t options) override
+	{
+		return std::make_unique<RE2PatternSet>(options);
+	}
+};
+
 class ModuleRegexRE2 : public Module
 {
  private:
-	Regex::SimpleEngine<RE2Pattern> regex;
+	RE2Engine regex;
 
  public:
 	ModuleRegexRE2()
 		: Module(VF_VENDOR, "Provides the re2 regular expression engine which uses the RE2 library.")
-		, regex(this, "re2")
+		, regex(this)
 	{
 	}
 };
@@ -36,6 +36,8 @@
 
 #include "inspircd.h"
 #include "modules/sql.h"
+#include "modules/stats.h"
+#include "utility/histogram.h"
 
 #include <sqlite3.h>
 
@@ -93,44 +95,210 @@ class SQLite3Result : public SQL::Result
 	}
 };
 
-class SQLConn : public SQL::Provider
+/** A query which has been submitted to a database. */
+struct QueryItem final
 {
-	sqlite3* conn;
-	std::shared_ptr<ConfigTag> config;
+	/** An object which handles the result of the query. */
+	SQL::Query* query;
+
+	/** The SQL query which is to be executed. */
+	std::string querystr;
+
+	/** The values to bind to the parameters of the query. */
+	SQL::ValueList values;
+
+	/** Whether the query is a prepared statement. Other queries have their values substituted
+	 * into them so they are rarely the same twice and are not cached.
+	 */
+	bool prepared;
+
+	/** The monotonic time in nanoseconds at which the query was submitted. */
+	uint64_t submitted;
+
+	/** The result of executing the query. */
+	SQLite3Result result;
+
+	/** The error which occurred when executing the query if it failed. */
+	std::optional<SQL::Error> error;
+
+	/** Whether the prepared statement for the query was found in the cache. */
+	bool cached = false;
+
+	QueryItem(SQL::Query* q, const std::string& s)
+		: query(q)
+		, querystr(s)
+		, prepared(false)
+		, submitted(insp::monotonic_ns())
+	{
+	}
+
+	QueryItem(SQL::Query* q, const SQL::Statement& statement, const SQL::ValueList& v)
+		: query(q)
+		, querystr(statement.GetQuery())
+		, values(v)
+		, prepared(true)
+		, submitted(insp::monotonic_ns())
+	{
+	}
+};
+
+typedef std::deque<std::unique_ptr<QueryItem>> QueryQueue;
+
+/** Caches prepared statements so that queries which are executed repeatedly only have to be
+ * compiled once. Only accessed from the worker thread of the database.
+ */
+class StatementCache final
+{
+ private:
+	typedef std::list<std::pair<std::string, sqlite3_stmt*>> StatementList;
+
+	/** The cached statements ordered from most to least recently used. */
+	StatementList statements;
+
+	/** The cached statements indexed by their query. */
+	std::unordered_map<std::string, StatementList::iterator> index;
+
+	/** The maximum number of statements to cache. */
+	const size_t maxsize;
 
  public:
-	SQLConn(Module* Parent, std::shared_ptr<ConfigTag> tag)
-		: SQL::Provider(Parent, tag->getString("id"))
-		, config(tag)
+	StatementCache(size_t size)
+		: maxsize(size)
 	{
-		std::string host = tag->getString("hostname");
-		if (sqlite3_open_v2(host.c_str(), &conn, SQLITE_OPEN_READWRITE, 0) != SQLITE_OK)
+	}
+
+	~StatementCache()
+	{
+		Clear();
+	}
+
+	void Clear()
+	{
+		for (const auto& [_, stmt] : statements)
+			sqlite3_finalize(stmt);
+		statements.clear();
+		index.clear();
+	}
+
+	/** Retrieves a prepared statement for a query, compiling it if it is not already cached.
+	 * @param conn The database to compile the statement for.
+	 * @param query The query to compile.
+	 * @param cacheable Whether the statement should be cached.
+	 * @param stmt The location to store the statement.
+	 * @param cached The location to store whether the statement was found in the cache.
+	 * @return The result of compiling the statement.
+	 */
+	int Get(sqlite3* conn, const std::string& query, bool cacheable, sqlite3_stmt*& stmt, bool& cached)
+	{
+		cached = false;
+		if (!cacheable || !maxsize)
+			return sqlite3_prepare_v2(conn, query.c_str(), static_cast<int>(query.length()), &stmt, NULL);
+
+		auto it = index.find(query);
+		if (it != index.end())
 		{
-			// Even in case of an error conn must be closed
-			sqlite3_close(conn);
-			conn = NULL;
-			ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "WARNING: Could not open DB with id: " + tag->getString("id"));
+			// Move the statement to the front so that it is evicted last.
+			statements.splice(statements.begin(), statements, it->second);
+			stmt = it->second->second;
+			cached = true;
+			return SQLITE_OK;
 		}
+
+		int err = sqlite3_prepare_v2(conn, query.c_str(), static_cast<int>(query.length()), &stmt, NULL);
+		if (err != SQLITE_OK)
+			return err;
+
+		if (statements.size() >= maxsize)
+		{
+			sqlite3_finalize(statements.back().second);
+			index.erase(statements.back().first);
+			statements.pop_back();
+		}
+		statements.emplace_front(query, stmt);
+		index.emplace(query, statements.begin());
+		return err;
 	}
 
-	~SQLConn() override
+	/** Releases a statement which was retrieved from this cache.
+	 * @param stmt The statement to release.
+	 * @param cacheable The value which was passed to Get() for the statement.
+	 */
+	void Release(sqlite3_stmt* stmt, bool cacheable)
 	{
-		if (conn)
+		if (cacheable && maxsize)
 		{
-			sqlite3_interrupt(conn);
-			sqlite3_close(conn);
+			sqlite3_reset(stmt);
+			sqlite3_clear_bindings(stmt);
+		}
+		else
+		{
+			sqlite3_finalize(stmt);
 		}
 	}
+};
+
+class SQLConn : public SQL::Provider, public SocketThread
+{
+ private:
+	sqlite3* conn;
+	std::shared_ptr<ConfigTag> config;
+
+	/** Prepared statements for queries which have been executed. */
+	StatementCache statements;
+
+	/** Queries which are waiting to be executed. Protected by the queue lock. */
+	QueryQueue pending;
+
+	/** Queries which have been executed but not delivered yet. Protected by the queue lock. */
+	QueryQueue completed;
+
+	/** Held by the worker thread whilst it is executing a query. */
+	std::mutex querylock;
 
-	void Query(SQL::Query* query, const std::string& q)
+	/** Whether the worker thread should exit. Protected by the queue lock. */
+	bool shutdown = false;
+
+	bool Bind(sqlite3_stmt* stmt, const SQL::ValueList& values)
+	{
+		for (size_t i = 0; i < values.size(); ++i)
+		{
+			// SQLite parameters are indexed from one.
+			const int index = static_cast<int>(i + 1);
+			const SQL::Value& value = values[i];
+
+			int err;
+			if (std::holds_alternative<int64_t>(value))
+				err = sqlite3_bind_int64(stmt, index, std::get<int64_t>(value));
+			else if (std::holds_alternative<double>(value))
+				err = sqlite3_bind_double(stmt, index, std::get<double>(value));
+			else if (std::holds_alternative<std::string>(value))
+			{
+				const std::string& str = std::get<std::string>(value);
+				err = sqlite3_bind_text(stmt, index, str.c_str(), static_cast<int>(str.length()), SQLITE_TRANSIENT);
+			}
+			else
+				err = sqlite3_bind_null(stmt, index);
+
+			if (err != SQLITE_OK)
+				return false;
+		}
+		return true;
+	}
+
+	void Query(QueryItem& item)
 	{
-		SQLite3Result res;
+		SQLite3Result& res = item.result;
 		sqlite3_stmt *stmt;
-		int err = sqlite3_prepare_v2(conn, q.c_str(), static_cast<int>(q.length()), &stmt, NULL);
+		int err = statements.Get(conn, item.querystr, item.prepared, stmt, item.cached);
 		if (err != SQLITE_OK)
 		{
-			SQL::Error error(SQL::QSEND_FAIL, sqlite3_errmsg(conn));
-			query->OnError(error);
+			item.error.emplace(SQL::QSEND_FAIL, sqlite3_errmsg(conn));
+			return;
+		}
+		if (!Bind(stmt, item.values))
+		{
+			item.error.emplace(SQL::QSEND_FAIL, sqlite3_errmsg(conn));
+			statements.Release(stmt, item.prepared);
 			return;
 		}
 		int cols = sqlite3_column_count(stmt);
@@ -157,24 +325,180 @@ class SQLConn : public SQL::Provider
 			}
 			else if (err == SQLITE_DONE)
 			{
-				query->OnResult(res);
 				break;
 			}
 			else
 			{
-				SQL::Error error(SQL::QREPLY_FAIL, sqlite3_errmsg(conn));
-				query->OnError(error);
+				item.error.emplace(SQL::QREPLY_FAIL, sqlite3_errmsg(conn));
 				break;
 			}
 		}
-		sqlite3_finalize(stmt);
+		statements.Release(stmt, item.prepared);
+	}
+
+	void OnStart() override
+	{
+		LockQueue();
+		while (!shutdown)
+		{
+			if (pending.empty())
+			{
+				WaitForQueue();
+				continue;
+			}
+
+			std::unique_ptr<QueryItem> item = std::move(pending.front());
+			pending.pop_front();
+			std::lock_guard<std::mutex> querylockguard(querylock);
+			UnlockQueue();
+
+			if (conn)
+				Query(*item);
+			else
+				item->error.emplace(SQL::BAD_CONN);
+
+			LockQueue();
+			completed.push_back(std::move(item));
+			NotifyParent();
+		}
+		UnlockQueue();
+	}
+
+ public:
+	/** The number of queries which have completed successfully. */
+	uint64_t successes = 0;
+
+	/** The number of queries which have failed. */
+	uint64_t failures = 0;
+
+	/** The number of queries whose prepared statement was found in the cache. */
+	uint64_t cachehits = 0;
+
+	/** The time between queries being submitted and their results being delivered in nanoseconds. */
+	insp::log2_histogram latency;
+
+	SQLConn(Module* Parent, std::shared_ptr<ConfigTag> tag)
+		: SQL::Provider(Parent, tag->getString("id"))
+		, config(tag)
+		, statements(tag->getUInt("statementcache", 32, 0, 10000))
+	{
+		std::string host = tag->getString("hostname");
+		if (sqlite3_open_v2(host.c_str(), &conn, SQLITE_OPEN_READWRITE, 0) != SQLITE_OK)
+		{
+			// Even in case of an error conn must be closed
+			sqlite3_close(conn);
+			conn = NULL;
+			ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "WARNING: Could not open DB with id: " + tag->getString("id"));
+		}
+		Start();
+	}
+
+	~SQLConn() override
+	{
+		if (conn)
+			sqlite3_interrupt(conn);
+
+		LockQueue();
+		shutdown = true;
+		UnlockQueueWakeup();
+		Stop();
+
+		// Deliver anything which has finished and fail anything which has not been started.
+		OnNotify();
+		SQL::Error err(SQL::BAD_DBID);
+		for (const auto& item : pending)
+		{
+			item->query->OnError(err);
+			delete item->query;
+		}
+
+		statements.Clear();
+		if (conn)
+			sqlite3_close(conn);
+	}
+
+	/** Retrieves the tag this database was configured from. */
+	const std::shared_ptr<ConfigTag>& GetConfig() const { return config; }
+
+	/** Retrieves the number of queries which are waiting to be executed. */
+	size_t GetQueueSize()
+	{
+		LockQueue();
+		size_t size = pending.size();
+		UnlockQueue();
+		return size;
+	}
+
+	/** Delivers the results of queries which have been executed. */
+	void OnNotify() override
+	{
+		QueryQueue results;
+		LockQueue();
+		results.swap(completed);
+		UnlockQueue();
+
+		for (const auto& item : results)
+		{
+			latency.add(insp::monotonic_ns() - item->submitted);
+			if (item->cached)
+				cachehits++;
+
+			if (item->error)
+			{
+				failures++;
+				item->query->OnError(*item->error);
+			}
+			else
+			{
+				successes++;
+				item->query->OnResult(item->result);
+			}
+			delete item->query;
+		}
+	}
+
+	/** Fails all queries from the specified module which have not been started and waits for
+	 * the query which is being executed to finish.
+	 * @param mod The module which is being unloaded.
+	 */
+	void OnUnloadModule(Module* mod)
+	{
+		SQL::Error err(SQL::BAD_DBID);
+		LockQueue();
+		for (QueryQueue::iterator it = pending.begin(); it != pending.end(); )
+		{
+			SQL::Query* query = (*it)->query;
+			if (query->creator == mod)
+			{
+				query->OnError(err);
+				delete query;
+				it = pending.erase(it);
+			}
+			else
+				++it;
+		}
+		UnlockQueue();
+
+		// The query being executed might be from the module so wait for it to finish.
+		querylock.lock();
+		querylock.unlock();
+		OnNotify();
 	}
 
 	void Submit(SQL::Query* query, const std::string& q) override
 	{
 		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Executing SQLite3 query: " + q);
-		Query(query, q);
-		delete query;
+		LockQueue();
+		pending.push_back(std::make_unique<QueryItem>(query, q));
+		UnlockQueueWakeup();
+	}
+
+	void SubmitPrepared(SQL::Query* query, const SQL::Statement& statement, const SQL::ValueList& values) override
+	{
+		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Executing SQLite3 statement: " + statement.GetQuery());
+		LockQueue();
+		pending.push_back(std::make_unique<QueryItem>(query, statement, values));
+		UnlockQueueWakeup();
 	}
 
 	void Submit(SQL::Query* query, const std::string& q, const SQL::ParamList& p) override
@@ -226,7 +550,7 @@ class SQLConn : public SQL::Provider
 	}
 };
 
-class ModuleSQLite3 : public Module
+class ModuleSQLite3 : public Module, public Stats::EventListener
 {
  private:
 	ConnMap conns;
@@ -234,6 +558,7 @@ class ModuleSQLite3 : public Module
  public:
 	ModuleSQLite3()
 		: Module(VF_VENDOR, "Provides the ability for SQL modules to query a SQLite 3 database.")
+		, Stats::EventListener(this)
 	{
 	}
 
@@ -254,17 +579,57 @@ class ModuleSQLite3 : public Module
 
 	void ReadConfig(ConfigStatus& status) override
 	{
-		ClearConns();
-
+		ConnMap newconns;
 		for (const auto& [_, tag] : ServerInstance->Config->ConfTags("database"))
 		{
 			if (!stdalgo::string::equalsci(tag->getString("module"), "sqlite"))
 				continue;
 
+			const std::string id = tag->getString("id");
+			ConnMap::iterator curr = conns.find(id);
+			if (curr != conns.end() && curr->second->GetConfig()->getString("hostname") == tag->getString("hostname")
+				&& curr->second->GetConfig()->getUInt("statementcache", 32) == tag->getUInt("statementcache", 32))
+			{
+				// The database has not changed so we can keep using the existing connection.
+				newconns.insert(*curr);
+				conns.erase(curr);
+				continue;
+			}
+
 			SQLConn* conn = new SQLConn(this, tag);
-			conns.emplace(tag->getString("id"), conn);
+			newconns.emplace(id, conn);
 			ServerInstance->Modules.AddService(*conn);
 		}
+
+		// Anything left in conns has been removed from the config.
+		ClearConns();
+		conns.swap(newconns);
+	}
+
+	void OnUnloadModule(Module* mod) override
+	{
+		for (const auto& [_, conn] : conns)
+			conn->OnUnloadModule(mod);
+	}
+
+	ModResult OnStats(Stats::Context& stats) override
+	{
+		if (stats.GetSymbol() != 'Q')
+			return MOD_RES_PASSTHRU;
+
+		for (const auto& [id, conn] : conns)
+		{
+			const std::string prefix = "SQLite " + id;
+			stats.AddRow(249, prefix + ": " + ConvToStr(conn->GetQueueSize()) + " queued, "
+				+ ConvToStr(conn->successes) + " succeeded, " + ConvToStr(conn->failures) + " failed, "
+				+ ConvToStr(conn->cachehits) + " statement cache hits");
+
+			// The latency is recorded in nanoseconds.
+			stats.AddRow(249, prefix + " latency: " + conn->latency.summarize(1000, "us"));
+		}
+
+		// Other SQL modules may also have databases to show.
+		return MOD_RES_PASSTHRU;
 	}
 };
 
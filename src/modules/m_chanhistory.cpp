@@ -27,60 +27,317 @@
 #include "modules/ircv3_servertime.h"
 #include "modules/ircv3_batch.h"
 #include "modules/server.h"
+#include "modules/stats.h"
 
-typedef insp::flat_map<std::string, std::string> HistoryTagMap;
+class HistoryList;
 
-struct HistoryItem
+/** Keeps track of the memory used by the history of every channel. */
+class HistoryStore final
 {
-	time_t ts;
+ private:
+	/** The interned source masks and the number of history lines which refer to each one. */
+	std::unordered_map<std::string, size_t> masks;
+
+ public:
+	typedef std::list<HistoryList*> LRUList;
+
+	/** The channel histories in the order they were last used in, most recent first. */
+	LRUList lru;
+
+	/** The approximate number of bytes used by all history lines. */
+	size_t memory = 0;
+
+	/** The maximum number of bytes which can be used by history lines or 0 for no limit. */
+	size_t maxmemory = 0;
+
+	/** The number of times a channel history was dropped to stay within maxmemory. */
+	uint64_t evictions = 0;
+
+	/** The number of times a history line was replayed using a previously built message. */
+	uint64_t cachehits = 0;
+
+	/** The number of times a history line had to be built into a message before it was replayed. */
+	uint64_t cachemisses = 0;
+
+	/** Interns a source mask.
+	 * @param mask The source mask to intern.
+	 * @return A pointer to the interned mask which remains valid until Release() is called for it.
+	 */
+	const std::string* Acquire(const std::string& mask)
+	{
+		auto [it, added] = masks.emplace(mask, 0);
+		if (added)
+			memory += sizeof(*it) + mask.length();
+		it->second++;
+		return &it->first;
+	}
+
+	/** Releases a source mask which was previously interned with Acquire().
+	 * @param mask The source mask to release.
+	 */
+	void Release(const std::string* mask)
+	{
+		auto it = masks.find(*mask);
+		if (--it->second)
+			return;
+
+		memory -= sizeof(*it) + mask->length();
+		masks.erase(it);
+	}
+
+	/** Retrieves the number of distinct source masks. */
+	size_t GetMaskCount() const { return masks.size(); }
+
+	/** Marks a channel history as recently used. */
+	void Touch(HistoryList* list);
+
+	/** Removes the cached messages from every channel history. */
+	void ClearCache();
+
+	/** Drops the least recently used channel histories until the memory used is within maxmemory.
+	 * @param keep A channel history which should not be dropped.
+	 */
+	void Trim(HistoryList* keep);
+};
+
+struct HistoryItem final
+{
+	/** The time at which the message was sent. */
+	time_t ts = 0;
+
+	/** The type of the message. */
+	MessageType type = MSG_PRIVMSG;
+
+	/** The source mask of the message. This is interned in the HistoryStore. */
+	const std::string* sourcemask = nullptr;
+
+	/** The text of the message. */
 	std::string text;
-	MessageType type;
-	HistoryTagMap tags;
-	std::string sourcemask;
 
-	HistoryItem(User* source, const MessageDetails& details)
+	/** The tags of the message stored as consecutive "name\0value\0" pairs. */
+	std::string tags;
+
+	/** The message which was built from this line when it was last replayed. This is kept so
+	 * that the serialized forms of it which are cached by the message can be reused.
+	 */
+	std::unique_ptr<ClientProtocol::Messages::Privmsg> msg;
+
+	HistoryItem() = default;
+
+	HistoryItem(HistoryStore& store, User* source, const MessageDetails& details)
 		: ts(ServerInstance->Time())
-		, text(details.text)
 		, type(details.type)
-		, sourcemask(source->GetFullHost())
+		, sourcemask(store.Acquire(source->GetFullHost()))
+		, text(details.text)
 	{
-		tags.reserve(details.tags_out.size());
 		for (const auto& [tagname, tagvalue] : details.tags_out)
-			tags[tagname] = tagvalue.value;
+		{
+			tags.append(tagname).push_back('\0');
+			tags.append(tagvalue.value).push_back('\0');
+		}
+	}
+
+	/** Retrieves the approximate number of bytes used by this line on top of its slot in the history. */
+	size_t GetMemory() const
+	{
+		size_t size = text.capacity() + tags.capacity();
+		if (msg)
+		{
+			// The message usually has one or two serialized forms of roughly this size.
+			size += sizeof(*msg) + 2 * (sourcemask->length() + text.length() + tags.length() + 64);
+		}
+		return size;
 	}
 };
 
-struct HistoryList
+/** The history of a channel. This is stored as a ring buffer which grows up to the maximum
+ * number of lines as messages are added.
+ */
+class HistoryList final
 {
-	std::deque<HistoryItem> lines;
+ private:
+	HistoryStore& store;
+
+	/** The slots of the ring buffer. */
+	std::vector<HistoryItem> items;
+
+	/** The index within items of the oldest line. */
+	size_t head = 0;
+
+	/** The number of lines in the history. */
+	size_t count = 0;
+
+	/** Changes the number of slots in the ring buffer, dropping the oldest lines if there are too many.
+	 * @param slots The new number of slots.
+	 */
+	void Resize(size_t slots)
+	{
+		while (count > slots)
+			PopFront();
+
+		// The cached message points into the text of the line it was built from so it has to
+		// be dropped when the line is moved to the new slots.
+		std::vector<HistoryItem> newitems(slots);
+		for (size_t idx = 0; idx < count; ++idx)
+		{
+			HistoryItem& item = At(idx);
+			store.memory -= item.GetMemory();
+			item.msg.reset();
+			newitems[idx] = std::move(item);
+			store.memory += newitems[idx].GetMemory();
+		}
+
+		store.memory -= items.size() * sizeof(HistoryItem);
+		store.memory += newitems.size() * sizeof(HistoryItem);
+		items.swap(newitems);
+		head = 0;
+	}
+
+ public:
+	/** The position of this history in HistoryStore::lru. */
+	HistoryStore::LRUList::iterator lrupos;
+
+	/** The batch reference which the cached messages were built with. */
+	std::string batchref;
+
 	unsigned long maxlen;
 	unsigned long maxtime;
 
-	HistoryList(unsigned long len, unsigned long time)
-		: maxlen(len)
+	HistoryList(HistoryStore& s, unsigned long len, unsigned long time)
+		: store(s)
+		, maxlen(len)
 		, maxtime(time)
 	{
+		store.lru.push_front(this);
+		lrupos = store.lru.begin();
+	}
+
+	~HistoryList()
+	{
+		Clear();
+		store.lru.erase(lrupos);
+	}
+
+	/** Retrieves the line at the specified index, oldest first. */
+	HistoryItem& At(size_t idx)
+	{
+		return items[(head + idx) % items.size()];
 	}
 
+	/** Removes all lines from the history and frees the ring buffer. */
+	void Clear()
+	{
+		Resize(0);
+	}
+
+	/** Removes the cached messages from all lines. */
+	void ClearCache()
+	{
+		for (size_t idx = 0; idx < count; ++idx)
+		{
+			HistoryItem& item = At(idx);
+			store.memory -= item.GetMemory();
+			item.msg.reset();
+			store.memory += item.GetMemory();
+		}
+	}
+
+	/** Retrieves the number of lines in the history. */
+	size_t GetCount() const { return count; }
+
+	/** Removes the oldest line from the history. */
+	void PopFront()
+	{
+		HistoryItem& item = At(0);
+		store.memory -= item.GetMemory();
+		store.Release(item.sourcemask);
+		item = HistoryItem();
+
+		head = (head + 1) % items.size();
+		count--;
+	}
+
+	/** Adds a line to the history, removing the oldest line if the history is full.
+	 * @param source The user who sent the message.
+	 * @param details The details of the message.
+	 */
+	void Push(User* source, const MessageDetails& details)
+	{
+		if (count >= maxlen)
+			PopFront();
+
+		if (count == items.size())
+			Resize(std::min<size_t>(maxlen, std::max<size_t>(count * 2, 4)));
+
+		HistoryItem& item = At(count);
+		item = HistoryItem(store, source, details);
+		store.memory += item.GetMemory();
+		count++;
+	}
+
+	/** Removes lines which are older than the maximum duration.
+	 * @return The number of lines remaining.
+	 */
 	size_t Prune()
 	{
 		// Prune expired entries from the list.
 		if (maxtime)
 		{
 			time_t mintime = ServerInstance->Time() - maxtime;
-			while (!lines.empty() && lines.front().ts < mintime)
-				lines.pop_front();
+			while (count && At(0).ts < mintime)
+				PopFront();
 		}
-		return lines.size();
+		return count;
+	}
+
+	/** Changes the maximum number of lines in the history.
+	 * @param len The new maximum number of lines.
+	 */
+	void SetMaxLen(unsigned long len)
+	{
+		maxlen = len;
+		if (items.size() > maxlen)
+			Resize(maxlen);
 	}
 };
 
+void HistoryStore::Touch(HistoryList* list)
+{
+	lru.splice(lru.begin(), lru, list->lrupos);
+}
+
+void HistoryStore::ClearCache()
+{
+	for (HistoryList* list : lru)
+		list->ClearCache();
+}
+
+void HistoryStore::Trim(HistoryList* keep)
+{
+	if (!maxmemory)
+		return;
+
+	for (LRUList::reverse_iterator it = lru.rbegin(); memory > maxmemory && it != lru.rend(); ++it)
+	{
+		HistoryList* list = *it;
+		if (list == keep || !list->GetCount())
+			continue;
+
+		list->Clear();
+		evictions++;
+	}
+}
+
 class HistoryMode : public ParamMode<HistoryMode, SimpleExtItem<HistoryList> >
 {
+ private:
+	HistoryStore& store;
+
  public:
 	unsigned long maxlines;
-	HistoryMode(Module* Creator)
+	HistoryMode(Module* Creator, HistoryStore& s)
 		: ParamMode<HistoryMode, SimpleExtItem<HistoryList> >(Creator, "history", 'H')
+		, store(s)
 	{
 		syntax = "<max-messages>:<max-duration>";
 	}
@@ -115,16 +372,13 @@ class HistoryMode : public ParamMode<HistoryMode, SimpleExtItem<HistoryList> >
 		if (history)
 		{
 			// Shrink the list if the new line number limit is lower than the old one
-			if (len < history->lines.size())
-				history->lines.erase(history->lines.begin(), history->lines.begin() + (history->lines.size() - len));
-
-			history->maxlen = len;
+			history->SetMaxLen(len);
 			history->maxtime = time;
 			history->Prune();
 		}
 		else
 		{
-			ext.Set(channel, len, time);
+			ext.Set(channel, store, len, time);
 		}
 		return MODEACTION_ALLOW;
 	}
@@ -140,8 +394,10 @@ class HistoryMode : public ParamMode<HistoryMode, SimpleExtItem<HistoryList> >
 class ModuleChanHistory
 	: public Module
 	, public ServerProtocol::BroadcastEventListener
+	, public Stats::EventListener
 {
  private:
+	HistoryStore store;
 	HistoryMode historymode;
 	SimpleUserMode nohistorymode;
 	bool prefixmsg;
@@ -167,6 +423,33 @@ class ModuleChanHistory
 		}
 	}
 
+	/** Builds the message which is sent to users when a history line is replayed.
+	 * @param channel The channel the line was sent to.
+	 * @param item The history line.
+	 */
+	void BuildMessage(Channel* channel, HistoryItem& item)
+	{
+		item.msg = std::make_unique<ClientProtocol::Messages::Privmsg>(ClientProtocol::Messages::Privmsg::nocopy, *item.sourcemask, channel, item.text, item.type);
+		ClientProtocol::Messages::Privmsg& msg = *item.msg;
+
+		for (size_t pos = 0; pos < item.tags.length(); )
+		{
+			const size_t namelen = item.tags.find('\0', pos) - pos;
+			std::string tagname(item.tags, pos, namelen);
+			pos += namelen + 1;
+
+			const size_t valuelen = item.tags.find('\0', pos) - pos;
+			std::string tagvalue(item.tags, pos, valuelen);
+			pos += valuelen + 1;
+
+			AddTag(msg, tagname, tagvalue);
+		}
+
+		if (servertimemanager)
+			servertimemanager->Set(msg, item.ts);
+		batch.AddToBatch(msg);
+	}
+
 	void SendHistory(LocalUser* user, Channel* channel, HistoryList* list)
 	{
 		if (batchmanager)
@@ -175,26 +458,44 @@ class ModuleChanHistory
 			batch.GetBatchStartMessage().PushParamRef(channel->name);
 		}
 
-		for (auto& item : list->lines)
+		// The cached messages contain the batch reference so they can only be reused if it is the same.
+		const std::string& batchref = batch.IsRunning() ? batch.GetRefTagStr() : "";
+		if (list->batchref != batchref)
+		{
+			list->ClearCache();
+			list->batchref = batchref;
+		}
+
+		for (size_t idx = 0; idx < list->GetCount(); ++idx)
 		{
-			ClientProtocol::Messages::Privmsg msg(ClientProtocol::Messages::Privmsg::nocopy, item.sourcemask, channel, item.text, item.type);
-			for (auto& [tagname, tagvalue] : item.tags)
-				AddTag(msg, tagname, tagvalue);
-			if (servertimemanager)
-				servertimemanager->Set(msg, item.ts);
-			batch.AddToBatch(msg);
-			user->Send(ServerInstance->GetRFCEvents().privmsg, msg);
+			HistoryItem& item = list->At(idx);
+			if (item.msg)
+			{
+				store.cachehits++;
+			}
+			else
+			{
+				store.cachemisses++;
+				store.memory -= item.GetMemory();
+				BuildMessage(channel, item);
+				store.memory += item.GetMemory();
+			}
+			user->Send(ServerInstance->GetRFCEvents().privmsg, *item.msg);
 		}
 
 		if (batchmanager)
 			batchmanager->End(batch);
+
+		store.Touch(list);
+		store.Trim(list);
 	}
 
  public:
 	ModuleChanHistory()
 		: Module(VF_VENDOR, "Adds channel mode H (history) which allows message history to be viewed on joining the channel.")
 		, ServerProtocol::BroadcastEventListener(this)
-		, historymode(this)
+		, Stats::EventListener(this)
+		, historymode(this, store)
 		, nohistorymode(this, "nohistory", 'N')
 		, botmode(this, "bot")
 		, batchcap(this)
@@ -209,10 +510,24 @@ class ModuleChanHistory
 	{
 		auto tag = ServerInstance->Config->ConfValue("chanhistory");
 		historymode.maxlines = tag->getUInt("maxlines", 50, 1);
+		store.maxmemory = tag->getUInt("maxmemory", 0);
+		store.Trim(nullptr);
 		prefixmsg = tag->getBool("prefixmsg", true);
 		dobots = tag->getBool("bots", true);
 	}
 
+	void OnLoadModule(Module* mod) override
+	{
+		// The new module may provide message tags which the cached messages do not have.
+		store.ClearCache();
+	}
+
+	void OnUnloadModule(Module* mod) override
+	{
+		// The cached messages refer to the message tag providers of other modules.
+		store.ClearCache();
+	}
+
 	ModResult OnBroadcastMessage(Channel* channel, const Server* server) override
 	{
 		return channel->IsModeSet(historymode) ? MOD_RES_ALLOW : MOD_RES_PASSTHRU;
@@ -231,9 +546,9 @@ class ModuleChanHistory
 		if (!list)
 			return;
 
-		list->lines.emplace_back(user, details);
-		if (list->lines.size() > list->maxlen)
-			list->lines.pop_front();
+		list->Push(user, details);
+		store.Touch(list);
+		store.Trim(list);
 	}
 
 	void OnPostJoin(Membership* memb) override
@@ -262,6 +577,28 @@ class ModuleChanHistory
 
 		SendHistory(localuser, memb->chan, list);
 	}
+
+	ModResult OnStats(Stats::Context& stats) override
+	{
+		if (stats.GetSymbol() != 'h')
+			return MOD_RES_PASSTHRU;
+
+		size_t lines = 0;
+		size_t channels = 0;
+		for (HistoryList* list : store.lru)
+		{
+			lines += list->GetCount();
+			if (list->GetCount())
+				channels++;
+		}
+
+		stats.AddRow(249, "Channel history: " + ConvToStr(lines) + " lines in " + ConvToStr(channels) + " of " + ConvToStr(store.lru.size())
+			+ " channels with " + ConvToStr(store.GetMaskCount()) + " distinct source masks");
+		stats.AddRow(249, "Channel history: using " + ConvToStr(store.memory) + " bytes of "
+			+ (store.maxmemory ? ConvToStr(store.maxmemory) : "unlimited") + ", " + ConvToStr(store.evictions) + " channels dropped to stay within the limit");
+		stats.AddRow(249, "Channel history: " + ConvToStr(store.cachehits) + " lines replayed from cache, " + ConvToStr(store.cachemisses) + " lines built");
+		return MOD_RES_DENY;
+	}
 };
 
 MODULE_INIT(ModuleChanHistory)
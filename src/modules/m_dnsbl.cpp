@@ -30,6 +30,7 @@
 #include "xline.h"
 #include "modules/dns.h"
 #include "modules/stats.h"
+#include "utility/histogram.h"
 
 class DNSBLEntry final
 {
@@ -100,6 +101,12 @@ public:
 	// The number of misses which have occurred when querying this DNSBL.
 	unsigned long stats_misses = 0;
 
+	// The number of results which were taken from the cache instead of querying this DNSBL.
+	unsigned long stats_cached = 0;
+
+	// The time taken for this DNSBL to answer queries in nanoseconds.
+	insp::log2_histogram latency;
+
 	// If action is set to gline, kline, or zline then the duration for an X-line to last for.
 	unsigned long xlineduration;
 
@@ -156,237 +163,393 @@ public:
 	}
 };
 
+typedef std::vector<std::shared_ptr<DNSBLEntry>> DNSBLConfList;
+
+/** Remembers the results of recent DNSBL lookups so that repeat connections from the same
+ * address (or network) do not have to be looked up again.
+ */
+class DNSBLCache final
+{
+ public:
+	/** The result of looking up an address in a DNSBL. */
+	struct Verdict final
+	{
+		/** The last octet of the address returned by the DNSBL or -1 if it is not listed. */
+		int result;
+
+		/** The time at which this verdict expires. */
+		time_t expires;
+	};
+
+ private:
+	typedef std::list<std::pair<std::string, Verdict>> VerdictList;
+
+	/** The verdicts in the order they were added in, oldest first. */
+	VerdictList verdicts;
+
+	/** The verdicts keyed by DNSBL domain and address. */
+	std::unordered_map<std::string, VerdictList::iterator> index;
+
+	std::string GetKey(const DNSBLEntry& entry, const irc::sockets::sockaddrs& sa) const
+	{
+		const unsigned char prefix = sa.family() == AF_INET6 ? ipv6prefix : ipv4prefix;
+		return entry.domain + " " + irc::sockets::cidr_mask(sa, prefix).str();
+	}
+
+ public:
+	/** The number of bits of an IPv4 address which verdicts are shared between. */
+	unsigned char ipv4prefix = 32;
+
+	/** The number of bits of an IPv6 address which verdicts are shared between. */
+	unsigned char ipv6prefix = 128;
+
+	/** The maximum number of verdicts to store. If this is 0 then no verdicts are stored. */
+	size_t maxentries = 0;
+
+	/** The maximum number of seconds to store a listed verdict for. */
+	unsigned long maxttl = 0;
+
+	/** The number of seconds to store a not listed verdict for. */
+	unsigned long missttl = 0;
+
+	/** Adds a verdict to the cache.
+	 * @param entry The DNSBL which the address was looked up in.
+	 * @param sa The address which was looked up.
+	 * @param result The last octet of the address returned by the DNSBL or -1 if it is not listed.
+	 * @param ttl The number of seconds the DNSBL says the verdict is valid for.
+	 */
+	void Add(const DNSBLEntry& entry, const irc::sockets::sockaddrs& sa, int result, unsigned long ttl)
+	{
+		ttl = std::min(ttl, result < 0 ? missttl : maxttl);
+		if (!maxentries || !ttl)
+			return;
+
+		const std::string key = GetKey(entry, sa);
+		auto it = index.find(key);
+		if (it != index.end())
+		{
+			verdicts.erase(it->second);
+			index.erase(it);
+		}
+
+		// Remove the oldest verdicts to make room for this one.
+		while (verdicts.size() >= maxentries)
+		{
+			index.erase(verdicts.front().first);
+			verdicts.pop_front();
+		}
+
+		verdicts.emplace_back(key, Verdict { result, ServerInstance->Time() + static_cast<time_t>(ttl) });
+		index[key] = std::prev(verdicts.end());
+	}
+
+	/** Removes all verdicts from the cache. */
+	void Clear()
+	{
+		verdicts.clear();
+		index.clear();
+	}
+
+	/** Finds the verdict for an address.
+	 * @param entry The DNSBL to find a verdict from.
+	 * @param sa The address to find a verdict for.
+	 * @return The verdict if one exists and has not expired; otherwise, nullptr.
+	 */
+	const Verdict* Find(const DNSBLEntry& entry, const irc::sockets::sockaddrs& sa)
+	{
+		auto it = index.find(GetKey(entry, sa));
+		if (it == index.end())
+			return nullptr;
+
+		if (it->second->second.expires <= ServerInstance->Time())
+		{
+			verdicts.erase(it->second);
+			index.erase(it);
+			return nullptr;
+		}
+		return &it->second->second;
+	}
+
+	/** Retrieves the number of verdicts in the cache. */
+	size_t GetCount() const { return verdicts.size(); }
+
+	/** Trims the cache to its maximum size. */
+	void Trim()
+	{
+		while (verdicts.size() > maxentries)
+		{
+			index.erase(verdicts.front().first);
+			verdicts.pop_front();
+		}
+	}
+};
+
+class ModuleDNSBL;
+
 class DNSBLResolver : public DNS::Request
 {
  private:
+	ModuleDNSBL* mod;
 	irc::sockets::sockaddrs theirsa;
 	std::string theiruid;
-	StringExtItem& nameExt;
-	IntExtItem& countExt;
 	std::shared_ptr<DNSBLEntry> ConfEntry;
 
+	/** The monotonic time in nanoseconds at which the lookup was started. */
+	uint64_t started;
+
  public:
-	DNSBLResolver(DNS::Manager *mgr, Module *me, StringExtItem& match, IntExtItem& ctr, const std::string &hostname, LocalUser* u, std::shared_ptr<DNSBLEntry> conf)
-		: DNS::Request(mgr, me, hostname, DNS::QUERY_A, true, conf->timeout)
-		, theirsa(u->client_sa)
-		, theiruid(u->uuid)
-		, nameExt(match)
-		, countExt(ctr)
-		, ConfEntry(conf)
-	{
-	}
+	DNSBLResolver(DNS::Manager *mgr, ModuleDNSBL* me, const std::string &hostname, LocalUser* u, std::shared_ptr<DNSBLEntry> conf);
 
 	/* Note: This may be called multiple times for multiple A record results */
-	void OnLookupComplete(const DNS::Query *r) override
+	void OnLookupComplete(const DNS::Query *r) override;
+
+	void OnError(const DNS::Query *q) override;
+};
+
+class ModuleDNSBL : public Module, public Stats::EventListener
+{
+	DNSBLConfList DNSBLConfEntries;
+	dynamic_reference<DNS::Manager> DNS;
+	StringExtItem nameExt;
+	IntExtItem countExt;
+
+	/** The DNSBLs which will be looked up once the pending lookups for a user have completed. */
+	SimpleExtItem<DNSBLConfList> deferExt;
+
+	/** Whether to only look up DNSBLs which mark users once no DNSBL which bans users has matched. */
+	bool stoponban;
+
+	/** Looks up a user in the specified DNSBLs.
+	 * @param user The user to look up.
+	 * @param entries The DNSBLs to look the user up in.
+	 */
+	void Lookup(LocalUser* user, const DNSBLConfList& entries)
 	{
-		/* Check the user still exists */
-		LocalUser* them = IS_LOCAL(ServerInstance->Users.FindUUID(theiruid));
-		if (!them || them->client_sa != theirsa)
+		std::string reversedip;
+		if (user->client_sa.family() == AF_INET)
 		{
-			ConfEntry->stats_misses++;
-			return;
+			unsigned int a, b, c, d;
+			d = (unsigned int) (user->client_sa.in4.sin_addr.s_addr >> 24) & 0xFF;
+			c = (unsigned int) (user->client_sa.in4.sin_addr.s_addr >> 16) & 0xFF;
+			b = (unsigned int) (user->client_sa.in4.sin_addr.s_addr >> 8) & 0xFF;
+			a = (unsigned int) user->client_sa.in4.sin_addr.s_addr & 0xFF;
+
+			reversedip = ConvToStr(d) + "." + ConvToStr(c) + "." + ConvToStr(b) + "." + ConvToStr(a);
 		}
+		else if (user->client_sa.family() == AF_INET6)
+		{
+			const unsigned char* ip = user->client_sa.in6.sin6_addr.s6_addr;
 
-		intptr_t i = countExt.Get(them);
-		if (i)
-			countExt.Set(them, i - 1);
+			const std::string buf = Hex::Encode(ip, 16);
+			for (const auto& chr : insp::reverse_range(buf))
+			{
+				reversedip.push_back(chr);
+				reversedip.push_back('.');
+			}
+			reversedip.erase(reversedip.length() - 1, 1);
+		}
+		else
+			return;
 
-		// The DNSBL reply must contain an A result.
-		const DNS::ResourceRecord* const ans_record = r->FindAnswerOfType(DNS::QUERY_A);
-		if (!ans_record)
+		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Reversed IP %s -> %s", user->GetIPString().c_str(), reversedip.c_str());
+
+		countExt.Set(user, entries.size());
+
+		// For each DNSBL, we will run through this lookup
+		for (const auto& entry : entries)
 		{
-			ConfEntry->stats_errors++;
-			ServerInstance->SNO.WriteGlobalSno('d', "%s returned an result with no IPv4 address.",
-				ConfEntry->name.c_str());
-			return;
+			// Use the verdict from a recent lookup of the same address if there is one.
+			const DNSBLCache::Verdict* verdict = cache.Find(*entry, user->client_sa);
+			if (verdict)
+			{
+				entry->stats_cached++;
+				if (verdict->result < 0)
+					entry->stats_misses++;
+				else
+					OnResult(user, *entry, verdict->result);
+				Complete(user);
+			}
+			else
+			{
+				// Fill hostname with a dnsbl style host (d.c.b.a.domain.tld)
+				std::string hostname = reversedip + "." + entry->domain;
+
+				/* now we'd need to fire off lookups for `hostname'. */
+				DNSBLResolver *r = new DNSBLResolver(*this->DNS, this, hostname, user, entry);
+				try
+				{
+					this->DNS->Process(r);
+				}
+				catch (DNS::Exception &ex)
+				{
+					delete r;
+					ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, ex.GetReason());
+					Complete(user);
+				}
+			}
+
+			if (user->quitting)
+				break;
 		}
+	}
 
-		// The DNSBL reply must be a valid IPv4 address.
-		in_addr resultip;
-		if (inet_pton(AF_INET, ans_record->rdata.c_str(), &resultip) != 1)
-		{
-			ConfEntry->stats_errors++;
-			ServerInstance->SNO.WriteGlobalSno('d', "%s returned an invalid IPv4 address: %s",
-				ConfEntry->name.c_str(), ans_record->rdata.c_str());
+ public:
+	DNSBLCache cache;
+
+	ModuleDNSBL()
+		: Module(VF_VENDOR, "Allows the server administrator to check the IP address of connecting users against a DNSBL.")
+		, Stats::EventListener(this)
+		, DNS(this, "DNS")
+		, nameExt(this, "dnsbl_match", ExtensionItem::EXT_USER)
+		, countExt(this, "dnsbl_pending", ExtensionItem::EXT_USER)
+		, deferExt(this, "dnsbl_deferred", ExtensionItem::EXT_USER)
+	{
+	}
+
+	/** Called when a lookup for a user has finished. Starts the deferred lookups if this was
+	 * the last pending one.
+	 * @param them The user who was looked up.
+	 */
+	void Complete(LocalUser* them)
+	{
+		intptr_t i = countExt.Get(them);
+		if (i)
+			countExt.Set(them, --i);
+
+		if (i || them->quitting)
 			return;
-		}
 
-		// The DNSBL reply should be in the 127.0.0.0/8 range.
-		if ((resultip.s_addr & 0xFF) != 127)
+		DNSBLConfList* deferred = deferExt.Get(them);
+		if (deferred)
 		{
-			ConfEntry->stats_errors++;
-			ServerInstance->SNO.WriteGlobalSno('d', "%s returned an IPv4 address which is outside of the 127.0.0.0/8 subnet: %s",
-				ConfEntry->name.c_str(), ans_record->rdata.c_str());
-			return;
+			const DNSBLConfList entries = *deferred;
+			deferExt.Unset(them, false);
+			Lookup(them, entries);
 		}
+	}
 
+	/** Called when a DNSBL has returned a result for a user.
+	 * @param them The user who was looked up.
+	 * @param entry The DNSBL which returned the result.
+	 * @param result The last octet of the address returned by the DNSBL.
+	 */
+	void OnResult(LocalUser* them, DNSBLEntry& entry, unsigned int result)
+	{
 		bool match = false;
-		unsigned int result = 0;
-		switch (ConfEntry->type)
+		switch (entry.type)
 		{
 			case DNSBLEntry::Type::BITMASK:
 			{
-				result = (resultip.s_addr >> 24) & ConfEntry->bitmask;
+				result &= entry.bitmask;
 				match = (result != 0);
 				break;
 			}
 			case DNSBLEntry::Type::RECORD:
 			{
-				result = resultip.s_addr >> 24;
-				match = (ConfEntry->records[result] == 1);
+				match = (entry.records[result] == 1);
 				break;
 			}
 		}
 
-		if (match)
+		if (!match)
 		{
-			std::string reason = ConfEntry->reason;
-			std::string::size_type x = reason.find("%ip%");
-			while (x != std::string::npos)
+			entry.stats_misses++;
+			return;
+		}
+
+		std::string reason = entry.reason;
+		std::string::size_type x = reason.find("%ip%");
+		while (x != std::string::npos)
+		{
+			reason.erase(x, 4);
+			reason.insert(x, them->GetIPString());
+			x = reason.find("%ip%");
+		}
+
+		entry.stats_hits++;
+
+		switch (entry.action)
+		{
+			case DNSBLEntry::Action::KILL:
 			{
-				reason.erase(x, 4);
-				reason.insert(x, them->GetIPString());
-				x = reason.find("%ip%");
+				ServerInstance->Users.QuitUser(them, "Killed (" + reason + ")");
+				break;
 			}
+			case DNSBLEntry::Action::MARK:
+			{
+				if (!entry.markident.empty())
+				{
+					them->WriteNotice("Your ident has been set to " + entry.markident + " because you matched " + reason);
+					them->ChangeIdent(entry.markident);
+				}
 
-			ConfEntry->stats_hits++;
+				if (!entry.markhost.empty())
+				{
+					them->WriteNotice("Your host has been set to " + entry.markhost + " because you matched " + reason);
+					them->ChangeDisplayedHost(entry.markhost);
+				}
 
-			switch (ConfEntry->action)
+				nameExt.Set(them, entry.name);
+				break;
+			}
+			case DNSBLEntry::Action::KLINE:
 			{
-				case DNSBLEntry::Action::KILL:
+				KLine* kl = new KLine(ServerInstance->Time(), entry.xlineduration, ServerInstance->Config->ServerName.c_str(), reason.c_str(),
+						"*", them->GetIPString());
+				if (ServerInstance->XLines->AddLine(kl,NULL))
 				{
-					ServerInstance->Users.QuitUser(them, "Killed (" + reason + ")");
-					break;
+					ServerInstance->SNO.WriteToSnoMask('x', "K-line added due to DNSBL match on *@%s to expire in %s (on %s): %s",
+						them->GetIPString().c_str(), InspIRCd::DurationString(kl->duration).c_str(),
+						InspIRCd::TimeString(kl->expiry).c_str(), reason.c_str());
+					ServerInstance->XLines->ApplyLines();
 				}
-				case DNSBLEntry::Action::MARK:
+				else
 				{
-					if (!ConfEntry->markident.empty())
-					{
-						them->WriteNotice("Your ident has been set to " + ConfEntry->markident + " because you matched " + reason);
-						them->ChangeIdent(ConfEntry->markident);
-					}
-
-					if (!ConfEntry->markhost.empty())
-					{
-						them->WriteNotice("Your host has been set to " + ConfEntry->markhost + " because you matched " + reason);
-						them->ChangeDisplayedHost(ConfEntry->markhost);
-					}
-
-					nameExt.Set(them, ConfEntry->name);
-					break;
+					delete kl;
+					return;
 				}
-				case DNSBLEntry::Action::KLINE:
+				break;
+			}
+			case DNSBLEntry::Action::GLINE:
+			{
+				GLine* gl = new GLine(ServerInstance->Time(), entry.xlineduration, ServerInstance->Config->ServerName.c_str(), reason.c_str(),
+						"*", them->GetIPString());
+				if (ServerInstance->XLines->AddLine(gl,NULL))
 				{
-					KLine* kl = new KLine(ServerInstance->Time(), ConfEntry->xlineduration, ServerInstance->Config->ServerName.c_str(), reason.c_str(),
-							"*", them->GetIPString());
-					if (ServerInstance->XLines->AddLine(kl,NULL))
-					{
-						ServerInstance->SNO.WriteToSnoMask('x', "K-line added due to DNSBL match on *@%s to expire in %s (on %s): %s",
-							them->GetIPString().c_str(), InspIRCd::DurationString(kl->duration).c_str(),
-							InspIRCd::TimeString(kl->expiry).c_str(), reason.c_str());
-						ServerInstance->XLines->ApplyLines();
-					}
-					else
-					{
-						delete kl;
-						return;
-					}
-					break;
+					ServerInstance->SNO.WriteToSnoMask('x', "G-line added due to DNSBL match on *@%s to expire in %s (on %s): %s",
+						them->GetIPString().c_str(), InspIRCd::DurationString(gl->duration).c_str(),
+						InspIRCd::TimeString(gl->expiry).c_str(), reason.c_str());
+					ServerInstance->XLines->ApplyLines();
 				}
-				case DNSBLEntry::Action::GLINE:
+				else
 				{
-					GLine* gl = new GLine(ServerInstance->Time(), ConfEntry->xlineduration, ServerInstance->Config->ServerName.c_str(), reason.c_str(),
-							"*", them->GetIPString());
-					if (ServerInstance->XLines->AddLine(gl,NULL))
-					{
-						ServerInstance->SNO.WriteToSnoMask('x', "G-line added due to DNSBL match on *@%s to expire in %s (on %s): %s",
-							them->GetIPString().c_str(), InspIRCd::DurationString(gl->duration).c_str(),
-							InspIRCd::TimeString(gl->expiry).c_str(), reason.c_str());
-						ServerInstance->XLines->ApplyLines();
-					}
-					else
-					{
-						delete gl;
-						return;
-					}
-					break;
+					delete gl;
+					return;
 				}
-				case DNSBLEntry::Action::ZLINE:
+				break;
+			}
+			case DNSBLEntry::Action::ZLINE:
+			{
+				ZLine* zl = new ZLine(ServerInstance->Time(), entry.xlineduration, ServerInstance->Config->ServerName.c_str(), reason.c_str(),
+						them->GetIPString());
+				if (ServerInstance->XLines->AddLine(zl,NULL))
 				{
-					ZLine* zl = new ZLine(ServerInstance->Time(), ConfEntry->xlineduration, ServerInstance->Config->ServerName.c_str(), reason.c_str(),
-							them->GetIPString());
-					if (ServerInstance->XLines->AddLine(zl,NULL))
-					{
-						ServerInstance->SNO.WriteToSnoMask('x', "Z-line added due to DNSBL match on %s to expire in %s (on %s): %s",
-							them->GetIPString().c_str(), InspIRCd::DurationString(zl->duration).c_str(),
-							InspIRCd::TimeString(zl->expiry).c_str(), reason.c_str());
-						ServerInstance->XLines->ApplyLines();
-					}
-					else
-					{
-						delete zl;
-						return;
-					}
-					break;
+					ServerInstance->SNO.WriteToSnoMask('x', "Z-line added due to DNSBL match on %s to expire in %s (on %s): %s",
+						them->GetIPString().c_str(), InspIRCd::DurationString(zl->duration).c_str(),
+						InspIRCd::TimeString(zl->expiry).c_str(), reason.c_str());
+					ServerInstance->XLines->ApplyLines();
+				}
+				else
+				{
+					delete zl;
+					return;
 				}
-			}
-
-			ServerInstance->SNO.WriteGlobalSno('d', "Connecting user %s (%s) detected as being on the '%s' DNS blacklist with result %d",
-				them->GetFullRealHost().c_str(), them->GetIPString().c_str(), ConfEntry->name.c_str(), result);
-		}
-		else
-			ConfEntry->stats_misses++;
-	}
-
-	void OnError(const DNS::Query *q) override
-	{
-		bool is_miss = true;
-		switch (q->error)
-		{
-			case DNS::ERROR_NO_RECORDS:
-			case DNS::ERROR_DOMAIN_NOT_FOUND:
-				ConfEntry->stats_misses++;
-				break;
-
-			default:
-				ConfEntry->stats_errors++;
-				is_miss = false;
 				break;
+			}
 		}
 
-		LocalUser* them = IS_LOCAL(ServerInstance->Users.FindUUID(theiruid));
-		if (!them || them->client_sa != theirsa)
-			return;
-
-		intptr_t i = countExt.Get(them);
-		if (i)
-			countExt.Set(them, i - 1);
-
-		if (is_miss)
-			return;
-
-		ServerInstance->SNO.WriteGlobalSno('d', "An error occurred whilst checking whether %s (%s) is on the '%s' DNS blacklist: %s",
-			them->GetFullRealHost().c_str(), them->GetIPString().c_str(), ConfEntry->name.c_str(), this->manager->GetErrorStr(q->error).c_str());
-	}
-};
-
-typedef std::vector<std::shared_ptr<DNSBLEntry>> DNSBLConfList;
-
-class ModuleDNSBL : public Module, public Stats::EventListener
-{
-	DNSBLConfList DNSBLConfEntries;
-	dynamic_reference<DNS::Manager> DNS;
-	StringExtItem nameExt;
-	IntExtItem countExt;
-
- public:
-	ModuleDNSBL()
-		: Module(VF_VENDOR, "Allows the server administrator to check the IP address of connecting users against a DNSBL.")
-		, Stats::EventListener(this)
-		, DNS(this, "DNS")
-		, nameExt(this, "dnsbl_match", ExtensionItem::EXT_USER)
-		, countExt(this, "dnsbl_pending", ExtensionItem::EXT_USER)
-	{
+		ServerInstance->SNO.WriteGlobalSno('d', "Connecting user %s (%s) detected as being on the '%s' DNS blacklist with result %d",
+			them->GetFullRealHost().c_str(), them->GetIPString().c_str(), entry.name.c_str(), result);
 	}
 
 	void init() override
@@ -409,6 +572,20 @@ class ModuleDNSBL : public Module, public Stats::EventListener
 			newentries.push_back(entry);
 		}
 
+		auto tag = ServerInstance->Config->ConfValue("dnsblconfig");
+		const unsigned char ipv4prefix = static_cast<unsigned char>(tag->getUInt("ipv4prefix", 32, 8, 32));
+		const unsigned char ipv6prefix = static_cast<unsigned char>(tag->getUInt("ipv6prefix", 128, 16, 128));
+		if (ipv4prefix != cache.ipv4prefix || ipv6prefix != cache.ipv6prefix)
+			cache.Clear();
+
+		cache.ipv4prefix = ipv4prefix;
+		cache.ipv6prefix = ipv6prefix;
+		cache.maxentries = tag->getUInt("cachesize", 10000);
+		cache.maxttl = tag->getDuration("cachettl", 60*60);
+		cache.missttl = tag->getDuration("missttl", 15*60);
+		cache.Trim();
+		stoponban = tag->getBool("stoponban");
+
 		DNSBLConfEntries.swap(newentries);
 	}
 
@@ -424,57 +601,32 @@ class ModuleDNSBL : public Module, public Stats::EventListener
 		if (!user->GetClass()->config->getBool("usednsbl", true))
 			return;
 
-		std::string reversedip;
-		if (user->client_sa.family() == AF_INET)
+		if (!stoponban)
 		{
-			unsigned int a, b, c, d;
-			d = (unsigned int) (user->client_sa.in4.sin_addr.s_addr >> 24) & 0xFF;
-			c = (unsigned int) (user->client_sa.in4.sin_addr.s_addr >> 16) & 0xFF;
-			b = (unsigned int) (user->client_sa.in4.sin_addr.s_addr >> 8) & 0xFF;
-			a = (unsigned int) user->client_sa.in4.sin_addr.s_addr & 0xFF;
-
-			reversedip = ConvToStr(d) + "." + ConvToStr(c) + "." + ConvToStr(b) + "." + ConvToStr(a);
+			Lookup(user, DNSBLConfEntries);
+			return;
 		}
-		else if (user->client_sa.family() == AF_INET6)
-		{
-			const unsigned char* ip = user->client_sa.in6.sin6_addr.s6_addr;
 
-			const std::string buf = Hex::Encode(ip, 16);
-			for (const auto& chr : insp::reverse_range(buf))
-			{
-				reversedip.push_back(chr);
-				reversedip.push_back('.');
-			}
-			reversedip.erase(reversedip.length() - 1, 1);
+		// Only look up the DNSBLs which mark users if none of the ones which ban users match.
+		DNSBLConfList bans;
+		DNSBLConfList marks;
+		for (const auto& entry : DNSBLConfEntries)
+		{
+			if (entry->action == DNSBLEntry::Action::MARK)
+				marks.push_back(entry);
+			else
+				bans.push_back(entry);
 		}
-		else
-			return;
-
-		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Reversed IP %s -> %s", user->GetIPString().c_str(), reversedip.c_str());
-
-		countExt.Set(user, DNSBLConfEntries.size());
 
-		// For each DNSBL, we will run through this lookup
-		for (unsigned i = 0; i < DNSBLConfEntries.size(); ++i)
+		if (bans.empty())
 		{
-			// Fill hostname with a dnsbl style host (d.c.b.a.domain.tld)
-			std::string hostname = reversedip + "." + DNSBLConfEntries[i]->domain;
-
-			/* now we'd need to fire off lookups for `hostname'. */
-			DNSBLResolver *r = new DNSBLResolver(*this->DNS, this, nameExt, countExt, hostname, user, DNSBLConfEntries[i]);
-			try
-			{
-				this->DNS->Process(r);
-			}
-			catch (DNS::Exception &ex)
-			{
-				delete r;
-				ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, ex.GetReason());
-			}
-
-			if (user->quitting)
-				break;
+			Lookup(user, marks);
+			return;
 		}
+
+		if (!marks.empty())
+			deferExt.Set(user, new DNSBLConfList(marks), false);
+		Lookup(user, bans);
 	}
 
 	ModResult OnSetConnectClass(LocalUser* user, std::shared_ptr<ConnectClass> myclass) override
@@ -516,21 +668,126 @@ class ModuleDNSBL : public Module, public Stats::EventListener
 		unsigned long total_hits = 0;
 		unsigned long total_misses = 0;
 		unsigned long total_errors = 0;
+		unsigned long total_cached = 0;
 		for (const auto& e : DNSBLConfEntries)
 		{
 			total_hits += e->stats_hits;
 			total_misses += e->stats_misses;
 			total_errors += e->stats_errors;
+			total_cached += e->stats_cached;
 
-			stats.AddRow(304, InspIRCd::Format("DNSBLSTATS \"%s\" had %lu hits, %lu misses, and %lu errors",
-				e->name.c_str(), e->stats_hits, e->stats_misses, e->stats_errors));
+			const unsigned long total = e->stats_hits + e->stats_misses + e->stats_errors;
+			const unsigned long hitrate = total ? e->stats_hits * 100 / total : 0;
+			stats.AddRow(304, InspIRCd::Format("DNSBLSTATS \"%s\" had %lu hits, %lu misses, and %lu errors (%lu%% hit rate, %lu from cache)",
+				e->name.c_str(), e->stats_hits, e->stats_misses, e->stats_errors, hitrate, e->stats_cached));
+
+			stats.AddRow(304, "DNSBLSTATS \"" + e->name + "\" latency: " + e->latency.summarize(1000, "us"));
 		}
 
 		stats.AddRow(304, "DNSBLSTATS Total hits: " + ConvToStr(total_hits));
 		stats.AddRow(304, "DNSBLSTATS Total misses: " + ConvToStr(total_misses));
 		stats.AddRow(304, "DNSBLSTATS Total errors: " + ConvToStr(total_errors));
+		stats.AddRow(304, "DNSBLSTATS Total from cache: " + ConvToStr(total_cached) + " (" + ConvToStr(cache.GetCount()) + " cached verdicts)");
 		return MOD_RES_PASSTHRU;
 	}
 };
 
+DNSBLResolver::DNSBLResolver(DNS::Manager *mgr, ModuleDNSBL* me, const std::string &hostname, LocalUser* u, std::shared_ptr<DNSBLEntry> conf)
+	: DNS::Request(mgr, me, hostname, DNS::QUERY_A, true, conf->timeout)
+	, mod(me)
+	, theirsa(u->client_sa)
+	, theiruid(u->uuid)
+	, ConfEntry(conf)
+	, started(insp::monotonic_ns())
+{
+}
+
+void DNSBLResolver::OnLookupComplete(const DNS::Query *r)
+{
+	ConfEntry->latency.add(insp::monotonic_ns() - started);
+
+	/* Check the user still exists. The reply is still checked and cached if they have gone as
+	 * other connections from the same address can use it.
+	 */
+	LocalUser* them = IS_LOCAL(ServerInstance->Users.FindUUID(theiruid));
+	if (them && them->client_sa != theirsa)
+		them = NULL;
+
+	// The DNSBL reply must contain an A result.
+	const DNS::ResourceRecord* const ans_record = r->FindAnswerOfType(DNS::QUERY_A);
+	if (!ans_record)
+	{
+		ConfEntry->stats_errors++;
+		ServerInstance->SNO.WriteGlobalSno('d', "%s returned an result with no IPv4 address.",
+			ConfEntry->name.c_str());
+		if (them)
+			mod->Complete(them);
+		return;
+	}
+
+	// The DNSBL reply must be a valid IPv4 address.
+	in_addr resultip;
+	if (inet_pton(AF_INET, ans_record->rdata.c_str(), &resultip) != 1)
+	{
+		ConfEntry->stats_errors++;
+		ServerInstance->SNO.WriteGlobalSno('d', "%s returned an invalid IPv4 address: %s",
+			ConfEntry->name.c_str(), ans_record->rdata.c_str());
+		if (them)
+			mod->Complete(them);
+		return;
+	}
+
+	// The DNSBL reply should be in the 127.0.0.0/8 range.
+	if ((resultip.s_addr & 0xFF) != 127)
+	{
+		ConfEntry->stats_errors++;
+		ServerInstance->SNO.WriteGlobalSno('d', "%s returned an IPv4 address which is outside of the 127.0.0.0/8 subnet: %s",
+			ConfEntry->name.c_str(), ans_record->rdata.c_str());
+		if (them)
+			mod->Complete(them);
+		return;
+	}
+
+	const unsigned int result = resultip.s_addr >> 24;
+	mod->cache.Add(*ConfEntry, theirsa, result, ans_record->ttl);
+	if (!them)
+	{
+		ConfEntry->stats_misses++;
+		return;
+	}
+
+	mod->OnResult(them, *ConfEntry, result);
+	mod->Complete(them);
+}
+
+void DNSBLResolver::OnError(const DNS::Query *q)
+{
+	bool is_miss = true;
+	switch (q->error)
+	{
+		case DNS::ERROR_NO_RECORDS:
+		case DNS::ERROR_DOMAIN_NOT_FOUND:
+			ConfEntry->latency.add(insp::monotonic_ns() - started);
+			ConfEntry->stats_misses++;
+			mod->cache.Add(*ConfEntry, theirsa, -1, ULONG_MAX);
+			break;
+
+		default:
+			ConfEntry->stats_errors++;
+			is_miss = false;
+			break;
+	}
+
+	LocalUser* them = IS_LOCAL(ServerInstance->Users.FindUUID(theiruid));
+	if (!them || them->client_sa != theirsa)
+		return;
+
+	if (!is_miss)
+	{
+		ServerInstance->SNO.WriteGlobalSno('d', "An error occurred whilst checking whether %s (%s) is on the '%s' DNS blacklist: %s",
+			them->GetFullRealHost().c_str(), them->GetIPString().c_str(), ConfEntry->name.c_str(), this->manager->GetErrorStr(q->error).c_str());
+	}
+	mod->Complete(them);
+}
+
 MODULE_INIT(ModuleDNSBL)
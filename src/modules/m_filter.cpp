@@ -166,6 +166,20 @@ class FilterResult
 	FilterResult() = default;
 };
 
+/** A set of filters which are matched against the same text in a single pass. */
+class FilterSet final
+{
+ public:
+	/** The compiled patterns or nullptr if the patterns could not be compiled as a set. */
+	Regex::PatternSetPtr patterns;
+
+	/** The indices within ModuleFilter::filters of the filters in this set in ascending order. */
+	std::vector<size_t> indices;
+
+	/** Whether this set needs to be rebuilt before it is next matched. */
+	bool dirty = true;
+};
+
 class CommandFilter : public Command
 {
  public:
@@ -198,7 +212,15 @@ class ModuleFilter
 	bool dirty = false;
 	std::string filterconf;
 	Regex::Engine* factory;
+
+	/** The filters which match against the message text as-is and those which match against
+	 * it with formatting stripped, in that order.
+	 */
+	FilterSet filtersets[2];
+
 	void FreeFilters();
+	void BuildFilterSet(bool strip);
+	void MarkFilterSetsDirty();
 
  public:
 	CommandFilter filtcommand;
@@ -372,10 +394,56 @@ Cullable::Result ModuleFilter::Cull()
 
 void ModuleFilter::FreeFilters()
 {
+	// The compiled sets may belong to a regex engine which is being unloaded so they have to
+	// be destroyed now rather than when they are next rebuilt.
+	for (auto& filterset : filtersets)
+	{
+		filterset.patterns.reset();
+		filterset.indices.clear();
+	}
+
 	filters.clear();
+	MarkFilterSetsDirty();
 	dirty = true;
 }
 
+void ModuleFilter::MarkFilterSetsDirty()
+{
+	for (auto& filterset : filtersets)
+		filterset.dirty = true;
+}
+
+void ModuleFilter::BuildFilterSet(bool strip)
+{
+	FilterSet& filterset = filtersets[strip];
+	filterset.dirty = false;
+	filterset.patterns.reset();
+	filterset.indices.clear();
+
+	for (size_t idx = 0; idx < filters.size(); ++idx)
+	{
+		if (filters[idx].flag_strip_color == strip)
+			filterset.indices.push_back(idx);
+	}
+
+	if (filterset.indices.empty() || !RegexEngine)
+		return;
+
+	try
+	{
+		Regex::PatternSetPtr patterns = RegexEngine->CreateSet();
+		for (size_t idx : filterset.indices)
+			patterns->Add(filters[idx].regex);
+		patterns->Compile();
+		filterset.patterns = std::move(patterns);
+	}
+	catch (const ModuleException& e)
+	{
+		// Fall back to matching each filter in turn.
+		ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "Unable to compile %zu filters as a set: %s", filterset.indices.size(), e.GetReason().c_str());
+	}
+}
+
 ModResult ModuleFilter::OnUserPreMessage(User* user, const MessageTarget& msgtarget, MessageDetails& details)
 {
 	// Leave remote users and servers alone
@@ -752,25 +820,54 @@ void ModuleFilter::OnDecodeMetaData(Extensible* target, const std::string &extna
 
 const FilterResult* ModuleFilter::FilterMatch(User* user, const std::string &text, int flgs)
 {
-	static std::string stripped_text;
-	stripped_text.clear();
+	// The index of the first filter which matched. Filters after this one can be skipped.
+	size_t first = filters.size();
 
-	for (const auto& filter : filters)
+	std::string stripped_text;
+	for (const bool strip : { false, true })
 	{
-		/* Skip ones that dont apply to us */
-		if (!AppliesToMe(user, filter, flgs))
+		FilterSet& filterset = filtersets[strip];
+		if (filterset.dirty)
+			BuildFilterSet(strip);
+
+		if (filterset.indices.empty() || filterset.indices.front() >= first)
 			continue;
 
-		if ((filter.flag_strip_color) && (stripped_text.empty()))
+		if (strip)
 		{
 			stripped_text = text;
 			InspIRCd::StripColor(stripped_text);
 		}
+		const std::string& subject = strip ? stripped_text : text;
+
+		/* Skip ones that dont apply to us */
+		auto applies = [&](size_t setidx)
+		{
+			const size_t idx = filterset.indices[setidx];
+			return idx < first && AppliesToMe(user, filters[idx], flgs);
+		};
+
+		size_t match = Regex::NO_MATCH;
+		if (filterset.patterns)
+		{
+			match = filterset.patterns->FindFirst(subject, applies);
+		}
+		else
+		{
+			for (size_t setidx = 0; setidx < filterset.indices.size(); ++setidx)
+			{
+				if (applies(setidx) && filters[filterset.indices[setidx]].regex->IsMatch(subject))
+				{
+					match = setidx;
+					break;
+				}
+			}
+		}
 
-		if (filter.regex->IsMatch(filter.flag_strip_color ? stripped_text : text))
-			return &filter;
+		if (match != Regex::NO_MATCH)
+			first = filterset.indices[match];
 	}
-	return NULL;
+	return first < filters.size() ? &filters[first] : NULL;
 }
 
 bool ModuleFilter::DeleteFilter(const std::string& freeform, std::string& reason)
@@ -781,6 +878,8 @@ bool ModuleFilter::DeleteFilter(const std::string& freeform, std::string& reason
 		{
 			reason.assign(i->reason);
 			filters.erase(i);
+			// Removing a filter changes the indices of the ones after it.
+			MarkFilterSetsDirty();
 			dirty = true;
 			return true;
 		}
@@ -801,6 +900,7 @@ std::pair<bool, std::string> ModuleFilter::AddFilter(const std::string& freeform
 	try
 	{
 		filters.emplace_back(RegexEngine, freeform, reason, type, duration, flgs, config);
+		filtersets[filters.back().flag_strip_color].dirty = true;
 		dirty = true;
 	}
 	catch (ModuleException &e)
@@ -860,6 +960,7 @@ void ModuleFilter::ReadFilters()
 		{
 			removedfilters.insert(filter->freeform);
 			filter = filters.erase(filter);
+			MarkFilterSetsDirty();
 			continue;
 		}
 
@@ -916,8 +1017,10 @@ ModResult ModuleFilter::OnStats(Stats::Context& stats)
 
 void ModuleFilter::OnUnloadModule(Module* mod)
 {
-	// If the regex engine became unavailable or has changed, remove all filters
-	if (!RegexEngine)
+	// If the regex engine became unavailable or has changed, remove all filters. This is called
+	// before the services of the module are removed so the engine may still be available here
+	// when it belongs to the module which is being unloaded.
+	if (!RegexEngine || RegexEngine->creator == mod)
 	{
 		FreeFilters();
 	}
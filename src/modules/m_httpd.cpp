@@ -55,6 +55,7 @@ static insp::intrusive_list<HttpServerSocket> sockets;
 static Events::ModuleEventProvider* aclevprov;
 static Events::ModuleEventProvider* reqevprov;
 static http_parser_settings parser_settings;
+static HTTPdStats httpstats;
 
 /** A socket used for HTTP transport
  */
@@ -72,15 +73,143 @@ class HttpServerSocket : public BufferedSocket, public Timer, public insp::intru
 	size_t total_buffers;
 	int status_code = 0;
 
+	/** The number of seconds to wait for a request to be received. */
+	unsigned long timeoutsec;
+
+	/** The number of seconds to wait for another request on a persistent connection. */
+	unsigned long keepalivesec;
+
+	/** The maximum number of requests which can be sent on one connection. */
+	unsigned long maxrequests;
+
+	/** The number of requests which have been received on this connection. */
+	unsigned long requests = 0;
+
+	/** Whether the connection will be kept open after the current response. */
+	bool keepalive = false;
+
+	/** Whether the connection must be closed after the current response. */
+	bool closing = false;
+
+	/** Whether the request parser is currently running. */
+	bool parsing = false;
+
+	/** Whether the connection is waiting for another request to start. */
+	bool idle = false;
+
 	/** True if this object is in the cull list
 	 */
 	bool waitingcull = false;
 	bool messagecomplete = false;
 
+	/** The generator for the response body if it is being streamed. */
+	std::unique_ptr<HTTPDocumentStream> stream;
+
+	/** The module which created the stream. */
+	Module* streammod = nullptr;
+
+	/** Whether the streamed response uses chunked transfer encoding. */
+	bool chunked = false;
+
+	/** The amount of data which is generated at once when streaming a response. */
+	static constexpr size_t STREAM_CHUNK_SIZE = 16 * 1024;
+
+	/** More of a streamed response is generated when the sendq drops below this size. */
+	static constexpr size_t STREAM_LOW_WATER = 128 * 1024;
+
+	void PumpStream()
+	{
+		while (stream && GetSendQSize() < STREAM_LOW_WATER)
+		{
+			std::string chunk;
+			const bool more = stream->Generate(chunk, STREAM_CHUNK_SIZE);
+			if (!chunk.empty())
+			{
+				if (chunked)
+				{
+					char sizebuf[24];
+					snprintf(sizebuf, sizeof(sizebuf), "%zx\r\n", chunk.length());
+					chunk.insert(0, sizebuf).append("\r\n");
+				}
+				WriteData(chunk);
+			}
+
+			if (!more)
+			{
+				if (chunked)
+					WriteData("0\r\n\r\n");
+
+				stream.reset();
+				streammod = nullptr;
+				FinishResponse();
+
+				// Any requests which were pipelined behind this one can now be answered.
+				ProcessRequests();
+			}
+		}
+	}
+
+	/** Closes the connection or waits for another request once a response has been sent. */
+	void FinishResponse()
+	{
+		if (!keepalive)
+		{
+			BufferedSocket::Close(true);
+			return;
+		}
+
+		idle = true;
+		messagecomplete = false;
+		SetInterval(keepalivesec);
+	}
+
+	/** Parses any requests which are waiting in the recvq. Requests are answered one at a
+	 * time so that the responses to pipelined requests are sent in the right order.
+	 */
+	void ProcessRequests()
+	{
+		while (!parsing && !messagecomplete && !waitingcull && !recvq.empty())
+		{
+			parsing = true;
+			const size_t parsed = http_parser_execute(&parser, &parser_settings, recvq.data(), recvq.size());
+			parsing = false;
+			recvq.erase(0, parsed);
+
+			if (parser.upgrade)
+			{
+				closing = true;
+				SendHTTPError(status_code ? status_code : 400);
+				return;
+			}
+
+			switch (HTTP_PARSER_ERRNO(&parser))
+			{
+				case HPE_OK:
+					// We need more data to finish the request.
+					return;
+
+				case HPE_PAUSED:
+					// A request has been answered; the next one can be parsed once the
+					// response has been sent.
+					http_parser_pause(&parser, 0);
+					break;
+
+				default:
+					closing = true;
+					recvq.clear();
+					SendHTTPError(status_code ? status_code : 400, http_errno_description((http_errno)parser.http_errno));
+					return;
+			}
+		}
+	}
+
 	bool Tick(time_t currtime) override
 	{
 		if (!messagecomplete)
 		{
+			if (idle)
+				httpstats.idletimeouts++;
+
 			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "HTTP socket %d timed out", GetFd());
 			Close();
 			return false;
@@ -109,6 +238,8 @@ class HttpServerSocket : public BufferedSocket, public Timer, public insp::intru
 		parser_settings.on_message_begin = Callback<&HttpServerSocket::OnMessageBegin>;
 		parser_settings.on_url = DataCallback<&HttpServerSocket::OnUrl>;
 		parser_settings.on_header_field = DataCallback<&HttpServerSocket::OnHeaderField>;
+		parser_settings.on_header_value = DataCallback<&HttpServerSocket::OnHeaderValue>;
+		parser_settings.on_headers_complete = Callback<&HttpServerSocket::OnHeadersComplete>;
 		parser_settings.on_body = DataCallback<&HttpServerSocket::OnBody>;
 		parser_settings.on_message_complete = Callback<&HttpServerSocket::OnMessageComplete>;
 	}
@@ -116,9 +247,20 @@ class HttpServerSocket : public BufferedSocket, public Timer, public insp::intru
 	int OnMessageBegin()
 	{
 		uri.clear();
+		headers = HTTPHeaders();
 		header_state = HEADER_NONE;
+		header_field.clear();
+		header_value.clear();
 		body.clear();
 		total_buffers = 0;
+		status_code = 0;
+
+		// A persistent connection gets the full request timeout once a new request starts.
+		if (idle)
+		{
+			idle = false;
+			SetInterval(timeoutsec);
+		}
 		return 0;
 	}
 
@@ -197,16 +339,30 @@ class HttpServerSocket : public BufferedSocket, public Timer, public insp::intru
 	int OnMessageComplete()
 	{
 		messagecomplete = true;
+		httpstats.requests++;
+		if (requests++)
+			httpstats.reused++;
+
 		ServeData();
+
+		// Stop parsing so that any pipelined requests are not answered until the response to
+		// this one has been sent.
+		http_parser_pause(&parser, 1);
 		return 0;
 	}
 
  public:
-	HttpServerSocket(int newfd, const std::string& IP, ListenSocket* via, irc::sockets::sockaddrs* client, irc::sockets::sockaddrs* server, unsigned long timeoutsec)
+	HttpServerSocket(int newfd, const std::string& IP, ListenSocket* via, irc::sockets::sockaddrs* client, irc::sockets::sockaddrs* server, unsigned long timeout, unsigned long keepalivetimeout, unsigned long maxreqs)
 		: BufferedSocket(newfd)
-		, Timer(timeoutsec)
+		, Timer(timeout)
 		, ip(IP)
+		, timeoutsec(timeout)
+		, keepalivesec(keepalivetimeout)
+		, maxrequests(maxreqs)
 	{
+		httpstats.accepted++;
+		httpstats.open++;
+
 		if ((!via->iohookprovs.empty()) && (via->iohookprovs.back()))
 		{
 			via->iohookprovs.back()->OnAccept(this, client, server);
@@ -227,6 +383,7 @@ class HttpServerSocket : public BufferedSocket, public Timer, public insp::intru
 
 	~HttpServerSocket() override
 	{
+		httpstats.open--;
 		sockets.erase(this);
 	}
 
@@ -263,23 +420,48 @@ class HttpServerSocket : public BufferedSocket, public Timer, public insp::intru
 		Page(data, response, &empty);
 	}
 
-	void SendHeaders(unsigned long size, unsigned int response, HTTPHeaders &rheaders)
+	void SendHeaders(unsigned long size, unsigned int response, HTTPHeaders &rheaders, bool streaming = false)
 	{
 		WriteData(InspIRCd::Format("HTTP/%u.%u %u %s\r\n", parser.http_major ? parser.http_major : 1, parser.http_major ? parser.http_minor : 1, response, http_status_str((http_status)response)));
 
 		rheaders.CreateHeader("Date", InspIRCd::TimeString(ServerInstance->Time(), "%a, %d %b %Y %H:%M:%S GMT", true));
 		rheaders.CreateHeader("Server", INSPIRCD_BRANCH);
-		rheaders.SetHeader("Content-Length", ConvToStr(size));
 
-		if (size)
+		if (streaming)
+		{
+			// HTTP/1.0 clients do not understand chunked encoding so the end of the body is
+			// indicated by closing the connection instead.
+			rheaders.RemoveHeader("Content-Length");
+			if (chunked)
+				rheaders.SetHeader("Transfer-Encoding", "chunked");
 			rheaders.CreateHeader("Content-Type", "text/html");
+		}
 		else
-			rheaders.RemoveHeader("Content-Type");
+		{
+			rheaders.SetHeader("Content-Length", ConvToStr(size));
+			if (size)
+				rheaders.CreateHeader("Content-Type", "text/html");
+			else
+				rheaders.RemoveHeader("Content-Type");
+		}
 
-		/* Supporting Connection: keep-alive causes a whole world of hurt synchronizing timeouts,
-		 * so remove it, its not essential for what we need.
-		 */
-		rheaders.SetHeader("Connection", "Close");
+		// Connections are only reused if the client asked for it and the end of the response
+		// can be determined without closing the connection.
+		keepalive = !closing && keepalivesec && requests < maxrequests && (!streaming || chunked)
+			&& messagecomplete && http_should_keep_alive(&parser);
+		if (keepalive)
+		{
+			if (parser.http_major == 1 && parser.http_minor == 0)
+				rheaders.SetHeader("Connection", "Keep-Alive");
+			else
+				rheaders.RemoveHeader("Connection");
+			rheaders.SetHeader("Keep-Alive", InspIRCd::Format("timeout=%lu, max=%lu", keepalivesec, maxrequests - requests));
+		}
+		else
+		{
+			rheaders.SetHeader("Connection", "Close");
+			rheaders.RemoveHeader("Keep-Alive");
+		}
 
 		WriteData(rheaders.GetFormattedHeaders());
 		WriteData("\r\n");
@@ -287,13 +469,13 @@ class HttpServerSocket : public BufferedSocket, public Timer, public insp::intru
 
 	void OnDataReady() override
 	{
-		if (parser.upgrade || HTTP_PARSER_ERRNO(&parser))
+		if (closing || parser.upgrade)
+		{
+			recvq.clear();
 			return;
-		http_parser_execute(&parser, &parser_settings, recvq.data(), recvq.size());
-		if (parser.upgrade)
-			SendHTTPError(status_code ? status_code : 400);
-		else if (HTTP_PARSER_ERRNO(&parser))
-			SendHTTPError(status_code ? status_code : 400, http_errno_description((http_errno)parser.http_errno));
+		}
+
+		ProcessRequests();
 	}
 
 	void ServeData()
@@ -318,7 +500,7 @@ class HttpServerSocket : public BufferedSocket, public Timer, public insp::intru
 	{
 		SendHeaders(s.length(), response, *hheaders);
 		WriteData(s);
-		BufferedSocket::Close(true);
+		FinishResponse();
 	}
 
 	void Page(std::stringstream* n, unsigned int response, HTTPHeaders* hheaders)
@@ -326,6 +508,33 @@ class HttpServerSocket : public BufferedSocket, public Timer, public insp::intru
 		Page(n->str(), response, hheaders);
 	}
 
+	void Stream(std::unique_ptr<HTTPDocumentStream> strm, Module* mod, unsigned int response, HTTPHeaders* hheaders)
+	{
+		chunked = parser.http_major > 1 || (parser.http_major == 1 && parser.http_minor >= 1);
+		SendHeaders(0, response, *hheaders, true);
+		stream = std::move(strm);
+		streammod = mod;
+		PumpStream();
+	}
+
+	/** Stops streaming a response if it was generated by the specified module. */
+	bool AbortStream(Module* mod)
+	{
+		if (!stream || streammod != mod)
+			return false;
+
+		stream.reset();
+		streammod = nullptr;
+		return true;
+	}
+
+	void OnEventHandlerWrite() override
+	{
+		BufferedSocket::OnEventHandlerWrite();
+		if (stream && !waitingcull && GetError().empty())
+			PumpStream();
+	}
+
 	bool ParseURI(const std::string& uristr, HTTPRequestURI& out)
 	{
 		http_parser_url_init(&url);
@@ -396,7 +605,15 @@ class HTTPdAPIImpl : public HTTPdAPIBase
 
 	void SendResponse(HTTPDocumentResponse& resp) override
 	{
-		resp.src.sock->Page(resp.document, resp.responsecode, &resp.headers);
+		if (resp.stream)
+			resp.src.sock->Stream(std::move(resp.stream), resp.module, resp.responsecode, &resp.headers);
+		else
+			resp.src.sock->Page(resp.document, resp.responsecode, &resp.headers);
+	}
+
+	const HTTPdStats& GetStats() override
+	{
+		return httpstats;
 	}
 };
 
@@ -405,6 +622,9 @@ class ModuleHttpServer : public Module
  private:
 	HTTPdAPIImpl APIImpl;
 	unsigned long timeoutsec;
+	unsigned long keepalivesec;
+	unsigned long maxrequests;
+	unsigned long maxconnections;
 	Events::ModuleEventProvider acleventprov;
 	Events::ModuleEventProvider reqeventprov;
 
@@ -429,6 +649,9 @@ class ModuleHttpServer : public Module
 	{
 		auto tag = ServerInstance->Config->ConfValue("httpd");
 		timeoutsec = tag->getDuration("timeout", 10, 1);
+		keepalivesec = tag->getDuration("keepalive", 15);
+		maxrequests = tag->getUInt("maxrequests", 100, 1);
+		maxconnections = tag->getUInt("maxconnections", 128);
 	}
 
 	ModResult OnAcceptConnection(int nfd, ListenSocket* from, irc::sockets::sockaddrs* client, irc::sockets::sockaddrs* server) override
@@ -436,7 +659,15 @@ class ModuleHttpServer : public Module
 		if (!stdalgo::string::equalsci(from->bind_tag->getString("type"), "httpd"))
 			return MOD_RES_PASSTHRU;
 
-		sockets.push_front(new HttpServerSocket(nfd, client->addr(), from, client, server, timeoutsec));
+		if (maxconnections && sockets.size() >= maxconnections)
+		{
+			ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Refusing HTTP connection from %s: too many connections are open (max: %lu)",
+				client->str().c_str(), maxconnections);
+			httpstats.refused++;
+			return MOD_RES_DENY;
+		}
+
+		sockets.push_front(new HttpServerSocket(nfd, client->addr(), from, client, server, timeoutsec, keepalivesec, maxrequests));
 		return MOD_RES_ALLOW;
 	}
 
@@ -446,7 +677,12 @@ class ModuleHttpServer : public Module
 		{
 			HttpServerSocket* sock = *i;
 			++i;
-			if (sock->GetModHook(mod))
+			if (sock->AbortStream(mod))
+			{
+				// The response can not be finished without the module which was generating it.
+				sock->Close();
+			}
+			else if (sock->GetModHook(mod))
 			{
 				sock->Cull();
 				delete sock;
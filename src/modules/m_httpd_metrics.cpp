@@ -0,0 +1,197 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "inspircd.h"
+#include "modules/httpd.h"
+#include "modules/metrics.h"
+#include "utility/histogram.h"
+#include "xline.h"
+
+class ModuleHttpMetrics final
+	: public Module
+	, public HTTPRequestEventListener
+{
+ private:
+	HTTPdAPI API;
+	Metrics::EventProvider metricsevprov;
+
+	static void SocketMetrics(Metrics::Writer& writer)
+	{
+		const SocketEngine::Statistics& sestats = SocketEngine::GetStats();
+
+		writer.Family("inspircd_socketengine_dispatches_total", Metrics::Type::COUNTER, "The number of times the socket engine has been polled for events.");
+		writer.Sample("inspircd_socketengine_dispatches_total", sestats.Dispatches);
+
+		writer.Family("inspircd_socketengine_events_total", Metrics::Type::COUNTER, "The number of events returned by the socket engine.");
+		writer.Sample("inspircd_socketengine_events_total", sestats.TotalEvents);
+
+		writer.Family("inspircd_socketengine_events_per_dispatch", Metrics::Type::HISTOGRAM, "The number of events returned each time the socket engine is polled.");
+		writer.Histogram("inspircd_socketengine_events_per_dispatch", *sestats.DispatchSizes);
+
+		writer.Family("inspircd_socket_syscalls_total", Metrics::Type::COUNTER, "The number of read and write system calls made on sockets.");
+		writer.Sample("inspircd_socket_syscalls_total", sestats.ReadEvents, { { "direction", "read" } });
+		writer.Sample("inspircd_socket_syscalls_total", sestats.WriteEvents, { { "direction", "write" } });
+
+		writer.Family("inspircd_socket_errors_total", Metrics::Type::COUNTER, "The number of socket errors.");
+		writer.Sample("inspircd_socket_errors_total", sestats.ErrorEvents);
+
+		writer.Family("inspircd_socket_bytes_total", Metrics::Type::COUNTER, "The number of bytes which have been received and sent on sockets.");
+		writer.Sample("inspircd_socket_bytes_total", sestats.BytesIn, { { "direction", "in" } });
+		writer.Sample("inspircd_socket_bytes_total", sestats.BytesOut, { { "direction", "out" } });
+
+		writer.Family("inspircd_socket_queue_bytes", Metrics::Type::GAUGE, "The number of bytes waiting in the send and receive queues of every socket.");
+		writer.Sample("inspircd_socket_queue_bytes", ServerInstance->stats.RecvQ, { { "queue", "recvq" } });
+		writer.Sample("inspircd_socket_queue_bytes", ServerInstance->stats.SendQ, { { "queue", "sendq" } });
+
+		writer.Family("inspircd_sockets", Metrics::Type::GAUGE, "The number of file descriptors in use by the socket engine.");
+		writer.Sample("inspircd_sockets", SocketEngine::GetUsedFds());
+	}
+
+	static void LoopMetrics(Metrics::Writer& writer)
+	{
+		const serverstats& stats = ServerInstance->stats;
+
+		// The loop times are recorded in nanoseconds.
+		writer.Family("inspircd_loop_iteration_seconds", Metrics::Type::HISTOGRAM, "The time each main loop iteration has spent working, excluding the time spent waiting for socket events.");
+		writer.Histogram("inspircd_loop_iteration_seconds", *stats.LoopTime, 1e9);
+
+		writer.Family("inspircd_loop_phase_seconds", Metrics::Type::HISTOGRAM, "The time each phase of the main loop has taken in the iterations that it ran in.");
+		for (size_t phase = 0; phase < serverstats::PHASE_COUNT; ++phase)
+			writer.Histogram("inspircd_loop_phase_seconds", *stats.LoopPhaseTime[phase], 1e9, { { "phase", serverstats::LOOP_PHASE_NAMES[phase] } });
+	}
+
+	static void ServerMetrics(Metrics::Writer& writer)
+	{
+		const serverstats& stats = ServerInstance->stats;
+
+		writer.Family("inspircd_start_time_seconds", Metrics::Type::GAUGE, "The UNIX time at which the server was started.");
+		writer.Sample("inspircd_start_time_seconds", ServerInstance->startup_time);
+
+		writer.Family("inspircd_connections_total", Metrics::Type::COUNTER, "The number of incoming connections which have been accepted or refused.");
+		writer.Sample("inspircd_connections_total", stats.Accept, { { "result", "accepted" } });
+		writer.Sample("inspircd_connections_total", stats.Refused, { { "result", "refused" } });
+
+		writer.Family("inspircd_user_connects_total", Metrics::Type::COUNTER, "The number of local users who have finished registering.");
+		writer.Sample("inspircd_user_connects_total", stats.Connects);
+
+		writer.Family("inspircd_user_quits_total", Metrics::Type::COUNTER, "The number of local users who have quit.");
+		writer.Sample("inspircd_user_quits_total", stats.Quits);
+
+		writer.Family("inspircd_users", Metrics::Type::GAUGE, "The number of users which are connected.");
+		writer.Sample("inspircd_users", ServerInstance->Users.GetUsers().size(), { { "scope", "global" } });
+		writer.Sample("inspircd_users", ServerInstance->Users.GetLocalUsers().size(), { { "scope", "local" } });
+		writer.Sample("inspircd_users", ServerInstance->Users.UnregisteredUserCount(), { { "scope", "unregistered" } });
+
+		writer.Family("inspircd_opers", Metrics::Type::GAUGE, "The number of server operators which are connected.");
+		writer.Sample("inspircd_opers", ServerInstance->Users.all_opers.size());
+
+		writer.Family("inspircd_channels", Metrics::Type::GAUGE, "The number of channels which exist.");
+		writer.Sample("inspircd_channels", ServerInstance->Channels.GetChans().size());
+
+		writer.Family("inspircd_nick_collisions_total", Metrics::Type::COUNTER, "The number of nickname collisions which have been handled.");
+		writer.Sample("inspircd_nick_collisions_total", stats.Collisions);
+
+		writer.Family("inspircd_dns_queries_total", Metrics::Type::COUNTER, "The number of DNS lookups which have been made for connecting users.");
+		writer.Sample("inspircd_dns_queries_total", stats.Dns);
+
+		writer.Family("inspircd_dns_replies_total", Metrics::Type::COUNTER, "The number of DNS lookups for connecting users which have finished.");
+		writer.Sample("inspircd_dns_replies_total", stats.DnsGood, { { "result", "good" } });
+		writer.Sample("inspircd_dns_replies_total", stats.DnsBad, { { "result", "bad" } });
+	}
+
+	static void CommandMetrics(Metrics::Writer& writer)
+	{
+		writer.Family("inspircd_commands_total", Metrics::Type::COUNTER, "The number of times each command has been used.");
+		for (const auto& [name, command] : ServerInstance->Parser.GetCommands())
+			writer.Sample("inspircd_commands_total", command->use_count, { { "command", name } });
+
+		// The execution times are recorded in nanoseconds.
+		writer.Family("inspircd_command_duration_seconds", Metrics::Type::HISTOGRAM, "The time taken to execute each command received from local users.");
+		for (const auto& [name, command] : ServerInstance->Parser.GetCommands())
+		{
+			if (command->exec_time->get_count())
+				writer.Histogram("inspircd_command_duration_seconds", *command->exec_time, 1e9, { { "command", name } });
+		}
+
+		writer.Family("inspircd_unknown_commands_total", Metrics::Type::COUNTER, "The number of unknown commands which have been received.");
+		writer.Sample("inspircd_unknown_commands_total", ServerInstance->stats.Unknown);
+	}
+
+	static void XLineMetrics(Metrics::Writer& writer)
+	{
+		writer.Family("inspircd_xline_hits_total", Metrics::Type::COUNTER, "The number of times an X-line of each type has matched.");
+		for (const auto& [type, factory] : ServerInstance->XLines->GetFactories())
+			writer.Sample("inspircd_xline_hits_total", factory->hits, { { "type", type } });
+	}
+
+	void HTTPMetrics(Metrics::Writer& writer)
+	{
+		if (!API)
+			return;
+
+		const HTTPdStats& httpstats = API->GetStats();
+		writer.Family("inspircd_httpd_connections_total", Metrics::Type::COUNTER, "The number of HTTP connections which have been accepted or refused.");
+		writer.Sample("inspircd_httpd_connections_total", httpstats.accepted, { { "result", "accepted" } });
+		writer.Sample("inspircd_httpd_connections_total", httpstats.refused, { { "result", "refused" } });
+
+		writer.Family("inspircd_httpd_open_connections", Metrics::Type::GAUGE, "The number of HTTP connections which are open.");
+		writer.Sample("inspircd_httpd_open_connections", httpstats.open);
+
+		writer.Family("inspircd_httpd_requests_total", Metrics::Type::COUNTER, "The number of HTTP requests which have been received.");
+		writer.Sample("inspircd_httpd_requests_total", httpstats.requests - httpstats.reused, { { "connection", "new" } });
+		writer.Sample("inspircd_httpd_requests_total", httpstats.reused, { { "connection", "reused" } });
+
+		writer.Family("inspircd_httpd_idle_timeouts_total", Metrics::Type::COUNTER, "The number of persistent HTTP connections which were closed for being idle.");
+		writer.Sample("inspircd_httpd_idle_timeouts_total", httpstats.idletimeouts);
+	}
+
+ public:
+	ModuleHttpMetrics()
+		: Module(VF_VENDOR, "Provides server metrics in the Prometheus text format over HTTP via the /metrics path.")
+		, HTTPRequestEventListener(this)
+		, API(this)
+		, metricsevprov(this)
+	{
+	}
+
+	ModResult OnHTTPRequest(HTTPRequest& request) override
+	{
+		if (request.GetPath() != "/metrics")
+			return MOD_RES_PASSTHRU;
+
+		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Handling HTTP request for %s", request.GetPath().c_str());
+
+		std::string buffer;
+		Metrics::Writer writer(buffer);
+		SocketMetrics(writer);
+		LoopMetrics(writer);
+		ServerMetrics(writer);
+		CommandMetrics(writer);
+		XLineMetrics(writer);
+		HTTPMetrics(writer);
+		metricsevprov.Call(&Metrics::EventListener::OnCollectMetrics, writer);
+
+		std::stringstream data(buffer);
+		HTTPDocumentResponse response(this, request, &data, 200);
+		response.headers.SetHeader("X-Powered-By", MODNAME);
+		response.headers.SetHeader("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+		API->SendResponse(response);
+		return MOD_RES_DENY;
+	}
+};
+
+MODULE_INIT(ModuleHttpMetrics)
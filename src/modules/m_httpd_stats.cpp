@@ -32,118 +32,404 @@
 #include "inspircd.h"
 #include "modules/isupport.h"
 #include "modules/httpd.h"
+#include "modules/stats.h"
+#include "utility/histogram.h"
 #include "xline.h"
 
 static ISupport::EventProvider* isevprov;
+static Events::ModuleEventProvider* statsevprov;
+static HTTPdAPI* httpdapi;
 
 namespace Stats
 {
-	struct Entities
+	/** Writes a structured document in a specific format. */
+	class Writer
 	{
-		static const insp::flat_map<char, char const*>& entities;
-	};
+	 public:
+		/** The buffer which the document is currently being written to. */
+		std::string* out = nullptr;
 
-	static const insp::flat_map<char, char const*>& init_entities()
-	{
-		static insp::flat_map<char, char const*> entities;
-		entities['<'] = "lt";
-		entities['>'] = "gt";
-		entities['&'] = "amp";
-		entities['"'] = "quot";
-		return entities;
-	}
+		virtual ~Writer() = default;
+
+		/** The MIME type of documents written by this writer. */
+		virtual const char* GetContentType() const = 0;
+
+		/** Starts the document. */
+		virtual void BeginDocument() = 0;
+
+		/** Finishes the document. */
+		virtual void EndDocument() = 0;
+
+		/** Starts a group of named values. If \p attrname is specified then the group has a
+		 * value of that name which is written as an XML attribute.
+		 */
+		virtual void BeginObject(const char* name, const char* attrname = nullptr, const std::string& attrvalue = std::string()) = 0;
+
+		/** Finishes a group of named values. */
+		virtual void EndObject(const char* name) = 0;
+
+		/** Starts a list of values. If \p xmlwrap is false then the items are written directly
+		 * into the enclosing XML element.
+		 */
+		virtual void BeginList(const char* name, bool xmlwrap = true) = 0;
+
+		/** Finishes a list of values. */
+		virtual void EndList(const char* name, bool xmlwrap = true) = 0;
+
+		/** Writes a string value. */
+		virtual void String(const char* name, const std::string& value) = 0;
+
+		/** Writes a numeric value. */
+		virtual void Number(const char* name, const std::string& value) = 0;
+
+		/** Writes a value which is either present or absent. */
+		virtual void Flag(const char* name) = 0;
 
-	const insp::flat_map<char, char const*>& Entities::entities = init_entities();
+		/** Writes an extension item. */
+		virtual void Meta(const std::string& name, const std::string& value) = 0;
 
-	std::string Sanitize(const std::string& str)
+		template <typename Numeric>
+		void Number(const char* name, Numeric value)
+		{
+			Number(name, ConvToStr(value));
+		}
+	};
+
+	class XMLWriter final
+		: public Writer
 	{
-		std::string ret;
-		ret.reserve(str.length() * 2);
+	 private:
+		static bool IsValidChar(unsigned char chr)
+		{
+			// The XML specification defines the following characters as valid inside an XML document:
+			// Char ::= #x9 | #xA | #xD | [#x20-#xD7FF] | [#xE000-#xFFFD] | [#x10000-#x10FFFF]
+			return chr == 0x09 || chr == 0x0A || chr == 0x0D || (chr >= 0x20 && chr <= 0x7E);
+		}
 
-		for (const auto& chr : str)
+		void Sanitize(const std::string& str)
 		{
-			insp::flat_map<char, char const*>::const_iterator it = Entities::entities.find(chr);
-			if (it != Entities::entities.end())
+			for (const auto chr : str)
 			{
-				ret += '&';
-				ret += it->second;
-				ret += ';';
+				if (!IsValidChar(chr))
+				{
+					// If we reached this point then the string contains characters which can
+					// not be represented in XML, even using a numeric escape. Therefore, we
+					// Base64 encode the entire string and wrap it in a CDATA.
+					out->append("<![CDATA[").append(Base64::Encode(str)).append("]]>");
+					return;
+				}
 			}
-			else if (chr == 0x09 || chr == 0x0A || chr == 0x0D || ((chr >= 0x20) && (chr <= 0x7e)))
+
+			size_t copyfrom = 0;
+			for (size_t idx = 0; idx < str.length(); ++idx)
 			{
-				// The XML specification defines the following characters as valid inside an XML document:
-				// Char ::= #x9 | #xA | #xD | [#x20-#xD7FF] | [#xE000-#xFFFD] | [#x10000-#x10FFFF]
-				ret += chr;
+				const char* entity;
+				switch (str[idx])
+				{
+					case '<':
+						entity = "&lt;";
+						break;
+					case '>':
+						entity = "&gt;";
+						break;
+					case '&':
+						entity = "&amp;";
+						break;
+					case '"':
+						entity = "&quot;";
+						break;
+					default:
+						continue;
+				}
+				out->append(str, copyfrom, idx - copyfrom).append(entity);
+				copyfrom = idx + 1;
 			}
-			else
+			out->append(str, copyfrom, std::string::npos);
+		}
+
+		void Open(const char* name)
+		{
+			out->append("<").append(name).push_back('>');
+		}
+
+		void Close(const char* name)
+		{
+			out->append("</").append(name).push_back('>');
+		}
+
+	 public:
+		const char* GetContentType() const override { return "text/xml"; }
+
+		void BeginDocument() override { Open("inspircdstats"); }
+
+		void EndDocument() override { Close("inspircdstats"); }
+
+		void BeginObject(const char* name, const char* attrname, const std::string& attrvalue) override
+		{
+			if (!attrname)
 			{
-				// If we reached this point then the string contains characters which can
-				// not be represented in XML, even using a numeric escape. Therefore, we
-				// Base64 encode the entire string and wrap it in a CDATA.
-				ret.clear();
-				ret += "<![CDATA[";
-				ret += Base64::Encode(str);
-				ret += "]]>";
-				break;
+				Open(name);
+				return;
 			}
+
+			out->append("<").append(name).append(" ").append(attrname).append("=\"");
+			Sanitize(attrvalue);
+			out->append("\">");
+		}
+
+		void EndObject(const char* name) override { Close(name); }
+
+		void BeginList(const char* name, bool xmlwrap) override
+		{
+			if (xmlwrap)
+				Open(name);
 		}
-		return ret;
-	}
 
-	void DumpMeta(std::ostream& data, Extensible* ext)
+		void EndList(const char* name, bool xmlwrap) override
+		{
+			if (xmlwrap)
+				Close(name);
+		}
+
+		void String(const char* name, const std::string& value) override
+		{
+			Open(name);
+			Sanitize(value);
+			Close(name);
+		}
+
+		void Number(const char* name, const std::string& value) override
+		{
+			Open(name);
+			out->append(value);
+			Close(name);
+		}
+
+		void Flag(const char* name) override
+		{
+			out->append("<").append(name).append("/>");
+		}
+
+		void Meta(const std::string& name, const std::string& value) override
+		{
+			out->append("<meta name=\"").append(name).append("\">");
+			Sanitize(value);
+			out->append("</meta>");
+		}
+	};
+
+	class JSONWriter final
+		: public Writer
 	{
-		data << "<metadata>";
+	 private:
+		/** Whether each of the currently open containers is a list. */
+		std::vector<bool> lists;
+
+		/** Whether the next value is the first in its container. */
+		bool first = true;
+
+		void Escape(const std::string& str)
+		{
+			out->push_back('"');
+			size_t copyfrom = 0;
+			for (size_t idx = 0; idx < str.length(); ++idx)
+			{
+				const auto chr = static_cast<unsigned char>(str[idx]);
+				if (chr >= 0x20 && chr < 0x7F && chr != '"' && chr != '\\')
+					continue;
+
+				out->append(str, copyfrom, idx - copyfrom);
+				copyfrom = idx + 1;
+				switch (chr)
+				{
+					case '"':
+						out->append("\\\"");
+						break;
+					case '\\':
+						out->append("\\\\");
+						break;
+					case '\n':
+						out->append("\\n");
+						break;
+					case '\r':
+						out->append("\\r");
+						break;
+					case '\t':
+						out->append("\\t");
+						break;
+					default:
+						// IRC does not guarantee that text is valid UTF-8 so other bytes are
+						// escaped as the code point with the same value. This is lossless.
+						char escape[8];
+						snprintf(escape, sizeof(escape), "\\u%04x", chr);
+						out->append(escape);
+						break;
+				}
+			}
+			out->append(str, copyfrom, std::string::npos);
+			out->push_back('"');
+		}
+
+		void Key(const char* name)
+		{
+			if (!first)
+				out->push_back(',');
+			first = false;
+
+			// Values inside a list do not have a name.
+			if (lists.empty() || lists.back())
+				return;
+
+			out->push_back('"');
+			out->append(name);
+			out->append("\":");
+		}
+
+		void Key(const std::string& name)
+		{
+			if (!first)
+				out->push_back(',');
+			first = false;
+
+			Escape(name);
+			out->push_back(':');
+		}
+
+		void Open(char chr, bool list)
+		{
+			out->push_back(chr);
+			lists.push_back(list);
+			first = true;
+		}
+
+		void Close(char chr)
+		{
+			out->push_back(chr);
+			lists.pop_back();
+			first = false;
+		}
+
+	 public:
+		const char* GetContentType() const override { return "application/json"; }
+
+		void BeginDocument() override { Open('{', false); }
+
+		void EndDocument() override { Close('}'); }
+
+		void BeginObject(const char* name, const char* attrname, const std::string& attrvalue) override
+		{
+			Key(name);
+			Open('{', false);
+			if (attrname)
+				String(attrname, attrvalue);
+		}
+
+		void EndObject(const char* name) override { Close('}'); }
+
+		void BeginList(const char* name, bool xmlwrap) override
+		{
+			Key(name);
+			Open('[', true);
+		}
+
+		void EndList(const char* name, bool xmlwrap) override { Close(']'); }
+
+		void String(const char* name, const std::string& value) override
+		{
+			Key(name);
+			Escape(value);
+		}
+
+		void Number(const char* name, const std::string& value) override
+		{
+			Key(name);
+			out->append(value);
+		}
+
+		void Flag(const char* name) override
+		{
+			Key(name);
+			out->append("true");
+		}
+
+		void Meta(const std::string& name, const std::string& value) override
+		{
+			Key(name);
+			Escape(value);
+		}
+	};
+
+	void DumpMeta(Writer& data, Extensible* ext)
+	{
+		data.BeginObject("metadata");
 		for (const auto& [item, obj] : ext->GetExtList())
 		{
 			const std::string value = item->ToHuman(ext, obj);
 			if (!value.empty())
-				data << "<meta name=\"" << item->name << "\">" << Sanitize(value) << "</meta>";
-			else if (!item->name.empty())
-				data << "<meta name=\"" << item->name << "\"/>";
+				data.Meta(item->name, value);
 		}
-		data << "</metadata>";
+		data.EndObject("metadata");
 	}
 
-	std::ostream& ServerInfo(std::ostream& data)
+	void ServerInfo(Writer& data)
 	{
-		return data << "<server><name>" << ServerInstance->Config->ServerName << "</name><description>"
-			<< Sanitize(ServerInstance->Config->ServerDesc) << "</description><version>"
-			<< Sanitize(ServerInstance->GetVersionString(true)) << "</version></server>";
+		data.BeginObject("server");
+		data.String("name", ServerInstance->Config->ServerName);
+		data.String("description", ServerInstance->Config->ServerDesc);
+		data.String("version", ServerInstance->GetVersionString(true));
+		data.EndObject("server");
 	}
 
-	std::ostream& ISupport(std::ostream& data)
+	void ISupport(Writer& data)
 	{
-		data << "<isupport>";
+		data.BeginList("isupport");
 
 		ISupport::TokenMap tokens;
 		isevprov->Call(&ISupport::EventListener::OnBuildISupport, tokens);
 		for (const auto& [key, value] : tokens)
 		{
-			data << "<token><name>" << Sanitize(key)
-				<< "</name><value>" << Sanitize(value)
-				<< "</value></token>";
+			data.BeginObject("token");
+			data.String("name", key);
+			data.String("value", value);
+			data.EndObject("token");
 		}
-		return data << "</isupport>";
+		data.EndList("isupport");
 	}
 
-	std::ostream& General(std::ostream& data)
+	void General(Writer& data)
 	{
-		data << "<general>";
-		data << "<usercount>" << ServerInstance->Users.GetUsers().size() << "</usercount>";
-		data << "<localusercount>" << ServerInstance->Users.GetLocalUsers().size() << "</localusercount>";
-		data << "<channelcount>" << ServerInstance->Channels.GetChans().size() << "</channelcount>";
-		data << "<opercount>" << ServerInstance->Users.all_opers.size() << "</opercount>";
-		data << "<socketcount>" << (SocketEngine::GetUsedFds()) << "</socketcount><socketmax>" << SocketEngine::GetMaxFds() << "</socketmax>";
-		data << "<uptime><boot_time_t>" << ServerInstance->startup_time << "</boot_time_t></uptime>";
-		data << "<currenttime>" << ServerInstance->Time() << "</currenttime>";
-
-		data << ISupport;
-		return data << "</general>";
+		data.BeginObject("general");
+		data.Number("usercount", ServerInstance->Users.GetUsers().size());
+		data.Number("localusercount", ServerInstance->Users.GetLocalUsers().size());
+		data.Number("channelcount", ServerInstance->Channels.GetChans().size());
+		data.Number("opercount", ServerInstance->Users.all_opers.size());
+		data.Number("socketcount", SocketEngine::GetUsedFds());
+		data.Number("socketmax", SocketEngine::GetMaxFds());
+		data.BeginObject("uptime");
+		data.Number("boot_time_t", ServerInstance->startup_time);
+		data.EndObject("uptime");
+		data.Number("currenttime", ServerInstance->Time());
+
+		if (*httpdapi)
+		{
+			const HTTPdStats& httpd = (*httpdapi)->GetStats();
+			data.BeginObject("httpd");
+			data.Number("accepted", httpd.accepted);
+			data.Number("refused", httpd.refused);
+			data.Number("open", httpd.open);
+			data.Number("requests", httpd.requests);
+			data.Number("reused", httpd.reused);
+			data.Number("idletimeouts", httpd.idletimeouts);
+			data.EndObject("httpd");
+		}
+
+		ISupport(data);
+		data.EndObject("general");
 	}
 
-	std::ostream& XLines(std::ostream& data)
+	void XLines(Writer& data)
 	{
-		data << "<xlines>";
+		data.BeginList("xlines");
 		for (const auto& xltype : ServerInstance->XLines->GetAllTypes())
 		{
 			XLineLookup* lookup = ServerInstance->XLines->GetAll(xltype);
@@ -152,134 +438,173 @@ namespace Stats
 
 			for (const auto& [_, xline] : *lookup)
 			{
-				data << "<xline type=\"" << xltype << "\"><mask>"
-					<< Sanitize(xline->Displayable()) << "</mask><settime>"
-					<< xline->set_time << "</settime><duration>" << xline->duration
-					<< "</duration><reason>" << Sanitize(xline->reason)
-					<< "</reason></xline>";
+				data.BeginObject("xline", "type", xltype);
+				data.String("mask", xline->Displayable());
+				data.Number("settime", xline->set_time);
+				data.Number("duration", xline->duration);
+				data.String("reason", xline->reason);
+				data.EndObject("xline");
 			}
 		}
-		return data << "</xlines>";
+		data.EndList("xlines");
 	}
 
-	std::ostream& Modules(std::ostream& data)
+	void Modules(Writer& data)
 	{
-		data << "<modulelist>";
+		data.BeginList("modulelist");
 		for (const auto& [modname, mod] : ServerInstance->Modules.GetModules())
 		{
-			data << "<module><name>" << modname << "</name><description>"
-				<< Sanitize(mod->description) << "</description></module>";
+			data.BeginObject("module");
+			data.String("name", modname);
+			data.String("description", mod->description);
+			data.EndObject("module");
 		}
-		return data << "</modulelist>";
+		data.EndList("modulelist");
 	}
 
-	std::ostream& Channels(std::ostream& data)
+	void DumpChannel(Writer& data, Channel* c)
 	{
-		data << "<channellist>";
-
-		for (const auto& [_, c] : ServerInstance->Channels.GetChans())
+		data.BeginObject("channel");
+		data.Number("usercount", c->GetUsers().size());
+		data.String("channelname", c->name);
+		data.BeginObject("channeltopic");
+		data.String("topictext", c->topic);
+		data.String("setby", c->setby);
+		data.Number("settime", c->topicset);
+		data.EndObject("channeltopic");
+		data.String("channelmodes", c->ChanModes(true));
+
+		data.BeginList("channelmembers", false);
+		for (const auto& [__, memb] : c->GetUsers())
 		{
-			data << "<channel>";
-			data << "<usercount>" << c->GetUsers().size() << "</usercount><channelname>" << Sanitize(c->name) << "</channelname>";
-			data << "<channeltopic>";
-			data << "<topictext>" << Sanitize(c->topic) << "</topictext>";
-			data << "<setby>" << Sanitize(c->setby) << "</setby>";
-			data << "<settime>" << c->topicset << "</settime>";
-			data << "</channeltopic>";
-			data << "<channelmodes>" << Sanitize(c->ChanModes(true)) << "</channelmodes>";
-
-			for (const auto& [__, memb] : c->GetUsers())
-			{
-				data << "<channelmember><uid>" << memb->user->uuid << "</uid><privs>"
-					<< Sanitize(memb->GetAllPrefixChars()) << "</privs><modes>"
-					<< memb->modes << "</modes>";
-				DumpMeta(data, memb);
-				data << "</channelmember>";
-			}
-
-			DumpMeta(data, c);
-
-			data << "</channel>";
+			data.BeginObject("channelmember");
+			data.String("uid", memb->user->uuid);
+			data.String("privs", memb->GetAllPrefixChars());
+			data.String("modes", memb->modes);
+			DumpMeta(data, memb);
+			data.EndObject("channelmember");
 		}
+		data.EndList("channelmembers", false);
 
-		return data << "</channellist>";
+		DumpMeta(data, c);
+		data.EndObject("channel");
 	}
 
-	std::ostream& DumpUser(std::ostream& data, User* u)
+	void DumpUser(Writer& data, User* u)
 	{
-		data << "<user>";
-		data << "<nickname>" << u->nick << "</nickname><uuid>" << u->uuid << "</uuid><realhost>"
-			<< u->GetRealHost() << "</realhost><displayhost>" << u->GetDisplayedHost() << "</displayhost><realname>"
-			<< Sanitize(u->GetRealName()) << "</realname><server>" << u->server->GetName() << "</server><signon>"
-			<< u->signon << "</signon><age>" << u->age << "</age>";
+		data.BeginObject("user");
+		data.String("nickname", u->nick);
+		data.String("uuid", u->uuid);
+		data.String("realhost", u->GetRealHost());
+		data.String("displayhost", u->GetDisplayedHost());
+		data.String("realname", u->GetRealName());
+		data.String("server", u->server->GetName());
+		data.Number("signon", u->signon);
+		data.Number("age", u->age);
 
 		if (u->IsAway())
-			data << "<away>" << Sanitize(u->awaymsg) << "</away><awaytime>" << u->awaytime << "</awaytime>";
+		{
+			data.String("away", u->awaymsg);
+			data.Number("awaytime", u->awaytime);
+		}
 
 		if (u->IsOper())
-			data << "<opertype>" << Sanitize(u->oper->name) << "</opertype>";
+			data.String("opertype", u->oper->name);
 
-		data << "<modes>" << u->GetModeLetters().substr(1) << "</modes><ident>" << Sanitize(u->ident) << "</ident>";
+		data.String("modes", u->GetModeLetters().substr(1));
+		data.String("ident", u->ident);
 
 		LocalUser* lu = IS_LOCAL(u);
 		if (lu)
-			data << "<local/><port>" << lu->server_sa.port() << "</port><servaddr>"
-				<< lu->server_sa.str() << "</servaddr><connectclass>"
-				<< lu->GetClass()->GetName() << "</connectclass><lastmsg>"
-				<< lu->idle_lastmsg << "</lastmsg>";
+		{
+			data.Flag("local");
+			data.Number("port", lu->server_sa.port());
+			data.String("servaddr", lu->server_sa.str());
+			data.String("connectclass", lu->GetClass()->GetName());
+			data.Number("lastmsg", lu->idle_lastmsg);
+		}
 
-		data << "<ipaddress>" << u->GetIPString() << "</ipaddress>";
+		data.String("ipaddress", u->GetIPString());
 
 		DumpMeta(data, u);
-
-		data << "</user>";
-		return data;
+		data.EndObject("user");
 	}
 
-	std::ostream& Users(std::ostream& data)
+	void Servers(Writer& data)
 	{
-		data << "<userlist>";
-		for (const auto& [_, u] : ServerInstance->Users.GetUsers())
-		{
-			if (u->registered != REG_ALL)
-				continue;
-
-			DumpUser(data, u);
-		}
-		return data << "</userlist>";
-	}
-
-	std::ostream& Servers(std::ostream& data)
-	{
-		data << "<serverlist>";
+		data.BeginList("serverlist");
 
 		ProtocolInterface::ServerList sl;
 		ServerInstance->PI->GetServerList(sl);
 
 		for (const auto& server : sl)
 		{
-			data << "<server>";
-			data << "<servername>" << server.servername << "</servername>";
-			data << "<parentname>" << server.parentname << "</parentname>";
-			data << "<description>" << Sanitize(server.description) << "</description>";
-			data << "<usercount>" << server.usercount << "</usercount>";
-			data << "<opercount>" << server.opercount << "</opercount>";
-			data << "<lagmillisecs>" << server.latencyms << "</lagmillisecs>";
-			data << "</server>";
+			data.BeginObject("server");
+			data.String("servername", server.servername);
+			data.String("parentname", server.parentname);
+			data.String("description", server.description);
+			data.Number("usercount", server.usercount);
+			data.Number("opercount", server.opercount);
+			data.Number("lagmillisecs", server.latencyms);
+			data.EndObject("server");
 		}
 
-		return data << "</serverlist>";
+		data.EndList("serverlist");
 	}
 
-	std::ostream& Commands(std::ostream& data)
+	void Commands(Writer& data)
 	{
-		data << "<commandlist>";
-
+		data.BeginList("commandlist");
 		for (const auto& [cmdname, cmd] : ServerInstance->Parser.GetCommands())
 		{
-			data << "<command><name>" << cmdname << "</name><usecount>" << cmd->use_count << "</usecount></command>";
+			data.BeginObject("command");
+			data.String("name", cmdname);
+			data.Number("usecount", cmd->use_count);
+
+			// The execution times are recorded in nanoseconds but shown in microseconds.
+			const insp::log2_histogram& exectime = *cmd->exec_time;
+			if (exectime.get_count())
+			{
+				data.BeginObject("exectime");
+				data.Number("count", exectime.get_count());
+				data.Number("total", exectime.get_sum() / 1000);
+				data.Number("mean", exectime.get_mean() / 1000);
+				data.Number("p50", exectime.get_percentile(50) / 1000);
+				data.Number("p90", exectime.get_percentile(90) / 1000);
+				data.Number("p99", exectime.get_percentile(99) / 1000);
+				data.Number("max", exectime.get_max() / 1000);
+				data.EndObject("exectime");
+			}
+			data.EndObject("command");
 		}
-		return data << "</commandlist>";
+		data.EndList("commandlist");
+	}
+
+	/** The STATS symbols which can be retrieved over HTTP. These only contain statistics (no
+	 * configuration or user details) and their handlers do not depend on who is asking for them
+	 * so they are safe to generate with the fake client as the source.
+	 */
+	const std::string_view SafeSymbols = "bDhQ";
+
+	void StatsSymbol(Writer& data, char symbol)
+	{
+		// Only the statistics provided by modules are available here.
+		Stats::Context stats(ServerInstance->FakeClient, symbol);
+		statsevprov->FirstResult(&Stats::EventListener::OnStats, stats);
+
+		data.BeginObject("stats", "symbol", std::string(1, symbol));
+		data.BeginList("rows", false);
+		for (const auto& row : stats.GetRows())
+		{
+			data.BeginObject("row", "numeric", ConvToStr(row.GetNumeric()));
+			data.BeginList("params", false);
+			for (const auto& param : row.GetParams())
+				data.String("param", param);
+			data.EndList("params", false);
+			data.EndObject("row");
+		}
+		data.EndList("rows", false);
+		data.EndObject("stats");
 	}
 
 	enum OrderBy
@@ -317,70 +642,249 @@ namespace Stats
 		}
 	};
 
-	std::ostream& ListUsers(std::ostream& data, const HTTPQueryParameters& params)
+	/** The filters which select the users in the user list. */
+	struct UserFilter final
+	{
+		size_t limit = 0;
+		bool showunreg = false;
+		bool localonly = false;
+		unsigned long min_idle = 0;
+		OrderBy orderby = OB_NONE;
+		bool desc = false;
+
+		UserFilter() = default;
+
+		UserFilter(const HTTPQueryParameters& params)
+		{
+			// Filters
+			limit = params.getNum<size_t>("limit");
+			showunreg = params.getBool("showunreg");
+			localonly = params.getBool("localonly");
+
+			// Minimum time since a user's last message
+			min_idle = params.getDuration("minidle");
+			if (min_idle)
+				// We can only check idle times on local users
+				localonly = true;
+
+			// Sorting
+			const std::string& sortmethod = params.getString("sortby");
+			desc = params.getBool("desc", false);
+
+			if (stdalgo::string::equalsci(sortmethod, "nick"))
+				orderby = OB_NICK;
+			else if (stdalgo::string::equalsci(sortmethod, "lastmsg"))
+			{
+				orderby = OB_LASTMSG;
+				// We can only check idle times on local users
+				localonly = true;
+			}
+		}
+
+		/** Retrieves the UUIDs of the users which match this filter in the order they should be listed. */
+		std::vector<std::string> GetUsers() const
+		{
+			const time_t maxlastmsg = ServerInstance->Time() - min_idle;
+
+			std::vector<User*> user_list;
+			for (const auto& [_, u] : ServerInstance->Users.GetUsers())
+			{
+				if (!showunreg && u->registered != REG_ALL)
+					continue;
+
+				LocalUser* lu = IS_LOCAL(u);
+				if (localonly && !lu)
+					continue;
+
+				if (min_idle && lu->idle_lastmsg > maxlastmsg)
+					continue;
+
+				user_list.push_back(u);
+			}
+
+			if (orderby != OB_NONE)
+				std::stable_sort(user_list.begin(), user_list.end(), UserSorter(orderby, desc));
+
+			if (limit && user_list.size() > limit)
+				user_list.resize(limit);
+
+			std::vector<std::string> uuids;
+			uuids.reserve(user_list.size());
+			for (const auto* u : user_list)
+				uuids.push_back(u->uuid);
+			return uuids;
+		}
+	};
+
+	/** The sections which can be included in a document. */
+	enum Section
+	{
+		SECTION_SERVER,
+		SECTION_GENERAL,
+		SECTION_XLINES,
+		SECTION_MODULES,
+		SECTION_CHANNELS,
+		SECTION_USERS,
+		SECTION_SERVERS,
+		SECTION_COMMANDS,
+		SECTION_STATS
+	};
+
+	/** Generates a statistics document as the client reads it. Channels and users are listed
+	 * by name so that any which are deleted whilst the document is being sent are skipped.
+	 */
+	class Document final
+		: public HTTPDocumentStream
 	{
-		if (params.empty())
-			return Users(data);
+	 private:
+		/** The writer for the format of the document. */
+		std::unique_ptr<Writer> writer;
 
-		data << "<userlist>";
+		/** The sections which have not been written yet. */
+		std::deque<Section> sections;
 
-		// Filters
-		size_t limit = params.getNum<size_t>("limit");
-		bool showunreg = params.getBool("showunreg");
-		bool localonly = params.getBool("localonly");
+		/** The filter for the users section. */
+		UserFilter userfilter;
 
-		// Minimum time since a user's last message
-		unsigned long min_idle = params.getDuration("minidle");
-		time_t maxlastmsg = ServerInstance->Time() - min_idle;
+		/** The symbol for the stats section. */
+		char symbol = 0;
 
-		if (min_idle)
-			// We can only check idle times on local users
-			localonly = true;
+		/** Whether the document has been started. */
+		bool started = false;
 
-		// Sorting
-		const std::string& sortmethod = params.getString("sortby");
-		bool desc = params.getBool("desc", false);
+		/** Whether a list section is currently being written. */
+		bool inlist = false;
 
-		OrderBy orderby;
-		if (stdalgo::string::equalsci(sortmethod, "nick"))
-			orderby = OB_NICK;
-		else if (stdalgo::string::equalsci(sortmethod, "lastmsg"))
+		/** The names of the channels or UUIDs of the users in the current list section. */
+		std::vector<std::string> names;
+
+		/** The position of the next entry in names. */
+		size_t position = 0;
+
+		void BeginListSection(Section section)
 		{
-			orderby = OB_LASTMSG;
-			// We can only check idle times on local users
-			localonly = true;
+			inlist = true;
+			position = 0;
+			names.clear();
+			if (section == SECTION_CHANNELS)
+			{
+				writer->BeginList("channellist");
+				names.reserve(ServerInstance->Channels.GetChans().size());
+				for (const auto& [_, c] : ServerInstance->Channels.GetChans())
+					names.push_back(c->name);
+			}
+			else
+			{
+				writer->BeginList("userlist");
+				names = userfilter.GetUsers();
+			}
 		}
-		else
-			orderby = OB_NONE;
 
-		typedef std::list<User*> NewUserList;
-		NewUserList user_list;
-		for (const auto& [_, u] : ServerInstance->Users.GetUsers())
+		void WriteListEntry(Section section)
 		{
-			if (!showunreg && u->registered != REG_ALL)
-				continue;
+			const std::string& name = names[position++];
+			if (section == SECTION_CHANNELS)
+			{
+				Channel* c = ServerInstance->Channels.Find(name);
+				if (c)
+					DumpChannel(*writer, c);
+			}
+			else
+			{
+				User* u = ServerInstance->Users.FindUUID(name);
+				if (u && !u->quitting)
+					DumpUser(*writer, u);
+			}
+		}
 
-			LocalUser* lu = IS_LOCAL(u);
-			if (localonly && !lu)
-				continue;
+		void WriteSection(Section section)
+		{
+			switch (section)
+			{
+				case SECTION_SERVER:
+					ServerInfo(*writer);
+					break;
+				case SECTION_GENERAL:
+					General(*writer);
+					break;
+				case SECTION_XLINES:
+					XLines(*writer);
+					break;
+				case SECTION_MODULES:
+					Modules(*writer);
+					break;
+				case SECTION_CHANNELS:
+				case SECTION_USERS:
+					BeginListSection(section);
+					break;
+				case SECTION_SERVERS:
+					Servers(*writer);
+					break;
+				case SECTION_COMMANDS:
+					Commands(*writer);
+					break;
+				case SECTION_STATS:
+					StatsSymbol(*writer, symbol);
+					break;
+			}
+		}
 
-			if (min_idle && lu->idle_lastmsg > maxlastmsg)
-				continue;
+	 public:
+		Document(std::unique_ptr<Writer> w, const UserFilter& filter)
+			: writer(std::move(w))
+			, userfilter(filter)
+		{
+		}
 
-			user_list.push_back(u);
+		/** Adds a section to the end of the document. */
+		void AddSection(Section section, char sym = 0)
+		{
+			sections.push_back(section);
+			if (sym)
+				symbol = sym;
 		}
 
-		UserSorter sorter(orderby, desc);
-		if (sorter.order != OB_NONE && !(!localonly && sorter.order == OB_LASTMSG))
-			user_list.sort(sorter);
+		const char* GetContentType() const { return writer->GetContentType(); }
 
-		size_t count = 0;
-		for (NewUserList::const_iterator i = user_list.begin(); i != user_list.end() && (!limit || count < limit); ++i, ++count)
-			DumpUser(data, *i);
+		bool Generate(std::string& out, size_t hint) override
+		{
+			writer->out = &out;
+			if (!started)
+			{
+				writer->BeginDocument();
+				started = true;
+			}
 
-		data << "</userlist>";
-		return data;
-	}
+			while (out.size() < hint)
+			{
+				if (inlist)
+				{
+					if (position < names.size())
+					{
+						WriteListEntry(sections.front());
+						continue;
+					}
+
+					writer->EndList(sections.front() == SECTION_CHANNELS ? "channellist" : "userlist");
+					names = std::vector<std::string>();
+					inlist = false;
+					sections.pop_front();
+					continue;
+				}
+
+				if (sections.empty())
+				{
+					writer->EndDocument();
+					return false;
+				}
+
+				WriteSection(sections.front());
+				if (!inlist)
+					sections.pop_front();
+			}
+			return true;
+		}
+	};
 }
 
 class ModuleHttpStats : public Module, public HTTPRequestEventListener
@@ -388,16 +892,47 @@ class ModuleHttpStats : public Module, public HTTPRequestEventListener
  private:
 	HTTPdAPI API;
 	ISupport::EventProvider isupportevprov;
+	Events::ModuleEventProvider statsprov;
 	bool enableparams = false;
 
+	/** Adds the sections named in a comma separated list to a document.
+	 * @return True if all of the sections are known; otherwise, false.
+	 */
+	static bool AddSections(Stats::Document& doc, const std::string& list)
+	{
+		static const insp::flat_map<std::string, Stats::Section> sectionnames = {
+			{ "server",   Stats::SECTION_SERVER   },
+			{ "general",  Stats::SECTION_GENERAL  },
+			{ "xlines",   Stats::SECTION_XLINES   },
+			{ "modules",  Stats::SECTION_MODULES  },
+			{ "channels", Stats::SECTION_CHANNELS },
+			{ "users",    Stats::SECTION_USERS    },
+			{ "servers",  Stats::SECTION_SERVERS  },
+			{ "commands", Stats::SECTION_COMMANDS },
+		};
+
+		irc::commasepstream sectionstream(list);
+		for (std::string name; sectionstream.GetToken(name); )
+		{
+			auto it = sectionnames.find(name);
+			if (it == sectionnames.end())
+				return false;
+			doc.AddSection(it->second);
+		}
+		return true;
+	}
+
  public:
 	ModuleHttpStats()
 		: Module(VF_VENDOR, "Provides XML-serialised statistics about the server, channels, and users over HTTP via the /stats path.")
 		, HTTPRequestEventListener(this)
 		, API(this)
 		, isupportevprov(this)
+		, statsprov(this, "event/stats")
 	{
 		isevprov = &isupportevprov;
+		statsevprov = &statsprov;
+		httpdapi = &API;
 	}
 
 	void ReadConfig(ConfigStatus& status) override
@@ -412,52 +947,68 @@ class ModuleHttpStats : public Module, public HTTPRequestEventListener
 
 	ModResult HandleRequest(HTTPRequest* http)
 	{
-		if (http->GetPath() != "/stats")
+		if (http->GetPath() != "/stats" && http->GetPath().compare(0, 7, "/stats/"))
 			return MOD_RES_PASSTHRU;
 
 		ServerInstance->Logs.Log(MODNAME, LOG_DEBUG, "Handling HTTP request for %s", http->GetPath().c_str());
 
-		bool found = true;
-		std::stringstream data;
-		data << "<inspircdstats>";
+		const HTTPQueryParameters& params = http->GetParsedURI().query_params;
+		std::unique_ptr<Stats::Writer> writer;
+		if (stdalgo::string::equalsci(params.getString("format"), "json"))
+			writer = std::make_unique<Stats::JSONWriter>();
+		else
+			writer = std::make_unique<Stats::XMLWriter>();
+
+		Stats::UserFilter filter;
+		if (enableparams && http->GetPath() == "/stats/users")
+			filter = Stats::UserFilter(params);
 
+		auto doc = std::make_unique<Stats::Document>(std::move(writer), filter);
+		unsigned int responsecode = 200;
 		if (http->GetPath() == "/stats")
 		{
-			data << Stats::ServerInfo << Stats::General
-				<< Stats::XLines << Stats::Modules
-				<< Stats::Channels << Stats::Users
-				<< Stats::Servers << Stats::Commands;
+			std::string sections;
+			if (!params.get("sections", sections))
+				sections = "server,general,xlines,modules,channels,users,servers,commands";
+
+			if (!AddSections(*doc, sections))
+				responsecode = 400;
 		}
 		else if (http->GetPath() == "/stats/general")
 		{
-			data << Stats::General;
+			doc->AddSection(Stats::SECTION_GENERAL);
 		}
 		else if (http->GetPath() == "/stats/users")
 		{
-			if (enableparams)
-				Stats::ListUsers(data, http->GetParsedURI().query_params);
+			doc->AddSection(Stats::SECTION_USERS);
+		}
+		else if (http->GetPath() == "/stats/stats")
+		{
+			const std::string symbol = params.getString("symbol");
+			if (symbol.length() == 1 && Stats::SafeSymbols.find(symbol[0]) != std::string_view::npos)
+				doc->AddSection(Stats::SECTION_STATS, symbol[0]);
 			else
-				data << Stats::Users;
+				responsecode = 404;
 		}
 		else
 		{
-			found = false;
+			responsecode = 404;
 		}
 
-		if (found)
-		{
-			data << "</inspircdstats>";
-		}
-		else
+		if (responsecode != 200)
 		{
-			data.clear();
-			data.str(std::string());
+			std::stringstream data;
+			HTTPDocumentResponse response(this, *http, &data, responsecode);
+			response.headers.SetHeader("X-Powered-By", MODNAME);
+			API->SendResponse(response);
+			return MOD_RES_DENY; // Handled
 		}
 
-		/* Send the document back to m_httpd */
-		HTTPDocumentResponse response(this, *http, &data, found ? 200 : 404);
+		/* Send the document back to m_httpd as it is generated */
+		const char* contenttype = doc->GetContentType();
+		HTTPDocumentResponse response(this, *http, std::move(doc), responsecode);
 		response.headers.SetHeader("X-Powered-By", MODNAME);
-		response.headers.SetHeader("Content-Type", "text/xml");
+		response.headers.SetHeader("Content-Type", contenttype);
 		API->SendResponse(response);
 		return MOD_RES_DENY; // Handled
 	}
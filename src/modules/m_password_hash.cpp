@@ -131,8 +131,8 @@ class ModulePasswordHash : public Module
 
 		HashProvider* hp = ServerInstance->Modules.FindDataService<HashProvider>("hash/" + hashtype);
 
-		/* Is this a valid hash name? */
-		if (hp)
+		/* Is this a valid hash name? Key derivation functions are compared by the core so it can do it off the main thread. */
+		if (hp && !hp->IsKDF())
 		{
 			if (hp->Compare(input, data))
 				return MOD_RES_ALLOW;
@@ -26,6 +26,7 @@
 
 #include "inspircd.h"
 #include "modules/exemption.h"
+#include "utility/editdistance.h"
 
 class ChannelSettings
 {
@@ -72,7 +73,8 @@ class RepeatMode : public ParamMode<RepeatMode, SimpleExtItem<ChannelSettings> >
 	{
 		time_t ts;
 		std::string line;
-		RepeatItem(time_t TS, const std::string& Line) : ts(TS), line(Line) { }
+		size_t hash;
+		RepeatItem(time_t TS, const std::string& Line, size_t Hash) : ts(TS), line(Line), hash(Hash) { }
 	};
 
 	typedef std::deque<RepeatItem> RepeatItemList;
@@ -94,34 +96,34 @@ class RepeatMode : public ParamMode<RepeatMode, SimpleExtItem<ChannelSettings> >
 
 	};
 
-	std::vector<size_t> mx[2];
+	/** The case folded form of the message which is currently being checked. */
+	std::string folded;
 
-	bool CompareLines(const std::string& message, const std::string& historyline, unsigned long trigger)
-	{
-		if (message == historyline)
-			return true;
-		else if (trigger)
-			return (Levenshtein(message, historyline) <= trigger);
+	/** The hash of the case folded form of the message which is currently being checked. */
+	size_t foldedhash = 0;
 
-		return false;
-	}
+	/** Matches the current message against the backlog when fuzzy matching is enabled. */
+	insp::edit_distance matcher;
 
-	size_t Levenshtein(const std::string& s1, const std::string& s2)
+	/** Whether the current message has been loaded into the matcher yet. */
+	bool matcherready = false;
+
+	bool CompareLines(const RepeatItem& item, unsigned long trigger)
 	{
-		size_t l1 = s1.size();
-		size_t l2 = s2.size();
+		if (item.hash == foldedhash && item.line == folded)
+			return true;
 
-		for (size_t i = 0; i < l2; i++)
-			mx[0][i] = i;
-		for (size_t i = 0; i < l1; i++)
-		{
-			mx[1][0] = i + 1;
-			for (size_t j = 0; j < l2; j++)
-				mx[1][j + 1] = std::min(std::min(mx[1][j] + 1, mx[0][j + 1] + 1), mx[0][j] + ((s1[i] == s2[j]) ? 0 : 1));
+		// The edit distance can never be less than the difference in length so lines which
+		// are obviously too different can be skipped without building the match vectors.
+		if (!trigger || (std::max(item.line.size(), folded.size()) - std::min(item.line.size(), folded.size()) > trigger))
+			return false;
 
-			mx[0].swap(mx[1]);
+		if (!matcherready)
+		{
+			matcher.set_pattern(folded);
+			matcherready = true;
 		}
-		return mx[0][l2];
+		return matcher.distance(item.line, trigger) <= trigger;
 	}
 
  public:
@@ -167,12 +169,14 @@ class RepeatMode : public ParamMode<RepeatMode, SimpleExtItem<ChannelSettings> >
 		return MODEACTION_ALLOW;
 	}
 
-	bool MatchLine(Membership* memb, ChannelSettings* rs, std::string message)
+	bool MatchLine(Membership* memb, ChannelSettings* rs, const std::string& message)
 	{
 		// If the message is larger than whatever size it's set to,
 		// let's pretend it isn't. If the first 512 (def. setting) match, it's probably spam.
-		if (message.size() > ms.MaxMessageSize)
-			message.erase(ms.MaxMessageSize);
+		folded.assign(message, 0, ms.MaxMessageSize);
+		std::transform(folded.begin(), folded.end(), folded.begin(), ::tolower);
+		foldedhash = std::hash<std::string>()(folded);
+		matcherready = false;
 
 		MemberInfo* rp = MemberInfoExt.Get(memb);
 		if (!rp)
@@ -186,11 +190,9 @@ class RepeatMode : public ParamMode<RepeatMode, SimpleExtItem<ChannelSettings> >
 			matches = rp->Counter;
 
 		RepeatItemList& items = rp->ItemList;
-		const unsigned long trigger = (message.size() * rs->Diff / 100);
+		const unsigned long trigger = (folded.size() * rs->Diff / 100);
 		const time_t now = ServerInstance->Time();
 
-		std::transform(message.begin(), message.end(), message.begin(), ::tolower);
-
 		for (std::deque<RepeatItem>::iterator it = items.begin(); it != items.end(); ++it)
 		{
 			if (it->ts < now)
@@ -200,7 +202,7 @@ class RepeatMode : public ParamMode<RepeatMode, SimpleExtItem<ChannelSettings> >
 				break;
 			}
 
-			if (CompareLines(message, it->line, trigger))
+			if (CompareLines(*it, trigger))
 			{
 				if (++matches >= rs->Lines)
 				{
@@ -221,21 +223,11 @@ class RepeatMode : public ParamMode<RepeatMode, SimpleExtItem<ChannelSettings> >
 		if (items.size() >= max_items)
 			items.pop_back();
 
-		items.push_front(RepeatItem(now + rs->Seconds, message));
+		items.push_front(RepeatItem(now + rs->Seconds, folded, foldedhash));
 		rp->Counter = matches;
 		return false;
 	}
 
-	void Resize(size_t size)
-	{
-		size_t newsize = size+1;
-		if (newsize <= mx[0].size())
-			return;
-		ms.MaxMessageSize = size;
-		mx[0].resize(newsize);
-		mx[1].resize(newsize);
-	}
-
 	void ReadConfig()
 	{
 		auto conf = ServerInstance->Config->ConfValue("repeat");
@@ -245,10 +237,7 @@ class RepeatMode : public ParamMode<RepeatMode, SimpleExtItem<ChannelSettings> >
 
 		ms.MaxDiff = static_cast<unsigned int>(conf->getUInt("maxdistance", 50, 0, 100));
 
-		unsigned long newsize = conf->getUInt("size", 512);
-		if (newsize > ServerInstance->Config->Limits.MaxLine)
-			newsize = ServerInstance->Config->Limits.MaxLine;
-		Resize(newsize);
+		ms.MaxMessageSize = std::min<size_t>(conf->getUInt("size", 512), ServerInstance->Config->Limits.MaxLine);
 
 		ms.KickMessage = conf->getString("kickmessage", "Repeat flood");
 	}
@@ -182,7 +182,147 @@ class SilenceEntry
 	}
 };
 
-typedef insp::flat_set<SilenceEntry> SilenceList;
+class SilenceList final
+{
+ public:
+	typedef insp::flat_set<SilenceEntry> EntryList;
+
+	/** The maximum number of verdicts to cache before the cache is emptied. */
+	static constexpr size_t MAX_VERDICTS = 256;
+
+ private:
+	/** The combined flags of all entries which match a mask. */
+	struct Verdict final
+	{
+		/** The flags which the mask is silenced for. */
+		uint32_t silenced = SilenceEntry::SF_NONE;
+
+		/** The flags which the mask is exempted from silencing for. */
+		uint32_t exempted = SilenceEntry::SF_NONE;
+
+		void Add(uint32_t flags)
+		{
+			if (flags & SilenceEntry::SF_EXEMPT)
+				exempted |= flags;
+			else
+				silenced |= flags;
+		}
+
+		void Add(const Verdict& other)
+		{
+			silenced |= other.silenced;
+			exempted |= other.exempted;
+		}
+	};
+
+	typedef std::unordered_map<std::string, Verdict, irc::insensitive, irc::StrHashComp> VerdictMap;
+
+	/** The entries in this silence list. */
+	EntryList entries;
+
+	/** Whether the entries have changed since the list was last compiled. */
+	bool dirty = true;
+
+	/** Entries with a mask that contains no wildcards, keyed by their mask. */
+	VerdictMap exact;
+
+	/** Entries with a mask of the form *!*@host where the host contains no wildcards, keyed by their host. */
+	VerdictMap hosts;
+
+	/** Entries which have to be matched with InspIRCd::Match. */
+	std::vector<std::pair<std::string, uint32_t>> wildcards;
+
+	/** Silenced flags for recently seen senders, keyed by their mask generation. */
+	std::unordered_map<uint64_t, uint32_t> verdicts;
+
+	/** Sorts the entries into the lookup buckets and discards any cached verdicts. */
+	void Compile()
+	{
+		exact.clear();
+		hosts.clear();
+		wildcards.clear();
+		verdicts.clear();
+
+		for (const auto& entry : entries)
+		{
+			const size_t wildpos = entry.mask.find_first_of("*?");
+			if (wildpos == std::string::npos)
+				exact[entry.mask].Add(entry.flags);
+			else if (entry.mask.compare(0, 4, "*!*@") == 0 && entry.mask.find_first_of("*?", 4) == std::string::npos)
+				hosts[entry.mask.substr(4)].Add(entry.flags);
+			else
+				wildcards.emplace_back(entry.mask, entry.flags);
+		}
+		dirty = false;
+	}
+
+ public:
+	bool Add(uint32_t flags, const std::string& mask)
+	{
+		if (!entries.emplace(flags, mask).second)
+			return false;
+
+		dirty = true;
+		return true;
+	}
+
+	bool Remove(uint32_t flags, const std::string& mask)
+	{
+		for (EntryList::iterator iter = entries.begin(); iter != entries.end(); ++iter)
+		{
+			if (!irc::equals(iter->mask, mask) || iter->flags != flags)
+				continue;
+
+			entries.erase(iter);
+			dirty = true;
+			return true;
+		}
+		return false;
+	}
+
+	EntryList::const_iterator begin() const { return entries.begin(); }
+	EntryList::const_iterator end() const { return entries.end(); }
+	size_t size() const { return entries.size(); }
+
+	/** Retrieves the flags which a sender is silenced for.
+	 * @param source The user who is sending a message.
+	 * @param generation The mask generation of the sender. This changes whenever the nick,
+	 *                   ident, or displayed host of the sender changes.
+	 */
+	uint32_t GetSilencedFlags(User* source, uint64_t generation)
+	{
+		if (dirty)
+			Compile();
+
+		auto cached = verdicts.find(generation);
+		if (cached != verdicts.end())
+			return cached->second;
+
+		// Exempt entries always sort before other entries so rather than searching for the
+		// first matching entry we can combine the flags of every matching entry.
+		Verdict verdict;
+		auto eiter = exact.find(source->GetFullHost());
+		if (eiter != exact.end())
+			verdict.Add(eiter->second);
+
+		auto hiter = hosts.find(source->GetDisplayedHost());
+		if (hiter != hosts.end())
+			verdict.Add(hiter->second);
+
+		for (const auto& [mask, flags] : wildcards)
+		{
+			if (InspIRCd::Match(source->GetFullHost(), mask))
+				verdict.Add(flags);
+		}
+
+		if (verdicts.size() >= MAX_VERDICTS)
+			verdicts.clear();
+
+		const uint32_t silenced = verdict.silenced & ~verdict.exempted;
+		verdicts.emplace(generation, silenced);
+		return silenced;
+	}
+};
 
 class SilenceExtItem : public SimpleExtItem<SilenceList>
 {
@@ -238,7 +378,7 @@ class SilenceExtItem : public SimpleExtItem<SilenceList>
 			}
 
 			// Store the silence entry.
-			list->emplace(flags, mask);
+			list->Add(flags, mask);
 		}
 
 		// The value was well formed.
@@ -249,7 +389,7 @@ class SilenceExtItem : public SimpleExtItem<SilenceList>
 	{
 		SilenceList* list = static_cast<SilenceList*>(item);
 		std::string buf;
-		for (SilenceList::const_iterator iter = list->begin(); iter != list->end(); ++iter)
+		for (SilenceList::EntryList::const_iterator iter = list->begin(); iter != list->end(); ++iter)
 		{
 			if (iter != list->begin())
 				buf.push_back(' ');
@@ -293,7 +433,7 @@ class CommandSilence : public SplitCommand
 			ext.Set(user, list);
 		}
 
-		if (!list->emplace(flags, mask).second)
+		if (!list->Add(flags, mask))
 		{
 			user->WriteNumeric(ERR_SILENCE, mask, SilenceEntry::BitsToFlags(flags), "The SILENCE entry you specified already exists");
 			return CmdResult::FAILURE;
@@ -307,18 +447,11 @@ class CommandSilence : public SplitCommand
 	CmdResult RemoveSilence(LocalUser* user, const std::string& mask, uint32_t flags)
 	{
 		SilenceList* list = ext.Get(user);
-		if (list)
+		if (list && list->Remove(flags, mask))
 		{
-			for (SilenceList::iterator iter = list->begin(); iter != list->end(); ++iter)
-			{
-				if (!irc::equals(iter->mask, mask) || iter->flags != flags)
-					continue;
-
-				list->erase(iter);
-				SilenceMessage msg("-" + mask, SilenceEntry::BitsToFlags(flags));
-				user->Send(msgprov, msg);
-				return CmdResult::SUCCESS;
-			}
+			SilenceMessage msg("-" + mask, SilenceEntry::BitsToFlags(flags));
+			user->Send(msgprov, msg);
+			return CmdResult::SUCCESS;
 		}
 
 		user->WriteNumeric(ERR_SILENCE, mask, SilenceEntry::BitsToFlags(flags), "The SILENCE entry you specified could not be found");
@@ -397,6 +530,23 @@ class ModuleSilence
 	bool exemptservice;
 	CommandSilence cmd;
 
+	/** The mask generation of each user who has sent a message to someone with a silence list. */
+	SimpleExtItem<uint64_t> maskgenext;
+
+	/** The last mask generation which was assigned to a user. */
+	uint64_t lastmaskgen = 0;
+
+	uint64_t GetMaskGeneration(User* user)
+	{
+		uint64_t* generation = maskgenext.Get(user);
+		if (!generation)
+		{
+			generation = new uint64_t(++lastmaskgen);
+			maskgenext.Set(user, generation, false);
+		}
+		return *generation;
+	}
+
 	ModResult BuildChannelExempts(User* source, Channel* channel, SilenceEntry::SilenceFlags flag, CUList& exemptions)
 	{
 		for (const auto& [user, _] : channel->GetUsers())
@@ -420,16 +570,7 @@ class ModuleSilence
 		if (!list)
 			return true;
 
-		for (const auto& entry : *list)
-		{
-			if (!(entry.flags & flag))
-				continue;
-
-			if (InspIRCd::Match(source->GetFullHost(), entry.mask))
-				return entry.flags & SilenceEntry::SF_EXEMPT;
-		}
-
-		return true;
+		return !(list->GetSilencedFlags(source, GetMaskGeneration(source)) & flag);
 	}
 
  public:
@@ -438,6 +579,7 @@ class ModuleSilence
 		, CTCTags::EventListener(this)
 		, ISupport::EventListener(this)
 		, cmd(this)
+		, maskgenext(this, "silence_maskgen", ExtensionItem::EXT_USER)
 	{
 	}
 
@@ -448,6 +590,22 @@ class ModuleSilence
 		cmd.ext.maxsilence = tag->getUInt("maxentries", 32, 1);
 	}
 
+	void OnChangeHost(User* user, const std::string& newhost) override
+	{
+		// Cached verdicts are keyed by the generation so a new one invalidates them.
+		maskgenext.Unset(user, false);
+	}
+
+	void OnChangeIdent(User* user, const std::string& newident) override
+	{
+		maskgenext.Unset(user, false);
+	}
+
+	void OnUserPostNick(User* user, const std::string& oldnick) override
+	{
+		maskgenext.Unset(user, false);
+	}
+
 	void OnBuildISupport(ISupport::TokenMap& tokens) override
 	{
 		tokens["ESILENCE"] = "CcdiNnPpTtx";
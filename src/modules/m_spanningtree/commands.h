@@ -107,11 +107,11 @@ class CommandMetadata : public ServerCommand
 	};
 };
 
-class CommandUID : public ServerOnlyServerCommand<CommandUID>
+class CommandUID : public ParsedServerCommand
 {
  public:
-	CommandUID(Module* Creator) : ServerOnlyServerCommand<CommandUID>(Creator, "UID", 10) { }
-	CmdResult HandleServer(TreeServer* server, CommandBase::Params& params);
+	CommandUID(Module* Creator) : ParsedServerCommand(Creator, "UID", 10) { }
+	CmdResult HandleParsed(User* user, ParsedLine& line, LineArena& arena) override;
 
 	class Builder : public CmdBuilder
 	{
@@ -135,7 +135,7 @@ class CommandOpertype : public UserOnlyServerCommand<CommandOpertype>
 
 class TreeSocket;
 class FwdFJoinBuilder;
-class CommandFJoin : public ServerCommand
+class CommandFJoin : public ParsedServerCommand
 {
 	/** Remove all modes from a channel, including statusmodes (+qaovh etc), simplemodes, parameter modes.
 	 * This does not update the timestamp of the target channel, this must be done separately.
@@ -150,11 +150,15 @@ class CommandFJoin : public ServerCommand
 	 * @param newname The new name of the channel; must be the same or a case change of the current name
 	 */
 	static void LowerTS(Channel* chan, time_t TS, const std::string& newname);
-	void ProcessModeUUIDPair(const std::string& item, TreeServer* sourceserver, Channel* chan, Modes::ChangeList* modechangelist, FwdFJoinBuilder& fwdfjoin);
+	/** Buffer used for looking up the uuid of each member. */
+	std::string uuidbuf;
+
+	void ProcessModeUUIDPair(const std::string_view& item, TreeServer* sourceserver, Channel* chan, Modes::ChangeList* modechangelist, FwdFJoinBuilder& fwdfjoin);
  public:
-	CommandFJoin(Module* Creator) : ServerCommand(Creator, "FJOIN", 3) { }
-	CmdResult Handle(User* user, Params& params) override;
+	CommandFJoin(Module* Creator) : ParsedServerCommand(Creator, "FJOIN", 3) { }
+	CmdResult HandleParsed(User* user, ParsedLine& line, LineArena& arena) override;
 	RouteDescriptor GetRouting(User* user, const Params& parameters) override { return ROUTE_LOCALONLY; }
+	RouteDescriptor GetParsedRouting(User* user, const ParsedLine& line) override { return ROUTE_LOCALONLY; }
 
 	class Builder : public CmdBuilder
 	{
@@ -166,14 +170,14 @@ class CommandFJoin : public ServerCommand
 		std::string::size_type pos;
 
 	protected:
-		void add(Membership* memb, std::string::const_iterator mbegin, std::string::const_iterator mend);
+		void add(Membership* memb, const std::string_view& modes);
 
 	 public:
 		Builder(Channel* chan, TreeServer* source = Utils->TreeRoot);
 
 		void add(Membership* memb)
 		{
-			add(memb, memb->modes.begin(), memb->modes.end());
+			add(memb, memb->modes);
 		}
 
 		void clear();
@@ -182,11 +186,11 @@ class CommandFJoin : public ServerCommand
 	};
 };
 
-class CommandFMode : public ServerCommand
+class CommandFMode : public ParsedServerCommand
 {
  public:
-	CommandFMode(Module* Creator) : ServerCommand(Creator, "FMODE", 3) { }
-	CmdResult Handle(User* user, Params& params) override;
+	CommandFMode(Module* Creator) : ParsedServerCommand(Creator, "FMODE", 3) { }
+	CmdResult HandleParsed(User* user, ParsedLine& line, LineArena& arena) override;
 };
 
 class CommandFTopic : public ServerCommand
@@ -37,11 +37,11 @@ class FwdFJoinBuilder : public CommandFJoin::Builder
 	{
 	}
 
-	void add(Membership* memb, std::string::const_iterator mbegin, std::string::const_iterator mend);
+	void add(Membership* memb, const std::string_view& modes);
 };
 
 /** FJOIN, almost identical to TS6 SJOIN, except for nicklist handling. */
-CmdResult CommandFJoin::Handle(User* srcuser, Params& params)
+CmdResult CommandFJoin::HandleParsed(User* srcuser, ParsedLine& line, LineArena& arena)
 {
 	/* 1.1+ FJOIN works as follows:
 	 *
@@ -113,9 +113,10 @@ CmdResult CommandFJoin::Handle(User* srcuser, Params& params)
 	 *
 	 */
 
+	const ParsedLine::Params& params = line.params;
 	time_t TS = ServerCommand::ExtractTS(params[1]);
 
-	const std::string& channel = params[0];
+	const std::string channel(params[0]);
 	Channel* chan = ServerInstance->Channels.Find(channel);
 	bool apply_other_sides_modes = true;
 	TreeServer* const sourceserver = TreeServer::Get(srcuser);
@@ -174,13 +175,16 @@ CmdResult CommandFJoin::Handle(User* srcuser, Params& params)
 	// after applying theirs. If they lost, the prefix modes from their message are not forwarded.
 	FwdFJoinBuilder fwdfjoin(chan, sourceserver);
 
-	// Process every member in the message
-	irc::spacesepstream users(params.back());
-	std::string item;
+	// Process every member in the message. This is done in place as a burst can contain a
+	// very large number of members and copying each of them would be wasteful.
 	Modes::ChangeList* modechangelistptr = (apply_other_sides_modes ? &modechangelist : NULL);
-	while (users.GetToken(item))
+	for (std::string_view users = params.back(); !users.empty(); )
 	{
-		ProcessModeUUIDPair(item, sourceserver, chan, modechangelistptr, fwdfjoin);
+		const std::string_view::size_type sep = users.find(' ');
+		const std::string_view item = users.substr(0, sep);
+		if (!item.empty())
+			ProcessModeUUIDPair(item, sourceserver, chan, modechangelistptr, fwdfjoin);
+		users.remove_prefix(sep == std::string_view::npos ? users.length() : sep + 1);
 	}
 
 	fwdfjoin.finalize();
@@ -193,14 +197,16 @@ CmdResult CommandFJoin::Handle(User* srcuser, Params& params)
 	return CmdResult::SUCCESS;
 }
 
-void CommandFJoin::ProcessModeUUIDPair(const std::string& item, TreeServer* sourceserver, Channel* chan, Modes::ChangeList* modechangelist, FwdFJoinBuilder& fwdfjoin)
+void CommandFJoin::ProcessModeUUIDPair(const std::string_view& item, TreeServer* sourceserver, Channel* chan, Modes::ChangeList* modechangelist, FwdFJoinBuilder& fwdfjoin)
 {
-	std::string::size_type comma = item.find(',');
+	std::string_view::size_type comma = item.find(',');
 
 	// Comma not required anymore if the user has no modes
-	const std::string::size_type ubegin = (comma == std::string::npos ? 0 : comma+1);
-	std::string uuid(item, ubegin, UIDGenerator::UUID_LENGTH);
-	User* who = ServerInstance->Users.FindUUID(uuid);
+	const std::string_view::size_type ubegin = (comma == std::string_view::npos ? 0 : comma+1);
+
+	// The uuid buffer is reused for every member so that looking them up does not allocate.
+	uuidbuf.assign(item.substr(ubegin, UIDGenerator::UUID_LENGTH));
+	User* who = ServerInstance->Users.FindUUID(uuidbuf);
 	if (!who)
 	{
 		// Probably KILLed, ignore
@@ -215,17 +221,17 @@ void CommandFJoin::ProcessModeUUIDPair(const std::string& item, TreeServer* sour
 		return;
 	}
 
-	std::string::const_iterator modeendit = item.begin(); // End of the "ov" mode string
+	std::string_view modes; // The "ov" mode string
 	/* Check if the user received at least one mode */
-	if ((modechangelist) && (comma != std::string::npos))
+	if ((modechangelist) && (comma != std::string_view::npos))
 	{
-		modeendit += comma;
+		modes = item.substr(0, comma);
 		/* Iterate through the modes and see if they are valid here, if so, apply */
-		for (std::string::const_iterator i = item.begin(); i != modeendit; ++i)
+		for (const auto& modechr : modes)
 		{
-			ModeHandler* mh = ServerInstance->Modes.FindMode(*i, MODETYPE_CHANNEL);
+			ModeHandler* mh = ServerInstance->Modes.FindMode(modechr, MODETYPE_CHANNEL);
 			if (!mh)
-				throw ProtocolException("Unrecognised mode '" + std::string(1, *i) + "'");
+				throw ProtocolException("Unrecognised mode '" + std::string(1, modechr) + "'");
 
 			/* Add any modes this user had to the mode stack */
 			modechangelist->push_add(mh, who->nick);
@@ -238,19 +244,19 @@ void CommandFJoin::ProcessModeUUIDPair(const std::string& item, TreeServer* sour
 		// User was already on the channel, forward because of the modes they potentially got
 		memb = chan->GetUser(who);
 		if (memb)
-			fwdfjoin.add(memb, item.begin(), modeendit);
+			fwdfjoin.add(memb, modes);
 		return;
 	}
 
 	// Assign the id to the new Membership
 	Membership::Id membid = 0;
-	const std::string::size_type colon = item.rfind(':');
-	if (colon != std::string::npos)
-		membid = Membership::IdFromString(item.substr(colon+1));
+	const std::string_view::size_type colon = item.rfind(':');
+	if (colon != std::string_view::npos)
+		membid = ParseNumber<Membership::Id>(item.substr(colon + 1));
 	memb->id = membid;
 
 	// Add member to fwdfjoin with prefix modes
-	fwdfjoin.add(memb, item.begin(), modeendit);
+	fwdfjoin.add(memb, modes);
 }
 
 void CommandFJoin::RemoveStatus(Channel* c)
@@ -298,9 +304,9 @@ CommandFJoin::Builder::Builder(Channel* chan, TreeServer* source)
 	push_raw(chan->ChanModes(true)).push_raw(" :");
 }
 
-void CommandFJoin::Builder::add(Membership* memb, std::string::const_iterator mbegin, std::string::const_iterator mend)
+void CommandFJoin::Builder::add(Membership* memb, const std::string_view& modes)
 {
-	push_raw(mbegin, mend).push_raw(',').push_raw(memb->user->uuid);
+	push_raw(modes.begin(), modes.end()).push_raw(',').push_raw(memb->user->uuid);
 	push_raw(':').push_raw_int(memb->id);
 	push_raw(' ');
 }
@@ -318,8 +324,8 @@ const std::string& CommandFJoin::Builder::finalize()
 	return str();
 }
 
-void FwdFJoinBuilder::add(Membership* memb, std::string::const_iterator mbegin, std::string::const_iterator mend)
+void FwdFJoinBuilder::add(Membership* memb, const std::string_view& modes)
 {
 	// Add the member and their modes exactly as they sent them
-	CommandFJoin::Builder::add(memb, mbegin, mend);
+	CommandFJoin::Builder::add(memb, modes);
 }
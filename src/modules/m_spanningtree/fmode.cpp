@@ -26,11 +26,12 @@
 #include "commands.h"
 
 /** FMODE command - channel mode change with timestamp checks */
-CmdResult CommandFMode::Handle(User* who, Params& params)
+CmdResult CommandFMode::HandleParsed(User* who, ParsedLine& line, LineArena& arena)
 {
+	const ParsedLine::Params& params = line.params;
 	time_t TS = ServerCommand::ExtractTS(params[1]);
 
-	Channel* const chan = ServerInstance->Channels.Find(params[0]);
+	Channel* const chan = ServerInstance->Channels.Find(std::string(params[0]));
 	if (!chan)
 		// Channel doesn't exist
 		return CmdResult::FAILURE;
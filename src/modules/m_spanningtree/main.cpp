@@ -43,6 +43,7 @@
 ModuleSpanningTree::ModuleSpanningTree()
 	: Module(VF_VENDOR, "Allows linking multiple servers together as part of one network.")
 	, Away::EventListener(this)
+	, Metrics::EventListener(this)
 	, Stats::EventListener(this)
 	, CTCTags::EventListener(this)
 	, rconnect(this)
@@ -56,6 +57,7 @@ ModuleSpanningTree::ModuleSpanningTree()
 	, sslapi(this)
 	, servertags(this)
 	, servicetag(this)
+	, netsplitbatch(this)
 	, DNS(this, "DNS")
 	, tagevprov(this)
 {
@@ -485,6 +487,14 @@ void ModuleSpanningTree::OnBackgroundTimer(time_t curtime)
 {
 	AutoConnectServers(curtime);
 	DoConnectTimeout(curtime);
+
+	for (const auto& server : Utils->TreeRoot->GetChildren())
+	{
+		// Only servers which are linked directly to us have link statistics.
+		TreeSocket* sock = server->GetSocket();
+		if (sock && server->IsLocal())
+			sock->linkstats.Sample();
+	}
 }
 
 void ModuleSpanningTree::OnUserConnect(LocalUser* user)
@@ -31,6 +31,7 @@
 #include "inspircd.h"
 #include "event.h"
 #include "modules/dns.h"
+#include "modules/metrics.h"
 #include "modules/ssl.h"
 #include "modules/stats.h"
 #include "modules/ctctags.h"
@@ -73,6 +74,7 @@ class Autoconnect;
 class ModuleSpanningTree
 	: public Module
 	, public Away::EventListener
+	, public Metrics::EventListener
 	, public Stats::EventListener
 	, public CTCTags::EventListener
 {
@@ -116,6 +118,9 @@ class ModuleSpanningTree
 	/** Tag for marking services pseudoclients. */
 	ServiceTag servicetag;
 
+	/** Batch for grouping the quit messages of users lost in a netsplit. */
+	NetsplitBatch netsplitbatch;
+
 	/** The DNS manager service provided by core_dns. */
 	dynamic_reference<DNS::Manager> DNS;
 
@@ -198,6 +203,7 @@ class ModuleSpanningTree
 	void OnAddLine(User *u, XLine *x) override;
 	void OnDelLine(User *u, XLine *x) override;
 	ModResult OnStats(Stats::Context& stats) override;
+	void OnCollectMetrics(Metrics::Writer& writer) override;
 	void OnUserAway(User* user) override;
 	void OnUserBack(User* user) override;
 	void OnLoadModule(Module* mod) override;
@@ -26,11 +26,21 @@
 #include "inspircd.h"
 #include "commands.h"
 
+namespace
+{
+	/** Retrieves a parameter which may be omitted without copying it. */
+	const std::string& GetValue(const CommandBase::Params& params, size_t index)
+	{
+		static const std::string empty;
+		return params.size() > index ? params[index] : empty;
+	}
+}
+
 CmdResult CommandMetadata::Handle(User* srcuser, Params& params)
 {
 	if (params[0] == "*")
 	{
-		std::string value = params.size() < 3 ? "" : params[2];
+		const std::string& value = GetValue(params, 2);
 		FOREACH_MOD(OnDecodeMetaData, (NULL,params[1],value));
 		return CmdResult::SUCCESS;
 	}
@@ -64,7 +74,7 @@ CmdResult CommandMetadata::Handle(User* srcuser, Params& params)
 			return CmdResult::FAILURE; // User is not in the channel.
 
 		ExtensionItem* item = ServerInstance->Extensions.GetItem(params[5]);
-		const std::string value = params.size() < 7 ? "" : params[6];
+		const std::string& value = GetValue(params, 6);
 		if (item && item->type == ExtensionItem::EXT_MEMBERSHIP)
 			item->FromNetwork(m, value);
 		FOREACH_MOD(OnDecodeMetaData, (m, params[5], value));
@@ -86,7 +96,7 @@ CmdResult CommandMetadata::Handle(User* srcuser, Params& params)
 			// Their TS is newer than ours, discard this command and do not propagate
 			return CmdResult::FAILURE;
 
-		std::string value = params.size() < 4 ? "" : params[3];
+		const std::string& value = GetValue(params, 3);
 
 		ExtensionItem* item = ServerInstance->Extensions.GetItem(params[2]);
 		if ((item) && (item->type == ExtensionItem::EXT_CHANNEL))
@@ -99,7 +109,7 @@ CmdResult CommandMetadata::Handle(User* srcuser, Params& params)
 		if (u)
 		{
 			ExtensionItem* item = ServerInstance->Extensions.GetItem(params[1]);
-			std::string value = params.size() < 3 ? "" : params[2];
+			const std::string& value = GetValue(params, 2);
 
 			if ((item) && (item->type == ExtensionItem::EXT_USER))
 				item->FromNetwork(u, value);
@@ -25,6 +25,97 @@
 #include "main.h"
 #include "utils.h"
 #include "link.h"
+#include "treeserver.h"
+#include "treesocket.h"
+
+namespace
+{
+	std::string FormatHistogram(const insp::log2_histogram& histogram, uint64_t divisor)
+	{
+		return histogram.summarize(divisor, "us") + " (" + ConvToStr(histogram.get_count()) + " samples)";
+	}
+
+	std::string FormatCounters(const LinkCounter& bytes, const LinkCounter& lines)
+	{
+		return ConvToStr(bytes.rate) + " B/s (peak " + ConvToStr(bytes.peakrate) + " B/s), "
+			+ ConvToStr(lines.rate) + " lines/s (peak " + ConvToStr(lines.peakrate) + " lines/s), "
+			+ ConvToStr(bytes.total) + " bytes and " + ConvToStr(lines.total) + " lines total";
+	}
+
+	void StatsLinks(Stats::Context& stats)
+	{
+		for (const auto& [_, server] : Utils->serverlist)
+		{
+			if (server->IsRoot())
+				continue;
+
+			const std::string prefix = "Link " + server->GetName();
+			stats.AddRow(249, prefix + " RTT: last " + ConvToStr(server->rtt) + "ms, " + FormatHistogram(server->rtthistogram, 1));
+
+			// Remote servers share the socket of their route so only show it for local ones.
+			TreeSocket* sock = server->GetSocket();
+			if (!sock || !server->IsLocal())
+				continue;
+
+			const LinkStats& linkstats = sock->linkstats;
+			stats.AddRow(249, prefix + " in: " + FormatCounters(linkstats.bytesin, linkstats.linesin));
+			stats.AddRow(249, prefix + " out: " + FormatCounters(linkstats.bytesout, linkstats.linesout));
+			stats.AddRow(249, prefix + " sendq: " + ConvToStr(sock->GetSendQSize()) + " bytes (peak " + ConvToStr(linkstats.peaksendq) + " bytes)");
+		}
+
+		// The command times are recorded in nanoseconds.
+		for (const auto& [command, histogram] : Utils->CommandTimes)
+			stats.AddRow(249, "Command " + command + ": " + FormatHistogram(histogram, 1000));
+	}
+}
+
+void ModuleSpanningTree::OnCollectMetrics(Metrics::Writer& writer)
+{
+	writer.Family("inspircd_servers", Metrics::Type::GAUGE, "The number of servers on the network.");
+	writer.Sample("inspircd_servers", Utils->serverlist.size());
+
+	writer.Family("inspircd_link_rtt_seconds", Metrics::Type::HISTOGRAM, "The round trip time of pings to each server.");
+	for (const auto& [_, server] : Utils->serverlist)
+	{
+		// The RTTs are recorded in microseconds.
+		if (!server->IsRoot())
+			writer.Histogram("inspircd_link_rtt_seconds", server->rtthistogram, 1e6, { { "server", server->GetName() } });
+	}
+
+	writer.Family("inspircd_link_bytes_total", Metrics::Type::COUNTER, "The number of bytes received from and sent to each directly linked server.");
+	for (const auto& server : Utils->TreeRoot->GetChildren())
+	{
+		if (!server->GetSocket())
+			continue;
+
+		const LinkStats& linkstats = server->GetSocket()->linkstats;
+		writer.Sample("inspircd_link_bytes_total", linkstats.bytesin.total, { { "server", server->GetName() }, { "direction", "in" } });
+		writer.Sample("inspircd_link_bytes_total", linkstats.bytesout.total, { { "server", server->GetName() }, { "direction", "out" } });
+	}
+
+	writer.Family("inspircd_link_lines_total", Metrics::Type::COUNTER, "The number of lines received from and sent to each directly linked server.");
+	for (const auto& server : Utils->TreeRoot->GetChildren())
+	{
+		if (!server->GetSocket())
+			continue;
+
+		const LinkStats& linkstats = server->GetSocket()->linkstats;
+		writer.Sample("inspircd_link_lines_total", linkstats.linesin.total, { { "server", server->GetName() }, { "direction", "in" } });
+		writer.Sample("inspircd_link_lines_total", linkstats.linesout.total, { { "server", server->GetName() }, { "direction", "out" } });
+	}
+
+	writer.Family("inspircd_link_sendq_bytes", Metrics::Type::GAUGE, "The number of bytes waiting to be sent to each directly linked server.");
+	for (const auto& server : Utils->TreeRoot->GetChildren())
+	{
+		if (server->GetSocket())
+			writer.Sample("inspircd_link_sendq_bytes", server->GetSocket()->GetSendQSize(), { { "server", server->GetName() } });
+	}
+
+	// The command times are recorded in nanoseconds.
+	writer.Family("inspircd_server_command_duration_seconds", Metrics::Type::HISTOGRAM, "The time taken to process and route each type of command received from other servers.");
+	for (const auto& [command, histogram] : Utils->CommandTimes)
+		writer.Histogram("inspircd_server_command_duration_seconds", histogram, 1e9, { { "command", command } });
+}
 
 ModResult ModuleSpanningTree::OnStats(Stats::Context& stats)
 {
@@ -45,6 +136,11 @@ ModResult ModuleSpanningTree::OnStats(Stats::Context& stats)
 		}
 		return MOD_RES_DENY;
 	}
+	else if (stats.GetSymbol() == 'b')
+	{
+		StatsLinks(stats);
+		return MOD_RES_DENY;
+	}
 	else if (stats.GetSymbol() == 'U')
 	{
 		for (const auto& [_, tag] : ServerInstance->Config->ConfTags("service", ServerInstance->Config->ConfTags("uline")))
@@ -0,0 +1,206 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <charconv>
+
+/** Converts a string to a number in the same way as ConvToNum but without constructing a stream.
+ * Leading whitespace and a sign are accepted and a negative value wraps around for unsigned types
+ * just like when extracting from a stream so that what is accepted on the wire does not change.
+ * @param str The string to convert.
+ * @return The converted value or 0 if the string does not start with a number in range.
+ */
+template<typename Numeric>
+Numeric ParseNumber(const std::string_view& str)
+{
+	std::string_view::size_type position = 0;
+	while (position < str.length() && isspace(static_cast<unsigned char>(str[position])))
+		position++;
+
+	bool negative = false;
+	if (position < str.length() && (str[position] == '+' || str[position] == '-'))
+		negative = (str[position++] == '-');
+
+	typedef std::make_unsigned_t<Numeric> Magnitude;
+	Magnitude magnitude = 0;
+	const std::from_chars_result result = std::from_chars(str.data() + position, str.data() + str.length(), magnitude);
+	if (result.ec != std::errc())
+		return 0;
+
+	if constexpr (std::is_signed_v<Numeric>)
+	{
+		const Magnitude limit = static_cast<Magnitude>(std::numeric_limits<Numeric>::max()) + negative;
+		if (magnitude > limit)
+			return 0;
+	}
+	return negative ? static_cast<Numeric>(Magnitude(0) - magnitude) : static_cast<Numeric>(magnitude);
+}
+
+/** Stores copies of strings which need to outlive the line they were created for until the end of
+ * the current read batch. Memory is handed out from large blocks which are kept between batches so
+ * once it has warmed up storing a string does not allocate.
+ */
+class LineArena final
+{
+ private:
+	/** The size of each block of memory. Strings larger than this get a block of their own. */
+	static constexpr size_t BLOCK_SIZE = 4096;
+
+	/** The blocks of memory which have been allocated. */
+	std::vector<std::pair<std::unique_ptr<char[]>, size_t>> blocks;
+
+	/** The index of the block which is currently being filled. */
+	size_t current = 0;
+
+	/** The number of bytes which have been used from the current block. */
+	size_t used = 0;
+
+ public:
+	/** Copies a string into the arena.
+	 * @param str The string to copy.
+	 * @return A view of the copy which is valid until Reset() is called.
+	 */
+	std::string_view Store(const std::string_view& str)
+	{
+		while (current < blocks.size() && used + str.length() > blocks[current].second)
+		{
+			current++;
+			used = 0;
+		}
+
+		if (current == blocks.size())
+		{
+			const size_t size = std::max(BLOCK_SIZE, str.length());
+			blocks.emplace_back(std::make_unique<char[]>(size), size);
+			used = 0;
+		}
+
+		char* data = blocks[current].first.get() + used;
+		std::copy(str.begin(), str.end(), data);
+		used += str.length();
+		return std::string_view(data, str.length());
+	}
+
+	/** Releases every string in the arena for reuse. */
+	void Reset()
+	{
+		current = used = 0;
+	}
+};
+
+/** A line received from a remote server which has been split into its components.
+ * All of the views point into the buffer the line was parsed from and are only valid
+ * until that buffer is next modified. An instance is intended to be reused for every
+ * line in a read batch so that steady-state parsing does not allocate.
+ */
+class ParsedLine final
+{
+ public:
+	typedef std::vector<std::string_view> Params;
+
+	/** The raw tag list without the leading '@'. */
+	std::string_view tags;
+
+	/** The message source without the leading ':'. */
+	std::string_view prefix;
+
+	/** The name of the command. */
+	std::string_view command;
+
+	/** The parameters of the message. A trailing parameter has its ':' removed. */
+	Params params;
+
+	/** Splits a line into its components.
+	 * @param line The line to split.
+	 * @return NULL if the line was parsed successfully or an error message if it was malformed.
+	 */
+	const char* Parse(const std::string_view& line)
+	{
+		tags = prefix = command = std::string_view();
+		params.clear();
+
+		std::string_view::size_type position = 0;
+		std::string_view token;
+		if (!NextMiddle(line, position, token))
+			return NULL;
+
+		if (token[0] == '@')
+		{
+			if (token.length() <= 1)
+				return "Received a message with empty tags";
+
+			tags = token.substr(1);
+			if (!NextMiddle(line, position, token))
+				return "Received a message with no command";
+		}
+
+		if (token[0] == ':')
+		{
+			if (token.length() <= 1)
+				return "Received a message with an empty prefix";
+
+			prefix = token.substr(1);
+			if (!NextMiddle(line, position, token))
+				return "Received a message with no command";
+		}
+
+		command = token;
+		while (position < line.length())
+		{
+			if (line[position] == ':')
+			{
+				// This is a <trailing> parameter which extends to the end of the line.
+				params.push_back(line.substr(position + 1));
+				break;
+			}
+
+			NextMiddle(line, position, token);
+			params.push_back(token);
+		}
+		return NULL;
+	}
+
+ private:
+	/** Extracts the next space delimited token from a line in the same way as irc::tokenstream::GetMiddle.
+	 * @param line The line to extract the token from.
+	 * @param position The position to start at. Updated to point past the token.
+	 * @param token The location to store the token.
+	 * @return True if a non-empty token was extracted; otherwise, false.
+	 */
+	static bool NextMiddle(const std::string_view& line, std::string_view::size_type& position, std::string_view& token)
+	{
+		if (position >= line.length())
+		{
+			token = std::string_view();
+			return false;
+		}
+
+		const std::string_view::size_type separator = line.find(' ', position);
+		if (separator == std::string_view::npos)
+		{
+			token = line.substr(position);
+			position = line.length();
+		}
+		else
+		{
+			token = line.substr(position, separator - position);
+			position = line.find_first_not_of(' ', separator);
+		}
+		return !token.empty();
+	}
+};
@@ -38,7 +38,7 @@ PingTimer::State PingTimer::TickInternal()
 	{
 		// Last ping was answered, send next ping
 		server->GetSocket()->WriteLine(CmdBuilder("PING").push(server->GetId()));
-		LastPingMsec = ServerInstance->Time() * 1000 + (ServerInstance->Time_ns() / 1000000);
+		LastPingNs = insp::monotonic_ns();
 		// Warn next unless warnings are disabled. If they are, jump straight to timeout.
 		if (Utils->PingWarnTime)
 			return PS_WARN;
@@ -95,8 +95,9 @@ bool PingTimer::Tick(time_t currtime)
 void PingTimer::OnPong()
 {
 	// Calculate RTT
-	long ts = ServerInstance->Time() * 1000 + (ServerInstance->Time_ns() / 1000000);
-	server->rtt = ts - LastPingMsec;
+	const uint64_t rttns = insp::monotonic_ns() - LastPingNs;
+	server->rtt = rttns / 1000000;
+	server->rtthistogram.add(rttns / 1000);
 
 	// Change state to send ping next, also reschedules the timer appropriately
 	SetState(PS_SENDPING);
@@ -45,9 +45,9 @@ class PingTimer : public Timer
 	 */
 	State state;
 
-	/** Last ping time in milliseconds, used to calculate round trip time
+	/** Monotonic time in nanoseconds at which the last ping was sent, used to calculate round trip time
 	 */
-	unsigned long LastPingMsec;
+	uint64_t LastPingNs = 0;
 
 	/** Update internal state and reschedule timer according to the new state
 	 * @param newstate State to change to
@@ -26,6 +26,7 @@
 #include "utils.h"
 #include "treeserver.h"
 #include "commandbuilder.h"
+#include "servercommand.h"
 
 void ModuleSpanningTree::OnPostCommand(Command* command, const CommandBase::Params& parameters, LocalUser* user, CmdResult result, bool loop)
 {
@@ -133,3 +134,19 @@ void SpanningTreeUtilities::RouteCommand(TreeServer* origin, CommandBase* thiscm
 		params.Unicast(sdest->ServerUser);
 	}
 }
+
+void SpanningTreeUtilities::RouteParsed(TreeServer* origin, ParsedServerCommand* thiscmd, const ParsedLine& line, const ClientProtocol::TagMap& tags, User* user)
+{
+	RouteDescriptor routing = thiscmd->GetParsedRouting(user, line);
+	if (routing.type != RouteType::BROADCAST)
+		return;
+
+	CmdBuilder params(user, thiscmd->name.c_str());
+	params.push_tags(tags);
+	for (ParsedLine::Params::const_iterator i = line.params.begin(); i != line.params.end(); ++i)
+	{
+		params.push_raw(i + 1 == line.params.end() ? " :" : " ");
+		params.push_raw(i->begin(), i->end());
+	}
+	params.Forward(origin);
+}
@@ -39,14 +39,26 @@ RouteDescriptor ServerCommand::GetRouting(User* user, const Params& parameters)
 	return ROUTE_BROADCAST;
 }
 
-time_t ServerCommand::ExtractTS(const std::string& tsstr)
+time_t ServerCommand::ExtractTS(const std::string_view& tsstr)
 {
-	time_t TS = ConvToNum<time_t>(tsstr);
+	// This is called for every user and channel in a burst so avoid ConvToNum
+	// here as it needs to construct a stream for every conversion.
+	time_t TS = ParseNumber<time_t>(tsstr);
 	if (!TS)
 		throw ProtocolException("Invalid TS");
 	return TS;
 }
 
+CmdResult ParsedServerCommand::Handle(User* user, Params& parameters)
+{
+	ParsedLine line;
+	line.command = name;
+	line.params.assign(parameters.begin(), parameters.end());
+
+	LineArena arena;
+	return HandleParsed(user, line, arena);
+}
+
 ServerCommand* ServerCommandManager::GetHandler(const std::string& command) const
 {
 	ServerCommandMap::const_iterator it = commands.find(command);
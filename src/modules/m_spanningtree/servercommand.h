@@ -22,6 +22,7 @@
 
 #include "utils.h"
 #include "treeserver.h"
+#include "parsedline.h"
 
 class ProtocolException : public ModuleException
 {
@@ -32,6 +33,8 @@ class ProtocolException : public ModuleException
 	}
 };
 
+class ParsedServerCommand;
+
 /** Base class for server-to-server commands that may have a (remote) user source or server source.
  */
 class ServerCommand : public CommandBase
@@ -46,6 +49,9 @@ class ServerCommand : public CommandBase
 	virtual CmdResult Handle(User* user, Params& parameters) = 0;
 	RouteDescriptor GetRouting(User* user, const Params& parameters) override;
 
+	/** Retrieves this command as a ParsedServerCommand if it can be handled directly from a parsed line. */
+	virtual ParsedServerCommand* AsParsed() { return NULL; }
+
 	/**
 	 * Extract the TS from a string.
 	 * @param tsstr The string containing the TS.
@@ -53,7 +59,38 @@ class ServerCommand : public CommandBase
 	 * This function throws a ProtocolException if it considers the TS invalid. Note that the detection of
 	 * invalid timestamps is not designed to be bulletproof, only some cases - like "0" - trigger an exception.
 	 */
-	static time_t ExtractTS(const std::string& tsstr);
+	static time_t ExtractTS(const std::string_view& tsstr);
+};
+
+/** Base class for server-to-server commands which are sent in large numbers during a burst.
+ * These are handled directly from the views of the received line so their parameters are
+ * never copied into a CommandBase::Params.
+ */
+class ParsedServerCommand : public ServerCommand
+{
+ public:
+	ParsedServerCommand(Module* Creator, const std::string& Name, unsigned int MinPara = 0, unsigned int MaxPara = 0)
+		: ServerCommand(Creator, Name, MinPara, MaxPara) { }
+
+	/** Handles the command from a line received from a remote server.
+	 * @param user The source of the line.
+	 * @param line The parsed line. Handlers may replace parameters with views of strings stored
+	 *             in the arena and these changes will be forwarded to the rest of the network.
+	 * @param arena The arena to store replacement parameters in.
+	 */
+	virtual CmdResult HandleParsed(User* user, ParsedLine& line, LineArena& arena) = 0;
+
+	/** Determines where a line which was handled successfully will be routed to.
+	 * Only ROUTE_LOCALONLY and ROUTE_BROADCAST are supported.
+	 * @param user The source of the line.
+	 * @param line The parsed line.
+	 */
+	virtual RouteDescriptor GetParsedRouting(User* user, const ParsedLine& line) { return ROUTE_BROADCAST; }
+
+	/** Handles the command from parameters which have already been copied, e.g. from ENCAP. */
+	CmdResult Handle(User* user, Params& parameters) override;
+
+	ParsedServerCommand* AsParsed() override { return this; }
 };
 
 /** Base class for server-to-server command handlers which are only valid if their source is a user.
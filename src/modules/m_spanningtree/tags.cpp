@@ -18,6 +18,7 @@
 
 
 #include "main.h"
+#include "treeserver.h"
 
 ServerTags::ServerTags(Module* Creator)
 	: ClientProtocol::MessageTagProvider(Creator)
@@ -56,3 +57,46 @@ bool ServiceTag::ShouldSendTag(LocalUser* user, const ClientProtocol::MessageTag
 {
 	return ctctagcap.IsEnabled(user);
 }
+
+NetsplitBatch::NetsplitBatch(Module* mod)
+	: ClientProtocol::MessageTagProvider(mod)
+	, batchmanager(mod)
+	, batch("netsplit")
+{
+}
+
+void NetsplitBatch::Start(const std::string& server1, const std::string& server2)
+{
+	if (!batchmanager)
+		return;
+
+	batchmanager->Start(batch);
+	if (batch.IsRunning())
+	{
+		batch.GetBatchStartMessage().PushParam(server1);
+		batch.GetBatchStartMessage().PushParam(server2);
+	}
+}
+
+void NetsplitBatch::End()
+{
+	if (batchmanager)
+		batchmanager->End(batch);
+}
+
+void NetsplitBatch::OnPopulateTags(ClientProtocol::Message& msg)
+{
+	if (!batch.IsRunning() || strcmp(msg.GetCommand(), "QUIT"))
+		return;
+
+	// Only the quits of users who were lost in the split belong in the batch.
+	User* const user = msg.GetSourceUser();
+	if (user && !IS_LOCAL(user) && TreeServer::Get(user)->IsDead())
+		batch.AddToBatch(msg);
+}
+
+bool NetsplitBatch::ShouldSendTag(LocalUser* user, const ClientProtocol::MessageTagData& tagdata)
+{
+	// The batch tag belongs to the batch manager so we never have anything to send.
+	return false;
+}
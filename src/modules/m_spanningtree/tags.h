@@ -20,6 +20,7 @@
 #pragma once
 
 #include "modules/ctctags.h"
+#include "modules/ircv3_batch.h"
 
 class ServerTags : public ClientProtocol::MessageTagProvider
 {
@@ -39,3 +40,25 @@ class ServiceTag : public ClientProtocol::MessageTagProvider
 	void OnPopulateTags(ClientProtocol::Message& msg) override;
 	bool ShouldSendTag(LocalUser* user, const ClientProtocol::MessageTagData& tagdata) override;
 };
+
+class NetsplitBatch : public ClientProtocol::MessageTagProvider
+{
+ private:
+	IRCv3::Batch::API batchmanager;
+	IRCv3::Batch::Batch batch;
+
+ public:
+	NetsplitBatch(Module* mod);
+
+	/** Starts a batch for the quit messages of the users lost in a netsplit.
+	 * @param server1 The name of the server which is still connected.
+	 * @param server2 The name of the server which split.
+	 */
+	void Start(const std::string& server1, const std::string& server2);
+
+	/** Ends the currently running netsplit batch. */
+	void End();
+
+	void OnPopulateTags(ClientProtocol::Message& msg) override;
+	bool ShouldSendTag(LocalUser* user, const ClientProtocol::MessageTagData& tagdata) override;
+};
@@ -184,8 +184,7 @@ void TreeServer::SQuitChild(TreeServer* server, const std::string& reason, bool
 	unsigned int num_lost_servers = 0;
 	server->SQuitInternal(num_lost_servers, error);
 
-	const std::string quitreason = GetName() + " " + server->GetName();
-	size_t num_lost_users = QuitUsers(quitreason);
+	size_t num_lost_users = QuitUsers(GetName(), server->GetName());
 
 	ServerInstance->SNO.WriteToSnoMask(IsRoot() ? 'l' : 'L', "Netsplit complete, lost \002%zu\002 user%s on \002%u\002 server%s.",
 		num_lost_users, num_lost_users != 1 ? "s" : "", num_lost_servers, num_lost_servers != 1 ? "s" : "");
@@ -214,21 +213,32 @@ void TreeServer::SQuitInternal(unsigned int& num_lost_servers, bool error)
 		Utils->Creator->linkeventprov.Call(&ServerProtocol::LinkEventListener::OnServerSplit, this, error);
 }
 
-size_t TreeServer::QuitUsers(const std::string& reason)
+size_t TreeServer::QuitUsers(const std::string& server1, const std::string& server2)
 {
-	std::string publicreason = Utils->HideSplits ? "*.net *.split" : reason;
+	const std::string reason = server1 + " " + server2;
+	const std::string publicreason = Utils->HideSplits ? "*.net *.split" : reason;
 
+	// The users are collected first so they can be removed in one go. This is a lot
+	// faster than removing them individually when they share channels.
 	const user_hash& users = ServerInstance->Users.GetUsers();
 	size_t original_size = users.size();
-	for (user_hash::const_iterator i = users.begin(); i != users.end(); )
+	std::vector<User*> lostusers;
+	for (const auto& [_, user] : users)
 	{
-		User* user = i->second;
-		// Increment the iterator now because QuitUser() removes the user from the container
-		++i;
 		TreeServer* server = TreeServer::Get(user);
 		if (server->IsDead())
-			ServerInstance->Users.QuitUser(user, publicreason, &reason);
+			lostusers.push_back(user);
 	}
+
+	if (lostusers.empty())
+		return 0;
+
+	// The parameters of a netsplit batch are the names of the servers so we can not send
+	// one if those are meant to be hidden.
+	if (!Utils->HideSplits)
+		Utils->Creator->netsplitbatch.Start(server1, server2);
+	ServerInstance->Users.QuitUsers(lostusers, publicreason, &reason);
+	Utils->Creator->netsplitbatch.End();
 	return original_size - users.size();
 }
 
@@ -28,6 +28,7 @@
 
 #include "treesocket.h"
 #include "pingtimer.h"
+#include "utility/histogram.h"
 
 /** Each server in the tree is represented by one class of
  * type TreeServer. A locally connected TreeServer can
@@ -121,7 +122,12 @@ class TreeServer : public Server
 		GetParent()->SQuitChild(this, reason, error);
 	}
 
-	static size_t QuitUsers(const std::string& reason);
+	/** Quits all of the users on servers which have been lost in a netsplit.
+	 * @param server1 The name of the server which is still connected.
+	 * @param server2 The name of the server which split.
+	 * @return The number of users who were quit.
+	 */
+	static size_t QuitUsers(const std::string& server1, const std::string& server2);
 
 	/** Get route.
 	 * The 'route' is defined as the locally-
@@ -159,6 +165,10 @@ class TreeServer : public Server
 	 */
 	unsigned long rtt = 0;
 
+	/** Round trip times of all pings to this server in microseconds
+	 */
+	insp::log2_histogram rtthistogram;
+
 	/** When we received BURST from this server, used to calculate total burst time at ENDBURST.
 	 */
 	uint64_t StartBurst = 0;
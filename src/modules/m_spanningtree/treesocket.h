@@ -30,6 +30,7 @@
 #include "inspircd.h"
 
 #include "utils.h"
+#include "parsedline.h"
 
 /*
  * The server list in InspIRCd is maintained as two structures
@@ -103,6 +104,73 @@ struct CapabData
 	}
 };
 
+/** Counts something which passes over a server link and tracks how quickly it is doing so.
+ */
+class LinkCounter final
+{
+ public:
+	/** The total amount counted since the link was established. */
+	uint64_t total = 0;
+
+	/** The value of total when the rate was last sampled. */
+	uint64_t sampled = 0;
+
+	/** The amount counted per second during the last sample period. */
+	uint64_t rate = 0;
+
+	/** The highest rate seen during any sample period. */
+	uint64_t peakrate = 0;
+
+	/** Updates the rate from the amount counted since the last sample.
+	 * @param elapsedms The number of milliseconds since the last sample.
+	 */
+	void Sample(uint64_t elapsedms)
+	{
+		rate = (total - sampled) * 1000 / std::max<uint64_t>(elapsedms, 1);
+		peakrate = std::max(peakrate, rate);
+		sampled = total;
+	}
+};
+
+/** Traffic statistics for a server link.
+ */
+class LinkStats final
+{
+ public:
+	/** The number of bytes received from the server. */
+	LinkCounter bytesin;
+
+	/** The number of bytes sent to the server. */
+	LinkCounter bytesout;
+
+	/** The number of lines received from the server. */
+	LinkCounter linesin;
+
+	/** The number of lines sent to the server. */
+	LinkCounter linesout;
+
+	/** The largest size the sendq has reached. */
+	size_t peaksendq = 0;
+
+	/** Monotonic time in nanoseconds at which the rates were last sampled. */
+	uint64_t lastsample = insp::monotonic_ns();
+
+	/** Updates the rates of all of the counters. */
+	void Sample()
+	{
+		const uint64_t now = insp::monotonic_ns();
+		const uint64_t elapsedms = (now - lastsample) / 1000000;
+		if (!elapsedms)
+			return;
+
+		bytesin.Sample(elapsedms);
+		bytesout.Sample(elapsedms);
+		linesin.Sample(elapsedms);
+		linesout.Sample(elapsedms);
+		lastsample = now;
+	}
+};
+
 /** Every SERVER connection inbound or outbound is represented by an object of
  * type TreeSocket. During setup, the object can be found in Utils->timeoutlist;
  * after setup, MyRoot will have been created as a child of Utils->TreeRoot
@@ -167,16 +235,38 @@ class TreeSocket : public BufferedSocket
 	 */
 	std::shared_ptr<Link> AuthRemote(const CommandBase::Params& params);
 
-	/** Convenience function: read a line from the socket
-	 * @param line The line read
+	/** The components of the line which is currently being processed. */
+	ParsedLine parsedline;
+
+	/** Stores parameters which were replaced by command handlers until the end of the read batch. */
+	LineArena arena;
+
+	/** Reusable buffers which the components of the line currently being processed are copied into.
+	 * These are kept for the lifetime of the socket so that their storage can be reused by each line.
+	 */
+	std::string linecommand;
+	std::string lineprefix;
+	CommandBase::Params lineparams;
+
+	/** Copies the parameters of the line currently being processed into the reusable buffer.
+	 * This is only needed for commands which are not handled directly from the parsed line.
+	 */
+	CommandBase::Params& CopyParams();
+
+	/** Convenience function: read a line from the recvq without removing it.
+	 * @param position The position in the recvq to read from. Updated to point past the line.
+	 * @param line The location to store a view of the line read.
 	 * @param delim The line delimiter
 	 * @return true if a line was read
 	 */
-	bool GetNextLine(std::string& line, char delim = '\n');
+	bool GetNextLine(std::string::size_type& position, std::string_view& line, char delim = '\n');
 
  public:
 	const time_t age;
 
+	/** Traffic statistics for this link. */
+	LinkStats linkstats;
+
 	// The protocol version which has been negotiated with the remote server.
 	uint16_t proto_version = 0;
 
@@ -311,19 +401,15 @@ class TreeSocket : public BufferedSocket
 	 */
 	bool Inbound_Server(CommandBase::Params& params);
 
-	/** Handle IRC line split
-	 */
-	void Split(const std::string& line, std::string& tags, std::string& prefix, std::string& command, CommandBase::Params& params);
-
 	/** Process complete line from buffer
 	 */
-	void ProcessLine(std::string &line);
+	void ProcessLine(const std::string_view& line);
 
 	/** Process message tags received from a remote server. */
-	void ProcessTag(User* source, const std::string& tag, ClientProtocol::TagMap& tags);
+	void ProcessTag(User* source, const std::string_view& tag, ClientProtocol::TagMap& tags);
 
 	/** Process a message for a fully connected server. */
-	void ProcessConnectedLine(std::string& tags, std::string& prefix, std::string& command, CommandBase::Params& params);
+	void ProcessConnectedLine(const std::string& prefix, const std::string& command);
 
 	/** Handle socket timeout from connect()
 	 */
@@ -186,13 +186,13 @@ CmdResult CommandSQuit::HandleServer(TreeServer* server, CommandBase::Params& pa
 	return ret;
 }
 
-bool TreeSocket::GetNextLine(std::string& line, char delim)
+bool TreeSocket::GetNextLine(std::string::size_type& position, std::string_view& line, char delim)
 {
-	std::string::size_type i = recvq.find(delim);
+	std::string::size_type i = recvq.find(delim, position);
 	if (i == std::string::npos)
 		return false;
-	line.assign(recvq, 0, i);
-	recvq.erase(0, i + 1);
+	line = std::string_view(recvq).substr(position, i - position);
+	position = i + 1;
 	return true;
 }
 
@@ -202,25 +202,31 @@ bool TreeSocket::GetNextLine(std::string& line, char delim)
 void TreeSocket::OnDataReady()
 {
 	Utils->Creator->loopCall = true;
-	std::string line;
-	while (GetNextLine(line))
+
+	// The lines in the recvq are processed in place and the consumed data is only
+	// removed from the recvq once the entire read batch has been processed.
+	std::string::size_type position = 0;
+	std::string_view line;
+	while (GetNextLine(position, line))
 	{
-		std::string::size_type rline = line.find('\r');
-		if (rline != std::string::npos)
-			line.erase(rline);
-		if (line.find('\0') != std::string::npos)
+		std::string_view::size_type rline = line.find('\r');
+		if (rline != std::string_view::npos)
+			line.remove_suffix(line.length() - rline);
+		if (line.find('\0') != std::string_view::npos)
 		{
 			SendError("Read null character from socket");
 			break;
 		}
 
+		linkstats.linesin.total++;
+
 		try
 		{
 			ProcessLine(line);
 		}
 		catch (CoreException& ex)
 		{
-			ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "Error while processing: " + line);
+			ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, "Error while processing: " + ConvToStr(line));
 			ServerInstance->Logs.Log(MODNAME, LOG_DEFAULT, ex.GetReason());
 			SendError(ex.GetReason() + " - check the log file for details");
 		}
@@ -228,6 +234,10 @@ void TreeSocket::OnDataReady()
 		if (!GetError().empty())
 			break;
 	}
+	linkstats.bytesin.total += position;
+	recvq.erase(0, position);
+	arena.Reset();
+
 	if (LinkState != CONNECTED && recvq.length() > 4096)
 		SendError("RecvQ overrun (line too long)");
 	Utils->Creator->loopCall = false;
@@ -240,4 +250,11 @@ void TreeSocket::WriteLine(const std::string& line)
 	ServerInstance->Logs.Log(MODNAME, LOG_RAWIO, "S[%d] O %s", this->GetFd(), line.c_str());
 	this->WriteData(line);
 	this->WriteData(newline);
+
+	linkstats.bytesout.total += line.length() + newline.length();
+	linkstats.linesout.total++;
+
+	const size_t sendqsize = GetSendQSize();
+	if (sendqsize > linkstats.peaksendq)
+		linkstats.peaksendq = sendqsize;
 }
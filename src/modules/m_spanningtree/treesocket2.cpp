@@ -41,65 +41,36 @@ void TreeSocket::Error(CommandBase::Params& params)
 	SetError("received ERROR " + msg);
 }
 
-void TreeSocket::Split(const std::string& line, std::string& tags, std::string& prefix, std::string& command, CommandBase::Params& params)
+void TreeSocket::ProcessLine(const std::string_view& line)
 {
-	std::string token;
-	irc::tokenstream tokens(line);
+	ServerInstance->Logs.Log(MODNAME, LOG_RAWIO, "S[%d] I %.*s", this->GetFd(), (int)line.length(), line.data());
 
-	if (!tokens.GetMiddle(token))
-		return;
-
-	if (token[0] == '@')
-	{
-		if (token.length() <= 1)
-		{
-			this->SendError("BUG: Received a message with empty tags: " + line);
-			return;
-		}
-
-		tags.assign(token, 1, std::string::npos);
-		if (!tokens.GetMiddle(token))
-		{
-			this->SendError("BUG: Received a message with no command: " + line);
-			return;
-		}
-	}
-
-	if (token[0] == ':')
+	const char* parseerror = parsedline.Parse(line);
+	if (parseerror)
 	{
-		if (token.length() <= 1)
-		{
-			this->SendError("BUG: Received a message with an empty prefix: " + line);
-			return;
-		}
-
-		prefix.assign(token, 1, std::string::npos);
-		if (!tokens.GetMiddle(token))
-		{
-			this->SendError("BUG: Received a message with no command: " + line);
-			return;
-		}
+		this->SendError(InspIRCd::Format("BUG: %s: %.*s", parseerror, (int)line.length(), line.data()));
+		return;
 	}
 
-	command.assign(token);
-	while (tokens.GetTrailing(token))
-		params.push_back(token);
-}
-
-void TreeSocket::ProcessLine(std::string &line)
-{
-	std::string tags;
-	std::string prefix;
-	std::string command;
-	CommandBase::Params params;
-
-	ServerInstance->Logs.Log(MODNAME, LOG_RAWIO, "S[%d] I %s", this->GetFd(), line.c_str());
-
-	Split(line, tags, prefix, command, params);
+	if (parsedline.command.empty())
+		return;
 
-	if (command.empty())
+	// Assigning to an existing string reuses its storage so looking up the command
+	// and source does not allocate once these have grown large enough.
+	const std::string& command = linecommand.assign(parsedline.command);
+	const std::string& prefix = lineprefix.assign(parsedline.prefix);
+	if (this->LinkState == CONNECTED)
+	{
+		/*
+		 * State CONNECTED:
+		 *  Credentials have been exchanged, we've gotten their 'BURST' (or sent ours).
+		 *  Anything from here on should be accepted a little more reasonably.
+		 */
+		this->ProcessConnectedLine(prefix, command);
 		return;
+	}
 
+	CommandBase::Params& params = CopyParams();
 	switch (this->LinkState)
 	{
 		case WAIT_AUTH_1:
@@ -214,18 +185,22 @@ void TreeSocket::ProcessLine(std::string &line)
 			}
 		break;
 		case CONNECTED:
-			/*
-			 * State CONNECTED:
-			 *  Credentials have been exchanged, we've gotten their 'BURST' (or sent ours).
-			 *  Anything from here on should be accepted a little more reasonably.
-			 */
-			this->ProcessConnectedLine(tags, prefix, command, params);
-		break;
 		case DYING:
 		break;
 	}
 }
 
+CommandBase::Params& TreeSocket::CopyParams()
+{
+	// Assigning to the existing strings reuses their storage so once the buffers
+	// have grown large enough copying the parameters does not allocate.
+	lineparams.GetTags().clear();
+	lineparams.resize(parsedline.params.size());
+	for (size_t i = 0; i < parsedline.params.size(); ++i)
+		lineparams[i].assign(parsedline.params[i]);
+	return lineparams;
+}
+
 User* TreeSocket::FindSource(const std::string& prefix, const std::string& command)
 {
 	// Empty prefix means the source is the directly connected server that sent this command
@@ -275,16 +250,16 @@ User* TreeSocket::FindSource(const std::string& prefix, const std::string& comma
 	return NULL;
 }
 
-void TreeSocket::ProcessTag(User* source, const std::string& tag, ClientProtocol::TagMap& tags)
+void TreeSocket::ProcessTag(User* source, const std::string_view& tag, ClientProtocol::TagMap& tags)
 {
 	std::string tagkey;
 	std::string tagval;
-	const std::string::size_type p = tag.find('=');
-	if (p != std::string::npos)
+	const std::string_view::size_type p = tag.find('=');
+	if (p != std::string_view::npos)
 	{
 		// Tag has a value
-		tagkey.assign(tag, 0, p);
-		tagval.assign(tag, p + 1, std::string::npos);
+		tagkey.assign(tag.substr(0, p));
+		tagval.assign(tag.substr(p + 1));
 	}
 	else
 	{
@@ -303,7 +278,7 @@ void TreeSocket::ProcessTag(User* source, const std::string& tag, ClientProtocol
 	}
 }
 
-void TreeSocket::ProcessConnectedLine(std::string& taglist, std::string& prefix, std::string& command, CommandBase::Params& params)
+void TreeSocket::ProcessConnectedLine(const std::string& prefix, const std::string& command)
 {
 	User* who = FindSource(prefix, command);
 	if (!who)
@@ -346,7 +321,7 @@ void TreeSocket::ProcessConnectedLine(std::string& taglist, std::string& prefix,
 		{
 			if (command == "ERROR")
 			{
-				this->Error(params);
+				this->Error(CopyParams());
 				return;
 			}
 			else if (command == "BURST")
@@ -360,37 +335,59 @@ void TreeSocket::ProcessConnectedLine(std::string& taglist, std::string& prefix,
 		cmdbase = cmd;
 	}
 
-	if (params.size() < cmdbase->min_params)
+	ParsedLine::Params& views = parsedline.params;
+	if (views.size() < cmdbase->min_params)
 		throw ProtocolException("Insufficient parameters");
 
-	if ((!params.empty()) && (params.back().empty()) && (!cmdbase->allow_empty_last_param))
+	if ((!views.empty()) && (views.back().empty()) && (!cmdbase->allow_empty_last_param))
 	{
 		// the last param is empty and the command handler doesn't allow that, check if there will be enough params if we drop the last
-		if (params.size()-1 < cmdbase->min_params)
+		if (views.size()-1 < cmdbase->min_params)
 			return;
-		params.pop_back();
+		views.pop_back();
 	}
 
-	CmdResult res;
-	ClientProtocol::TagMap tags;
-	std::string tag;
-	irc::sepstream tagstream(taglist, ';');
-	while (tagstream.GetToken(tag))
-		ProcessTag(who, tag, tags);
+	// Commands which are sent in large numbers during a burst are handled straight from the received
+	// line. Everything else needs its parameters copied as command handlers take them as strings.
+	ParsedServerCommand* const pcmd = scmd ? scmd->AsParsed() : NULL;
+	CommandBase::Params& params = pcmd ? lineparams : CopyParams();
+	if (pcmd)
+	{
+		params.clear();
+		params.GetTags().clear();
+	}
 
-	CommandBase::Params newparams(params, tags);
+	for (std::string_view tags = parsedline.tags; !tags.empty(); )
+	{
+		const std::string_view::size_type sep = tags.find(';');
+		const std::string_view tag = tags.substr(0, sep);
+		if (!tag.empty())
+			ProcessTag(who, tag, params.GetTags());
+		tags.remove_prefix(sep == std::string_view::npos ? tags.length() : sep + 1);
+	}
 
-	if (scmd)
-		res = scmd->Handle(who, newparams);
+	const uint64_t started = insp::monotonic_ns();
+	CmdResult res;
+	if (pcmd)
+		res = pcmd->HandleParsed(who, parsedline, arena);
+	else if (scmd)
+		res = scmd->Handle(who, params);
 	else
 	{
-		res = cmd->Handle(who, newparams);
+		res = cmd->Handle(who, params);
 		if (res == CmdResult::INVALID)
 			throw ProtocolException("Error in command handler");
 	}
 
 	if (res == CmdResult::SUCCESS)
-		Utils->RouteCommand(server->GetRoute(), cmdbase, newparams, who);
+	{
+		if (pcmd)
+			Utils->RouteParsed(server->GetRoute(), pcmd, parsedline, params.GetTags(), who);
+		else
+			Utils->RouteCommand(server->GetRoute(), cmdbase, params, who);
+	}
+
+	Utils->CommandTimes[cmdbase->name].add(insp::monotonic_ns() - started);
 }
 
 void TreeSocket::OnTimeout()
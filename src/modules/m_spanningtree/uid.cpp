@@ -30,25 +30,34 @@
 #include "treeserver.h"
 #include "remoteuser.h"
 
-CmdResult CommandUID::HandleServer(TreeServer* remoteserver, CommandBase::Params& params)
+CmdResult CommandUID::HandleParsed(User* user, ParsedLine& line, LineArena& arena)
 {
+	if (!IS_SERVER(user))
+		throw ProtocolException("Invalid source");
+	TreeServer* remoteserver = TreeServer::Get(user);
+
 	/**
 	 *      0    1    2    3    4    5        6        7     8        9       (n-1)
 	 * UID uuid age nick host dhost ident ip.string signon +modes (modepara) :real
 	 */
+	ParsedLine::Params& params = line.params;
 	time_t age_ts = ServerCommand::ExtractTS(params[1]);
 	time_t signon = ServerCommand::ExtractTS(params[7]);
-	const std::string& modestr = params[8];
+	const std::string_view& modestr = params[8];
 
 	// Check if the length of the uuid is correct and confirm the sid portion of the uuid matches the sid of the server introducing the user
 	if (params[0].length() != UIDGenerator::UUID_LENGTH || params[0].compare(0, 3, remoteserver->GetId()))
 		throw ProtocolException("Bogus UUID");
 	// Sanity check on mode string: must begin with '+'
-	if (modestr[0] != '+')
+	if (modestr.empty() || modestr[0] != '+')
 		throw ProtocolException("Invalid mode string");
 
+	const std::string uuid(params[0]);
+	const std::string ident(params[5]);
+	const std::string ip(params[6]);
+
 	// See if there is a nick collision
-	User* collideswith = ServerInstance->Users.FindNick(params[2]);
+	User* collideswith = ServerInstance->Users.FindNick(std::string(params[2]));
 	if ((collideswith) && (collideswith->registered != REG_ALL))
 	{
 		// User that the incoming user is colliding with is not fully registered, we force nick change the
@@ -59,13 +68,13 @@ CmdResult CommandUID::HandleServer(TreeServer* remoteserver, CommandBase::Params
 	else if (collideswith)
 	{
 		// The user on this side is registered, handle the collision
-		bool they_change = Utils->DoCollision(collideswith, remoteserver, age_ts, params[5], params[6], params[0], "UID");
+		bool they_change = Utils->DoCollision(collideswith, remoteserver, age_ts, ident, ip, uuid, "UID");
 		if (they_change)
 		{
 			// The client being introduced needs to change nick to uuid, change the nick in the message before
 			// processing/forwarding it. Also change the nick TS to CommandSave::SavedTimestamp.
 			age_ts = CommandSave::SavedTimestamp;
-			params[1] = ConvToStr(CommandSave::SavedTimestamp);
+			params[1] = arena.Store(ConvToStr(CommandSave::SavedTimestamp));
 			params[2] = params[0];
 		}
 	}
@@ -73,13 +82,13 @@ CmdResult CommandUID::HandleServer(TreeServer* remoteserver, CommandBase::Params
 	/* For remote users, we pass the UUID they sent to the constructor.
 	 * If the UUID already exists User::User() throws an exception which causes this connection to be closed.
 	 */
-	RemoteUser* _new = new SpanningTree::RemoteUser(params[0], remoteserver);
-	ServerInstance->Users.clientlist[params[2]] = _new;
-	_new->nick = params[2];
-	_new->ChangeRealHost(params[3], false);
-	_new->ChangeDisplayedHost(params[4]);
-	_new->ident = params[5];
-	_new->ChangeRealName(params.back());
+	RemoteUser* _new = new SpanningTree::RemoteUser(uuid, remoteserver);
+	_new->nick.assign(params[2]);
+	ServerInstance->Users.clientlist[_new->nick] = _new;
+	_new->ChangeRealHost(std::string(params[3]), false);
+	_new->ChangeDisplayedHost(std::string(params[4]));
+	_new->ident = ident;
+	_new->ChangeRealName(std::string(params.back()));
 	_new->registered = REG_ALL;
 	_new->signon = signon;
 	_new->age = age_ts;
@@ -111,7 +120,7 @@ CmdResult CommandUID::HandleServer(TreeServer* remoteserver, CommandBase::Params
 			 * will not change in future versions if you want to make use of this protective behaviour
 			 * yourself.
 			 */
-			Modes::Change modechange(mh, true, params[paramptr++]);
+			Modes::Change modechange(mh, true, std::string(params[paramptr++]));
 			mh->OnModeChange(_new, _new, NULL, modechange);
 		}
 		else
@@ -122,7 +131,7 @@ CmdResult CommandUID::HandleServer(TreeServer* remoteserver, CommandBase::Params
 		_new->SetMode(mh, true);
 	}
 
-	_new->SetClientIP(params[6]);
+	_new->SetClientIP(ip);
 
 	ServerInstance->Users.AddClone(_new);
 	remoteserver->UserCount++;
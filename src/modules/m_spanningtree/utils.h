@@ -27,6 +27,7 @@
 
 #include "inspircd.h"
 #include "cachetimer.h"
+#include "utility/histogram.h"
 
 class TreeServer;
 class TreeSocket;
@@ -34,6 +35,8 @@ class Link;
 class Autoconnect;
 class ModuleSpanningTree;
 class SpanningTreeUtilities;
+class ParsedServerCommand;
+class ParsedLine;
 class CmdBuilder;
 
 extern SpanningTreeUtilities* Utils;
@@ -110,6 +113,10 @@ class SpanningTreeUtilities : public Cullable
 	 */
 	unsigned long PingFreq = 60;
 
+	/** The time spent processing each type of command received from other servers in nanoseconds
+	 */
+	std::map<std::string, insp::log2_histogram> CommandTimes;
+
 	/** Initialise utility class
 	 */
 	SpanningTreeUtilities(ModuleSpanningTree* Creator);
@@ -124,6 +131,9 @@ class SpanningTreeUtilities : public Cullable
 
 	void RouteCommand(TreeServer* origin, CommandBase* cmd, const CommandBase::Params& parameters, User* user);
 
+	/** Routes a line which was handled directly from its parsed form by a ParsedServerCommand. */
+	void RouteParsed(TreeServer* origin, ParsedServerCommand* cmd, const ParsedLine& line, const ClientProtocol::TagMap& tags, User* user);
+
 	/** Send a message from this server to one other local or remote
 	 */
 	void DoOneToOne(const CmdBuilder& params, Server* target);
@@ -35,6 +35,41 @@ enum AuthState {
 	AUTH_STATE_FAIL = 2
 };
 
+namespace
+{
+	/** Compares the password a user sent to password hashes from the database one at a time
+	 * until one matches. These use a key derivation function so they are compared on a worker
+	 * thread and the user is kept in OnCheckReady until the result is available.
+	 */
+	void CompareKDF(Module* mod, IntExtItem& pendingExt, bool verbose, const std::string& uid, const std::string& kdf, const std::shared_ptr<std::vector<std::string>>& hashes, size_t index)
+	{
+		LocalUser* user = IS_LOCAL(ServerInstance->Users.FindUUID(uid));
+		if (!user)
+			return;
+
+		if (index >= hashes->size())
+		{
+			if (verbose)
+				ServerInstance->SNO.WriteGlobalSno('a', "Forbidden connection from %s (password from the SQL query did not match the user provided password)", user->GetFullRealHost().c_str());
+			pendingExt.Set(user, AUTH_STATE_FAIL);
+			return;
+		}
+
+		ServerInstance->PassCompare(mod, user, (*hashes)[index], user->password, kdf, [mod, &pendingExt, verbose, uid, kdf, hashes, index](bool result)
+		{
+			if (!result)
+			{
+				CompareKDF(mod, pendingExt, verbose, uid, kdf, hashes, index + 1);
+				return;
+			}
+
+			LocalUser* luser = IS_LOCAL(ServerInstance->Users.FindUUID(uid));
+			if (luser)
+				pendingExt.Set(luser, AUTH_STATE_NONE);
+		});
+	}
+}
+
 class AuthQuery : public SQL::Query
 {
  public:
@@ -83,6 +118,18 @@ class AuthQuery : public SQL::Query
 				}
 
 				SQL::Row row;
+				if (hashprov->IsKDF())
+				{
+					auto hashes = std::make_shared<std::vector<std::string>>();
+					while (res.GetRow(row))
+					{
+						if (row[colindex].has_value())
+							hashes->push_back(*row[colindex]);
+					}
+					CompareKDF(creator, pendingExt, verbose, uid, kdf, hashes, 0);
+					return;
+				}
+
 				while (res.GetRow(row))
 				{
 					if (row[colindex].has_value() && hashprov->Compare(user->password, *row[colindex]))
@@ -125,7 +172,7 @@ class ModuleSQLAuth : public Module
 	dynamic_reference<SQL::Provider> SQL;
 	UserCertificateAPI sslapi;
 
-	std::string freeformquery;
+	SQL::Statement freeformquery;
 	std::string killreason;
 	std::string allowpattern;
 	bool verbose;
@@ -150,7 +197,7 @@ class ModuleSQLAuth : public Module
 			SQL.SetProvider("SQL");
 		else
 			SQL.SetProvider("SQL/" + dbid);
-		freeformquery = conf->getString("query");
+		freeformquery = SQL::Statement(conf->getString("query"));
 		killreason = conf->getString("killreason");
 		allowpattern = conf->getString("allowpattern");
 		verbose = conf->getBool("verbose");
@@ -198,7 +245,7 @@ class ModuleSQLAuth : public Module
 				userinfo[algo + "pass"] = hashprov->Generate(user->password);
 		}
 
-		SQL->Submit(new AuthQuery(this, user->uuid, pendingExt, verbose, kdf, pwcolumn), freeformquery, userinfo);
+		SQL->Submit(new AuthQuery(this, user->uuid, pendingExt, verbose, kdf, pwcolumn), freeformquery, SQL::ValueMap(userinfo.begin(), userinfo.end()));
 
 		return MOD_RES_PASSTHRU;
 	}
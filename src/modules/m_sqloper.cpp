@@ -163,7 +163,7 @@ class ModuleSQLOper : public Module
  private:
 	// Whether OperQuery is running
 	bool active = false;
-	std::string query;
+	SQL::Statement query;
 	// Stores oper blocks from DB
 	std::vector<std::string> my_blocks;
 	dynamic_reference<SQL::Provider> SQL;
@@ -188,7 +188,7 @@ public:
 		else
 			SQL.SetProvider("SQL/" + dbid);
 
-		query = tag->getString("query", "SELECT * FROM ircd_opers WHERE active=1;", 1);
+		query = SQL::Statement(tag->getString("query", "SELECT * FROM ircd_opers WHERE active=1;", 1));
 		// Update sqloper list from the database.
 		GetOperBlocks();
 	}
@@ -226,13 +226,13 @@ public:
 	// The one w/o params is for non-/OPER DB updates, such as a rehash.
 	void GetOperBlocks()
 	{
-		SQL->Submit(new OperQuery(this, my_blocks), query);
+		SQL->Submit(new OperQuery(this, my_blocks), query, SQL::ValueList());
 	}
 	void GetOperBlocks(const std::string u, const std::string& un, const std::string& pw)
 	{
 		active = true;
 		// Call to SQL query to fetch oper list from SQL table.
-		SQL->Submit(new OperQuery(this, my_blocks, u, un, pw), query);
+		SQL->Submit(new OperQuery(this, my_blocks, u, un, pw), query, SQL::ValueList());
 	}
 
 	void Prioritize() override
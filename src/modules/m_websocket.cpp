@@ -23,6 +23,7 @@
 
 #include "inspircd.h"
 #include "iohook.h"
+#include "modules/deflate.h"
 #include "modules/hash.h"
 
 #define UTF_CPP_CPLUSPLUS 199711L
@@ -31,6 +32,7 @@
 static const char MagicGUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 static const char whitespace[] = " \t\r\n";
 static dynamic_reference_nocheck<HashProvider>* sha1;
+static dynamic_reference_nocheck<Deflate::Provider>* deflateprov;
 
 struct WebSocketConfig
 {
@@ -45,6 +47,15 @@ struct WebSocketConfig
 
 	// Whether to send as UTF-8 text instead of binary data.
 	bool sendastext;
+
+	// Whether to offer the permessage-deflate extension to clients.
+	bool deflate;
+
+	// The compression level to use for messages sent to clients.
+	int deflatelevel;
+
+	// Whether to keep the compression history between messages.
+	bool contexttakeover;
 };
 
 class WebSocketHookProvider : public IOHookProvider
@@ -93,6 +104,11 @@ class WebSocketHook : public IOHookMiddle
 		{
 			return std::string(req, bpos, len);
 		}
+
+		std::string ExtractLine(const std::string& req) const
+		{
+			return std::string(req, bpos, req.find("\r\n", bpos) - bpos);
+		}
 	};
 
 	enum OpCode
@@ -113,6 +129,9 @@ class WebSocketHook : public IOHookMiddle
 
 	static const unsigned char WS_MASKBIT = (1 << 7);
 	static const unsigned char WS_FINBIT = (1 << 7);
+	static const unsigned char WS_RSV1BIT = (1 << 6);
+	static const unsigned char WS_RSVBITS = (7 << 4);
+	static const unsigned char WS_CONTROLBIT = (1 << 3);
 	static const unsigned char WS_PAYLOAD_LENGTH_MAGIC_LARGE = 126;
 	static const unsigned char WS_PAYLOAD_LENGTH_MAGIC_HUGE = 127;
 	static const size_t WS_MAX_PAYLOAD_LENGTH_SMALL = 125;
@@ -126,10 +145,21 @@ class WebSocketHook : public IOHookMiddle
 	time_t lastpingpong = 0;
 	WebSocketConfig& config;
 
-	static size_t FillHeader(unsigned char* outbuf, size_t sendlength, OpCode opcode)
+	// The permessage-deflate state if the client negotiated it.
+	Deflate::CompressorPtr compressor;
+	Deflate::DecompressorPtr decompressor;
+
+	// Whether the compression history is kept between messages in each direction.
+	bool servercontext = true;
+	bool clientcontext = true;
+
+	// Whether the data frames currently being received are compressed.
+	bool inflating = false;
+
+	static size_t FillHeader(unsigned char* outbuf, size_t sendlength, OpCode opcode, bool compressed = false)
 	{
 		size_t pos = 0;
-		outbuf[pos++] = WS_FINBIT | opcode;
+		outbuf[pos++] = WS_FINBIT | (compressed ? WS_RSV1BIT : 0) | opcode;
 
 		if (sendlength <= WS_MAX_PAYLOAD_LENGTH_SMALL)
 		{
@@ -160,6 +190,52 @@ class WebSocketHook : public IOHookMiddle
 		return StreamSocket::SendQueue::Element(reinterpret_cast<const char*>(header), n);
 	}
 
+	static void Unmask(const unsigned char* in, size_t len, const unsigned char* maskkey, char* out)
+	{
+		// The key repeats every four bytes so it can be applied to eight bytes at a time. The
+		// memcpy calls are turned into unaligned loads and stores and the loop is vectorised
+		// by the compiler where the target supports it.
+		uint64_t widekey;
+		const unsigned char keybytes[sizeof(widekey)] = {
+			maskkey[0], maskkey[1], maskkey[2], maskkey[3],
+			maskkey[0], maskkey[1], maskkey[2], maskkey[3]
+		};
+		memcpy(&widekey, keybytes, sizeof(widekey));
+
+		size_t pos = 0;
+		for (; pos + sizeof(widekey) <= len; pos += sizeof(widekey))
+		{
+			uint64_t word;
+			memcpy(&word, in + pos, sizeof(word));
+			word ^= widekey;
+			memcpy(out + pos, &word, sizeof(word));
+		}
+
+		for (; pos < len; ++pos)
+			out[pos] = static_cast<char>(in[pos] ^ maskkey[pos % 4]);
+	}
+
+	static bool IsValidUTF8(const char* data, size_t len)
+	{
+		// Most IRC traffic is ASCII which is always valid so check for that a word at a time first.
+		const uint64_t highbits = UINT64_C(0x8080808080808080);
+		size_t pos = 0;
+		for (; pos + sizeof(highbits) <= len; pos += sizeof(highbits))
+		{
+			uint64_t word;
+			memcpy(&word, data + pos, sizeof(word));
+			if (word & highbits)
+				break;
+		}
+
+		for (; pos < len; ++pos)
+		{
+			if (static_cast<unsigned char>(data[pos]) & 0x80)
+				return utf8::find_invalid(data + pos, data + len) == data + len;
+		}
+		return true;
+	}
+
 	int HandleAppData(StreamSocket* sock, std::string& appdataout, bool allowlarge)
 	{
 		std::string& myrecvq = GetRecvQ();
@@ -218,16 +294,11 @@ class WebSocketHook : public IOHookMiddle
 		if (myrecvq.length() < payloadstartoffset + len)
 			return 0;
 
-		unsigned int maskkeypos = 0;
-		const std::string::iterator endit = myrecvq.begin() + payloadstartoffset + len;
-		for (std::string::const_iterator i = myrecvq.begin() + payloadstartoffset; i != endit; ++i)
-		{
-			const unsigned char c = (unsigned char)*i;
-			appdataout.push_back(c ^ maskkey[maskkeypos++]);
-			maskkeypos %= 4;
-		}
+		const size_t outpos = appdataout.length();
+		appdataout.resize(outpos + len);
+		Unmask(reinterpret_cast<const unsigned char*>(cmyrecvq.data()) + payloadstartoffset, len, maskkey, &appdataout[outpos]);
 
-		myrecvq.erase(myrecvq.begin(), endit);
+		myrecvq.erase(0, payloadstartoffset + len);
 		return 1;
 	}
 
@@ -261,23 +332,65 @@ class WebSocketHook : public IOHookMiddle
 			return 0;
 
 		unsigned char opcode = (unsigned char)GetRecvQ().c_str()[0];
+
+		// RSV1 marks the first frame of a compressed message and is only valid on data frames
+		// if permessage-deflate was negotiated. The other reserved bits are never valid.
+		const unsigned char rsv = opcode & WS_RSVBITS;
+		if (rsv && (rsv != WS_RSV1BIT || !decompressor || (opcode & WS_CONTROLBIT)))
+		{
+			sock->SetError("WebSocket protocol violation: reserved bits set");
+			return -1;
+		}
+		opcode &= ~WS_RSVBITS;
+
 		switch (opcode & ~WS_FINBIT)
 		{
 			case OP_CONTINUATION:
 			case OP_TEXT:
 			case OP_BINARY:
 			{
-				std::string appdata;
-				const int result = HandleAppData(sock, appdata, true);
-				if (result != 1)
-					return result;
+				if ((opcode & ~WS_FINBIT) != OP_CONTINUATION)
+					inflating = rsv;
+				else if (rsv)
+				{
+					sock->SetError("WebSocket protocol violation: compressed continuation frame");
+					return -1;
+				}
 
-				// Strip out any CR+LF which may have been erroneously sent.
-				for (const auto& chr : appdata)
+				const size_t startpos = destrecvq.length();
+				if (!inflating)
 				{
-					if (chr != '\r' && chr != '\n')
-						destrecvq.push_back(chr);
+					// Uncompressed data is unmasked straight into the destination.
+					const int result = HandleAppData(sock, destrecvq, true);
+					if (result != 1)
+						return result;
 				}
+				else
+				{
+					static std::string framebuf;
+					framebuf.clear();
+					const int result = HandleAppData(sock, framebuf, true);
+					if (result != 1)
+						return result;
+
+					// The sender removes the empty block at the end of each message so we have to add it back.
+					if (opcode & WS_FINBIT)
+						framebuf.append("\x00\x00\xFF\xFF", 4);
+
+					if (!decompressor || !decompressor->Decompress(framebuf.data(), framebuf.length(), destrecvq, WS_MAX_PAYLOAD_LENGTH_LARGE))
+					{
+						sock->SetError("WebSocket: Invalid compressed frame");
+						return -1;
+					}
+
+					if ((opcode & WS_FINBIT) && !clientcontext)
+						decompressor->Reset();
+				}
+
+				// Strip out any CR+LF which may have been erroneously sent.
+				destrecvq.erase(std::remove_if(destrecvq.begin() + startpos, destrecvq.end(), [](char chr) {
+					return chr == '\r' || chr == '\n';
+				}), destrecvq.end());
 
 				// If we are on the final message of this block append a line terminator.
 				if (opcode & WS_FINBIT)
@@ -312,6 +425,144 @@ class WebSocketHook : public IOHookMiddle
 		}
 	}
 
+	static std::string TrimWhitespace(const std::string& str)
+	{
+		const std::string::size_type start = str.find_first_not_of(whitespace);
+		if (start == std::string::npos)
+			return std::string();
+
+		const std::string::size_type end = str.find_last_not_of(whitespace);
+		return str.substr(start, end - start + 1);
+	}
+
+	/** Picks the first acceptable permessage-deflate offer (RFC 7692) from the client.
+	 * @param offers The value of the Sec-WebSocket-Extensions header sent by the client.
+	 * @return The extension parameters to send back or an empty string if no offer was acceptable.
+	 */
+	std::string NegotiateDeflate(const std::string& offers)
+	{
+		irc::sepstream offerstream(offers, ',');
+		for (std::string offer; offerstream.GetToken(offer); )
+		{
+			irc::sepstream paramstream(offer, ';');
+			std::string param;
+			if (!paramstream.GetToken(param) || TrimWhitespace(param) != "permessage-deflate")
+				continue;
+
+			bool servertakeover = config.contexttakeover;
+			bool clienttakeover = config.contexttakeover;
+			int serverbits = 0;
+			bool valid = true;
+			std::set<std::string> seen;
+			while (valid && paramstream.GetToken(param))
+			{
+				std::string value;
+				const std::string::size_type eqpos = param.find('=');
+				if (eqpos != std::string::npos)
+				{
+					value = TrimWhitespace(param.substr(eqpos + 1));
+					if (value.length() >= 2 && value[0] == '"' && value[value.length() - 1] == '"')
+						value = value.substr(1, value.length() - 2);
+					param.erase(eqpos);
+				}
+				param = TrimWhitespace(param);
+
+				// Each parameter may only be specified once.
+				if (!seen.insert(param).second)
+					valid = false;
+				else if (param == "server_no_context_takeover")
+				{
+					servertakeover = false;
+					valid = eqpos == std::string::npos;
+				}
+				else if (param == "client_no_context_takeover")
+				{
+					clienttakeover = false;
+					valid = eqpos == std::string::npos;
+				}
+				else if (param == "server_max_window_bits")
+				{
+					// zlib can not produce raw streams with an 8-bit window so decline those.
+					serverbits = ConvToNum<int>(value);
+					valid = serverbits >= Deflate::MIN_WINDOW_BITS && serverbits <= Deflate::MAX_WINDOW_BITS;
+				}
+				else if (param == "client_max_window_bits")
+				{
+					// We always decompress with the largest window so any value is acceptable.
+					const int clientbits = eqpos == std::string::npos ? Deflate::MAX_WINDOW_BITS : ConvToNum<int>(value);
+					valid = clientbits >= 8 && clientbits <= Deflate::MAX_WINDOW_BITS;
+				}
+				else
+					valid = false;
+			}
+
+			if (!valid)
+				continue;
+
+			compressor = (*deflateprov)->CreateCompressor(serverbits ? serverbits : Deflate::MAX_WINDOW_BITS, config.deflatelevel);
+			decompressor = (*deflateprov)->CreateDecompressor(Deflate::MAX_WINDOW_BITS);
+			servercontext = servertakeover;
+			clientcontext = clienttakeover;
+
+			std::string response = "permessage-deflate";
+			if (!servertakeover)
+				response.append("; server_no_context_takeover");
+			if (!clienttakeover)
+				response.append("; client_no_context_takeover");
+			if (serverbits)
+				response.append("; server_max_window_bits=").append(ConvToStr(serverbits));
+			return response;
+		}
+		return std::string();
+	}
+
+	void AppendFrame(std::string& out, const char* data, size_t len)
+	{
+		// Lines are terminated with CR+LF but WebSocket messages are not.
+		if (len && data[len - 1] == '\r')
+			len--;
+
+		OpCode opcode = OP_BINARY;
+		if (config.sendastext)
+		{
+			// If we send messages as text then we need to ensure they are valid UTF-8.
+			opcode = OP_TEXT;
+			if (!IsValidUTF8(data, len))
+			{
+				static std::string encoded;
+				encoded.clear();
+				utf8::unchecked::replace_invalid(data, data + len, std::back_inserter(encoded));
+				data = encoded.data();
+				len = encoded.length();
+			}
+		}
+
+		unsigned char header[MAXHEADERSIZE];
+		if (compressor)
+		{
+			static std::string compressed;
+			compressed.clear();
+			if (compressor->Compress(data, len, compressed) && compressed.length() >= 4)
+			{
+				// The empty block at the end of each message is implied (RFC 7692 section 7.2.1).
+				compressed.resize(compressed.length() - 4);
+				if (!servercontext)
+					compressor->Reset();
+
+				const size_t headerlen = FillHeader(header, compressed.length(), opcode, true);
+				out.append(reinterpret_cast<const char*>(header), headerlen).append(compressed);
+				return;
+			}
+
+			// The compressor is in an unknown state. Uncompressed messages are always valid so
+			// fall back to sending those.
+			compressor.reset();
+		}
+
+		const size_t headerlen = FillHeader(header, len, opcode);
+		out.append(reinterpret_cast<const char*>(header), headerlen).append(data, len);
+	}
+
 	void FailHandshake(StreamSocket* sock, const char* httpreply, const char* sockerror)
 	{
 		GetSendQ().push_back(StreamSocket::SendQueue::Element(httpreply));
@@ -405,7 +656,16 @@ class WebSocketHook : public IOHookMiddle
 		key.append(MagicGUID);
 
 		std::string reply = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
-		reply.append(Base64::Encode((*sha1)->GenerateRaw(key), nullptr, '=')).append("\r\n\r\n");
+		reply.append(Base64::Encode((*sha1)->GenerateRaw(key), nullptr, '=')).append("\r\n");
+
+		HTTPHeaderFinder extheader;
+		if (config.deflate && *deflateprov && extheader.Find(recvq, "Sec-WebSocket-Extensions:", 25, reqend))
+		{
+			const std::string extensions = NegotiateDeflate(extheader.ExtractLine(recvq));
+			if (!extensions.empty())
+				reply.append("Sec-WebSocket-Extensions: ").append(extensions).append("\r\n");
+		}
+		reply.append("\r\n");
 		GetSendQ().push_back(StreamSocket::SendQueue::Element(reply));
 
 		SocketEngine::ChangeEventMask(sock, FD_ADD_TRIAL_WRITE);
@@ -423,6 +683,19 @@ class WebSocketHook : public IOHookMiddle
 		sock->AddIOHook(this);
 	}
 
+	/** Stops using the permessage-deflate extension. This is called when the DEFLATE provider is unloaded.
+	 * @return True if the extension had been negotiated; otherwise, false.
+	 */
+	bool DisableCompression()
+	{
+		if (!compressor && !decompressor)
+			return false;
+
+		compressor.reset();
+		decompressor.reset();
+		return true;
+	}
+
 	ssize_t OnStreamSocketWrite(StreamSocket* sock, StreamSocket::SendQueue& uppersendq) override
 	{
 		StreamSocket::SendQueue& mysendq = GetSendQ();
@@ -431,43 +704,36 @@ class WebSocketHook : public IOHookMiddle
 		if (state != STATE_ESTABLISHED)
 			return (mysendq.empty() ? 0 : 1);
 
-		std::string message;
+		// Every complete line is framed into one buffer so that lines which do not span multiple
+		// elements of the upper send queue are copied exactly once.
+		std::string frames;
+		std::string partial;
 		for (const auto& elem : uppersendq)
 		{
-			for (const auto& chr : elem)
+			std::string::size_type linestart = 0;
+			for (std::string::size_type lineend; (lineend = elem.find('\n', linestart)) != std::string::npos; linestart = lineend + 1)
 			{
-				if (chr == '\n')
+				if (partial.empty())
 				{
-					// We have found an entire message. Send it in its own frame.
-					if (config.sendastext)
-					{
-						// If we send messages as text then we need to ensure they are valid UTF-8.
-						std::string encoded;
-						utf8::unchecked::replace_invalid(message.begin(), message.end(), std::back_inserter(encoded));
-
-						mysendq.push_back(PrepareSendQElem(encoded.length(), OP_TEXT));
-						mysendq.push_back(encoded);
-					}
-					else
-					{
-						// Otherwise, send the raw message as a binary frame.
-						mysendq.push_back(PrepareSendQElem(message.length(), OP_BINARY));
-						mysendq.push_back(message);
-					}
-					message.clear();
-				}
-				else if (chr != '\r')
-				{
-					message.push_back(chr);
+					AppendFrame(frames, elem.data() + linestart, lineend - linestart);
+					continue;
 				}
+
+				partial.append(elem, linestart, lineend - linestart);
+				AppendFrame(frames, partial.data(), partial.length());
+				partial.clear();
 			}
+			partial.append(elem, linestart, std::string::npos);
 		}
 
+		if (!frames.empty())
+			mysendq.push_back(std::move(frames));
+
 		// Empty the upper send queue and push whatever is left back onto it.
 		uppersendq.clear();
-		if (!message.empty())
+		if (!partial.empty())
 		{
-			uppersendq.push_back(message);
+			uppersendq.push_back(std::move(partial));
 			return 0;
 		}
 
@@ -507,15 +773,18 @@ class ModuleWebSocket : public Module
 {
  private:
 	dynamic_reference_nocheck<HashProvider> hash;
+	dynamic_reference_nocheck<Deflate::Provider> deflate;
 	std::shared_ptr<WebSocketHookProvider> hookprov;
 
  public:
 	ModuleWebSocket()
 		: Module(VF_VENDOR, "Allows WebSocket clients to connect to the IRC server.")
 		, hash(this, "hash/sha1")
+		, deflate(this, "deflate/zlib")
 		, hookprov(std::make_shared<WebSocketHookProvider>(this))
 	{
 		sha1 = &hash;
+		deflateprov = &deflate;
 	}
 
 	void ReadConfig(ConfigStatus& status) override
@@ -537,6 +806,9 @@ class ModuleWebSocket : public Module
 
 		auto tag = ServerInstance->Config->ConfValue("websocket");
 		config.sendastext = tag->getBool("sendastext", true);
+		config.deflate = tag->getBool("deflate", true);
+		config.deflatelevel = static_cast<int>(tag->getUInt("deflatelevel", 6, 1, 9));
+		config.contexttakeover = tag->getBool("contexttakeover", true);
 
 		irc::spacesepstream proxyranges(tag->getString("proxyranges"));
 		for (std::string proxyrange; proxyranges.GetToken(proxyrange); )
@@ -546,6 +818,23 @@ class ModuleWebSocket : public Module
 		hookprov->config = config;
 	}
 
+	void OnUnloadModule(Module* mod) override
+	{
+		if (!deflate || deflate->creator != mod)
+			return;
+
+		// Compressors can not outlive the module which created them and clients which negotiated
+		// compression will keep sending compressed messages so they have to be disconnected.
+		const UserManager::LocalList& users = ServerInstance->Users.GetLocalUsers();
+		for (UserManager::LocalList::const_iterator iter = users.begin(); iter != users.end(); )
+		{
+			LocalUser* user = *iter++;
+			WebSocketHook* hook = static_cast<WebSocketHook*>(user->eh.GetModHook(this));
+			if (hook && hook->DisableCompression())
+				ServerInstance->Users.QuitUser(user, "WebSocket compression provider unloading");
+		}
+	}
+
 	void OnCleanup(ExtensionItem::ExtensibleType type, Extensible* item) override
 	{
 		if (type != ExtensionItem::EXT_USER)
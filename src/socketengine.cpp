@@ -28,6 +28,7 @@
 
 #include "exitcodes.h"
 #include "inspircd.h"
+#include "utility/histogram.h"
 
 #include <iostream>
 
@@ -312,13 +313,23 @@ int SocketEngine::Shutdown(int fd, int how)
 	return shutdown(fd, how);
 }
 
+SocketEngine::Statistics::Statistics()
+	: DispatchSizes(std::make_unique<insp::log2_histogram>())
+{
+}
+
+SocketEngine::Statistics::~Statistics() = default;
+
 void SocketEngine::Statistics::UpdateReadCounters(ssize_t len_in)
 {
 	CheckFlush();
 
 	ReadEvents++;
 	if (len_in > 0)
+	{
 		indata += static_cast<size_t>(len_in);
+		BytesIn += static_cast<size_t>(len_in);
+	}
 	else if (len_in < 0)
 		ErrorEvents++;
 }
@@ -329,11 +340,23 @@ void SocketEngine::Statistics::UpdateWriteCounters(ssize_t len_out)
 
 	WriteEvents++;
 	if (len_out > 0)
+	{
 		outdata += static_cast<size_t>(len_out);
+		BytesOut += static_cast<size_t>(len_out);
+	}
 	else if (len_out < 0)
 		ErrorEvents++;
 }
 
+void SocketEngine::Statistics::UpdateDispatchCounters(int events)
+{
+	LastWake = insp::monotonic_ns();
+	Dispatches++;
+	if (events > 0)
+		TotalEvents += events;
+	DispatchSizes->add(events > 0 ? events : 0);
+}
+
 void SocketEngine::Statistics::CheckFlush() const
 {
 	// Reset the in/out byte counters if it has been more than a second
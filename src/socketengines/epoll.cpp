@@ -161,10 +161,12 @@ void SocketEngine::DelFd(EventHandler* eh)
 
 int SocketEngine::DispatchEvents()
 {
-	int i = epoll_wait(EngineHandle, &events[0], static_cast<int>(events.size()), 1000);
+	// Edge-triggered sockets which still have data to read after a trial read will not wake us
+	// up again so don't wait for events if there are any trial reads or writes pending.
+	int i = epoll_wait(EngineHandle, &events[0], static_cast<int>(events.size()), trials.empty() ? 1000 : 0);
 	ServerInstance->UpdateTime();
 
-	stats.TotalEvents += i;
+	stats.UpdateDispatchCounters(i);
 
 	for (int j = 0; j < i; j++)
 	{
@@ -167,7 +167,10 @@ int SocketEngine::DispatchEvents()
 {
 	struct timespec ts;
 	ts.tv_nsec = 0;
-	ts.tv_sec = 1;
+
+	// Sockets which still have data to read after a trial read will not wake us up again
+	// so don't wait for events if there are any trial reads or writes pending.
+	ts.tv_sec = trials.empty() ? 1 : 0;
 
 	int i = kevent(EngineHandle, &changelist.front(), ChangePos, &ke_list.front(), static_cast<int>(ke_list.size()), &ts);
 	ChangePos = 0;
@@ -176,7 +179,7 @@ int SocketEngine::DispatchEvents()
 	if (i < 0)
 		return i;
 
-	stats.TotalEvents += i;
+	stats.UpdateDispatchCounters(i);
 
 	for (int j = 0; j < i; j++)
 	{
@@ -160,6 +160,8 @@ int SocketEngine::DispatchEvents()
 	int processed = 0;
 	ServerInstance->UpdateTime();
 
+	stats.UpdateDispatchCounters(i);
+
 	for (size_t index = 0; index < CurrentSetSize && processed < i; index++)
 	{
 		struct pollfd& pfd = events[index];
@@ -138,6 +138,8 @@ int SocketEngine::DispatchEvents()
 	int sresult = select(MaxFD + 1, &rfdset, &wfdset, &errfdset, &tval);
 	ServerInstance->UpdateTime();
 
+	stats.UpdateDispatchCounters(sresult);
+
 	for (int i = 0, j = sresult; i <= MaxFD && j > 0; i++)
 	{
 		int has_read = FD_ISSET(i, &rfdset), has_write = FD_ISSET(i, &wfdset), has_error = FD_ISSET(i, &errfdset);
@@ -0,0 +1,229 @@
+/*
+ * InspIRCd -- Internet Relay Chat Daemon
+ *
+ * This file is part of InspIRCd.  InspIRCd is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "inspircd.h"
+
+/** The first worker thread. This also owns the queues and the socket which is used
+ * to tell the main thread that tasks have completed.
+ */
+class ThreadPool::Dispatcher final : public SocketThread
+{
+ private:
+	/** A worker thread other than the dispatcher. */
+	class Worker final : public Thread
+	{
+	 private:
+		Dispatcher* const dispatcher;
+
+		void OnStart() override
+		{
+			dispatcher->Work();
+		}
+
+	 public:
+		Worker(Dispatcher* d)
+			: dispatcher(d)
+		{
+		}
+	};
+
+	/** The tasks which are waiting for a worker thread. Protected by the queue lock. */
+	std::deque<Task*> pending;
+
+	/** The tasks which have been run but not delivered yet. Protected by the queue lock. */
+	std::vector<Task*> completed;
+
+	/** The number of tasks which are currently being run. Protected by the queue lock. */
+	size_t running = 0;
+
+	/** Whether the worker threads should exit. Protected by the queue lock. */
+	bool shutdown = false;
+
+	/** The worker threads other than the dispatcher. Only accessed from the main thread. */
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	void OnStart() override
+	{
+		Work();
+	}
+
+ public:
+	/** Delivers the results of all tasks which have completed. */
+	void OnNotify() override
+	{
+		std::vector<Task*> tasks;
+		LockQueue();
+		tasks.swap(completed);
+		UnlockQueue();
+
+		for (Task* task : tasks)
+		{
+			task->OnComplete();
+			delete task;
+		}
+	}
+
+	/** Runs tasks until the thread pool is shut down. */
+	void Work()
+	{
+		LockQueue();
+		while (!shutdown)
+		{
+			if (pending.empty())
+			{
+				WaitForQueue();
+				continue;
+			}
+
+			Task* task = pending.front();
+			pending.pop_front();
+			running++;
+			UnlockQueue();
+
+			task->Run();
+
+			LockQueue();
+			running--;
+			completed.push_back(task);
+
+			// Wake up anything which is waiting for the running tasks to finish.
+			UnlockQueueWakeup();
+			NotifyParent();
+			LockQueue();
+		}
+		UnlockQueue();
+	}
+
+	/** Cancels the tasks in the specified queue which were submitted by the specified module. */
+	template <typename Queue>
+	static void Cancel(Queue& tasks, Module* mod)
+	{
+		for (typename Queue::iterator it = tasks.begin(); it != tasks.end(); )
+		{
+			if ((*it)->creator == mod)
+			{
+				delete *it;
+				it = tasks.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+
+	void Flush(Module* mod)
+	{
+		LockQueue();
+		Cancel(pending, mod);
+
+		// Tasks from other modules may be using code from the module being unloaded so we wait
+		// for the workers to finish them. Their results are delivered from the main loop later.
+		while (running || !pending.empty())
+			WaitForQueue();
+
+		Cancel(completed, mod);
+		UnlockQueue();
+	}
+
+	size_t GetQueueSize()
+	{
+		LockQueue();
+		size_t size = pending.size();
+		UnlockQueue();
+		return size;
+	}
+
+	size_t GetThreadCount() const
+	{
+		return workers.size() + 1;
+	}
+
+	void Shutdown()
+	{
+		LockQueue();
+		shutdown = true;
+		UnlockQueueWakeup();
+
+		for (const auto& worker : workers)
+			worker->Stop();
+		workers.clear();
+		Stop();
+
+		// The modules which submitted any remaining tasks have been unloaded so their results
+		// can not be delivered.
+		for (Task* task : pending)
+			delete task;
+		pending.clear();
+		for (Task* task : completed)
+			delete task;
+		completed.clear();
+	}
+
+	void Submit(Task* task)
+	{
+		LockQueue();
+		pending.push_back(task);
+		const bool busy = pending.size() + running > GetThreadCount();
+		UnlockQueueWakeup();
+
+		// Start another worker if all of the current ones are busy and we are allowed to.
+		if (busy && GetThreadCount() < ServerInstance->Config->WorkerThreads)
+		{
+			workers.push_back(std::make_unique<Worker>(this));
+			workers.back()->Start();
+		}
+	}
+};
+
+ThreadPool::~ThreadPool()
+{
+	delete dispatcher;
+}
+
+void ThreadPool::Flush(Module* mod)
+{
+	if (dispatcher)
+		dispatcher->Flush(mod);
+}
+
+size_t ThreadPool::GetQueueSize() const
+{
+	return dispatcher ? dispatcher->GetQueueSize() : 0;
+}
+
+size_t ThreadPool::GetThreadCount() const
+{
+	return dispatcher ? dispatcher->GetThreadCount() : 0;
+}
+
+void ThreadPool::Stop()
+{
+	if (!dispatcher)
+		return;
+
+	dispatcher->Shutdown();
+	stdalgo::delete_zero(dispatcher);
+}
+
+void ThreadPool::Submit(Task* task)
+{
+	if (!dispatcher)
+	{
+		dispatcher = new Dispatcher();
+		dispatcher->Start();
+	}
+	dispatcher->Submit(task);
+}
@@ -24,6 +24,8 @@
  */
 
 
+#include <chrono>
+
 #include "inspircd.h"
 
 void Timer::SetInterval(unsigned long newinterval)
@@ -85,3 +87,9 @@ void TimerManager::AddTimer(Timer* t)
 {
 	Timers.emplace(t->GetTrigger(), t);
 }
+
+uint64_t insp::monotonic_ns()
+{
+	const auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
@@ -54,6 +54,15 @@ namespace
 		{
 			user->ForEachNeighbor(*this, false);
 		}
+
+		WriteCommonQuit(User* user, const std::string& msg, const std::string& opermsg, User::LocalMemberCache& cache)
+			: quitmsg(user, msg)
+			, quitevent(ServerInstance->GetRFCEvents().quit, quitmsg)
+			, operquitmsg(user, opermsg)
+			, operquitevent(ServerInstance->GetRFCEvents().quit, operquitmsg)
+		{
+			user->ForEachNeighbor(*this, cache, false);
+		}
 	};
 
 	void CheckPingTimeout(LocalUser* user)
@@ -90,8 +99,14 @@ namespace
 
 	void CheckModulesReady(LocalUser* user)
 	{
+		// Connect class passwords which are slow to compare are compared in the background so
+		// the connect class of the user can not be chosen until they have finished.
 		ModResult res;
-		FIRST_MOD_RESULT(OnCheckReady, res, (user));
+		if (!user->CheckClassPasswords())
+			res = MOD_RES_DENY;
+		else
+			FIRST_MOD_RESULT(OnCheckReady, res, (user));
+
 		if (res == MOD_RES_PASSTHRU)
 		{
 			// User has sent NICK/USER and modules are ready.
@@ -234,17 +249,8 @@ void UserManager::AddUser(int socket, ListenSocket* via, irc::sockets::sockaddrs
 
 void UserManager::QuitUser(User* user, const std::string& quitmessage, const std::string* operquitmessage)
 {
-	if (user->quitting)
-	{
-		ServerInstance->Logs.Log("USERS", LOG_DEFAULT, "ERROR: Tried to quit quitting user: " + user->nick);
+	if (!CanQuit(user))
 		return;
-	}
-
-	if (IS_SERVER(user))
-	{
-		ServerInstance->Logs.Log("USERS", LOG_DEFAULT, "ERROR: Tried to quit server user: " + user->nick);
-		return;
-	}
 
 	std::string quitmsg(quitmessage);
 	std::string operquitmsg;
@@ -268,10 +274,64 @@ void UserManager::QuitUser(User* user, const std::string& quitmessage, const std
 	else if (operquitmsg.length() > ServerInstance->Config->Limits.MaxQuit)
 		operquitmsg.erase(ServerInstance->Config->Limits.MaxQuit + 1);
 
+	FinishQuit(user, quitmsg, operquitmsg, nullptr);
+}
+
+void UserManager::QuitUsers(const std::vector<User*>& users, const std::string& quitmessage, const std::string* operquitmessage)
+{
+	std::string quitmsg(quitmessage);
+	if (quitmsg.length() > ServerInstance->Config->Limits.MaxQuit)
+		quitmsg.erase(ServerInstance->Config->Limits.MaxQuit + 1);
+
+	std::string operquitmsg(operquitmessage ? *operquitmessage : quitmsg);
+	if (operquitmsg.length() > ServerInstance->Config->Limits.MaxQuit)
+		operquitmsg.erase(ServerInstance->Config->Limits.MaxQuit + 1);
+
+	// Local users need the full treatment as modules can deny the quit. They are handled
+	// first as the cache of local channel members can not be used once they leave.
+	for (auto* user : users)
+	{
+		if (IS_LOCAL(user))
+			QuitUser(user, quitmessage, operquitmessage);
+	}
+
+	// Removing a remote user does not change the local members of a channel so these only
+	// have to be looked up once for all of the users.
+	User::LocalMemberCache cache;
+	for (auto* user : users)
+	{
+		if (!IS_LOCAL(user) && CanQuit(user))
+			FinishQuit(user, quitmsg, operquitmsg, &cache);
+	}
+}
+
+bool UserManager::CanQuit(User* user)
+{
+	if (user->quitting)
+	{
+		ServerInstance->Logs.Log("USERS", LOG_DEFAULT, "ERROR: Tried to quit quitting user: " + user->nick);
+		return false;
+	}
+
+	if (IS_SERVER(user))
+	{
+		ServerInstance->Logs.Log("USERS", LOG_DEFAULT, "ERROR: Tried to quit server user: " + user->nick);
+		return false;
+	}
+
+	return true;
+}
+
+void UserManager::FinishQuit(User* user, const std::string& quitmsg, const std::string& operquitmsg, User::LocalMemberCache* cache)
+{
 	user->quitting = true;
-	ServerInstance->Logs.Log("USERS", LOG_DEBUG, "QuitUser: %s=%s '%s'", user->uuid.c_str(), user->nick.c_str(), quitmessage.c_str());
+	ServerInstance->Logs.Log("USERS", LOG_DEBUG, "QuitUser: %s=%s '%s'", user->uuid.c_str(), user->nick.c_str(), quitmsg.c_str());
+
+	LocalUser* const localuser = IS_LOCAL(user);
 	if (localuser)
 	{
+		ServerInstance->stats.Quits++;
+
 		ClientProtocol::Messages::Error errormsg(InspIRCd::Format("Closing link: (%s@%s) [%s]", user->ident.c_str(), user->GetRealHost().c_str(), operquitmsg.c_str()));
 		localuser->Send(ServerInstance->GetRFCEvents().error, errormsg);
 	}
@@ -281,25 +341,29 @@ void UserManager::QuitUser(User* user, const std::string& quitmessage, const std
 	if (user->registered == REG_ALL)
 	{
 		FOREACH_MOD(OnUserQuit, (user, quitmsg, operquitmsg));
-		WriteCommonQuit(user, quitmsg, operquitmsg);
+		if (cache)
+			WriteCommonQuit(user, quitmsg, operquitmsg, *cache);
+		else
+			WriteCommonQuit(user, quitmsg, operquitmsg);
 	}
 	else
 		unregistered_count--;
 
-	if (IS_LOCAL(user))
+	if (localuser)
 	{
-		LocalUser* lu = IS_LOCAL(user);
-		FOREACH_MOD(OnUserDisconnect, (lu));
-		lu->eh.Close();
+		FOREACH_MOD(OnUserDisconnect, (localuser));
+		localuser->eh.Close();
 
-		if (lu->registered == REG_ALL)
+		if (localuser->registered == REG_ALL)
 			ServerInstance->SNO.WriteToSnoMask('q',"Client exiting: %s (%s) [%s]", user->GetFullRealHost().c_str(), user->GetIPString().c_str(), operquitmsg.c_str());
-		local_users.erase(lu);
+		local_users.erase(localuser);
 	}
 
 	if (!clientlist.erase(user->nick))
 		ServerInstance->Logs.Log("USERS", LOG_DEFAULT, "ERROR: Nick not found in clientlist, cannot remove: " + user->nick);
 
+	// The user is removed from their channels straight away so that they are not visible
+	// to the OnUserQuit handlers of any users who are quit after them.
 	uuidlist.erase(user->uuid);
 	user->PurgeEmptyChannels();
 	user->UnOper();
@@ -381,6 +445,9 @@ void UserManager::DoBackgroundUserStuff()
 			else
 				curr->CommandFloodPenalty = 0;
 			curr->eh.OnDataReady();
+
+			// Commands which were held back by fakelag have been taken out of the recvq.
+			curr->eh.UpdateQueueTotals();
 		}
 
 		switch (curr->registered)
@@ -35,6 +35,7 @@
 
 
 #include "inspircd.h"
+#include "modules/hash.h"
 #include "xline.h"
 
 ClientProtocol::MessageList LocalUser::sendmsglist;
@@ -522,6 +523,97 @@ void LocalUser::CheckClass(bool clone_count)
 	this->nextping = ServerInstance->Time() + a->GetPingTime();
 }
 
+namespace
+{
+	bool MatchesHosts(LocalUser* user, const std::shared_ptr<ConnectClass>& klass)
+	{
+		for (const auto& host : klass->GetHosts())
+		{
+			if (InspIRCd::MatchCIDR(user->GetIPString(), host) || InspIRCd::MatchCIDR(user->GetRealHost(), host))
+				return true;
+		}
+		return false;
+	}
+}
+
+bool LocalUser::CheckClassPasswords()
+{
+	// The host of the user may have changed since this was last called so this has to
+	// check for classes which have started matching.
+	for (const auto& klass : ServerInstance->Config->Classes)
+	{
+		if (klass->type == CC_ALLOW && !klass->password.empty() && MatchesHosts(this, klass))
+			CheckClassPassword(klass);
+	}
+
+	for (const auto& classpassword : classpasswords)
+	{
+		if (!classpassword.done)
+			return false;
+	}
+	return true;
+}
+
+bool LocalUser::CheckClassPassword(const std::shared_ptr<ConnectClass>& klass)
+{
+	// Only key derivation functions are slow enough to need comparing in the background.
+	HashProvider* hp = klass->passwordhash.empty() ? nullptr : ServerInstance->Modules.FindDataService<HashProvider>("hash/" + klass->passwordhash);
+	if (!hp || !hp->IsKDF())
+		return ServerInstance->PassCompare(this, klass->password, password, klass->passwordhash);
+
+	auto it = std::find_if(classpasswords.begin(), classpasswords.end(), [&klass](const ClassPassword& cp) {
+		return cp.data == klass->password && cp.hashtype == klass->passwordhash;
+	});
+
+	if (it == classpasswords.end())
+	{
+		classpasswords.emplace_back(klass->password, klass->passwordhash);
+
+		// The password the user sent is not stored with the result. Instead, the result is
+		// only used if the user has not sent a different password by the time it is available.
+		const std::string id = uuid;
+		const std::string data = klass->password;
+		const std::string hashtype = klass->passwordhash;
+		const std::string input = password;
+		ServerInstance->PassCompare(nullptr, this, data, input, hashtype, [id, data, hashtype, input](bool result)
+		{
+			OnClassPasswordChecked(id, data, hashtype, input, result);
+		});
+
+		// If a module handled the comparison then the result is already available.
+		it = classpasswords.end() - 1;
+		if (!it->done)
+			it->background = true;
+	}
+
+	return it->done && it->result;
+}
+
+void LocalUser::OnClassPasswordChecked(const std::string& uuid, const std::string& data, const std::string& hashtype, const std::string& input, bool result)
+{
+	LocalUser* user = IS_LOCAL(ServerInstance->Users.FindUUID(uuid));
+	if (!user || user->quitting || user->password != input)
+		return;
+
+	for (auto& classpassword : user->classpasswords)
+	{
+		if (classpassword.done || classpassword.data != data || classpassword.hashtype != hashtype)
+			continue;
+
+		classpassword.done = true;
+		classpassword.result = result;
+
+		// If the user is already connected their connect class was chosen whilst this was
+		// being compared so it may need to be chosen again.
+		if (classpassword.background && result && user->registered == REG_ALL && !user->IsOper())
+		{
+			user->SetClass();
+			user->CheckClass();
+		}
+		break;
+	}
+}
+
 bool LocalUser::CheckLines(bool doZline)
 {
 	const char* check[] = { "G" , "K", (doZline) ? "Z" : NULL, NULL };
@@ -887,6 +979,52 @@ void User::WriteCommonRaw(ClientProtocol::Event& protoev, bool include_self)
 	ForEachNeighbor(handler, include_self);
 }
 
+const std::vector<LocalUser*>& User::LocalMemberCache::GetMembers(Channel* chan)
+{
+	auto [it, inserted] = members.emplace(chan, std::vector<LocalUser*>());
+	if (inserted)
+	{
+		for (const auto& [user, _] : chan->GetUsers())
+		{
+			LocalUser* luser = IS_LOCAL(user);
+			if (luser)
+				it->second.push_back(luser);
+		}
+	}
+	return it->second;
+}
+
+namespace
+{
+	/** Visits the exceptions built by OnBuildNeighborList and returns the id which has been used to mark them. */
+	uint64_t VisitNeighborExceptions(User* user, User::ForEachNeighborHandler& handler, bool include_self, IncludeChanList& include_chans)
+	{
+		// Ask modules to build a list of exceptions.
+		// Mods may also exclude entire channels by erasing them from include_chans.
+		std::map<User*, bool> exceptions;
+		exceptions[user] = include_self;
+		FOREACH_MOD(OnBuildNeighborList, (user, include_chans, exceptions));
+
+		// Get next id, guaranteed to differ from the already_sent field of all users
+		const uint64_t newid = ServerInstance->Users.NextAlreadySentId();
+
+		// Handle exceptions first
+		for (std::map<User*, bool>::const_iterator i = exceptions.begin(); i != exceptions.end(); ++i)
+		{
+			LocalUser* curr = IS_LOCAL(i->first);
+			if (curr)
+			{
+				// Mark as visited to ensure we won't visit again if there is a common channel
+				curr->already_sent = newid;
+				// Always treat quitting users as excluded
+				if ((i->second) && (!curr->quitting))
+					handler.Execute(curr);
+			}
+		}
+		return newid;
+	}
+}
+
 void User::ForEachNeighbor(ForEachNeighborHandler& handler, bool include_self)
 {
 	// The basic logic for visiting the neighbors of a user is to iterate the channel list of the user
@@ -896,30 +1034,8 @@ void User::ForEachNeighbor(ForEachNeighborHandler& handler, bool include_self)
 	// The global counter is incremented every time we do something for each neighbor of a user. Then,
 	// before visiting a member we examine user->already_sent. If it's equal to the current counter, we
 	// skip the member. Otherwise, we set it to the current counter and visit the member.
-
-	// Ask modules to build a list of exceptions.
-	// Mods may also exclude entire channels by erasing them from include_chans.
 	IncludeChanList include_chans(chans.begin(), chans.end());
-	std::map<User*, bool> exceptions;
-	exceptions[this] = include_self;
-	FOREACH_MOD(OnBuildNeighborList, (this, include_chans, exceptions));
-
-	// Get next id, guaranteed to differ from the already_sent field of all users
-	const uint64_t newid = ServerInstance->Users.NextAlreadySentId();
-
-	// Handle exceptions first
-	for (std::map<User*, bool>::const_iterator i = exceptions.begin(); i != exceptions.end(); ++i)
-	{
-		LocalUser* curr = IS_LOCAL(i->first);
-		if (curr)
-		{
-			// Mark as visited to ensure we won't visit again if there is a common channel
-			curr->already_sent = newid;
-			// Always treat quitting users as excluded
-			if ((i->second) && (!curr->quitting))
-				handler.Execute(curr);
-		}
-	}
+	const uint64_t newid = VisitNeighborExceptions(this, handler, include_self, include_chans);
 
 	// Now consider the real neighbors
 	for (const auto* memb : include_chans)
@@ -938,6 +1054,27 @@ void User::ForEachNeighbor(ForEachNeighborHandler& handler, bool include_self)
 	}
 }
 
+void User::ForEachNeighbor(ForEachNeighborHandler& handler, LocalMemberCache& cache, bool include_self)
+{
+	// This works the same way as the uncached version but only has to consider the local
+	// members of each channel. Local members may have quit since they were cached so
+	// those need to be skipped here.
+	IncludeChanList include_chans(chans.begin(), chans.end());
+	const uint64_t newid = VisitNeighborExceptions(this, handler, include_self, include_chans);
+
+	for (const auto* memb : include_chans)
+	{
+		for (auto* curr : cache.GetMembers(memb->chan))
+		{
+			if ((curr->already_sent != newid) && (!curr->quitting))
+			{
+				curr->already_sent = newid;
+				handler.Execute(curr);
+			}
+		}
+	}
+}
+
 void User::WriteRemoteNumeric(const Numeric::Numeric& numeric)
 {
 	WriteNumeric(numeric);
@@ -1121,16 +1258,7 @@ void LocalUser::SetClass(const std::string &explicit_name)
 				continue;
 			}
 
-			bool hostmatches = false;
-			for (const auto& host : c->GetHosts())
-			{
-				if (InspIRCd::MatchCIDR(this->GetIPString(), host) || InspIRCd::MatchCIDR(this->GetRealHost(), host))
-				{
-					hostmatches = true;
-					break;
-				}
-			}
-			if (!hostmatches)
+			if (!MatchesHosts(this, c))
 			{
 				const std::string hosts = stdalgo::string::join(c->GetHosts());
 				ServerInstance->Logs.Log("CONNECTCLASS", LOG_DEBUG, "The %s connect class is not suitable as neither the host (%s) nor the IP (%s) matches %s",
@@ -1158,7 +1286,7 @@ void LocalUser::SetClass(const std::string &explicit_name)
 				continue;
 			}
 
-			if (regdone && !c->password.empty() && !ServerInstance->PassCompare(this, c->password, password, c->passwordhash))
+			if (regdone && !c->password.empty() && !CheckClassPassword(c))
 			{
 				ServerInstance->Logs.Log("CONNECTCLASS", LOG_DEBUG, "The %s connect class is not suitable as requires a password and %s",
 					c->GetName().c_str(), password.empty() ? "one was not provided" : "the provided password was incorrect");
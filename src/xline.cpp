@@ -381,7 +381,7 @@ XLine* XLineManager::MatchesLine(const std::string &type, User* user)
 
 		if (i->second->Matches(user))
 		{
-			return i->second;
+			return RecordHit(i->second);
 		}
 
 		i = safei;
@@ -416,7 +416,7 @@ XLine* XLineManager::MatchesLine(const std::string &type, const std::string &pat
 				continue;
 			}
 			else
-				return i->second;
+				return RecordHit(i->second);
 		}
 
 		i = safei;
@@ -461,6 +461,7 @@ void XLineManager::ApplyLines()
 		{
 			if (x->Matches(u))
 			{
+				RecordHit(x);
 				x->Apply(u);
 
 				// If applying the X-line has killed the user then don't
@@ -763,6 +764,14 @@ bool XLineManager::UnregisterFactory(XLineFactory* xlf)
 	return true;
 }
 
+XLine* XLineManager::RecordHit(XLine* line)
+{
+	XLineFactory* xlf = GetFactory(line->type);
+	if (xlf)
+		xlf->hits++;
+	return line;
+}
+
 XLineFactory* XLineManager::GetFactory(const std::string &type)
 {
 	XLineFactMap::iterator n = line_factory.find(type);